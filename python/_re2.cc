@@ -320,7 +320,13 @@ PYBIND11_MODULE(_re2, module) {
                     &RE2::Options::set_word_boundary)   //
       .def_property("one_line",                         //
                     &RE2::Options::one_line,            //
-                    &RE2::Options::set_one_line);       //
+                    &RE2::Options::set_one_line)        //
+      .def_property("per_thread_dfa",                   //
+                    &RE2::Options::per_thread_dfa,      //
+                    &RE2::Options::set_per_thread_dfa)  //
+      .def_property("bit_state_max_mem",                //
+                    &RE2::Options::bit_state_max_mem,   //
+                    &RE2::Options::set_bit_state_max_mem); //
 
   re2.def(py::init(&RE2InitShim))
       .def("ok", &RE2::ok)
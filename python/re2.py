@@ -56,6 +56,8 @@ class Options(_re2.RE2.Options):
       'perl_classes',
       'word_boundary',
       'one_line',
+      'per_thread_dfa',
+      'bit_state_max_mem',
   )
 
 
@@ -0,0 +1,236 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tested by aho_corasick_test.cc
+
+#include "re2/aho_corasick.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "re2/sparse_set.h"
+
+namespace re2 {
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& strings,
+                         bool foldcase, int64_t max_mem)
+    : ok_(false),
+      num_states_(0),
+      num_classes_(0),
+      start_(0),
+      match_start_(0),
+      num_first_bytes_(0),
+      first_byte_(0) {
+  memset(is_first_byte_, 0, sizeof is_first_byte_);
+  // Give each byte that occurs in the strings a class of its own,
+  // folding ASCII case if asked. All other bytes share class 0.
+  memset(bytemap_, 0, sizeof bytemap_);
+  bool used[256] = {};
+  for (const std::string& s : strings) {
+    for (char c : s) {
+      uint8_t b = static_cast<uint8_t>(c);
+      if (foldcase && 'A' <= b && b <= 'Z')
+        b += 'a' - 'A';
+      used[b] = true;
+    }
+  }
+  int nclass = 1;
+  for (int b = 0; b < 256; b++) {
+    if (used[b])
+      bytemap_[b] = static_cast<uint8_t>(nclass++);
+  }
+  if (foldcase) {
+    for (int b = 'A'; b <= 'Z'; b++)
+      bytemap_[b] = bytemap_[b + 'a' - 'A'];
+  }
+  num_classes_ = nclass;
+
+  // Build the trie. Row s of delta holds the transitions out of state s,
+  // with 0 meaning none: no trie edge leads back to the root (state 0).
+  const int64_t row_size = nclass * static_cast<int64_t>(sizeof(uint32_t));
+  std::vector<uint32_t> delta(nclass, 0);
+  std::vector<std::vector<int>> out(1);  // indices of strings that end here
+  int nstate = 1;
+  for (size_t i = 0; i < strings.size(); i++) {
+    const std::string& s = strings[i];
+    if (s.empty())
+      continue;
+    int state = 0;
+    for (char c : s) {
+      uint8_t b = bytemap_[static_cast<uint8_t>(c)];
+      if (delta[state * nclass + b] == 0) {
+        if ((nstate + 1) * row_size > max_mem ||
+            (nstate + 1) * static_cast<int64_t>(nclass) > int64_t{1} << 32)
+          return;
+        delta[state * nclass + b] = nstate++;
+        delta.resize(nstate * nclass, 0);
+        out.emplace_back();
+      }
+      state = delta[state * nclass + b];
+    }
+    out[state].push_back(static_cast<int>(i));
+  }
+
+  // Compute the failure links breadth first and use them to fill in the
+  // missing transitions: state s goes wherever its failure link goes.
+  // The strings that end at a state include those that end at its
+  // failure link, since the latter spells a suffix of the former.
+  // Each state's failure link is shallower than it, so its row is done.
+  // Until then, the only non-zero transitions in a row are trie edges.
+  std::vector<int> fail(nstate, 0);
+  std::vector<int> order;
+  order.reserve(nstate);
+  order.push_back(0);
+  for (size_t i = 0; i < order.size(); i++) {
+    int s = order[i];
+    for (int c = 0; c < nclass; c++) {
+      int t = static_cast<int>(delta[s * nclass + c]);
+      int f = s == 0 ? 0 : static_cast<int>(delta[fail[s] * nclass + c]);
+      if (t != 0) {
+        // A trie edge.
+        fail[t] = f;
+        out[t].insert(out[t].end(), out[f].begin(), out[f].end());
+        order.push_back(t);
+      } else {
+        delta[s * nclass + c] = f;
+      }
+    }
+  }
+
+  // Renumber the states so that the matching states come last, which
+  // lets FindFirst() notice a match with a single comparison.
+  std::vector<uint32_t> renumber(nstate);
+  int nmatch = 0;
+  int64_t nout = 0;
+  for (int s = 0; s < nstate; s++) {
+    nmatch += !out[s].empty();
+    nout += out[s].size();
+  }
+  if (nstate * row_size + (nmatch + 1 + nout) * int64_t{sizeof(int)} >
+      max_mem)
+    return;
+  uint32_t nonmatching = 0;
+  uint32_t matching = nstate - nmatch;
+  for (int s = 0; s < nstate; s++)
+    renumber[s] = (out[s].empty() ? nonmatching++ : matching++) * nclass;
+  next_.resize(delta.size());
+  for (int s = 0; s < nstate; s++) {
+    for (int c = 0; c < nclass; c++)
+      next_[renumber[s] + c] = renumber[delta[s * nclass + c]];
+  }
+  // Lay out the strings for the matching states in their new order.
+  std::vector<int> by_number(nmatch);
+  for (int s = 0; s < nstate; s++) {
+    if (!out[s].empty())
+      by_number[renumber[s] / nclass - (nstate - nmatch)] = s;
+  }
+  out_begin_.reserve(nmatch + 1);
+  out_.reserve(nout);
+  for (int s : by_number) {
+    out_begin_.push_back(static_cast<int>(out_.size()));
+    out_.insert(out_.end(), out[s].begin(), out[s].end());
+  }
+  out_begin_.push_back(static_cast<int>(out_.size()));
+  num_states_ = nstate;
+  start_ = renumber[0];
+  match_start_ = (nstate - nmatch) * nclass;
+  for (int b = 0; b < 256; b++) {
+    if (next_[start_ + bytemap_[b]] != start_) {
+      is_first_byte_[b] = true;
+      first_byte_ = static_cast<uint8_t>(b);
+      num_first_bytes_++;
+    }
+  }
+  ok_ = true;
+}
+
+AhoCorasick::~AhoCorasick() {}
+
+size_t AhoCorasick::memory() const {
+  return next_.size() * sizeof next_[0] +
+         out_begin_.size() * sizeof out_begin_[0] +
+         out_.size() * sizeof out_[0];
+}
+
+const char* AhoCorasick::FindFirst(absl::string_view text) const {
+  if (!ok_)
+    return NULL;
+  const uint32_t* next = next_.data();
+  const uint8_t* bytemap = bytemap_;
+  const size_t match_start = match_start_;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+  const uint8_t* ep = p + text.size();
+  const size_t start = start_;
+  size_t s = start;
+  if (s >= match_start)
+    return text.data();
+  while (p < ep) {
+    if (s == start) {
+      // Skip to the next byte that leaves the start state.
+      if (num_first_bytes_ == 1) {
+        p = reinterpret_cast<const uint8_t*>(memchr(p, first_byte_, ep - p));
+        if (p == NULL)
+          return NULL;
+      } else {
+        while (p < ep && !is_first_byte_[*p])
+          p++;
+        if (p == ep)
+          return NULL;
+      }
+    }
+    s = next[s + bytemap[*p++]];
+    if (s >= match_start)
+      return reinterpret_cast<const char*>(p);
+  }
+  return NULL;
+}
+
+void AhoCorasick::FindAll(absl::string_view text,
+                          std::vector<int>* ids) const {
+  ids->clear();
+  if (!ok_)
+    return;
+  const uint32_t* next = next_.data();
+  const uint8_t* bytemap = bytemap_;
+  const size_t match_start = match_start_;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+  const uint8_t* ep = p + text.size();
+  const size_t start = start_;
+  size_t s = start;
+  // Each matching state contributes its strings only the first time.
+  SparseSet seen(static_cast<int>(out_begin_.size()) - 1);
+  while (p < ep) {
+    if (s == start) {
+      if (num_first_bytes_ == 1) {
+        p = reinterpret_cast<const uint8_t*>(memchr(p, first_byte_, ep - p));
+        if (p == NULL)
+          break;
+      } else {
+        while (p < ep && !is_first_byte_[*p])
+          p++;
+        if (p == ep)
+          break;
+      }
+    }
+    s = next[s + bytemap[*p++]];
+    if (s >= match_start) {
+      int i = static_cast<int>((s - match_start) / num_classes_);
+      if (!seen.contains(i)) {
+        seen.insert_new(i);
+        ids->insert(ids->end(), out_.begin() + out_begin_[i],
+                    out_.begin() + out_begin_[i+1]);
+      }
+    }
+  }
+  std::sort(ids->begin(), ids->end());
+  ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+}
+
+}  // namespace re2
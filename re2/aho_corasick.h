@@ -0,0 +1,86 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_AHO_CORASICK_H_
+#define RE2_AHO_CORASICK_H_
+
+// The AhoCorasick class finds occurrences of any of a set of strings
+// in a text, in a single pass over the text.  It is a DFA built from
+// the trie of the strings and its failure links, stored as a flat table
+// of transitions over byte classes, so the search loop does one table
+// lookup per byte of text and never backtracks.
+//
+// RE2::Set uses it to find the literals that its regexps require, and
+// FilteredRE2 uses it to find the atoms of its regexps.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace re2 {
+
+class AhoCorasick {
+ public:
+  // Builds the automaton for strings, ignoring any empty strings.
+  // If foldcase is true, ASCII letters match regardless of case.
+  // If the table would need more than max_mem bytes, gives up:
+  // ok() returns false and nothing matches.
+  AhoCorasick(const std::vector<std::string>& strings, bool foldcase,
+              int64_t max_mem);
+  ~AhoCorasick();
+
+  // Not copyable.
+  AhoCorasick(const AhoCorasick&) = delete;
+  AhoCorasick& operator=(const AhoCorasick&) = delete;
+
+  // Returns whether the automaton was built within max_mem.
+  bool ok() const { return ok_; }
+
+  // Returns the number of states.
+  int num_states() const { return num_states_; }
+
+  // Returns the memory used by the automaton, in bytes.
+  size_t memory() const;
+
+  // Returns a pointer to the end of the earliest-ending occurrence in text
+  // of any of the strings, or NULL if none of them occurs.
+  const char* FindFirst(absl::string_view text) const;
+
+  // Sets *ids to the indices in strings of the strings that occur in text,
+  // in increasing order and without duplicates.
+  void FindAll(absl::string_view text, std::vector<int>* ids) const;
+
+ private:
+  bool ok_;
+  int num_states_;
+  int num_classes_;       // number of byte classes
+  uint32_t start_;        // offset in next_ of the start state
+  uint32_t match_start_;  // offset in next_ of the first matching state
+  uint8_t bytemap_[256];  // map from input bytes to byte classes
+
+  // The bytes that leave the start state.  FindFirst() skips over other
+  // bytes without consulting the table, using memchr(3) if there is just
+  // one such byte.
+  int num_first_bytes_;
+  uint8_t first_byte_;
+  bool is_first_byte_[256];
+
+  // For each state, num_classes_ entries giving the offset in next_ of the
+  // next state (that is, the state number premultiplied by num_classes_).
+  // The states are numbered so that the matching states come last.
+  std::vector<uint32_t> next_;
+
+  // For the ith matching state, the indices of the strings that end there
+  // are out_[out_begin_[i]] through out_[out_begin_[i+1]-1].
+  std::vector<int> out_begin_;
+  std::vector<int> out_;
+};
+
+}  // namespace re2
+
+#endif  // RE2_AHO_CORASICK_H_
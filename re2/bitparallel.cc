@@ -0,0 +1,227 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tested by search_test.cc.
+//
+// Prog::SearchBitParallel is a bit-parallel simulation of the NFA
+// (in the style of Shift-And and of Glushkov automata) for small
+// programs: one bit for each ByteRange instruction, plus one for
+// Match, so that the set of threads fits in a single 64-bit word.
+// Like the DFA, it only says whether there is a match, but it needs
+// no state cache, takes no locks and costs the same for every byte:
+//
+//   state = Follow(state & ByteMask(c))
+//
+// where ByteMask(c) is the set of ByteRange instructions that match c
+// and Follow() is the union of the states that each of them leads to
+// (by following empty arrows).  Follow() is tabulated eight bits at a
+// time, so a step is at most eight table lookups -- fewer when only
+// low-numbered instructions are live, which is the common case because
+// they are numbered in program order.
+//
+// Empty-width assertions other than the program's start and end
+// anchors would make Follow() depend on the position, so programs
+// that have them are not bit-parallel.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "absl/log/absl_check.h"
+#include "absl/log/absl_log.h"
+#include "absl/strings/string_view.h"
+#include "re2/pod_array.h"
+#include "re2/prog.h"
+#include "re2/sparse_set.h"
+
+namespace re2 {
+
+// The bit for the Match instruction(s).
+static const uint64_t kMatchBit = uint64_t{1} << 63;
+
+// ByteRange instructions get bits 0..62.
+static const int kMaxBitParallelInsts = 63;
+
+// Returns the set of threads reached from the list at id by following
+// empty arrows, using bit to number the ByteRange instructions.
+// Sets *ok to false if an empty-width assertion is reached.
+static uint64_t Closure(Prog* prog, int id, const PODArray<int>& bit,
+                        SparseSet* seen, std::vector<int>* stk, bool* ok) {
+  uint64_t mask = 0;
+  seen->clear();
+  stk->clear();
+  stk->push_back(id);
+  while (!stk->empty()) {
+    id = stk->back();
+    stk->pop_back();
+    if (id == 0 || seen->contains(id))
+      continue;
+    seen->insert_new(id);
+
+    // Each instruction on the list is an alternative.
+    for (;; id++) {
+      Prog::Inst* ip = prog->inst(id);
+      switch (ip->opcode()) {
+        default:
+          ABSL_LOG(DFATAL) << "unhandled " << ip->opcode() << " in Closure";
+          break;
+
+        case kInstByteRange:
+          mask |= uint64_t{1} << bit[id];
+          break;
+
+        case kInstMatch:
+          mask |= kMatchBit;
+          break;
+
+        case kInstCapture:
+        case kInstNop:
+          stk->push_back(ip->out());
+          break;
+
+        case kInstAltMatch:
+          // The alternatives follow on the list.
+          break;
+
+        case kInstEmptyWidth:
+          *ok = false;
+          return 0;
+
+        case kInstFail:
+          break;
+      }
+      if (ip->last())
+        break;
+    }
+  }
+  return mask;
+}
+
+// Returns whether it is safe to use SearchBitParallel on this program,
+// building the tables that it uses on the first call.
+// The tables are laid out as bytemap_range() masks for ByteMask(),
+// followed by 256 masks for each byte of the state for Follow().
+bool Prog::IsBitParallel() {
+  absl::call_once(bitparallel_once_, [](Prog* prog) {
+    prog->BuildBitParallel();
+  }, this);
+  return bitparallel_.data() != NULL;
+}
+
+void Prog::BuildBitParallel() {
+  if (reversed_ || start() == 0)
+    return;
+  if (inst_count(kInstEmptyWidth) > 0)
+    return;
+  int ninst = inst_count(kInstByteRange);
+  if (ninst > kMaxBitParallelInsts)
+    return;
+
+  // Number the ByteRange instructions in program order.
+  PODArray<int> bit(size());
+  PODArray<uint64_t> follow(ninst);
+  int n = 0;
+  for (int id = 0; id < size(); id++) {
+    if (inst(id)->opcode() == kInstByteRange)
+      bit[id] = n++;
+  }
+  ABSL_DCHECK_EQ(n, ninst);
+
+  SparseSet seen(size());
+  std::vector<int> stk;
+  bool ok = true;
+  uint64_t start_mask = Closure(this, start(), bit, &seen, &stk, &ok);
+  for (int id = 0; ok && id < size(); id++) {
+    Prog::Inst* ip = inst(id);
+    if (ip->opcode() == kInstByteRange)
+      follow[bit[id]] = Closure(this, ip->out(), bit, &seen, &stk, &ok);
+  }
+  if (!ok)
+    return;
+
+  // Steal memory for the tables from the overall DFA budget,
+  // as IsOnePass() does.
+  int nchunks = (ninst + 7) / 8;
+  int ntables = bytemap_range() + 256*nchunks;
+  int64_t mem = static_cast<int64_t>(ntables)*sizeof(uint64_t);
+  if (TakeDFAMem(mem, mem) == 0)
+    return;
+
+  PODArray<uint64_t> tables(ntables);
+  memset(tables.data(), 0, ntables*sizeof tables[0]);
+  uint64_t* bytemask = tables.data();
+  for (int c = 0; c < 256; c++) {
+    uint64_t mask = 0;
+    for (int id = 0; id < size(); id++) {
+      Prog::Inst* ip = inst(id);
+      if (ip->opcode() == kInstByteRange && ip->Matches(c))
+        mask |= uint64_t{1} << bit[id];
+    }
+    bytemask[bytemap_[c]] |= mask;
+  }
+  for (int k = 0; k < nchunks; k++) {
+    uint64_t* chunk = tables.data() + bytemap_range() + 256*k;
+    for (int v = 1; v < 256; v++) {
+      // Add the lowest bit of v to the entry for v without it.
+      int i = 8*k;
+      for (int w = v; (w & 1) == 0; w >>= 1)
+        i++;
+      chunk[v] = chunk[v & (v-1)] | (i < ninst ? follow[i] : 0);
+    }
+  }
+
+  bitparallel_start_ = start_mask;
+  bitparallel_ = std::move(tables);
+}
+
+bool Prog::SearchBitParallel(absl::string_view text,
+                             absl::string_view context, Anchor anchor,
+                             MatchKind kind) {
+  if (search_counters_ != NULL)
+    search_counters_->AddUnsynced(SearchCounters::kBitParallelBytes,
+                                  text.size());
+
+  if (context.data() == NULL)
+    context = text;
+  if (anchor_start() && BeginPtr(context) != BeginPtr(text))
+    return false;
+  if (anchor_end() && EndPtr(context) != EndPtr(text))
+    return false;
+  bool anchored = anchor == kAnchored || anchor_start() || kind == kFullMatch;
+  bool endmatch = kind == kFullMatch || anchor_end();
+
+  const uint64_t* bytemask = bitparallel_.data();
+  const uint64_t* follow = bitparallel_.data() + bytemap_range();
+  const uint64_t start = bitparallel_start_;
+  const uint8_t* bytemap = bytemap_;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+  const uint8_t* ep = p + text.size();
+
+  uint64_t state = start;
+  if (!endmatch && (state & kMatchBit))
+    return true;
+  while (p < ep) {
+    if (!anchored && state == start && can_prefix_accel()) {
+      // No thread has got anywhere, so skip to where one could.
+      p = reinterpret_cast<const uint8_t*>(PrefixAccel(p, ep - p));
+      if (p == NULL)
+        return false;
+    }
+    uint64_t live = state & bytemask[bytemap[*p++]];
+    state = 0;
+    for (const uint64_t* f = follow; live != 0; f += 256, live >>= 8)
+      state |= f[live & 0xFF];
+    if (!anchored)
+      state |= start;
+    else if (state == 0)
+      return false;
+    if (!endmatch && (state & kMatchBit))
+      return true;
+  }
+  return (state & kMatchBit) != 0;
+}
+
+}  // namespace re2
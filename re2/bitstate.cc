@@ -10,6 +10,9 @@
 // lists) * (length of text) bits to make sure it never explores the
 // same (instruction list, character position) multiple times.  This
 // limits the search to run in time linear in the length of the text.
+// The bitmap is kept in order of text position and cleared a chunk at
+// a time as the search first reaches each part of the text, so that
+// a search that explores only part of a long text pays only for that.
 //
 // Unlike testing/backtrack.cc, SearchBitState is not recursive
 // on the text.
@@ -49,7 +52,10 @@ class BitState {
               bool longest, absl::string_view* submatch, int nsubmatch);
 
  private:
-  static inline bool ShouldVisit(absl::string_view text, uint64_t* visited, uint16_t id, const char* p);
+  static inline bool ShouldVisit(const char* bp, int nlist, uint64_t* visited,
+                                 uint8_t* cleared, uint16_t list_id,
+                                 const char* p);
+  static void ClearChunk(uint64_t* visited, uint8_t* cleared, int chunk);
   void Push(int id, const char* p);
   void GrowStack();
   bool TrySearch(int id, const char* p);
@@ -66,7 +72,9 @@ class BitState {
 
   // Search state
   static constexpr int kVisitedBits = 64;
-  PODArray<uint64_t> visited_;  // bitmap: (list ID, char*) pairs visited
+  static constexpr int kChunkShift = 12;  // 512 bytes of bitmap per chunk
+  PODArray<uint64_t> visited_;  // bitmap: (char*, list ID) pairs visited
+  PODArray<uint8_t> cleared_;   // whether each chunk of visited_ is cleared
   PODArray<const char*> cap_;   // capture registers
   PODArray<Job> job_;           // stack of text positions to explore
   int njob_;                    // stack size
@@ -85,22 +93,34 @@ BitState::BitState(Prog* prog)
     njob_(0) {
 }
 
-// Given the text being searched and current visited state,
-// as well as a list ID, should the search visit the (list ID, p) pair?
+// Given the start of the text being searched, the number of lists
+// and current visited state, as well as a list ID, should the search
+// visit the (p, list ID) pair?
 // If so, remember that it was visited so that the next time,
 // we don't repeat the visit.
-// We pass text and visited to this as a static method so that the
+// We pass the search state to this as a static method so that the
 // caller can do those loads once instead of this code dereferencing
 // them multiple times.
-bool BitState::ShouldVisit(absl::string_view text, uint64_t* visited, uint16_t list_id, const char* p) {
-  int n = list_id * static_cast<int>(text.size()+1) +
-          static_cast<int>(p-text.data());
+bool BitState::ShouldVisit(const char* bp, int nlist, uint64_t* visited,
+                           uint8_t* cleared, uint16_t list_id,
+                           const char* p) {
+  int n = static_cast<int>(p-bp) * nlist + list_id;
+  if (!cleared[n >> kChunkShift])
+    ClearChunk(visited, cleared, n >> kChunkShift);
   if (visited[n/kVisitedBits] & (uint64_t{1} << (n & (kVisitedBits-1))))
     return false;
   visited[n/kVisitedBits] |= uint64_t{1} << (n & (kVisitedBits-1));
   return true;
 }
 
+// Clears the given chunk of the visited bitmap, which the search
+// has reached for the first time.
+void BitState::ClearChunk(uint64_t* visited, uint8_t* cleared, int chunk) {
+  memset(visited + chunk * ((1 << kChunkShift) / kVisitedBits), 0,
+         (1 << kChunkShift) / 8);
+  cleared[chunk] = 1;
+}
+
 // Grow the stack.
 void BitState::GrowStack() {
   PODArray<Job> tmp(2*job_.size());
@@ -144,11 +164,14 @@ bool BitState::TrySearch(int id0, const char* p0) {
   bool matched = false;
   const char* end = text_.data() + text_.size();
   uint16_t* list_heads = prog_->list_heads();
+  const char* bp = text_.data();
+  int nlist = prog_->list_count();
   uint64_t* visited = visited_.data();
+  uint8_t* cleared = cleared_.data();
   njob_ = 0;
   // Push() no longer checks ShouldVisit(),
   // so we must perform the check ourselves.
-  if (ShouldVisit(text_, visited, list_heads[id0], p0))
+  if (ShouldVisit(bp, nlist, visited, cleared, list_heads[id0], p0))
     Push(id0, p0);
   while (njob_ > 0) {
     // Pop job off stack.
@@ -242,7 +265,7 @@ bool BitState::TrySearch(int id0, const char* p0) {
         // Sanity check: id is the head of its list, which must
         // be the case if id-1 is the last of *its* list. :)
         ABSL_DCHECK(id == 0 || prog_->inst(id-1)->last());
-        if (ShouldVisit(text_, visited, list_heads[id], p))
+        if (ShouldVisit(bp, nlist, visited, cleared, list_heads[id], p))
           goto Loop;
         break;
 
@@ -312,11 +335,16 @@ bool BitState::Search(absl::string_view text, absl::string_view context,
   for (int i = 0; i < nsubmatch_; i++)
     submatch_[i] = absl::string_view();
 
-  // Allocate scratch space.
-  int nvisited = prog_->list_count() * static_cast<int>(text.size()+1);
-  nvisited = (nvisited + kVisitedBits-1) / kVisitedBits;
-  visited_ = PODArray<uint64_t>(nvisited);
-  memset(visited_.data(), 0, nvisited*sizeof visited_[0]);
+  // Allocate scratch space.  ShouldVisit() clears the chunks of
+  // visited_ when it first needs them.  The bitmap may have as many as
+  // INT_MAX bits, so round it up to whole chunks in size_t.
+  size_t nvisited = static_cast<size_t>(prog_->list_count()) *
+                    (text.size()+1);
+  size_t nchunk = (nvisited + (size_t{1} << kChunkShift)-1) >> kChunkShift;
+  visited_ = PODArray<uint64_t>(
+      static_cast<int>((nchunk << kChunkShift) / kVisitedBits));
+  cleared_ = PODArray<uint8_t>(static_cast<int>(nchunk));
+  memset(cleared_.data(), 0, nchunk);
 
   int ncap = 2*nsubmatch;
   if (ncap < 2)
@@ -363,6 +391,10 @@ bool BitState::Search(absl::string_view text, absl::string_view context,
 bool Prog::SearchBitState(absl::string_view text, absl::string_view context,
                           Anchor anchor, MatchKind kind,
                           absl::string_view* match, int nmatch) {
+  if (search_counters_ != NULL)
+    search_counters_->AddUnsynced(SearchCounters::kBitStateBytes,
+                                  text.size());
+
   // If full match, we ask for an anchored longest match
   // and then check that match[0] == text.
   // So make sure match[0] exists.
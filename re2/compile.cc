@@ -13,11 +13,14 @@
 
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "re2/pod_array.h"
 #include "re2/prog.h"
 #include "re2/re2.h"
@@ -109,7 +112,10 @@ class Compiler : public Regexp::Walker<Frag> {
 
   // Compiles alternation of all the re to a new Prog.
   // Each re has a match with an id equal to its index in the vector.
-  static Prog* CompileSet(Regexp* re, RE2::Anchor anchor, int64_t max_mem);
+  // If reversed is true, the program runs backward over the input; see
+  // Prog::CompileReverseSet().
+  static Prog* CompileSet(Regexp* re, RE2::Anchor anchor, bool reversed,
+                          int64_t max_mem);
 
   // Interface for Regexp::Walker, which helps traverse the Regexp.
   // The walk is purely post-recursive: given the machines for the
@@ -194,6 +200,14 @@ class Compiler : public Regexp::Walker<Frag> {
   // Returns the alternation of all the added suffixes.
   Frag EndRange();
 
+  // Copies the character class compiled under key from the global
+  // cache into the program.  Returns false if it is not in the cache.
+  bool CachedCharClass(const std::string& key, Frag* f);
+
+  // Adds the character class compiled to f, starting at instruction
+  // base, to the global cache under key.
+  void CacheCharClass(const std::string& key, int base, Frag f);
+
   // Single rune.
   Frag Literal(Rune r, bool foldcase);
 
@@ -446,6 +460,126 @@ static int MaxRune(int len) {
   return (1<<b) - 1;   // maximum Rune for b bits.
 }
 
+// Large character classes, such as \p{L} or [^\p{Greek}\p{Latin}], take
+// far longer to compile to UTF-8 than anything else in a typical regexp,
+// and the same few of them get compiled over and over.  So the compiled
+// form of a class with many ranges is kept in a global cache, keyed by
+// the ranges, and later programs copy the instructions instead of building
+// them again.  The cache never evicts anything; once it is full, classes
+// that miss are simply compiled as usual.
+static const int kMinCachedCharClassRanges = 16;
+static const int64_t kMaxCharClassCacheMem = 4<<20;
+
+// Controls whether the compiler uses the cache of compiled classes.
+static bool compile_char_class_cache = true;
+
+void Prog::TESTING_ONLY_set_compile_char_class_cache(bool b) {
+  compile_char_class_cache = b;
+}
+
+// A character class as compiled to instructions [base, base+inst.size()).
+// Instruction ids are as they were then; the fields on the patch list are
+// zeroed instead, and exits lists them in patch list order.
+struct CompiledCharClass {
+  int base;
+  PODArray<Prog::Inst> inst;
+  uint32_t begin;
+  std::vector<uint32_t> exits;
+};
+
+// Similar to EmptyStorage in re2.cc.
+struct CharClassCache {
+  absl::Mutex mutex;
+  absl::flat_hash_map<std::string, CompiledCharClass> map;
+  int64_t mem = 0;
+};
+alignas(CharClassCache) static char char_class_cache_storage[
+    sizeof(CharClassCache)];
+
+static CharClassCache* char_class_cache() {
+  static absl::once_flag char_class_cache_once;
+  absl::call_once(char_class_cache_once, []() {
+    (void) new (char_class_cache_storage) CharClassCache;
+  });
+  return reinterpret_cast<CharClassCache*>(char_class_cache_storage);
+}
+
+// Returns the key for character class cc: the direction of the program
+// and the ASCII case-folding optimization (see PostVisit) determine the
+// compiled form as much as the ranges do.
+static std::string CharClassCacheKey(CharClass* cc, bool foldascii,
+                                     bool reversed) {
+  std::string key;
+  key.reserve(2 + (cc->end() - cc->begin())*sizeof(RuneRange));
+  key.push_back(reversed ? 'r' : 'f');
+  key.push_back(foldascii ? 'i' : 's');
+  for (CharClass::iterator i = cc->begin(); i != cc->end(); ++i)
+    key.append(reinterpret_cast<const char*>(&*i), sizeof *i);
+  return key;
+}
+
+bool Compiler::CachedCharClass(const std::string& key, Frag* f) {
+  CharClassCache* cache = char_class_cache();
+  absl::ReaderMutexLock l(cache->mutex);
+  auto it = cache->map.find(key);
+  if (it == cache->map.end())
+    return false;
+  const CompiledCharClass& cc = it->second;
+
+  int n = cc.inst.size();
+  int id = AllocInst(n);
+  if (id < 0) {
+    *f = NoMatch();
+    return true;
+  }
+  memmove(inst_.data() + id, cc.inst.data(), n*sizeof inst_[0]);
+
+  // Move the instructions from base to id, then thread the patch list
+  // back through the zeroed fields.
+  int delta = id - cc.base;
+  for (int i = id; i < id+n; i++) {
+    Prog::Inst* ip = &inst_[i];
+    if (ip->out() != 0)
+      ip->set_out(ip->out() + delta);
+    if (ip->opcode() == kInstAlt && ip->out1_ != 0)
+      ip->out1_ += delta;
+  }
+  PatchList end = kNullPatchList;
+  for (uint32_t p : cc.exits)
+    end = PatchList::Append(inst_.data(), end, PatchList::Mk(p + 2*delta));
+  *f = Frag(cc.begin + delta, end, false);
+  return true;
+}
+
+void Compiler::CacheCharClass(const std::string& key, int base, Frag f) {
+  CompiledCharClass cc;
+  cc.base = base;
+  cc.begin = f.begin;
+  int n = ninst_ - base;
+  cc.inst = PODArray<Prog::Inst>(n);
+  memmove(cc.inst.data(), inst_.data() + base, n*sizeof inst_[0]);
+  for (uint32_t l = f.end.head; l != 0;) {
+    cc.exits.push_back(l);
+    Prog::Inst* ip = &cc.inst[(l>>1) - base];
+    if (l&1) {
+      l = ip->out1();
+      ip->out1_ = 0;
+    } else {
+      l = ip->out();
+      ip->set_out(0);
+    }
+  }
+  int64_t mem = key.size() + n*sizeof cc.inst[0] +
+                cc.exits.size()*sizeof cc.exits[0];
+
+  CharClassCache* cache = char_class_cache();
+  absl::MutexLock l(cache->mutex);
+  if (cache->mem + mem > kMaxCharClassCacheMem)
+    return;
+  if (cache->map.emplace(key, std::move(cc)).second)
+    cache->mem += mem;
+}
+
 // The rune range compiler caches common suffix fragments,
 // which are very common in UTF-8 (e.g., [80-bf]).
 // The fragment suffixes are identified by their start
@@ -933,6 +1067,17 @@ Frag Compiler::PostVisit(Regexp* re, Frag, Frag, Frag* child_frags,
       // (?i)abc from 3 insts per letter to 1 per letter.
       bool foldascii = cc->FoldsASCII();
 
+      // Large classes are worth getting from the global cache (see above).
+      std::string key;
+      if (compile_char_class_cache && encoding_ == kEncodingUTF8 &&
+          cc->end() - cc->begin() >= kMinCachedCharClassRanges) {
+        key = CharClassCacheKey(cc, foldascii, reversed_);
+        Frag f;
+        if (CachedCharClass(key, &f))
+          return f;
+      }
+      int base = ninst_;
+
       // Character class is just a big OR of the different
       // character ranges in the class.
       BeginRange();
@@ -950,7 +1095,10 @@ Frag Compiler::PostVisit(Regexp* re, Frag, Frag, Frag* child_frags,
 
         AddRuneRange(i->lo, i->hi, fold);
       }
-      return EndRange();
+      Frag f = EndRange();
+      if (!key.empty() && !failed_)
+        CacheCharClass(key, base, f);
+      return f;
     }
 
     case kRegexpCapture:
@@ -1117,20 +1265,30 @@ Prog* Compiler::Compile(Regexp* re, bool reversed, int64_t max_mem) {
   c.Setup(re->parse_flags(), max_mem, RE2::UNANCHORED /* unused */);
   c.reversed_ = reversed;
 
-  // Simplify to remove things like counted repetitions
-  // and character classes like \d.
-  Regexp* sre = re->Simplify();
-  if (sre == NULL)
-    return NULL;
-
-  // Record whether prog is anchored, removing the anchors.
-  // (They get in the way of other optimizations.)
-  bool is_anchor_start = IsAnchorStart(&sre, 0);
-  bool is_anchor_end = IsAnchorEnd(&sre, 0);
-
-  // Generate fragment for entire regexp.
-  Frag all = c.WalkExponential(sre, Frag(), 2*c.max_ninst_);
-  sre->Decref();
+  // The simplified regexp is needed only for the walk, so it comes
+  // from an arena, which releases all of it at once afterward.
+  RegexpArena arena;
+  bool is_anchor_start;
+  bool is_anchor_end;
+  Frag all;
+  {
+    RegexpArena::Scope scope(&arena);
+
+    // Simplify to remove things like counted repetitions
+    // and character classes like \d.
+    Regexp* sre = re->Simplify();
+    if (sre == NULL)
+      return NULL;
+
+    // Record whether prog is anchored, removing the anchors.
+    // (They get in the way of other optimizations.)
+    is_anchor_start = IsAnchorStart(&sre, 0);
+    is_anchor_end = IsAnchorEnd(&sre, 0);
+
+    // Generate fragment for entire regexp.
+    all = c.WalkExponential(sre, Frag(), 2*c.max_ninst_);
+    sre->Decref();
+  }
   if (c.failed_)
     return NULL;
 
@@ -1216,21 +1374,32 @@ Frag Compiler::DotStar() {
 }
 
 // Compiles RE set to Prog.
-Prog* Compiler::CompileSet(Regexp* re, RE2::Anchor anchor, int64_t max_mem) {
+Prog* Compiler::CompileSet(Regexp* re, RE2::Anchor anchor, bool reversed,
+                           int64_t max_mem) {
   Compiler c;
   c.Setup(re->parse_flags(), max_mem, anchor);
+  c.reversed_ = reversed;
 
-  Regexp* sre = re->Simplify();
-  if (sre == NULL)
-    return NULL;
-
-  Frag all = c.WalkExponential(sre, Frag(), 2*c.max_ninst_);
-  sre->Decref();
+  // As in Compile(), the simplified regexp comes from an arena.
+  RegexpArena arena;
+  Frag all;
+  {
+    RegexpArena::Scope scope(&arena);
+    Regexp* sre = re->Simplify();
+    if (sre == NULL)
+      return NULL;
+
+    all = c.WalkExponential(sre, Frag(), 2*c.max_ninst_);
+    sre->Decref();
+  }
   if (c.failed_)
     return NULL;
 
-  c.prog_->set_anchor_start(true);
-  c.prog_->set_anchor_end(true);
+  // A reversed set runs from wherever the caller knows that a match ends,
+  // so it must not insist on the ends of the context.
+  c.prog_->set_reversed(reversed);
+  c.prog_->set_anchor_start(!reversed);
+  c.prog_->set_anchor_end(!reversed);
 
   if (anchor == RE2::UNANCHORED) {
     // Prepend .* or else the expression will effectively be anchored.
@@ -1259,7 +1428,11 @@ Prog* Compiler::CompileSet(Regexp* re, RE2::Anchor anchor, int64_t max_mem) {
 }
 
 Prog* Prog::CompileSet(Regexp* re, RE2::Anchor anchor, int64_t max_mem) {
-  return Compiler::CompileSet(re, anchor, max_mem);
+  return Compiler::CompileSet(re, anchor, false, max_mem);
+}
+
+Prog* Prog::CompileReverseSet(Regexp* re, int64_t max_mem) {
+  return Compiler::CompileSet(re, RE2::ANCHOR_START, true, max_mem);
 }
 
 }  // namespace re2
@@ -29,8 +29,10 @@
 #include <algorithm>
 #include <atomic>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -48,6 +50,8 @@
 #include "re2/pod_array.h"
 #include "re2/prog.h"
 #include "re2/re2.h"
+#include "re2/rw_locker.h"
+#include "re2/sharded_reader_mutex.h"
 #include "re2/sparse_set.h"
 #include "util/strutil.h"
 
@@ -65,10 +69,54 @@ void Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(bool b) {
   dfa_should_bail_when_slow = b;
 }
 
+// The smallest segment of text that a parallel search gives a thread.
+static size_t dfa_min_parallel_segment = 1<<20;
+
+void Prog::TESTING_ONLY_set_dfa_min_parallel_segment(size_t n) {
+  dfa_min_parallel_segment = n;
+}
+
+// Controls whether resetting the DFA state cache keeps its hottest states.
+static bool dfa_keep_hot_states = true;
+
+void Prog::TESTING_ONLY_set_dfa_keep_hot_states(bool b) {
+  dfa_keep_hot_states = b;
+}
+
+// Controls whether DFA::SearchBatch() searches the texts of a batch in
+// lockstep or one after another.
+static bool dfa_interleave_batches = true;
+
+void Prog::TESTING_ONLY_set_dfa_interleave_batches(bool b) {
+  dfa_interleave_batches = b;
+}
+
 // Changing this to true compiles in prints that trace execution of the DFA.
 // Generates a lot of output -- only useful for debugging.
 static const bool ExtraDebug = false;
 
+// The state cache hash table seems to incur about 18 bytes per State*.
+// Worst case for non-small sets is it being half full, where each value
+// present takes up 1 byte hash sample plus the pointer itself.
+static const int kStateCacheOverhead = 18;
+
+// Threads are numbered in the order in which they first call this
+// function, so that the first few threads to use a shared structure
+// land on distinct shards.
+int Prog::ThreadShardIndex() {
+  static std::atomic<int> next_index{0};
+#ifdef RE2_HAVE_THREAD_LOCAL
+  static thread_local int index = -1;
+  if (index < 0)
+    index = next_index.fetch_add(1, std::memory_order_relaxed) & 0x7fffffff;
+  return index;
+#else
+  (void)next_index;
+  return static_cast<int>(
+      std::hash<std::thread::id>()(std::this_thread::get_id()) & 0x7fffffff);
+#endif
+}
+
 // A DFA implementation of a regular expression program.
 // Since this is entirely a forward declaration mandated by C++,
 // some of the comments here are better understood after reading
@@ -93,23 +141,68 @@ class DFA {
   //   returning the leftmost end of the match instead of the rightmost one.
   // If the DFA cannot complete the search (for example, if it is out of
   //   memory), it sets *failed and returns false.
+  // If positions is not NULL, it must have an element per match ID, all
+  //   NULL, and matches must not be NULL: positions[id] is set to where
+  //   the DFA first saw that id match or, if latest_positions, last saw it.
   bool Search(absl::string_view text, absl::string_view context, bool anchored,
               bool want_earliest_match, bool run_forward, bool* failed,
-              const char** ep, SparseSet* matches);
+              const char** ep, SparseSet* matches, const char** positions,
+              bool latest_positions);
 
-  // Builds out all states for the entire DFA.
+  // Builds out all states for the entire DFA, starting from the start
+  // state for an unanchored (or anchored) search at the beginning of text.
   // If cb is not empty, it receives one callback per state built.
+  // If max_states > 0, stops once that many states are known.
   // Returns the number of states built.
-  // FOR TESTING OR EXPERIMENTAL PURPOSES ONLY.
-  int BuildAllStates(const Prog::DFAStateCallback& cb);
+  int BuildAllStates(bool anchored, const Prog::DFAStateCallback& cb,
+                     int max_states);
+
+  // Builds states ahead of time, either by searching each of texts
+  // (within contexts, as for SearchBatch()) to the end or by building
+  // about max_states states breadth-first from the start state, as
+  // BuildAllStates() would.  Returns the number of states built.
+  int Warmup(absl::Span<const absl::string_view> texts,
+             absl::Span<const absl::string_view> contexts,
+             bool anchored, bool run_forward);
+  int Warmup(int max_states, bool anchored);
 
   // Computes min and max for matching strings.  Won't return strings
   // bigger than maxlen.
   bool PossibleMatchRange(std::string* min, std::string* max, int maxlen);
 
+  // Searches chunk, the next part of a text that arrives in chunks,
+  // picking up in the state saved in *stream.  See Prog::SearchDFAStream.
+  bool SearchStream(DFAStream* stream, absl::string_view chunk,
+                    bool end_of_text, std::vector<int64_t>* ends);
+
+  // Like Search() for each of texts in turn, within the corresponding
+  // contexts (or within themselves if contexts is empty), but holding the
+  // cache lock for the whole batch.  Sets (*results)[i] to 1 if texts[i]
+  // matched, 0 if not, or -1 if the search failed, and (*eps)[i] to the
+  // end point of the match.  If ids is not NULL, sets (*ids)[i] to the
+  // match IDs that Search() would have put in matches.
+  void SearchBatch(absl::Span<const absl::string_view> texts,
+                   absl::Span<const absl::string_view> contexts,
+                   bool anchored, bool want_earliest_match, bool run_forward,
+                   std::vector<int>* results, std::vector<const char*>* eps,
+                   std::vector<std::vector<int>>* ids);
+
+  // Like Search() for an unanchored forward search, but divides text
+  // among as many as nthreads threads.  See Prog::SearchDFAParallel.
+  bool SearchParallel(absl::string_view text, absl::string_view context,
+                      bool want_earliest_match, int nthreads, bool* failed,
+                      const char** ep);
+
+  // Starts counting in counters, which the Prog has just been given.
+  void SetCounters(SearchCounters* counters);
+
+  // Searches hold the cache mutex for reading on every call, so it needs
+  // to scale with the number of reading threads.  See below.
+  using CacheMutex = ShardedReaderMutex;
+  using RWLocker = re2::RWLocker<CacheMutex>;
+
   // These data structures are logically private, but C++ makes it too
   // difficult to mark them as such.
-  class RWLocker;
   class StateSaver;
   class Workq;
 
@@ -168,9 +261,6 @@ class DFA {
   typedef absl::flat_hash_set<State*, StateHash, StateEqual> StateSet;
 
  private:
-  // Make it easier to swap in a scalable reader-writer mutex.
-  using CacheMutex = absl::Mutex;
-
   enum {
     // Indices into start_ for unanchored searches.
     // Add kStartAnchored for anchored searches.
@@ -187,6 +277,8 @@ class DFA {
   // Releases and reacquires cache_mutex_ via cache_lock, so any
   // State* existing before the call are not valid after the call.
   // Use a StateSaver to preserve important states across the call.
+  // (The start states and the most used states survive the reset if they
+  // fit in a quarter of the budget, but callers must not rely on that.)
   // cache_mutex_.r <= L < mutex_
   // After: cache_mutex_.w <= L < mutex_
   void ResetCache(RWLocker* cache_lock);
@@ -203,6 +295,19 @@ class DFA {
   // Must hold cache_mutex_.w or be in destructor.
   void ClearCache();
 
+  // Clears the cache except for the start states and the states with the
+  // most transitions computed (a cheap measure of how often the search
+  // has passed through them), as many as fit in a quarter of the budget.
+  // Transitions to discarded states are forgotten.
+  // Must hold cache_mutex_.w.
+  void ShrinkCache();
+
+  // Returns the memory that s takes up in the budget.
+  int64_t StateMemory(State* s);
+
+  // Deallocates s, which must not be in the cache.
+  void DeleteState(State* s);
+
   // Converts a State into a Workq: the opposite of WorkqToCachedState.
   // L >= mutex_
   void StateToWorkq(State* s, Workq* q);
@@ -247,7 +352,9 @@ class DFA {
         cache_lock(cache_lock),
         failed(false),
         ep(NULL),
-        matches(NULL) {}
+        matches(NULL),
+        positions(NULL),
+        latest_positions(false) {}
 
     absl::string_view text;
     absl::string_view context;
@@ -260,6 +367,10 @@ class DFA {
     bool failed;     // "out" parameter: whether search gave up
     const char* ep;  // "out" parameter: end pointer for match
     SparseSet* matches;
+    // If not NULL, indexed by match ID: where each ID first (or,
+    // if latest_positions, last) matched.  Requires matches.
+    const char** positions;
+    bool latest_positions;
 
    private:
     SearchParams(const SearchParams&) = delete;
@@ -278,9 +389,33 @@ class DFA {
   // false on failure.
   // cache_mutex_.r <= L < mutex_
   bool AnalyzeSearch(SearchParams* params);
+  bool AnalyzeStart(SearchParams* params, int c);
   bool AnalyzeSearchHelper(SearchParams* params, StartInfo* info,
                            uint32_t flags);
 
+  // Looks up the State saved in stream, which was computed by a DFA
+  // (perhaps this one) with a different cache, recreating it if need be.
+  // cache_mutex_.r <= L < mutex_
+  // Might unlock and relock cache_mutex_ via params->cache_lock.
+  State* RestoreStreamState(DFAStream* stream, SearchParams* params);
+
+  // A segment of the text in a parallel search.
+  struct Segment;
+
+  // Searches seg speculatively, recording the results in seg.
+  // limit is the end of the text.  Gives up if *cancel becomes true.
+  // L < mutex_ (takes cache_mutex_.r)
+  void SearchSegment(Segment* seg, const uint8_t* limit,
+                     bool want_earliest_match, std::atomic<bool>* cancel);
+
+  // Runs the real search over the speculatively searched segments.
+  // Returns false and sets *failed if they cannot be used after all.
+  // L < mutex_ (takes cache_mutex_.r)
+  bool ResolveSegments(const std::vector<Segment>& segs,
+                       absl::string_view text, absl::string_view context,
+                       bool want_earliest_match, bool* failed,
+                       const char** ep);
+
   // The generic search loop, inlined to create specialized versions.
   // cache_mutex_.r <= L < mutex_
   // Might unlock and relock cache_mutex_ via params->cache_lock.
@@ -289,6 +424,10 @@ class DFA {
             bool run_forward>
   inline bool InlinedSearchLoop(SearchParams* params);
 
+  // Adds the match IDs in s to params->matches and, if it is not NULL,
+  // records lastmatch in params->positions for them.
+  void RecordMatches(SearchParams* params, State* s, const uint8_t* lastmatch);
+
   // The specialized versions of InlinedSearchLoop.  The three letters
   // at the ends of the name denote the true/false values used as the
   // last three parameters of InlinedSearchLoop.
@@ -309,6 +448,25 @@ class DFA {
   // Might unlock and relock cache_mutex_ via params->cache_lock.
   bool FastSearchLoop(SearchParams* params);
 
+  // Searches text alone for SearchBatch(), setting *result and *ep as
+  // SearchBatch() sets (*results)[i] and (*eps)[i].
+  // cache_mutex_.r <= L < mutex_
+  // Might unlock and relock cache_mutex_ via cache_lock.
+  void SearchBatchText(absl::string_view text, absl::string_view context,
+                       bool anchored, bool want_earliest_match,
+                       bool run_forward, RWLocker* cache_lock,
+                       SparseSet* matches, int* result, const char** ep);
+
+  // Like calling SearchBatchText() for each of texts, but advances several
+  // texts through the DFA in lockstep.  See the comment there.
+  // cache_mutex_.r <= L < mutex_
+  // Might unlock and relock cache_mutex_ via cache_lock.
+  template <bool run_forward>
+  void InterleavedSearchBatch(absl::Span<const absl::string_view> texts,
+                              absl::Span<const absl::string_view> contexts,
+                              bool anchored, bool want_earliest_match,
+                              RWLocker* cache_lock, std::vector<int>* results,
+                              std::vector<const char*>* eps);
 
   // Looks up bytes in bytemap_ but handles case c == kByteEndText too.
   int ByteMap(int c) {
@@ -317,10 +475,21 @@ class DFA {
     return prog_->bytemap()[c];
   }
 
+  // Adds n to counter c of the Prog's search counters, if it has any.
+  void Count(SearchCounters::Counter c, int64_t n) {
+    if (counters_ != NULL)
+      counters_->Add(c, n);
+  }
+  void CountUnsynced(SearchCounters::Counter c, int64_t n) {
+    if (counters_ != NULL)
+      counters_->AddUnsynced(c, n);
+  }
+
   // Constant after initialization.
   Prog* prog_;              // The regular expression program to run.
   Prog::MatchKind kind_;    // The kind of DFA.
   bool init_failed_;        // initialization failed (out of memory)
+  SearchCounters* counters_;  // prog_->search_counters()
 
   absl::Mutex mutex_;  // mutex_ >= cache_mutex_.r
 
@@ -339,6 +508,9 @@ class DFA {
   int64_t mem_budget_;     // Total memory budget for all States.
   int64_t state_budget_;   // Amount of memory remaining for new States.
   StateSet state_cache_;   // All States computed so far.
+  uint64_t cache_generation_;  // Number of times the cache has been reset.
+  int64_t states_built_;   // Number of States ever built, under mutex_.
+  int64_t mem_counted_;    // Memory in use, as last added to counters_.
   StartInfo start_[kMaxStart];
 
   DFA(const DFA&) = delete;
@@ -421,9 +593,13 @@ DFA::DFA(Prog* prog, Prog::MatchKind kind, int64_t max_mem)
   : prog_(prog),
     kind_(kind),
     init_failed_(false),
+    counters_(prog->search_counters()),
     q0_(NULL),
     q1_(NULL),
-    mem_budget_(max_mem) {
+    mem_budget_(max_mem),
+    cache_generation_(0),
+    states_built_(0),
+    mem_counted_(0) {
   if (ExtraDebug)
     absl::FPrintF(stderr, "\nkind %d\n%s\n", kind_, prog_->DumpUnanchored());
   int nmark = 0;
@@ -464,9 +640,14 @@ DFA::DFA(Prog* prog, Prog::MatchKind kind, int64_t max_mem)
   q0_ = new Workq(prog_->size(), nmark);
   q1_ = new Workq(prog_->size(), nmark);
   stack_ = PODArray<int>(nstack);
+  Count(SearchCounters::kDFAMemBudget, state_budget_);
 }
 
 DFA::~DFA() {
+  if (ok()) {
+    Count(SearchCounters::kDFAMemBudget, -state_budget_);
+    Count(SearchCounters::kDFAMemInUse, -mem_counted_);
+  }
   delete q0_;
   delete q1_;
   ClearCache();
@@ -762,10 +943,7 @@ DFA::State* DFA::CachedState(int* inst, int ninst, uint32_t flag) {
 
   // Must have enough memory for new state.
   // In addition to what we're going to allocate,
-  // the state cache hash table seems to incur about 18 bytes per
-  // State*. Worst case for non-small sets is it being half full, where each
-  // value present takes up 1 byte hash sample plus the pointer itself.
-  const int kStateCacheOverhead = 18;
+  // the state cache hash table incurs kStateCacheOverhead bytes per State*.
   int nnext = prog_->bytemap_range() + 1;  // + 1 for kByteEndText slot
   int mem = sizeof(State) + nnext*sizeof(std::atomic<State*>);
   int instmem = ninst*sizeof(int);
@@ -796,6 +974,10 @@ DFA::State* DFA::CachedState(int* inst, int ninst, uint32_t flag) {
 
   // Put state in cache and return it.
   state_cache_.insert(s);
+  states_built_++;
+  mem_counted_ += mem + instmem + kStateCacheOverhead;
+  Count(SearchCounters::kDFAStatesBuilt, 1);
+  Count(SearchCounters::kDFAMemInUse, mem + instmem + kStateCacheOverhead);
   return s;
 }
 
@@ -806,17 +988,92 @@ void DFA::ClearCache() {
   while (begin != end) {
     StateSet::iterator tmp = begin;
     ++begin;
-    // Deallocate the instruction array, which is stored separately as above.
-    std::allocator<int>().deallocate((*tmp)->inst_, (*tmp)->ninst_);
-    // Deallocate the blob of memory that we allocated in DFA::CachedState().
-    // We recompute mem in order to benefit from sized delete where possible.
-    int nnext = prog_->bytemap_range() + 1;  // + 1 for kByteEndText slot
-    int mem = sizeof(State) + nnext*sizeof(std::atomic<State*>);
-    std::allocator<char>().deallocate(reinterpret_cast<char*>(*tmp), mem);
+    DeleteState(*tmp);
   }
   state_cache_.clear();
 }
 
+void DFA::DeleteState(State* s) {
+  // Deallocate the instruction array, which is stored separately as above.
+  std::allocator<int>().deallocate(s->inst_, s->ninst_);
+  // Deallocate the blob of memory that we allocated in DFA::CachedState().
+  // We recompute mem in order to benefit from sized delete where possible.
+  int nnext = prog_->bytemap_range() + 1;  // + 1 for kByteEndText slot
+  int mem = sizeof(State) + nnext*sizeof(std::atomic<State*>);
+  std::allocator<char>().deallocate(reinterpret_cast<char*>(s), mem);
+}
+
+int64_t DFA::StateMemory(State* s) {
+  // As in DFA::CachedState().
+  int nnext = prog_->bytemap_range() + 1;  // + 1 for kByteEndText slot
+  return sizeof(State) + nnext*sizeof(std::atomic<State*>) +
+         s->ninst_*sizeof(int) + kStateCacheOverhead;
+}
+
+void DFA::ShrinkCache() {
+  int nnext = prog_->bytemap_range() + 1;  // + 1 for kByteEndText slot
+
+  // Rank the states, start states first.
+  absl::flat_hash_set<State*> starts;
+  for (int i = 0; i < kMaxStart; i++) {
+    State* s = start_[i].start.load(std::memory_order_relaxed);
+    if (s > SpecialStateMax)
+      starts.insert(s);
+  }
+  std::vector<std::pair<int, State*>> ranked;
+  ranked.reserve(state_cache_.size());
+  for (State* s : state_cache_) {
+    int n = 0;
+    for (int i = 0; i < nnext; i++)
+      if (s->next_[i].load(std::memory_order_relaxed) != NULL)
+        n++;
+    if (starts.contains(s))
+      n = nnext + 1;
+    if (n > 0)
+      ranked.emplace_back(n, s);
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const std::pair<int, State*>& a,
+               const std::pair<int, State*>& b) -> bool {
+              return a.first > b.first;
+            });
+
+  int64_t budget = state_budget_ / 4;
+  absl::flat_hash_set<State*> keep;
+  for (const std::pair<int, State*>& r : ranked) {
+    int64_t mem = StateMemory(r.second);
+    if (mem > budget)
+      break;
+    budget -= mem;
+    keep.insert(r.second);
+  }
+
+  // Forget transitions to the states that are going, then delete them.
+  mem_budget_ = state_budget_;
+  for (State* s : keep) {
+    for (int i = 0; i < nnext; i++) {
+      State* ns = s->next_[i].load(std::memory_order_relaxed);
+      if (ns > SpecialStateMax && !keep.contains(ns))
+        s->next_[i].store(NULL, std::memory_order_relaxed);
+    }
+    mem_budget_ -= StateMemory(s);
+  }
+  for (int i = 0; i < kMaxStart; i++) {
+    State* s = start_[i].start.load(std::memory_order_relaxed);
+    if (s > SpecialStateMax && !keep.contains(s))
+      start_[i].start.store(NULL, std::memory_order_relaxed);
+  }
+  for (StateSet::iterator it = state_cache_.begin();
+       it != state_cache_.end();) {
+    StateSet::iterator tmp = it;
+    ++it;
+    if (!keep.contains(*tmp)) {
+      DeleteState(*tmp);
+      state_cache_.erase(tmp);
+    }
+  }
+}
+
 // Copies insts in state s to the work queue q.
 void DFA::StateToWorkq(State* s, Workq* q) {
   q->clear();
@@ -1110,6 +1367,7 @@ DFA::State* DFA::RunStateOnByte(State* state, int c) {
   // main search loop can proceed without any locking, for speed.
   // (Otherwise it would need one mutex operation per input byte.)
   state->next_[ByteMap(c)].store(ns, std::memory_order_release);
+  Count(SearchCounters::kDFATransitionsBuilt, 1);
   return ns;
 }
 
@@ -1117,62 +1375,6 @@ DFA::State* DFA::RunStateOnByte(State* state, int c) {
 //////////////////////////////////////////////////////////////////////
 // DFA cache reset.
 
-// Reader-writer lock helper.
-//
-// The DFA uses a reader-writer mutex to protect the state graph itself.
-// Traversing the state graph requires holding the mutex for reading,
-// and discarding the state graph and starting over requires holding the
-// lock for writing.  If a search needs to expand the graph but is out
-// of memory, it will need to drop its read lock and then acquire the
-// write lock.  Since it cannot then atomically downgrade from write lock
-// to read lock, it runs the rest of the search holding the write lock.
-// (This probably helps avoid repeated contention, but really the decision
-// is forced by the Mutex interface.)  It's a bit complicated to keep
-// track of whether the lock is held for reading or writing and thread
-// that through the search, so instead we encapsulate it in the RWLocker
-// and pass that around.
-
-class DFA::RWLocker {
- public:
-  explicit RWLocker(CacheMutex* mu);
-  ~RWLocker();
-
-  // If the lock is only held for reading right now,
-  // drop the read lock and re-acquire for writing.
-  // Subsequent calls to LockForWriting are no-ops.
-  // Notice that the lock is *released* temporarily.
-  void LockForWriting();
-
- private:
-  CacheMutex* mu_;
-  bool writing_;
-
-  RWLocker(const RWLocker&) = delete;
-  RWLocker& operator=(const RWLocker&) = delete;
-};
-
-DFA::RWLocker::RWLocker(CacheMutex* mu) : mu_(mu), writing_(false) {
-  mu_->ReaderLock();
-}
-
-// This function is marked as ABSL_NO_THREAD_SAFETY_ANALYSIS because
-// the annotations don't support lock upgrade.
-void DFA::RWLocker::LockForWriting() ABSL_NO_THREAD_SAFETY_ANALYSIS {
-  if (!writing_) {
-    mu_->ReaderUnlock();
-    mu_->WriterLock();
-    writing_ = true;
-  }
-}
-
-DFA::RWLocker::~RWLocker() {
-  if (!writing_)
-    mu_->ReaderUnlock();
-  else
-    mu_->WriterUnlock();
-}
-
-
 // When the DFA's State cache fills, we discard all the states in the
 // cache and start over.  Many threads can be using and adding to the
 // cache at the same time, so we synchronize using the cache_mutex_
@@ -1193,11 +1395,21 @@ void DFA::ResetCache(RWLocker* cache_lock) {
       state_cache_.size(),
   });
 
-  // Clear the cache, reset the memory budget.
-  for (int i = 0; i < kMaxStart; i++)
-    start_[i].start.store(NULL, std::memory_order_relaxed);
-  ClearCache();
-  mem_budget_ = state_budget_;
+  if (dfa_keep_hot_states) {
+    // Keep the hottest part of the cache, reset the memory budget.
+    ShrinkCache();
+  } else {
+    // Clear the cache, reset the memory budget.
+    for (int i = 0; i < kMaxStart; i++)
+      start_[i].start.store(NULL, std::memory_order_relaxed);
+    ClearCache();
+    mem_budget_ = state_budget_;
+  }
+  cache_generation_++;
+  Count(SearchCounters::kDFACacheResets, 1);
+  int64_t in_use = state_budget_ - mem_budget_;
+  Count(SearchCounters::kDFAMemInUse, in_use - mem_counted_);
+  mem_counted_ = in_use;
 }
 
 // Typically, a couple States do need to be preserved across a cache
@@ -1337,6 +1549,21 @@ DFA::State* DFA::StateSaver::Restore() {
 // When s->next[c]->IsMatch(), it means that there is a match ending just
 // *before* byte c.
 
+void DFA::RecordMatches(SearchParams* params, State* s,
+                        const uint8_t* lastmatch) {
+  for (int i = s->ninst_ - 1; i >= 0; i--) {
+    int id = s->inst_[i];
+    if (id == MatchSep)
+      break;
+    params->matches->insert(id);
+    if (params->positions != NULL) {
+      const char*& pos = params->positions[id];
+      if (pos == NULL || params->latest_positions)
+        pos = reinterpret_cast<const char*>(lastmatch);
+    }
+  }
+}
+
 // The generic search loop.  Searches text for a match, returning
 // the pointer to the end of the chosen match, or NULL if no match.
 // The bools are equal to the same-named variables in params, but
@@ -1352,6 +1579,7 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
   const uint8_t* ep = BytePtr(params->text.data() +
                               params->text.size());  // end of text
   const uint8_t* resetp = NULL;                      // p at last cache reset
+  size_t reset_size = 0;             // state_cache_.size() after that reset
   if (!run_forward) {
     using std::swap;
     swap(p, ep);
@@ -1370,14 +1598,8 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
     lastmatch = p;
     if (ExtraDebug)
       absl::FPrintF(stderr, "match @stx! [%s]\n", DumpState(s));
-    if (params->matches != NULL) {
-      for (int i = s->ninst_ - 1; i >= 0; i--) {
-        int id = s->inst_[i];
-        if (id == MatchSep)
-          break;
-        params->matches->insert(id);
-      }
-    }
+    if (params->matches != NULL)
+      RecordMatches(params, s, lastmatch);
     if (want_earliest_match) {
       params->ep = reinterpret_cast<const char*>(lastmatch);
       return true;
@@ -1436,9 +1658,13 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
         // of 10 bytes per state computation, fail so that RE2 can
         // fall back to the NFA.  However, RE2::Set cannot fall back,
         // so we just have to keep on keeping on in that case.
+        // Only the states built since the reset count: the hot states
+        // that ShrinkCache() kept cost this search nothing.
         if (dfa_should_bail_when_slow && resetp != NULL &&
-            static_cast<size_t>(p - resetp) < 10*state_cache_.size() &&
+            static_cast<size_t>(p - resetp) <
+                10*(state_cache_.size() - reset_size) &&
             kind_ != Prog::kManyMatch) {
+          Count(SearchCounters::kDFABailouts, 1);
           params->failed = true;
           return false;
         }
@@ -1450,6 +1676,7 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
 
         // Discard all the States in the cache.
         ResetCache(params->cache_lock);
+        reset_size = state_cache_.size();
 
         // Restore start and s so we can continue.
         if ((start = save_start.Restore()) == NULL ||
@@ -1487,14 +1714,8 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
         lastmatch = p + 1;
       if (ExtraDebug)
         absl::FPrintF(stderr, "match @%d! [%s]\n", lastmatch - bp, DumpState(s));
-      if (params->matches != NULL) {
-        for (int i = s->ninst_ - 1; i >= 0; i--) {
-          int id = s->inst_[i];
-          if (id == MatchSep)
-            break;
-          params->matches->insert(id);
-        }
-      }
+      if (params->matches != NULL)
+        RecordMatches(params, s, lastmatch);
       if (want_earliest_match) {
         params->ep = reinterpret_cast<const char*>(lastmatch);
         return true;
@@ -1554,14 +1775,8 @@ inline bool DFA::InlinedSearchLoop(SearchParams* params) {
     lastmatch = p;
     if (ExtraDebug)
       absl::FPrintF(stderr, "match @etx! [%s]\n", DumpState(s));
-    if (params->matches != NULL) {
-      for (int i = s->ninst_ - 1; i >= 0; i--) {
-        int id = s->inst_[i];
-        if (id == MatchSep)
-          break;
-        params->matches->insert(id);
-      }
-    }
+    if (params->matches != NULL)
+      RecordMatches(params, s, lastmatch);
   }
 
   params->ep = reinterpret_cast<const char*>(lastmatch);
@@ -1654,37 +1869,38 @@ bool DFA::AnalyzeSearch(SearchParams* params) {
     return true;
   }
 
+  // Determine the byte next to text in the direction opposite to the
+  // search, unless text is at the edge of context.
+  int c = -1;
+  if (params->run_forward) {
+    if (BeginPtr(text) != BeginPtr(context))
+      c = BeginPtr(text)[-1] & 0xFF;
+  } else {
+    if (EndPtr(text) != EndPtr(context))
+      c = EndPtr(text)[0] & 0xFF;
+  }
+  return AnalyzeStart(params, c);
+}
+
+// Fills in params->start and params->can_prefix_accel for a search that
+// begins just after byte c, or at the beginning of the context if c is -1.
+// Returns true on success, false on failure.
+bool DFA::AnalyzeStart(SearchParams* params, int c) {
   // Determine correct search type.
   int start;
   uint32_t flags;
-  if (params->run_forward) {
-    if (BeginPtr(text) == BeginPtr(context)) {
-      start = kStartBeginText;
-      flags = kEmptyBeginText|kEmptyBeginLine;
-    } else if (BeginPtr(text)[-1] == '\n') {
-      start = kStartBeginLine;
-      flags = kEmptyBeginLine;
-    } else if (Prog::IsWordChar(BeginPtr(text)[-1] & 0xFF)) {
-      start = kStartAfterWordChar;
-      flags = kFlagLastWord;
-    } else {
-      start = kStartAfterNonWordChar;
-      flags = 0;
-    }
+  if (c < 0) {
+    start = kStartBeginText;
+    flags = kEmptyBeginText|kEmptyBeginLine;
+  } else if (c == '\n') {
+    start = kStartBeginLine;
+    flags = kEmptyBeginLine;
+  } else if (Prog::IsWordChar(static_cast<uint8_t>(c))) {
+    start = kStartAfterWordChar;
+    flags = kFlagLastWord;
   } else {
-    if (EndPtr(text) == EndPtr(context)) {
-      start = kStartBeginText;
-      flags = kEmptyBeginText|kEmptyBeginLine;
-    } else if (EndPtr(text)[0] == '\n') {
-      start = kStartBeginLine;
-      flags = kEmptyBeginLine;
-    } else if (Prog::IsWordChar(EndPtr(text)[0] & 0xFF)) {
-      start = kStartAfterWordChar;
-      flags = kFlagLastWord;
-    } else {
-      start = kStartAfterNonWordChar;
-      flags = 0;
-    }
+    start = kStartAfterNonWordChar;
+    flags = 0;
   }
   if (params->anchored)
     start |= kStartAnchored;
@@ -1708,11 +1924,11 @@ bool DFA::AnalyzeSearch(SearchParams* params) {
   // less obviously, we cannot do so when we are going to need flags.
   // This trick works only when there is a single byte that leads to a
   // different state!
-  if (prog_->can_prefix_accel() &&
+  params->can_prefix_accel =
+      prog_->can_prefix_accel() &&
       !params->anchored &&
       params->start > SpecialStateMax &&
-      params->start->flag_ >> kFlagNeedShift == 0)
-    params->can_prefix_accel = true;
+      params->start->flag_ >> kFlagNeedShift == 0;
 
   if (ExtraDebug)
     absl::FPrintF(stderr, "anchored=%d fwd=%d flags=%#x state=%s can_prefix_accel=%d\n",
@@ -1751,7 +1967,8 @@ bool DFA::AnalyzeSearchHelper(SearchParams* params, StartInfo* info,
 // The actual DFA search: calls AnalyzeSearch and then FastSearchLoop.
 bool DFA::Search(absl::string_view text, absl::string_view context,
                  bool anchored, bool want_earliest_match, bool run_forward,
-                 bool* failed, const char** epp, SparseSet* matches) {
+                 bool* failed, const char** epp, SparseSet* matches,
+                 const char** positions, bool latest_positions) {
   *epp = NULL;
   if (!ok()) {
     *failed = true;
@@ -1765,6 +1982,9 @@ bool DFA::Search(absl::string_view text, absl::string_view context,
                   text, anchored, want_earliest_match, run_forward, kind_);
   }
 
+  CountUnsynced(SearchCounters::kDFASearches, 1);
+  CountUnsynced(SearchCounters::kDFABytes, text.size());
+
   RWLocker l(&cache_mutex_);
   SearchParams params(text, context, &l);
   params.anchored = anchored;
@@ -1773,6 +1993,9 @@ bool DFA::Search(absl::string_view text, absl::string_view context,
   // matches should be null except when using RE2::Set.
   ABSL_DCHECK(matches == NULL || kind_ == Prog::kManyMatch);
   params.matches = matches;
+  ABSL_DCHECK(positions == NULL || matches != NULL);
+  params.positions = positions;
+  params.latest_positions = latest_positions;
 
   if (!AnalyzeSearch(&params)) {
     *failed = true;
@@ -1798,7 +2021,847 @@ bool DFA::Search(absl::string_view text, absl::string_view context,
   return ret;
 }
 
-DFA* Prog::GetDFA(MatchKind kind) {
+void DFA::SearchBatch(absl::Span<const absl::string_view> texts,
+                      absl::Span<const absl::string_view> contexts,
+                      bool anchored, bool want_earliest_match,
+                      bool run_forward, std::vector<int>* results,
+                      std::vector<const char*>* eps,
+                      std::vector<std::vector<int>>* ids) {
+  results->assign(texts.size(), 0);
+  eps->assign(texts.size(), NULL);
+  if (ids != NULL) {
+    ids->resize(texts.size());
+    for (std::vector<int>& v : *ids)
+      v.clear();
+  }
+  if (!ok()) {
+    results->assign(texts.size(), -1);
+    return;
+  }
+  // matches should be null except when using RE2::Set.
+  ABSL_DCHECK(ids == NULL || kind_ == Prog::kManyMatch);
+  // Match IDs are less than the number of instructions.
+  SparseSet matches(ids != NULL ? prog_->size() : 0);
+
+  size_t nbytes = 0;
+  for (absl::string_view text : texts)
+    nbytes += text.size();
+  CountUnsynced(SearchCounters::kDFASearches, texts.size());
+  CountUnsynced(SearchCounters::kDFABytes, nbytes);
+
+  RWLocker l(&cache_mutex_);
+  if (ids == NULL && texts.size() > 1 && dfa_interleave_batches) {
+    if (run_forward)
+      InterleavedSearchBatch<true>(texts, contexts, anchored,
+                                   want_earliest_match, &l, results, eps);
+    else
+      InterleavedSearchBatch<false>(texts, contexts, anchored,
+                                    want_earliest_match, &l, results, eps);
+    return;
+  }
+  for (size_t i = 0; i < texts.size(); i++) {
+    absl::string_view text = texts[i];
+    absl::string_view context = contexts.empty() ? text : contexts[i];
+    if (ids != NULL)
+      matches.clear();
+    SearchBatchText(text, context, anchored, want_earliest_match,
+                    run_forward, &l, ids != NULL ? &matches : NULL,
+                    &(*results)[i], &(*eps)[i]);
+    if (ids != NULL && (*results)[i] == 1)
+      (*ids)[i].assign(matches.begin(), matches.end());
+  }
+}
+
+void DFA::SearchBatchText(absl::string_view text, absl::string_view context,
+                          bool anchored, bool want_earliest_match,
+                          bool run_forward, RWLocker* cache_lock,
+                          SparseSet* matches, int* result, const char** ep) {
+  SearchParams params(text, context, cache_lock);
+  params.anchored = anchored;
+  params.want_earliest_match = want_earliest_match;
+  params.run_forward = run_forward;
+  params.matches = matches;
+  *result = 0;
+  *ep = NULL;
+  if (!AnalyzeSearch(&params)) {
+    *result = -1;
+    return;
+  }
+  if (params.start == DeadState)
+    return;
+  if (params.start == FullMatchState) {
+    *result = 1;
+    if (run_forward == want_earliest_match)
+      *ep = text.data();
+    else
+      *ep = text.data() + text.size();
+    return;
+  }
+  bool matched = FastSearchLoop(&params);
+  if (params.failed) {
+    *result = -1;
+    return;
+  }
+  if (!matched)
+    return;
+  *result = 1;
+  *ep = params.ep;
+}
+
+// Prefetches the memory at addr into the cache, where the compiler can.
+static inline void Prefetch(const void* addr) {
+#if defined(__GNUC__)
+  __builtin_prefetch(addr);
+#else
+  (void)addr;
+#endif
+}
+
+// In a batch of short texts, InlinedSearchLoop spends most of its time
+// waiting: each transition loads the next State, and the load for the
+// next byte cannot begin until that State is known.  The texts of a batch
+// are independent, though, so InterleavedSearchBatch() keeps kLanes of
+// them in flight and advances each one by a byte in turn, which lets the
+// processor overlap their loads, and prefetches the transition that each
+// text will take next.  A text leaves its lane when its search is over,
+// and the next text of the batch takes its place.
+//
+// The lanes hold State pointers, which a cache reset invalidates.  Most
+// resets are avoided: a text whose next State does not fit in the cache
+// is searched alone, from the start, by SearchBatchText(), which knows how
+// to reset the cache and carry on.  If that (or finding a start state)
+// does reset the cache, the texts in the other lanes start over.
+//
+// The lanes do not use prefix acceleration, which pays off only in texts
+// much longer than those that batches are for.
+
+template <bool run_forward>
+void DFA::InterleavedSearchBatch(absl::Span<const absl::string_view> texts,
+                                 absl::Span<const absl::string_view> contexts,
+                                 bool anchored, bool want_earliest_match,
+                                 RWLocker* cache_lock,
+                                 std::vector<int>* results,
+                                 std::vector<const char*>* eps) {
+  static const int kLanes = 8;
+  struct Lane {
+    size_t i;                   // index of the text
+    State* s;                   // current state
+    const uint8_t* p;           // text scanning point
+    const uint8_t* ep;          // where scanning stops
+    const uint8_t* lastmatch;   // most recent matching position, if any
+  };
+  Lane lanes[kLanes];
+  int nlanes = 0;                // lanes[0..nlanes) are in flight
+  size_t next = 0;               // next text to start
+  std::vector<size_t> restart;   // texts to start over after a reset
+  const uint8_t* bytemap = prog_->bytemap();
+
+  auto context_of = [&](size_t i) -> absl::string_view {
+    return contexts.empty() ? texts[i] : contexts[i];
+  };
+
+  // Called when the cache has been reset: every other lane starts over.
+  auto start_over = [&](int keep) {
+    for (int j = 0; j < nlanes; j++)
+      if (j != keep)
+        restart.push_back(lanes[j].i);
+    if (keep >= 0) {
+      lanes[0] = lanes[keep];
+      nlanes = 1;
+    } else {
+      nlanes = 0;
+    }
+  };
+
+  // Searches texts[i] alone.
+  auto search_alone = [&](size_t i) {
+    uint64_t generation = cache_generation_;
+    SearchBatchText(texts[i], context_of(i), anchored, want_earliest_match,
+                    run_forward, cache_lock, NULL, &(*results)[i],
+                    &(*eps)[i]);
+    if (cache_generation_ != generation)
+      start_over(-1);
+  };
+
+  // Finishes the search in lane j, which then holds the last lane.
+  auto finish = [&](int j, int result, const uint8_t* ep) {
+    (*results)[lanes[j].i] = result;
+    (*eps)[lanes[j].i] = reinterpret_cast<const char*>(ep);
+    lanes[j] = lanes[--nlanes];
+  };
+
+  // Starts texts[i] in a new lane, unless the search is over already.
+  auto start = [&](size_t i) {
+    absl::string_view text = texts[i];
+    SearchParams params(text, context_of(i), cache_lock);
+    params.anchored = anchored;
+    params.want_earliest_match = want_earliest_match;
+    params.run_forward = run_forward;
+    uint64_t generation = cache_generation_;
+    bool ok = AnalyzeSearch(&params);
+    if (cache_generation_ != generation)
+      start_over(-1);
+    (*results)[i] = 0;
+    (*eps)[i] = NULL;
+    if (!ok) {
+      (*results)[i] = -1;
+      return;
+    }
+    if (params.start == DeadState)
+      return;
+    if (params.start == FullMatchState) {
+      (*results)[i] = 1;
+      if (run_forward == want_earliest_match)
+        (*eps)[i] = text.data();
+      else
+        (*eps)[i] = text.data() + text.size();
+      return;
+    }
+    Lane* lane = &lanes[nlanes++];
+    lane->i = i;
+    lane->s = params.start;
+    lane->p = BytePtr(text.data());
+    lane->ep = BytePtr(text.data() + text.size());
+    if (!run_forward) {
+      using std::swap;
+      swap(lane->p, lane->ep);
+    }
+    lane->lastmatch = NULL;
+    if (lane->s->IsMatch()) {
+      lane->lastmatch = lane->p;
+      if (want_earliest_match)
+        finish(nlanes - 1, 1, lane->p);
+    }
+  };
+
+  for (;;) {
+    while (nlanes < kLanes && (!restart.empty() || next < texts.size())) {
+      if (!restart.empty()) {
+        size_t i = restart.back();
+        restart.pop_back();
+        start(i);
+      } else {
+        start(next++);
+      }
+    }
+    if (nlanes == 0)
+      break;
+
+    for (int j = 0; j < nlanes;) {
+      Lane* lane = &lanes[j];
+      State* ns;
+      if (lane->p != lane->ep) {
+        int c = run_forward ? *lane->p++ : *--lane->p;
+        ns = lane->s->next_[bytemap[c]].load(std::memory_order_acquire);
+        if (ns == NULL) {
+          ns = RunStateOnByteUnlocked(lane->s, c);
+          if (ns == NULL) {
+            // The cache is full.
+            size_t i = lane->i;
+            lanes[j] = lanes[--nlanes];
+            search_alone(i);
+            break;
+          }
+        }
+        if (ns > SpecialStateMax) {
+          lane->s = ns;
+          if (lane->p != lane->ep)
+            Prefetch(&ns->next_[bytemap[run_forward ? lane->p[0]
+                                                    : lane->p[-1]]]);
+          if (ns->IsMatch()) {
+            // Matches are noticed one byte late, as in InlinedSearchLoop().
+            lane->lastmatch = run_forward ? lane->p - 1 : lane->p + 1;
+            if (want_earliest_match) {
+              finish(j, 1, lane->lastmatch);
+              continue;
+            }
+          }
+          j++;
+          continue;
+        }
+      } else {
+        // Process one more byte to see if it triggers a match.
+        absl::string_view text = texts[lane->i];
+        absl::string_view context = context_of(lane->i);
+        int lastbyte;
+        if (run_forward) {
+          if (EndPtr(text) == EndPtr(context))
+            lastbyte = kByteEndText;
+          else
+            lastbyte = EndPtr(text)[0] & 0xFF;
+        } else {
+          if (BeginPtr(text) == BeginPtr(context))
+            lastbyte = kByteEndText;
+          else
+            lastbyte = BeginPtr(text)[-1] & 0xFF;
+        }
+        ns = lane->s->next_[ByteMap(lastbyte)].load(
+            std::memory_order_acquire);
+        if (ns == NULL) {
+          ns = RunStateOnByteUnlocked(lane->s, lastbyte);
+          if (ns == NULL) {
+            size_t i = lane->i;
+            lanes[j] = lanes[--nlanes];
+            search_alone(i);
+            break;
+          }
+        }
+        if (ns > SpecialStateMax) {
+          if (ns->IsMatch())
+            lane->lastmatch = lane->p;
+          finish(j, lane->lastmatch != NULL, lane->lastmatch);
+          continue;
+        }
+      }
+      // DeadState or FullMatchState
+      if (ns == DeadState)
+        finish(j, lane->lastmatch != NULL, lane->lastmatch);
+      else
+        finish(j, 1, lane->ep);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Streaming search.
+//
+// RE2::StreamMatcher searches a text that arrives in chunks.  It runs the
+// longest-match DFA over each chunk in turn and, between chunks, keeps the
+// current State in a DFAStream.  The State records the empty-width
+// flags and whether the last byte was a word character, so \b and $ work
+// across chunk boundaries exactly as they do within a chunk.  Since matches
+// are noticed one byte late, a match that ends at the end of a chunk is
+// noticed in the next chunk, or at the end of the text.
+//
+// Once a match is found, the search starts over where it ended, so the
+// matches reported are the earliest-ending match in the text, then the
+// earliest-ending match that begins where that one ended, and so on.
+// (In longest-match mode, a State that contains a match drops the
+// threads that began after that match did, which is why the search must
+// start over rather than carry on.)  If a search that started at the end
+// of the last match finds an empty match there, it starts over one byte
+// later instead, much as RE2::GlobalReplace() does.
+//
+// A State is valid only until the cache is next reset, which can happen
+// between one chunk and the next, so the stream also keeps a copy of its
+// contents, from which an equivalent State can be recreated if need be.
+
+struct DFAStream {
+  DFA* dfa = NULL;           // DFA that computed state
+  uint64_t generation = 0;   // dfa->cache_generation_ when state was saved
+  DFA::State* state = NULL;  // current state, or NULL to start a search
+  int start_byte = -1;       // byte before the start of the search, or -1
+  std::vector<int> inst;     // contents of state, if it is not special
+  uint32_t flag = 0;
+  int64_t offset = 0;        // number of bytes searched so far
+  int last_byte = -1;        // last byte searched, or -1 if none
+  int64_t last_end = -1;     // end of the last match reported, or -1
+  bool done = false;         // whether no more matches are possible
+};
+
+DFA::State* DFA::RestoreStreamState(DFAStream* stream,
+                                    SearchParams* params) {
+  State* s = stream->state;
+  if (s <= SpecialStateMax ||
+      (stream->dfa == this && stream->generation == cache_generation_))
+    return s;
+  int* inst = stream->inst.data();
+  int ninst = static_cast<int>(stream->inst.size());
+  {
+    absl::MutexLock l(mutex_);
+    s = CachedState(inst, ninst, stream->flag);
+  }
+  if (s == NULL) {
+    // The cache is full.  Reset it, which invalidates params->start.
+    ResetCache(params->cache_lock);
+    if (!AnalyzeStart(params, stream->start_byte))
+      return NULL;
+    absl::MutexLock l(mutex_);
+    s = CachedState(inst, ninst, stream->flag);
+    if (s == NULL)
+      ABSL_LOG(DFATAL) << "CachedState failed after ResetCache";
+  }
+  return s;
+}
+
+bool DFA::SearchStream(DFAStream* stream, absl::string_view chunk,
+                       bool end_of_text, std::vector<int64_t>* ends) {
+  ends->clear();
+  if (!ok())
+    return false;
+
+  const uint8_t* bp = BytePtr(chunk.data());  // start of chunk
+  const uint8_t* p = bp;                      // chunk scanning point
+  const uint8_t* ep = bp + chunk.size();      // end of chunk
+  const uint8_t* accel_ep = ep;               // end of prefix accel
+  if (prog_->can_prefix_accel())
+    accel_ep -= std::min(prog_->prefix_size() - 1, chunk.size());
+  const uint8_t* bytemap = prog_->bytemap();
+  // A match must end at the end of the text, so ignore any before then.
+  const bool anchor_end = prog_->anchor_end();
+
+  CountUnsynced(SearchCounters::kDFASearches, 1);
+  CountUnsynced(SearchCounters::kDFABytes, chunk.size());
+
+  RWLocker l(&cache_mutex_);
+  SearchParams params(chunk, chunk, &l);
+  params.anchored = prog_->anchor_start();
+  params.run_forward = true;
+
+  // Pick up where the last chunk left off.
+  State* start = NULL;
+  State* s = NULL;
+  if (!stream->done && stream->state != NULL) {
+    if (!AnalyzeStart(&params, stream->start_byte))
+      return false;
+    if ((s = RestoreStreamState(stream, &params)) == NULL)
+      return false;
+    start = params.start;
+  }
+
+  // Handles a match that ends just before p[-1]: reports it and starts a
+  // new search there, unless it is an empty match where the last match
+  // ended, in which case the search starts over at p instead.
+  auto matched = [&]() {
+    int64_t end = stream->offset + (p - 1 - bp);
+    if (end != stream->last_end) {
+      ends->push_back(end);
+      stream->last_end = end;
+      p--;
+    }
+    s = NULL;
+    // A regexp that begins with \A cannot match again.
+    if (params.anchored)
+      stream->done = true;
+  };
+
+  while (!stream->done) {
+    if (s == NULL) {
+      // Start a new search at p.  If p is at the end of the chunk,
+      // leave that to the next chunk, which will know whether p is
+      // also at the end of the text.
+      if (p == ep)
+        break;
+      stream->start_byte = p > bp ? p[-1] : stream->last_byte;
+      if (!AnalyzeStart(&params, stream->start_byte))
+        return false;
+      start = s = params.start;
+      // Start states are never matching states, since matches are
+      // noticed one byte late.  Thus, the only special state that
+      // can turn up here is DeadState.
+      if (s <= SpecialStateMax) {
+        stream->done = true;
+        break;
+      }
+    }
+    if (s == FullMatchState) {
+      // Only when anchor_end: the rest of the text matches.
+      p = ep;
+      break;
+    }
+
+    State* ns = NULL;
+    while (p < ep) {
+      if (params.can_prefix_accel && s == start && p < accel_ep) {
+        // Prefix accel cannot find an occurrence of the prefix that
+        // the end of the chunk cuts short, so it must leave the last
+        // prefix_size()-1 bytes of the chunk to the DFA.
+        p = BytePtr(prog_->PrefixAccel(p, ep - p));
+        if (p == NULL) {
+          p = accel_ep;
+          if (p == ep)
+            break;
+        }
+      }
+      int c = *p++;
+      ns = s->next_[bytemap[c]].load(std::memory_order_acquire);
+      if (ns == NULL) {
+        ns = RunStateOnByteUnlocked(s, c);
+        if (ns == NULL) {
+          // As in InlinedSearchLoop(), but there is nothing to fall back
+          // to, so keep going however slowly.
+          StateSaver save_start(this, start);
+          StateSaver save_s(this, s);
+          ResetCache(params.cache_lock);
+          if ((start = save_start.Restore()) == NULL ||
+              (s = save_s.Restore()) == NULL)
+            return false;
+          ns = RunStateOnByteUnlocked(s, c);
+          if (ns == NULL) {
+            ABSL_LOG(DFATAL)
+                << "RunStateOnByteUnlocked failed after ResetCache";
+            return false;
+          }
+        }
+      }
+      if (ns <= SpecialStateMax || (ns->IsMatch() && !anchor_end))
+        break;
+      s = ns;
+      ns = NULL;
+    }
+    if (ns == NULL)
+      break;  // end of chunk
+    if (ns == DeadState) {
+      stream->done = true;
+    } else if (ns == FullMatchState && anchor_end) {
+      s = ns;
+    } else {
+      // FullMatchState also means that a match ends just before p[-1].
+      matched();
+    }
+  }
+
+  if (end_of_text && !stream->done) {
+    // Process the fake "end of text" byte to see if it triggers a match.
+    stream->done = true;
+    if (s == NULL) {
+      stream->start_byte = chunk.empty() ? stream->last_byte : ep[-1];
+      if (!AnalyzeStart(&params, stream->start_byte))
+        return false;
+      s = params.start;
+    }
+    State* ns = s;
+    if (s > SpecialStateMax) {
+      ns = s->next_[ByteMap(kByteEndText)].load(std::memory_order_acquire);
+      if (ns == NULL) {
+        ns = RunStateOnByteUnlocked(s, kByteEndText);
+        if (ns == NULL) {
+          StateSaver save_s(this, s);
+          ResetCache(params.cache_lock);
+          if ((s = save_s.Restore()) == NULL)
+            return false;
+          ns = RunStateOnByteUnlocked(s, kByteEndText);
+          if (ns == NULL) {
+            ABSL_LOG(DFATAL) << "RunStateOnByteUnlocked failed after Reset";
+            return false;
+          }
+        }
+      }
+    }
+    int64_t end = stream->offset + chunk.size();
+    if ((ns == FullMatchState || (ns > SpecialStateMax && ns->IsMatch())) &&
+        end != stream->last_end) {
+      ends->push_back(end);
+      stream->last_end = end;
+    }
+    s = NULL;
+  }
+
+  // Save the state for the next chunk.  Copying its contents can be
+  // skipped if they are already saved.
+  if (s > SpecialStateMax &&
+      (s != stream->state || stream->dfa != this ||
+       stream->generation != cache_generation_)) {
+    stream->inst.assign(s->inst_, s->inst_ + s->ninst_);
+    stream->flag = s->flag_;
+  }
+  stream->state = s;
+  stream->dfa = this;
+  stream->generation = cache_generation_;
+  stream->offset += chunk.size();
+  if (!chunk.empty())
+    stream->last_byte = ep[-1];
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Parallel search.
+//
+// Each step of the DFA depends on the step before it, but an unanchored
+// search can still be divided among threads.  The text is cut into
+// segments, and each thread searches one segment speculatively, starting
+// in the start state as though the search began there.  That leaves out
+// the threads of the real search that began in earlier segments, but
+// they usually die out within a few bytes, after which the speculative
+// search is in the same State as the real one would be and stays that
+// way.  (Comparing State pointers suffices, since the cache never holds
+// two equal States.)  So each speculative search records its State at
+// a series of checkpoints, and then the real search runs through the
+// segments in order, stepping the DFA only until it is in the recorded
+// State at a checkpoint, and taking the speculative results from there
+// to the end of the segment.
+//
+// When the earlier threads do not die out -- a.*b after an a, say --
+// the real search ends up doing all of the work itself, so the result
+// is always the same as that of Search(), just not always sooner.
+//
+// A State is valid only until the cache is next reset, so none of this
+// resets the cache.  If the cache fills up, or if another search resets
+// it before the real search is done, the search fails and SearchParallel
+// falls back to Search().
+
+// The real search usually catches up within a few bytes, so checkpoints
+// are close together at first and then spread out.
+static const size_t kFirstCheckpointGap = 16;
+static const size_t kMaxCheckpointGap = 64<<10;
+
+struct DFA::Segment {
+  const uint8_t* begin = NULL;  // the text in the segment
+  const uint8_t* end = NULL;
+  int prev_byte = -1;           // byte before begin, or -1 if none
+  uint64_t generation = 0;      // cache_generation_ during the search
+  bool failed = false;          // whether the search gave up
+
+  // Checkpoint i is at points[i], where the search was in states[i].
+  // lastmatch[i] is the end of the last match that the search found
+  // after that and before the next checkpoint, or NULL if none.
+  std::vector<const uint8_t*> points;
+  std::vector<State*> states;
+  std::vector<const uint8_t*> lastmatch;
+
+  // If the search stopped before the end of the segment, stop_state is
+  // DeadState, FullMatchState or, when looking for the earliest match,
+  // the matching State, in which case stop is the end of that match.
+  // Otherwise, final_state is the State at the end of the segment.
+  State* stop_state = NULL;
+  const uint8_t* stop = NULL;
+  State* final_state = NULL;
+};
+
+void DFA::SearchSegment(Segment* seg, const uint8_t* limit,
+                        bool want_earliest_match,
+                        std::atomic<bool>* cancel) {
+  RWLocker l(&cache_mutex_);
+  SearchParams params(absl::string_view(), absl::string_view(), &l);
+  params.anchored = false;
+  params.run_forward = true;
+  if (!AnalyzeStart(&params, seg->prev_byte)) {
+    seg->failed = true;
+    return;
+  }
+  seg->generation = cache_generation_;
+
+  State* start = params.start;
+  State* s = start;
+  const bool can_prefix_accel = params.can_prefix_accel;
+  const uint8_t* p = seg->begin;
+  const uint8_t* ep = seg->end;
+  const uint8_t* bytemap = prog_->bytemap();
+  size_t gap = kFirstCheckpointGap;
+  // The start of the next occurrence of the prefix, if it starts
+  // before ep; ep if it does not; NULL if not yet known.
+  const uint8_t* accel = NULL;
+
+  seg->points.push_back(p);
+  seg->states.push_back(s);
+  seg->lastmatch.push_back(NULL);
+  if (s <= SpecialStateMax) {
+    seg->stop_state = s;
+    return;
+  }
+  while (p < ep) {
+    const uint8_t* cp = static_cast<size_t>(ep - p) > gap ? p + gap : ep;
+    gap = std::min(2*gap, kMaxCheckpointGap);
+    while (p < cp) {
+      if (can_prefix_accel && s == start) {
+        if (accel == NULL || accel < p) {
+          // The occurrence may run past ep, but not past limit.
+          size_t n = std::min(static_cast<size_t>(limit - p),
+                              static_cast<size_t>(ep - p) +
+                                  prog_->prefix_size() - 1);
+          accel = BytePtr(prog_->PrefixAccel(p, n));
+          if (accel == NULL || accel > ep)
+            accel = ep;
+        }
+        if (accel >= cp) {
+          p = cp;
+          break;
+        }
+        p = accel;
+      }
+      int c = *p++;
+      State* ns = s->next_[bytemap[c]].load(std::memory_order_acquire);
+      if (ns == NULL) {
+        ns = RunStateOnByteUnlocked(s, c);
+        if (ns == NULL) {
+          // Out of memory.  See above.
+          seg->failed = true;
+          return;
+        }
+      }
+      if (ns <= SpecialStateMax) {
+        seg->stop_state = ns;
+        return;
+      }
+      s = ns;
+      if (s->IsMatch()) {
+        seg->lastmatch.back() = p - 1;
+        if (want_earliest_match) {
+          seg->stop_state = s;
+          seg->stop = p - 1;
+          return;
+        }
+      }
+    }
+    if (p == ep)
+      break;
+    if (cancel->load(std::memory_order_relaxed)) {
+      seg->failed = true;
+      return;
+    }
+    seg->points.push_back(p);
+    seg->states.push_back(s);
+    seg->lastmatch.push_back(NULL);
+  }
+  seg->final_state = s;
+}
+
+bool DFA::ResolveSegments(const std::vector<Segment>& segs,
+                          absl::string_view text, absl::string_view context,
+                          bool want_earliest_match, bool* failed,
+                          const char** epp) {
+  RWLocker l(&cache_mutex_);
+  const uint8_t* lastmatch = NULL;
+  bool matched = false;
+  State* s = NULL;
+
+  // Returns the State after reading c in state from,
+  // or NULL if out of memory.
+  auto step = [this](State* from, int c) -> State* {
+    State* ns = from->next_[ByteMap(c)].load(std::memory_order_acquire);
+    if (ns == NULL)
+      ns = RunStateOnByteUnlocked(from, c);
+    return ns;
+  };
+
+  for (size_t i = 0; i < segs.size(); i++) {
+    const Segment& seg = segs[i];
+    if (seg.failed || seg.generation != cache_generation_) {
+      *failed = true;
+      return false;
+    }
+    // Step the real search until it catches up with the speculative one.
+    // The speculative search of the first segment is the real search.
+    size_t j = 0;
+    if (i > 0) {
+      const uint8_t* p = seg.begin;
+      for (;;) {
+        if (j < seg.points.size() && p == seg.points[j]) {
+          if (s == seg.states[j])
+            break;
+          j++;
+        }
+        if (p == seg.end)
+          break;
+        State* ns = step(s, *p++);
+        if (ns == NULL) {
+          *failed = true;
+          return false;
+        }
+        if (ns <= SpecialStateMax) {
+          *epp = reinterpret_cast<const char*>(
+              ns == DeadState ? lastmatch : BytePtr(EndPtr(text)));
+          return ns == DeadState ? matched : true;
+        }
+        s = ns;
+        if (s->IsMatch()) {
+          matched = true;
+          lastmatch = p - 1;
+          if (want_earliest_match) {
+            *epp = reinterpret_cast<const char*>(lastmatch);
+            return true;
+          }
+        }
+      }
+      if (j == seg.points.size())
+        continue;  // never caught up; s is the State at seg.end
+    }
+    for (size_t k = j; k < seg.lastmatch.size(); k++) {
+      if (seg.lastmatch[k] != NULL) {
+        matched = true;
+        lastmatch = seg.lastmatch[k];
+      }
+    }
+    if (seg.stop_state == DeadState) {
+      *epp = reinterpret_cast<const char*>(lastmatch);
+      return matched;
+    } else if (seg.stop_state == FullMatchState) {
+      *epp = EndPtr(text);
+      return true;
+    } else if (seg.stop_state != NULL) {
+      *epp = reinterpret_cast<const char*>(seg.stop);
+      return true;
+    }
+    s = seg.final_state;
+  }
+
+  // Process one more byte to see if it triggers a match.
+  // (Remember, matches are delayed one byte.)
+  int lastbyte = kByteEndText;
+  if (EndPtr(text) != EndPtr(context))
+    lastbyte = EndPtr(text)[0] & 0xFF;
+  State* ns = step(s, lastbyte);
+  if (ns == NULL) {
+    *failed = true;
+    return false;
+  }
+  if (ns == FullMatchState || (ns > SpecialStateMax && ns->IsMatch())) {
+    matched = true;
+    lastmatch = BytePtr(EndPtr(text));
+  }
+  *epp = reinterpret_cast<const char*>(lastmatch);
+  return matched;
+}
+
+bool DFA::SearchParallel(absl::string_view text, absl::string_view context,
+                         bool want_earliest_match, int nthreads,
+                         bool* failed, const char** epp) {
+  size_t nseg = std::min(static_cast<size_t>(std::max(nthreads, 1)),
+                         text.size() / std::max<size_t>(
+                             dfa_min_parallel_segment, 1));
+  if (nseg < 2 || !ok() || BeginPtr(text) < BeginPtr(context) ||
+      EndPtr(text) > EndPtr(context))
+    return Search(text, context, false, want_earliest_match, true, failed,
+                  epp, NULL, NULL, false);
+
+  CountUnsynced(SearchCounters::kDFASearches, 1);
+  CountUnsynced(SearchCounters::kDFABytes, text.size());
+
+  std::vector<Segment> segs(nseg);
+  const uint8_t* bp = BytePtr(text.data());
+  for (size_t i = 0; i < nseg; i++) {
+    Segment* seg = &segs[i];
+    seg->begin = bp + text.size() / nseg * i;
+    seg->end = i + 1 < nseg ? bp + text.size() / nseg * (i+1)
+                            : bp + text.size();
+    if (seg->begin > BytePtr(context.data()))
+      seg->prev_byte = seg->begin[-1];
+  }
+
+  // The first segment runs in this thread.  Once it stops early, the
+  // others are of no use, so it cancels them.
+  const uint8_t* limit = bp + text.size();
+  std::atomic<bool> cancel{false};
+  std::vector<std::thread> threads;
+  threads.reserve(nseg - 1);
+  for (size_t i = 1; i < nseg; i++)
+    threads.emplace_back(&DFA::SearchSegment, this, &segs[i], limit,
+                         want_earliest_match, &cancel);
+  SearchSegment(&segs[0], limit, want_earliest_match, &cancel);
+  if (segs[0].stop_state != NULL)
+    cancel.store(true, std::memory_order_relaxed);
+  for (std::thread& t : threads)
+    t.join();
+
+  *epp = NULL;
+  *failed = false;
+  if (!segs[0].failed && segs[0].states[0] > SpecialStateMax) {
+    bool matched = ResolveSegments(segs, text, context, want_earliest_match,
+                                   failed, epp);
+    if (!*failed)
+      return matched;
+  }
+  return Search(text, context, false, want_earliest_match, true, failed,
+                epp, NULL, NULL, false);
+}
+
+// Returns the DFA for kind from *first or *longest, creating it if
+// necessary.  max_mem is the memory available to the Prog's DFAs.
+static DFA* GetOrCreateDFA(Prog* prog, Prog::MatchKind kind, int64_t max_mem,
+                           DFA** first, absl::once_flag* first_once,
+                           DFA** longest, absl::once_flag* longest_once) {
   // For a forward DFA, half the memory goes to each DFA.
   // However, if it is a "many match" DFA, then there is
   // no counterpart with which the memory must be shared.
@@ -1806,31 +2869,106 @@ DFA* Prog::GetDFA(MatchKind kind) {
   // For a reverse DFA, all the memory goes to the
   // "longest match" DFA, because RE2 never does reverse
   // "first match" searches.
-  if (kind == kFirstMatch) {
-    absl::call_once(dfa_first_once_, [](Prog* prog) {
-      prog->dfa_first_ = new DFA(prog, kFirstMatch, prog->dfa_mem_ / 2);
-    }, this);
-    return dfa_first_;
-  } else if (kind == kManyMatch) {
-    absl::call_once(dfa_first_once_, [](Prog* prog) {
-      prog->dfa_first_ = new DFA(prog, kManyMatch, prog->dfa_mem_);
-    }, this);
-    return dfa_first_;
+  if (kind == Prog::kFirstMatch) {
+    absl::call_once(*first_once, [&]() {
+      *first = new DFA(prog, Prog::kFirstMatch, max_mem / 2);
+    });
+    return *first;
+  } else if (kind == Prog::kManyMatch) {
+    absl::call_once(*first_once, [&]() {
+      *first = new DFA(prog, Prog::kManyMatch, max_mem);
+    });
+    return *first;
   } else {
-    absl::call_once(dfa_longest_once_, [](Prog* prog) {
-      if (!prog->reversed_)
-        prog->dfa_longest_ = new DFA(prog, kLongestMatch, prog->dfa_mem_ / 2);
+    absl::call_once(*longest_once, [&]() {
+      if (!prog->reversed())
+        *longest = new DFA(prog, Prog::kLongestMatch, max_mem / 2);
       else
-        prog->dfa_longest_ = new DFA(prog, kLongestMatch, prog->dfa_mem_);
-    }, this);
-    return dfa_longest_;
+        *longest = new DFA(prog, Prog::kLongestMatch, max_mem);
+    });
+    return *longest;
   }
 }
 
+// The least memory that an element of per_thread_dfas_ is given, which
+// its first-match and longest-match DFAs then split.  Dividing the budget
+// among more elements than that would leave their DFAs too small to be
+// of much use.
+static const int64_t kMinPerThreadDFAMem = 512<<10;
+
+// When dfa_per_thread_ is set, threads do not share DFAs.  Instead,
+// each thread searches using the DFAs in the element of per_thread_dfas_
+// picked by ThreadShardIndex(), so that threads neither contend for the
+// cache locks nor evict each other's states.  There is one element per
+// hardware thread (up to a limit), but no more than leave each element
+// kMinPerThreadDFAMem of the budget; threads beyond that share.  The DFAs
+// of an element are only created when a thread first searches with them.
+struct Prog::PerThreadDFA {
+  DFA* first = NULL;    // DFA for kFirstMatch/kManyMatch
+  DFA* longest = NULL;  // DFA for kLongestMatch/kFullMatch
+  absl::once_flag first_once;
+  absl::once_flag longest_once;
+};
+
+DFA* Prog::GetDFA(MatchKind kind) {
+  if (!dfa_per_thread_)
+    return GetOrCreateDFA(this, kind, dfa_mem_,
+                          &dfa_first_, &dfa_first_once_,
+                          &dfa_longest_, &dfa_longest_once_);
+
+  absl::call_once(per_thread_dfas_once_, [](Prog* prog) {
+    int n = static_cast<int>(std::thread::hardware_concurrency());
+    n = std::min(n, 64);
+    n = static_cast<int>(std::min<int64_t>(
+        n, prog->dfa_mem() / kMinPerThreadDFAMem));
+    n = std::max(n, 1);
+    prog->num_per_thread_dfas_ = n;
+    prog->per_thread_dfas_ = new PerThreadDFA[n];
+  }, this);
+  PerThreadDFA* p =
+      &per_thread_dfas_[ThreadShardIndex() % num_per_thread_dfas_];
+  // The memory budget is divided evenly among the threads.
+  return GetOrCreateDFA(this, kind, dfa_mem_ / num_per_thread_dfas_,
+                        &p->first, &p->first_once,
+                        &p->longest, &p->longest_once);
+}
+
 void Prog::DeleteDFA(DFA* dfa) {
   delete dfa;
 }
 
+void DFA::SetCounters(SearchCounters* counters) {
+  ABSL_DCHECK(counters_ == NULL);
+  counters_ = counters;
+  if (ok()) {
+    Count(SearchCounters::kDFAMemBudget, state_budget_);
+    Count(SearchCounters::kDFAMemInUse, mem_counted_);
+  }
+}
+
+void Prog::set_search_counters(SearchCounters* c) {
+  search_counters_ = c;
+  // Compiling a set runs the DFA once, so it can exist already.
+  if (dfa_first_ != NULL)
+    dfa_first_->SetCounters(c);
+  if (dfa_longest_ != NULL)
+    dfa_longest_->SetCounters(c);
+  for (int i = 0; i < num_per_thread_dfas_; i++) {
+    if (per_thread_dfas_[i].first != NULL)
+      per_thread_dfas_[i].first->SetCounters(c);
+    if (per_thread_dfas_[i].longest != NULL)
+      per_thread_dfas_[i].longest->SetCounters(c);
+  }
+}
+
+void Prog::DeletePerThreadDFAs() {
+  for (int i = 0; i < num_per_thread_dfas_; i++) {
+    delete per_thread_dfas_[i].first;
+    delete per_thread_dfas_[i].longest;
+  }
+  delete[] per_thread_dfas_;
+}
+
 // Executes the regexp program to search in text,
 // which itself is inside the larger context.  (As a convenience,
 // passing a NULL context is equivalent to passing text.)
@@ -1888,8 +3026,10 @@ bool Prog::SearchDFA(absl::string_view text, absl::string_view context,
   const char* ep;
   bool matched = dfa->Search(text, context, anchored,
                              want_earliest_match, !reversed_,
-                             failed, &ep, matches);
+                             failed, &ep, matches, NULL, false);
   if (*failed) {
+    if (search_counters_ != NULL)
+      search_counters_->Add(SearchCounters::kDFAFailures, 1);
     hooks::GetDFASearchFailureHook()({
         // Nothing yet...
     });
@@ -1914,16 +3054,163 @@ bool Prog::SearchDFA(absl::string_view text, absl::string_view context,
   return true;
 }
 
+bool Prog::SearchDFAPositions(absl::string_view text,
+                              absl::string_view context, Anchor anchor,
+                              bool latest, bool* failed, SparseSet* matches,
+                              const char** positions) {
+  *failed = false;
+
+  if (context.data() == NULL)
+    context = text;
+  bool caret = anchor_start();
+  bool dollar = anchor_end();
+  if (reversed_) {
+    using std::swap;
+    swap(caret, dollar);
+  }
+  if (caret && BeginPtr(context) != BeginPtr(text))
+    return false;
+  if (dollar && EndPtr(context) != EndPtr(text))
+    return false;
+
+  bool anchored = anchor == kAnchored || anchor_start();
+  const char* ep;
+  bool matched = GetDFA(kManyMatch)->Search(text, context, anchored, false,
+                                            !reversed_, failed, &ep,
+                                            matches, positions, latest);
+  if (*failed) {
+    if (search_counters_ != NULL)
+      search_counters_->Add(SearchCounters::kDFAFailures, 1);
+    hooks::GetDFASearchFailureHook()({
+        // Nothing yet...
+    });
+    return false;
+  }
+  return matched;
+}
+
+void Prog::SearchDFABatch(absl::Span<const absl::string_view> texts,
+                          absl::Span<const absl::string_view> contexts,
+                          Anchor anchor, MatchKind kind,
+                          std::vector<int>* results,
+                          std::vector<std::vector<int>>* matches) {
+  // As in SearchDFA(), except that the location of the match is never
+  // wanted, and the checks of anchors against contexts are done for
+  // each text below.
+  bool caret = anchor_start();
+  bool dollar = anchor_end();
+  if (reversed_) {
+    using std::swap;
+    swap(caret, dollar);
+  }
+  bool anchored = anchor == kAnchored || anchor_start() || kind == kFullMatch;
+  bool endmatch = false;
+  if (kind == kManyMatch) {
+    // This is split out in order to avoid clobbering kind.
+  } else if (kind == kFullMatch || anchor_end()) {
+    endmatch = true;
+    kind = kLongestMatch;
+  }
+  bool want_earliest_match = false;
+  if (kind == kManyMatch) {
+    if (matches == NULL)
+      want_earliest_match = true;
+  } else if (!endmatch) {
+    want_earliest_match = true;
+    kind = kLongestMatch;
+  }
+
+  std::vector<const char*> eps;
+  GetDFA(kind)->SearchBatch(texts, contexts, anchored, want_earliest_match,
+                            !reversed_, results, &eps,
+                            kind == kManyMatch ? matches : NULL);
+  for (size_t i = 0; i < texts.size(); i++) {
+    absl::string_view text = texts[i];
+    absl::string_view context = contexts.empty() ? text : contexts[i];
+    if ((caret && BeginPtr(context) != BeginPtr(text)) ||
+        (dollar && EndPtr(context) != EndPtr(text)) ||
+        ((*results)[i] == 1 && endmatch &&
+         eps[i] != (reversed_ ? text.data() : text.data() + text.size()))) {
+      (*results)[i] = 0;
+      if (matches != NULL && kind == kManyMatch)
+        (*matches)[i].clear();
+    }
+  }
+  int64_t nfailed = std::count(results->begin(), results->end(), -1);
+  if (nfailed > 0) {
+    if (search_counters_ != NULL)
+      search_counters_->Add(SearchCounters::kDFAFailures, nfailed);
+    hooks::GetDFASearchFailureHook()({
+        // Nothing yet...
+    });
+  }
+}
+
+bool Prog::SearchDFAParallel(absl::string_view text,
+                             absl::string_view context, MatchKind kind,
+                             absl::string_view* match0, bool* failed,
+                             int num_threads) {
+  // Anchored searches usually stop early anyway, so they are not worth
+  // dividing up; nor are the searches that SearchDFA() runs anchored.
+  if (num_threads <= 1 || reversed_ || anchor_start() || anchor_end() ||
+      kind == kFullMatch || kind == kManyMatch)
+    return SearchDFA(text, context, kUnanchored, kind, match0, failed, NULL);
+
+  *failed = false;
+  if (context.data() == NULL)
+    context = text;
+  bool want_earliest_match = false;
+  if (match0 == NULL) {
+    want_earliest_match = true;
+    kind = kLongestMatch;
+  }
+
+  // GetDFA() might pick a different DFA in each thread, so get the DFA
+  // here for all of them.
+  DFA* dfa = GetDFA(kind);
+  const char* ep;
+  bool matched = dfa->SearchParallel(text, context, want_earliest_match,
+                                     num_threads, failed, &ep);
+  if (*failed) {
+    if (search_counters_ != NULL)
+      search_counters_->Add(SearchCounters::kDFAFailures, 1);
+    hooks::GetDFASearchFailureHook()({
+        // Nothing yet...
+    });
+    return false;
+  }
+  if (!matched)
+    return false;
+  if (match0)
+    *match0 =
+        absl::string_view(text.data(), static_cast<size_t>(ep - text.data()));
+  return true;
+}
+
+DFAStream* Prog::NewDFAStream() {
+  return new DFAStream;
+}
+
+void Prog::DeleteDFAStream(DFAStream* stream) {
+  delete stream;
+}
+
+bool Prog::SearchDFAStream(DFAStream* stream, absl::string_view chunk,
+                           bool end_of_text, std::vector<int64_t>* ends) {
+  ABSL_DCHECK(!reversed_);
+  return GetDFA(kLongestMatch)->SearchStream(stream, chunk, end_of_text, ends);
+}
+
 // Build out all states in DFA.  Returns number of states.
-int DFA::BuildAllStates(const Prog::DFAStateCallback& cb) {
+int DFA::BuildAllStates(bool anchored, const Prog::DFAStateCallback& cb,
+                        int max_states) {
   if (!ok())
     return 0;
 
-  // Pick out start state for unanchored search
-  // at beginning of text.
+  // Pick out start state for search at beginning of text.
   RWLocker l(&cache_mutex_);
   SearchParams params(absl::string_view(), absl::string_view(), &l);
-  params.anchored = false;
+  params.anchored = anchored;
   if (!AnalyzeSearch(&params) ||
       params.start == NULL ||
       params.start == DeadState)
@@ -1954,6 +3241,8 @@ int DFA::BuildAllStates(const Prog::DFAStateCallback& cb) {
   // Flood to expand every state.
   bool oom = false;
   while (!q.empty()) {
+    if (max_states > 0 && static_cast<int>(m.size()) >= max_states)
+      break;
     State* s = q.front();
     q.pop_front();
     for (int c : input) {
@@ -1984,7 +3273,72 @@ int DFA::BuildAllStates(const Prog::DFAStateCallback& cb) {
 
 // Build out all states in DFA for kind.  Returns number of states.
 int Prog::BuildEntireDFA(MatchKind kind, const DFAStateCallback& cb) {
-  return GetDFA(kind)->BuildAllStates(cb);
+  return GetDFA(kind)->BuildAllStates(false, cb, 0);
+}
+
+int Prog::BuildEntireDFA(MatchKind kind, Anchor anchor,
+                         const DFAStateCallback& cb) {
+  return GetDFA(kind)->BuildAllStates(anchor == kAnchored, cb, 0);
+}
+
+int DFA::Warmup(absl::Span<const absl::string_view> texts,
+                absl::Span<const absl::string_view> contexts,
+                bool anchored, bool run_forward) {
+  if (!ok())
+    return 0;
+  int64_t before;
+  {
+    absl::MutexLock l(mutex_);
+    before = states_built_;
+  }
+  // A search that wants the latest match runs until it can no longer
+  // match, so it builds every state that any search of the text would.
+  std::unique_ptr<SparseSet> matches;
+  if (kind_ == Prog::kManyMatch)
+    matches.reset(new SparseSet(prog_->size()));
+  for (size_t i = 0; i < texts.size(); i++) {
+    absl::string_view context = contexts.empty() ? texts[i] : contexts[i];
+    bool failed = false;
+    const char* ep;
+    if (matches != NULL)
+      matches->clear();
+    Search(texts[i], context, anchored, false, run_forward, &failed, &ep,
+           matches.get(), NULL, false);
+    if (failed)
+      break;
+  }
+  absl::MutexLock l(mutex_);
+  return static_cast<int>(states_built_ - before);
+}
+
+int DFA::Warmup(int max_states, bool anchored) {
+  if (!ok() || max_states <= 0)
+    return 0;
+  int64_t before;
+  {
+    absl::MutexLock l(mutex_);
+    before = states_built_;
+  }
+  BuildAllStates(anchored, nullptr, max_states);
+  absl::MutexLock l(mutex_);
+  return static_cast<int>(states_built_ - before);
+}
+
+int Prog::WarmupDFA(absl::Span<const absl::string_view> texts,
+                    absl::Span<const absl::string_view> contexts,
+                    Anchor anchor, MatchKind kind) {
+  // As in SearchDFA().
+  bool anchored = anchor == kAnchored || anchor_start() || kind == kFullMatch;
+  if (kind == kFullMatch)
+    kind = kLongestMatch;
+  return GetDFA(kind)->Warmup(texts, contexts, anchored, !reversed_);
+}
+
+int Prog::WarmupDFA(int max_states, Anchor anchor, MatchKind kind) {
+  bool anchored = anchor == kAnchored || anchor_start() || kind == kFullMatch;
+  if (kind == kFullMatch)
+    kind = kLongestMatch;
+  return GetDFA(kind)->Warmup(max_states, anchored);
 }
 
 // Computes min and max for matching string.
@@ -5,18 +5,27 @@
 #include "re2/filtered_re2.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <algorithm>
+#include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/log/absl_log.h"
 #include "absl/strings/string_view.h"
+#include "re2/aho_corasick.h"
 #include "re2/prefilter.h"
 #include "re2/prefilter_tree.h"
 
 namespace re2 {
 
+// The most memory that the atom matcher may use: as much as a single
+// regexp gets by default.  If the atoms need more than that, FindAtoms
+// lets every regexp through the filter.
+static const int64_t kAtomMatcherMaxMem = RE2::Options::kDefaultMaxMem;
+
 FilteredRE2::FilteredRE2()
     : compiled_(false),
       prefilter_tree_(new PrefilterTree()) {
@@ -35,11 +44,16 @@ FilteredRE2::~FilteredRE2() {
 FilteredRE2::FilteredRE2(FilteredRE2&& other)
     : re2_vec_(std::move(other.re2_vec_)),
       compiled_(other.compiled_),
-      prefilter_tree_(std::move(other.prefilter_tree_)) {
+      prefilter_tree_(std::move(other.prefilter_tree_)),
+      atoms_(std::move(other.atoms_)),
+      atom_matcher_(std::move(other.atom_matcher_)) {
   other.re2_vec_.clear();
   other.re2_vec_.shrink_to_fit();
   other.compiled_ = false;
   other.prefilter_tree_.reset(new PrefilterTree());
+  other.atoms_.clear();
+  other.atoms_.shrink_to_fit();
+  other.atom_matcher_.reset();
 }
 
 FilteredRE2& FilteredRE2::operator=(FilteredRE2&& other) {
@@ -85,6 +99,8 @@ void FilteredRE2::Compile(std::vector<std::string>* atoms) {
   }
   atoms->clear();
   prefilter_tree_->Compile(atoms);
+  atoms_ = *atoms;
+  atom_matcher_.reset(new AhoCorasick(atoms_, true, kAtomMatcherMaxMem));
   compiled_ = true;
 }
 
@@ -121,6 +137,43 @@ bool FilteredRE2::AllMatches(absl::string_view text,
   return !matching_regexps->empty();
 }
 
+int FilteredRE2::FirstMatch(absl::string_view text) const {
+  std::vector<int> atoms;
+  if (compiled_)
+    FindAtoms(text, &atoms);
+  return FirstMatch(text, atoms);
+}
+
+bool FilteredRE2::AllMatches(absl::string_view text,
+                             std::vector<int>* matching_regexps) const {
+  std::vector<int> atoms;
+  if (compiled_)
+    FindAtoms(text, &atoms);
+  return AllMatches(text, atoms, matching_regexps);
+}
+
+void FilteredRE2::FindAtoms(absl::string_view text,
+                            std::vector<int>* atoms) const {
+  if (!atom_matcher_->ok()) {
+    // Let every regexp through the filter.
+    atoms->resize(atoms_.size());
+    std::iota(atoms->begin(), atoms->end(), 0);
+    return;
+  }
+  atom_matcher_->FindAll(text, atoms);
+
+  // The atoms of UTF-8 regexps are lowercased beyond ASCII, which the
+  // automaton can't fold by itself, so look in lowercased text as well.
+  if (std::any_of(text.begin(), text.end(),
+                  [](char c) { return static_cast<uint8_t>(c) >= 0x80; })) {
+    std::vector<int> more;
+    atom_matcher_->FindAll(Prefilter::ToLowerUTF8(text), &more);
+    atoms->insert(atoms->end(), more.begin(), more.end());
+    std::sort(atoms->begin(), atoms->end());
+    atoms->erase(std::unique(atoms->begin(), atoms->end()), atoms->end());
+  }
+}
+
 void FilteredRE2::AllPotentials(const std::vector<int>& atoms,
                                 std::vector<int>* potential_regexps) const {
   prefilter_tree_->RegexpsGivenStrings(atoms, potential_regexps);
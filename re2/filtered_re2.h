@@ -20,6 +20,10 @@
 // on a lowercased version of the search text. Then call FirstMatch
 // or AllMatches with a vector of indices of strings that were found
 // in the text to get the actual regexp matches.
+//
+// Alternatively, FirstMatch and AllMatches can do the string matching
+// themselves, using an Aho-Corasick automaton that Compile builds from
+// the strings.
 
 #include <memory>
 #include <string>
@@ -30,6 +34,7 @@
 
 namespace re2 {
 
+class AhoCorasick;
 class PrefilterTree;
 
 class FilteredRE2 {
@@ -78,6 +83,12 @@ class FilteredRE2 {
                   const std::vector<int>& atoms,
                   std::vector<int>* matching_regexps) const;
 
+  // As above, but finds the strings returned by Compile in text without
+  // help from the caller.
+  int FirstMatch(absl::string_view text) const;
+  bool AllMatches(absl::string_view text,
+                  std::vector<int>* matching_regexps) const;
+
   // Returns the indices of all potentially matching regexps after first
   // clearing potential_regexps.
   // A regexp is potentially matching if it passes the filter.
@@ -100,6 +111,10 @@ class FilteredRE2 {
   void RegexpsGivenStrings(const std::vector<int>& matched_atoms,
                            std::vector<int>* passed_regexps);
 
+  // Sets *atoms to the indices of the strings returned by Compile
+  // that occur in text.
+  void FindAtoms(absl::string_view text, std::vector<int>* atoms) const;
+
   // All the regexps in the FilteredRE2.
   std::vector<RE2*> re2_vec_;
 
@@ -108,6 +123,11 @@ class FilteredRE2 {
 
   // An AND-OR tree of string atoms used for filtering regexps.
   std::unique_ptr<PrefilterTree> prefilter_tree_;
+
+  // The strings returned by Compile and, built from them by Compile,
+  // a matcher that finds them regardless of ASCII case.
+  std::vector<std::string> atoms_;
+  std::unique_ptr<AhoCorasick> atom_matcher_;
 };
 
 }  // namespace re2
@@ -28,7 +28,6 @@
 #include <string.h>
 
 #include <algorithm>
-#include <deque>
 #include <string>
 #include <utility>
 
@@ -66,42 +65,63 @@ class NFA {
               bool longest, absl::string_view* submatch, int nsubmatch);
 
  private:
-  struct Thread {
-    union {
-      int ref;
-      Thread* next;  // when on free list
-    };
-    const char** capture;
+  // Threadq is a list of threads.  The list is sorted by the order
+  // in which Perl would explore that particular state -- the earlier
+  // choices appear earlier in the list.
+  //
+  // Each thread's capture slots live in a row of the queue's slot table
+  // rather than in a separately allocated, reference-counted array:
+  // ids maps an instruction to the offset of its row, or to -1 if the
+  // instruction has been visited but holds no thread.  Rows are handed
+  // out in order, so a queue needs at most one row per ByteRange, Match
+  // or AltMatch.  The table grows on demand, so it stops allocating once
+  // it has reached the high-water mark for the search.
+  struct Threadq {
+    SparseArray<int> ids;          // instruction -> offset in slots, or -1
+    PODArray<const char*> slots;   // rows of ncapture_ slots each
+    int nslots;                    // slots in use
+
+    void clear() {
+      ids.clear();
+      nslots = 0;
+    }
   };
 
   // State for explicit stack in AddToThreadq.
+  // If id is 0 and cap is not -1, the entry restores slot cap
+  // to p once we finish exploring the possibility that set it.
   struct AddState {
-    int id;     // Inst to process
-    Thread* t;  // if not null, set t0 = t before processing id
+    int id;         // Inst to process
+    int cap;        // if id == 0 and cap >= 0, slot to restore
+    const char* p;  // value to restore into slot cap
   };
 
-  // Threadq is a list of threads.  The list is sorted by the order
-  // in which Perl would explore that particular state -- the earlier
-  // choices appear earlier in the list.
-  typedef SparseArray<Thread*> Threadq;
+  // Returns the capture slots of the row at offset r in q.
+  const char** Row(Threadq* q, int r) {
+    return q->slots.data() + r;
+  }
 
-  inline Thread* AllocThread();
-  inline Thread* Incref(Thread* t);
-  inline void Decref(Thread* t);
+  // Appends a row to q holding a copy of cap and returns its offset.
+  inline int AddRow(Threadq* q, const char** cap);
+
+  // Grows the slot table of q to make room for another row.
+  void GrowSlots(Threadq* q);
 
   // Follows all empty arrows from id0 and enqueues all the states reached.
   // Enqueues only the ByteRange instructions that match byte c.
   // context is used (with p) for evaluating empty-width specials.
-  // p is the current input position, and t0 is the current thread.
+  // p is the current input position, and cap is the capture slots
+  // of the current thread; Capture instructions update cap in place
+  // and restore it before exploring the next alternative.
   void AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
-                    const char* p, Thread* t0);
+                    const char* p, const char** cap);
 
   // Run runq on byte c, appending new states to nextq.
   // Updates matched_ and match_ as new, better matches are found.
   // context is used (with p) for evaluating empty-width specials.
   // p is the position of byte c in the input string for AddToThreadq;
   // p-1 will be used when processing Match instructions.
-  // Frees all the threads on runq.
+  // Clears runq.
   // If there is a shortcut to the end, returns that shortcut.
   int Step(Threadq* runq, Threadq* nextq, int c, absl::string_view context,
            const char* p);
@@ -120,11 +140,12 @@ class NFA {
   bool endmatch_;             // whether match must end at text.end()
   const char* btext_;         // beginning of text (for FormatSubmatch)
   const char* etext_;         // end of text (for endmatch_)
+  int nrows_;                 // maximum number of rows in a Threadq
   Threadq q0_, q1_;           // pre-allocated for Search.
   PODArray<AddState> stack_;  // pre-allocated for AddToThreadq
-  std::deque<Thread> arena_;  // thread arena
-  Thread* freelist_;          // thread freelist
+  PODArray<const char*> scratch_;  // holds match_ and start_cap_
   const char** match_;        // best match so far
+  const char** start_cap_;    // capture slots for a new thread
   bool matched_;              // any match so far?
 
   NFA(const NFA&) = delete;
@@ -139,62 +160,52 @@ NFA::NFA(Prog* prog) {
   endmatch_ = false;
   btext_ = NULL;
   etext_ = NULL;
-  q0_.resize(prog_->size());
-  q1_.resize(prog_->size());
+  // See NFA::Threadq for why this is so.
+  nrows_ = prog_->inst_count(kInstByteRange) +
+           prog_->inst_count(kInstMatch) +
+           prog_->inst_count(kInstAltMatch);
+  q0_.ids.resize(prog_->size());
+  q1_.ids.resize(prog_->size());
+  q0_.nslots = 0;
+  q1_.nslots = 0;
   // See NFA::AddToThreadq() for why this is so.
   int nstack = 2*prog_->inst_count(kInstCapture) +
                prog_->inst_count(kInstEmptyWidth) +
                prog_->inst_count(kInstNop) + 1;  // + 1 for start inst
   stack_ = PODArray<AddState>(nstack);
-  freelist_ = NULL;
   match_ = NULL;
+  start_cap_ = NULL;
   matched_ = false;
 }
 
-NFA::~NFA() {
-  delete[] match_;
-  for (const Thread& t : arena_)
-    delete[] t.capture;
-}
-
-NFA::Thread* NFA::AllocThread() {
-  Thread* t = freelist_;
-  if (t != NULL) {
-    freelist_ = t->next;
-    t->ref = 1;
-    // We don't need to touch t->capture because
-    // the caller will immediately overwrite it.
-    return t;
-  }
-  arena_.emplace_back();
-  t = &arena_.back();
-  t->ref = 1;
-  t->capture = new const char*[ncapture_];
-  return t;
-}
+NFA::~NFA() {}
 
-NFA::Thread* NFA::Incref(Thread* t) {
-  ABSL_DCHECK(t != NULL);
-  t->ref++;
-  return t;
+int NFA::AddRow(Threadq* q, const char** cap) {
+  if (q->slots.size() - q->nslots < ncapture_)
+    GrowSlots(q);
+  int r = q->nslots;
+  q->nslots += ncapture_;
+  CopyCapture(Row(q, r), cap);
+  return r;
 }
 
-void NFA::Decref(Thread* t) {
-  ABSL_DCHECK(t != NULL);
-  t->ref--;
-  if (t->ref > 0)
-    return;
-  ABSL_DCHECK_EQ(t->ref, 0);
-  t->next = freelist_;
-  freelist_ = t;
+void NFA::GrowSlots(Threadq* q) {
+  int nrows = q->nslots / ncapture_;
+  ABSL_DCHECK_LT(nrows, nrows_);
+  nrows = std::min(std::max(2*nrows, 16), nrows_);
+  PODArray<const char*> slots(nrows * ncapture_);
+  if (q->nslots > 0)
+    memmove(slots.data(), q->slots.data(), q->nslots * sizeof slots[0]);
+  q->slots = std::move(slots);
 }
 
 // Follows all empty arrows from id0 and enqueues all the states reached.
 // Enqueues only the ByteRange instructions that match byte c.
 // context is used (with p) for evaluating empty-width specials.
-// p is the current input position, and t0 is the current thread.
+// p is the current input position, and cap is the capture slots
+// of the current thread.
 void NFA::AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
-                       const char* p, Thread* t0) {
+                       const char* p, const char** cap) {
   if (id0 == 0)
     return;
 
@@ -208,35 +219,34 @@ void NFA::AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
   AddState* stk = stack_.data();
   int nstk = 0;
 
-  stk[nstk++] = {id0, NULL};
+  stk[nstk++] = {id0, -1, NULL};
   while (nstk > 0) {
     ABSL_DCHECK_LE(nstk, stack_.size());
     AddState a = stk[--nstk];
 
   Loop:
-    if (a.t != NULL) {
-      // t0 was a thread that we allocated and copied in order to
-      // record the capture, so we must now decref it.
-      Decref(t0);
-      t0 = a.t;
+    if (a.cap >= 0) {
+      // Undo the capture that was recorded before exploring
+      // the possibility that we have just finished with.
+      cap[a.cap] = a.p;
+      continue;
     }
 
     int id = a.id;
     if (id == 0)
       continue;
-    if (q->has_index(id)) {
+    if (q->ids.has_index(id)) {
       if (ExtraDebug)
-        absl::FPrintF(stderr, "  [%d%s]\n", id, FormatCapture(t0->capture));
+        absl::FPrintF(stderr, "  [%d%s]\n", id, FormatCapture(cap));
       continue;
     }
 
     // Create entry in q no matter what.  We might fill it in below,
     // or we might not.  Even if not, it is necessary to have it,
     // so that we don't revisit id0 during the recursion.
-    q->set_new(id, NULL);
-    Thread** tp = &q->get_existing(id);
+    q->ids.set_new(id, -1);
+    int* rp = &q->ids.get_existing(id);
     int j;
-    Thread* t;
     Prog::Inst* ip = prog_->inst(id);
     switch (ip->opcode()) {
     default:
@@ -248,37 +258,33 @@ void NFA::AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
 
     case kInstAltMatch:
       // Save state; will pick up at next byte.
-      t = Incref(t0);
-      *tp = t;
+      *rp = AddRow(q, cap);
 
       ABSL_DCHECK(!ip->last());
-      a = {id+1, NULL};
+      a = {id+1, -1, NULL};
       goto Loop;
 
     case kInstNop:
       if (!ip->last())
-        stk[nstk++] = {id+1, NULL};
+        stk[nstk++] = {id+1, -1, NULL};
 
       // Continue on.
-      a = {ip->out(), NULL};
+      a = {ip->out(), -1, NULL};
       goto Loop;
 
     case kInstCapture:
       if (!ip->last())
-        stk[nstk++] = {id+1, NULL};
+        stk[nstk++] = {id+1, -1, NULL};
 
       if ((j=ip->cap()) < ncapture_) {
-        // Push a dummy whose only job is to restore t0
+        // Push a dummy whose only job is to restore cap[j]
         // once we finish exploring this possibility.
-        stk[nstk++] = {0, t0};
+        stk[nstk++] = {0, j, cap[j]};
 
         // Record capture.
-        t = AllocThread();
-        CopyCapture(t->capture, t0->capture);
-        t->capture[j] = p;
-        t0 = t;
+        cap[j] = p;
       }
-      a = {ip->out(), NULL};
+      a = {ip->out(), -1, NULL};
       goto Loop;
 
     case kInstByteRange:
@@ -286,37 +292,35 @@ void NFA::AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
         goto Next;
 
       // Save state; will pick up at next byte.
-      t = Incref(t0);
-      *tp = t;
+      *rp = AddRow(q, cap);
       if (ExtraDebug)
-        absl::FPrintF(stderr, " + %d%s\n", id, FormatCapture(t0->capture));
+        absl::FPrintF(stderr, " + %d%s\n", id, FormatCapture(cap));
 
       if (ip->hint() == 0)
         break;
-      a = {id+ip->hint(), NULL};
+      a = {id+ip->hint(), -1, NULL};
       goto Loop;
 
     case kInstMatch:
       // Save state; will pick up at next byte.
-      t = Incref(t0);
-      *tp = t;
+      *rp = AddRow(q, cap);
       if (ExtraDebug)
-        absl::FPrintF(stderr, " ! %d%s\n", id, FormatCapture(t0->capture));
+        absl::FPrintF(stderr, " ! %d%s\n", id, FormatCapture(cap));
 
     Next:
       if (ip->last())
         break;
-      a = {id+1, NULL};
+      a = {id+1, -1, NULL};
       goto Loop;
 
     case kInstEmptyWidth:
       if (!ip->last())
-        stk[nstk++] = {id+1, NULL};
+        stk[nstk++] = {id+1, -1, NULL};
 
       // Continue on if we have all the right flag bits.
       if (ip->empty() & ~Prog::EmptyFlags(context, p))
         break;
-      a = {ip->out(), NULL};
+      a = {ip->out(), -1, NULL};
       goto Loop;
     }
   }
@@ -327,23 +331,24 @@ void NFA::AddToThreadq(Threadq* q, int id0, int c, absl::string_view context,
 // context is used (with p) for evaluating empty-width specials.
 // p is the position of byte c in the input string for AddToThreadq;
 // p-1 will be used when processing Match instructions.
-// Frees all the threads on runq.
+// Clears runq.
 // If there is a shortcut to the end, returns that shortcut.
 int NFA::Step(Threadq* runq, Threadq* nextq, int c, absl::string_view context,
               const char* p) {
   nextq->clear();
 
-  for (Threadq::iterator i = runq->begin(); i != runq->end(); ++i) {
-    Thread* t = i->value();
-    if (t == NULL)
+  for (SparseArray<int>::iterator i = runq->ids.begin();
+       i != runq->ids.end(); ++i) {
+    if (i->value() < 0)
       continue;
+    // Once its byte has been consumed, the thread's row is dead,
+    // so AddToThreadq can record captures in it directly.
+    const char** t = Row(runq, i->value());
 
     if (longest_) {
       // Can skip any threads started after our current best match.
-      if (matched_ && match_[0] < t->capture[0]) {
-        Decref(t);
+      if (matched_ && match_[0] < t[0])
         continue;
-      }
     }
 
     int id = i->index();
@@ -360,18 +365,13 @@ int NFA::Step(Threadq* runq, Threadq* nextq, int c, absl::string_view context,
         break;
 
       case kInstAltMatch:
-        if (i != runq->begin())
+        if (i != runq->ids.begin())
           break;
         // The match is ours if we want it.
         if (ip->greedy(prog_) || longest_) {
-          CopyCapture(match_, t->capture);
+          CopyCapture(match_, t);
           matched_ = true;
 
-          Decref(t);
-          for (++i; i != runq->end(); ++i) {
-            if (i->value() != NULL)
-              Decref(i->value());
-          }
           runq->clear();
           if (ip->greedy(prog_))
             return ip->out1();
@@ -384,7 +384,7 @@ int NFA::Step(Threadq* runq, Threadq* nextq, int c, absl::string_view context,
         // by storing p instead of p-1. (What would the latter even mean?!)
         // This complements the special case in NFA::Search().
         if (p == NULL) {
-          CopyCapture(match_, t->capture);
+          CopyCapture(match_, t);
           match_[1] = p;
           matched_ = true;
           break;
@@ -397,34 +397,28 @@ int NFA::Step(Threadq* runq, Threadq* nextq, int c, absl::string_view context,
           // Leftmost-longest mode: save this match only if
           // it is either farther to the left or at the same
           // point but longer than an existing match.
-          if (!matched_ || t->capture[0] < match_[0] ||
-              (t->capture[0] == match_[0] && p-1 > match_[1])) {
-            CopyCapture(match_, t->capture);
+          if (!matched_ || t[0] < match_[0] ||
+              (t[0] == match_[0] && p-1 > match_[1])) {
+            CopyCapture(match_, t);
             match_[1] = p-1;
             matched_ = true;
           }
         } else {
           // Leftmost-biased mode: this match is by definition
           // better than what we've already found (see next line).
-          CopyCapture(match_, t->capture);
+          CopyCapture(match_, t);
           match_[1] = p-1;
           matched_ = true;
 
           // Cut off the threads that can only find matches
           // worse than the one we just found: don't run the
           // rest of the current Threadq.
-          Decref(t);
-          for (++i; i != runq->end(); ++i) {
-            if (i->value() != NULL)
-              Decref(i->value());
-          }
           runq->clear();
           return 0;
         }
         break;
       }
     }
-    Decref(t);
   }
   runq->clear();
   return 0;
@@ -487,7 +481,9 @@ bool NFA::Search(absl::string_view text, absl::string_view context,
     ncapture_ = 2;
   }
 
-  match_ = new const char*[ncapture_];
+  scratch_ = PODArray<const char*>(2*ncapture_);
+  match_ = scratch_.data();
+  start_cap_ = match_ + ncapture_;
   memset(match_, 0, ncapture_*sizeof match_[0]);
   matched_ = false;
 
@@ -518,18 +514,19 @@ bool NFA::Search(absl::string_view text, absl::string_view context,
         c = p[0] & 0xFF;
 
       absl::FPrintF(stderr, "%c:", c);
-      for (Threadq::iterator i = runq->begin(); i != runq->end(); ++i) {
-        Thread* t = i->value();
-        if (t == NULL)
+      for (SparseArray<int>::iterator i = runq->ids.begin();
+           i != runq->ids.end(); ++i) {
+        if (i->value() < 0)
           continue;
-        absl::FPrintF(stderr, " %d%s", i->index(), FormatCapture(t->capture));
+        absl::FPrintF(stderr, " %d%s", i->index(),
+                      FormatCapture(Row(runq, i->value())));
       }
       absl::FPrintF(stderr, "\n");
     }
 
     // This is a no-op the first time around the loop because runq is empty.
     int id = Step(runq, nextq, p < etext_ ? p[0] & 0xFF : -1, context, p);
-    ABSL_DCHECK_EQ(runq->size(), 0);
+    ABSL_DCHECK_EQ(runq->ids.size(), 0);
     using std::swap;
     swap(nextq, runq);
     nextq->clear();
@@ -575,23 +572,21 @@ bool NFA::Search(absl::string_view text, absl::string_view context,
       // Try to use prefix accel (e.g. memchr) to skip ahead.
       // The search must be unanchored and there must be zero
       // possible matches already.
-      if (!anchored && runq->size() == 0 &&
+      if (!anchored && runq->ids.size() == 0 &&
           p < etext_ && prog_->can_prefix_accel()) {
         p = reinterpret_cast<const char*>(prog_->PrefixAccel(p, etext_ - p));
         if (p == NULL)
           p = etext_;
       }
 
-      Thread* t = AllocThread();
-      CopyCapture(t->capture, match_);
-      t->capture[0] = p;
+      CopyCapture(start_cap_, match_);
+      start_cap_[0] = p;
       AddToThreadq(runq, start_, p < etext_ ? p[0] & 0xFF : -1, context, p,
-                   t);
-      Decref(t);
+                   start_cap_);
     }
 
     // If all the threads have died, stop early.
-    if (runq->size() == 0) {
+    if (runq->ids.size() == 0) {
       if (ExtraDebug)
         absl::FPrintF(stderr, "dead\n");
       break;
@@ -602,7 +597,7 @@ bool NFA::Search(absl::string_view text, absl::string_view context,
     // This complements the special case in NFA::Step().
     if (p == NULL) {
       (void) Step(runq, nextq, -1, context, p);
-      ABSL_DCHECK_EQ(runq->size(), 0);
+      ABSL_DCHECK_EQ(runq->ids.size(), 0);
       using std::swap;
       swap(nextq, runq);
       nextq->clear();
@@ -610,11 +605,6 @@ bool NFA::Search(absl::string_view text, absl::string_view context,
     }
   }
 
-  for (Threadq::iterator i = runq->begin(); i != runq->end(); ++i) {
-    if (i->value() != NULL)
-      Decref(i->value());
-  }
-
   if (matched_) {
     for (int i = 0; i < nsubmatch; i++)
       submatch[i] = absl::string_view(
@@ -634,6 +624,9 @@ bool Prog::SearchNFA(absl::string_view text, absl::string_view context,
                      int nmatch) {
   if (ExtraDebug)
     Dump();
+  if (search_counters_ != NULL)
+    search_counters_->AddUnsynced(SearchCounters::kNFABytes,
+                                  text.size());
 
   NFA nfa(this);
   absl::string_view sp;
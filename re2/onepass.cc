@@ -56,6 +56,8 @@
 #include <algorithm>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/container/fixed_array.h"
 #include "absl/container/inlined_vector.h"
@@ -158,26 +160,23 @@ struct OneState {
 // Bits 0-5 are the empty-width flags from prog.h.
 // Bit 6 is kMatchWins, which means the match takes
 // priority over moving to next in a first-match search.
-// The remaining bits mark capture registers that should
-// be set to the current input position.  The capture bits
-// start at index 2, since the search loop can take care of
-// cap[0], cap[1] (the overall match position).
-// That means we can handle up to 5 capturing parens: $1 through $4, plus $0.
+// The remaining bits are the index of the set of capture registers
+// that should be set to the current input position, or 0 if there are
+// none.  The sets themselves are kept out of line, in onepass_caps_,
+// so that any number of capturing parens fits in the action.  They do
+// not include cap[0], cap[1], since the search loop can take care of
+// the overall match position.
 // No input position can satisfy both kEmptyWordBoundary
 // and kEmptyNonWordBoundary, so we can use that as a sentinel
 // instead of needing an extra bit.
 
 static const int    kIndexShift   = 16;  // number of bits below index
 static const int    kEmptyShift   = 6;   // number of empty flags in prog.h
-static const int    kRealCapShift = kEmptyShift + 1;
-static const int    kRealMaxCap   = (kIndexShift - kRealCapShift) / 2 * 2;
-
-// Parameters used to skip over cap[0], cap[1].
-static const int    kCapShift     = kRealCapShift - 2;
-static const int    kMaxCap       = kRealMaxCap + 2;
+static const int    kCapSetShift  = kEmptyShift + 1;
+static const int    kMaxCapSets   = 1 << (kIndexShift - kCapSetShift);
 
 static const uint32_t kMatchWins  = 1 << kEmptyShift;
-static const uint32_t kCapMask    = ((1 << kRealMaxCap) - 1) << kRealCapShift;
+static const uint32_t kCapMask    = (kMaxCapSets - 1) << kCapSetShift;
 
 static const uint32_t kImpossible = kEmptyWordBoundary | kEmptyNonWordBoundary;
 
@@ -186,9 +185,6 @@ static const uint32_t kImpossible = kEmptyWordBoundary | kEmptyNonWordBoundary;
 void OnePass_Checks() {
   static_assert((1<<kEmptyShift)-1 == kEmptyAllFlags,
                 "kEmptyShift disagrees with kEmptyAllFlags");
-  // kMaxCap counts pointers, kMaxOnePassCapture counts pairs.
-  static_assert(kMaxCap == Prog::kMaxOnePassCapture*2,
-                "kMaxCap disagrees with kMaxOnePassCapture");
 }
 
 static bool Satisfy(uint32_t cond, absl::string_view context, const char* p) {
@@ -198,13 +194,17 @@ static bool Satisfy(uint32_t cond, absl::string_view context, const char* p) {
   return true;
 }
 
-// Apply the capture bits in cond, saving p to the appropriate
-// locations in cap[].
-static void ApplyCaptures(uint32_t cond, const char* p,
+// Apply the set of capture registers in cond, saving p to the
+// appropriate locations in cap[].  capsets holds the offsets of the
+// sets, followed by the registers in each set in increasing order.
+static void ApplyCaptures(const int* capsets, uint32_t cond, const char* p,
                           const char** cap, int ncap) {
-  for (int i = 2; i < ncap; i++)
-    if (cond & (1 << kCapShift << i))
-      cap[i] = p;
+  int id = (cond & kCapMask) >> kCapSetShift;
+  for (int i = capsets[id]; i < capsets[id+1]; i++) {
+    if (capsets[i] >= ncap)
+      break;
+    cap[capsets[i]] = p;
+  }
 }
 
 // Computes the OneState* for the given nodeindex.
@@ -220,6 +220,9 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
     ABSL_LOG(DFATAL) << "Cannot use SearchOnePass for unanchored matches.";
     return false;
   }
+  if (search_counters_ != NULL)
+    search_counters_->AddUnsynced(SearchCounters::kOnePassBytes,
+                                  text.size());
 
   // Make sure we have at least cap[1],
   // because we use it to tell if we matched.
@@ -227,13 +230,11 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
   if (ncap < 2)
     ncap = 2;
 
-  const char* cap[kMaxCap];
-  for (int i = 0; i < ncap; i++)
-    cap[i] = NULL;
+  absl::FixedArray<const char*, 32> cap_storage(ncap, NULL);
+  const char** cap = cap_storage.data();
 
-  const char* matchcap[kMaxCap];
-  for (int i = 0; i < ncap; i++)
-    matchcap[i] = NULL;
+  absl::FixedArray<const char*, 32> matchcap_storage(ncap, NULL);
+  const char** matchcap = matchcap_storage.data();
 
   if (context.data() == NULL)
     context = text;
@@ -245,6 +246,7 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
     kind = kFullMatch;
 
   uint8_t* nodes = onepass_nodes_.data();
+  const int* capsets = onepass_caps_.data();
   int statesize = sizeof(OneState) + bytemap_range()*sizeof(uint32_t);
   // start() is always mapped to the zeroth OneState.
   OneState* state = IndexToNode(nodes, statesize, 0);
@@ -301,7 +303,7 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
       for (int i = 2; i < 2*nmatch; i++)
         matchcap[i] = cap[i];
       if (nmatch > 1 && (matchcond & kCapMask))
-        ApplyCaptures(matchcond, p, matchcap, ncap);
+        ApplyCaptures(capsets, matchcond, p, matchcap, ncap);
       matchcap[1] = p;
       matched = true;
 
@@ -318,7 +320,7 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
     if (state == NULL)
       goto done;
     if ((cond & kCapMask) && nmatch > 1)
-      ApplyCaptures(cond, p, cap, ncap);
+      ApplyCaptures(capsets, cond, p, cap, ncap);
   }
 
   // Look for match at end of input.
@@ -327,7 +329,7 @@ bool Prog::SearchOnePass(absl::string_view text, absl::string_view context,
     if (matchcond != kImpossible &&
         ((matchcond & kEmptyAllFlags) == 0 || Satisfy(matchcond, context, p))) {
       if (nmatch > 1 && (matchcond & kCapMask))
-        ApplyCaptures(matchcond, p, cap, ncap);
+        ApplyCaptures(capsets, matchcond, p, cap, ncap);
       for (int i = 2; i < ncap; i++)
         matchcap[i] = cap[i];
       matchcap[1] = p;
@@ -365,6 +367,58 @@ struct InstCond {
   uint32_t cond;
 };
 
+// Assigns indices to the sets of capture registers that the actions
+// of a one-pass NFA set, so that an action can refer to its set with
+// the bits above kCapSetShift.  Index 0 is the empty set.
+class CaptureSets {
+ public:
+  CaptureSets() : sets_(1) { ids_[sets_[0]] = 0; }
+
+  // Returns the index of the set with the registers of set id
+  // and register cap, or -1 if there would be too many sets.
+  int Add(int id, int cap) {
+    std::vector<int> set = sets_[id];
+    std::vector<int>::iterator it =
+        std::lower_bound(set.begin(), set.end(), cap);
+    if (it != set.end() && *it == cap)
+      return id;
+    set.insert(it, cap);
+    std::map<std::vector<int>, int>::const_iterator found = ids_.find(set);
+    if (found != ids_.end())
+      return found->second;
+    if (static_cast<int>(sets_.size()) >= kMaxCapSets)
+      return -1;
+    int newid = static_cast<int>(sets_.size());
+    ids_[set] = newid;
+    sets_.push_back(std::move(set));
+    return newid;
+  }
+
+  // Returns the sets in the form that ApplyCaptures() expects.
+  PODArray<int> Flatten() const {
+    int nsets = static_cast<int>(sets_.size());
+    int n = nsets + 1;
+    for (const std::vector<int>& set : sets_)
+      n += static_cast<int>(set.size());
+    PODArray<int> flat(n);
+    int j = nsets + 1;
+    for (int i = 0; i < nsets; i++) {
+      flat[i] = j;
+      for (int cap : sets_[i])
+        flat[j++] = cap;
+    }
+    flat[nsets] = j;
+    return flat;
+  }
+
+ private:
+  std::vector<std::vector<int>> sets_;
+  std::map<std::vector<int>, int> ids_;
+
+  CaptureSets(const CaptureSets&) = delete;
+  CaptureSets& operator=(const CaptureSets&) = delete;
+};
+
 // Returns whether this is a one-pass program; that is,
 // returns whether it is safe to use SearchOnePass on this program.
 // These conditions must be true for any instruction ip:
@@ -415,6 +469,8 @@ bool Prog::IsOnePass() {
   // upfront for a large program when it is unlikely to be one-pass?
   absl::InlinedVector<uint8_t, 2048> nodes;
 
+  CaptureSets capsets;
+
   Instq tovisit(size), workq(size);
   AddQ(&tovisit, start());
   nodebyid[start()] = 0;
@@ -535,8 +591,18 @@ bool Prog::IsOnePass() {
             stack[nstack++].cond = cond;
           }
 
-          if (ip->opcode() == kInstCapture && ip->cap() < kMaxCap)
-            cond |= (1 << kCapShift) << ip->cap();
+          // The search loop takes care of cap[0], cap[1].
+          if (ip->opcode() == kInstCapture && ip->cap() >= 2) {
+            int capset = capsets.Add((cond & kCapMask) >> kCapSetShift,
+                                     ip->cap());
+            if (capset < 0) {
+              if (ExtraDebug)
+                ABSL_LOG(ERROR) << absl::StrFormat(
+                    "Not OnePass: too many capture sets at state %d", *it);
+              goto fail;
+            }
+            cond = (cond & ~kCapMask) | (capset << kCapSetShift);
+          }
           if (ip->opcode() == kInstEmptyWidth)
             cond |= ip->empty();
 
@@ -611,7 +677,8 @@ bool Prog::IsOnePass() {
     ABSL_LOG(ERROR) << "nodes:\n" << dump;
   }
 
-  dfa_mem_ -= nalloc*statesize;
+  onepass_caps_ = capsets.Flatten();
+  dfa_mem_ -= nalloc*statesize + onepass_caps_.size()*sizeof(int);
   onepass_nodes_ = PODArray<uint8_t>(nalloc*statesize);
   memmove(onepass_nodes_.data(), nodes.data(), nalloc*statesize);
   return true;
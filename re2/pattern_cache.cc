@@ -0,0 +1,172 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/pattern_cache.h"
+
+#include <stdint.h>
+
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "absl/base/call_once.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+const int64_t RE2::PatternCache::kDefaultMaxMem;  // set in pattern_cache.h
+
+RE2::PatternCache::PatternCache(int64_t max_mem)
+    : max_mem_(max_mem),
+      mem_(0),
+      hits_(0),
+      misses_(0) {
+}
+
+RE2::PatternCache::~PatternCache() {
+}
+
+// Similar to EmptyStorage in re2.cc.
+alignas(RE2::PatternCache) static char global_cache_storage[
+    sizeof(RE2::PatternCache)];
+
+RE2::PatternCache* RE2::PatternCache::Global() {
+  static absl::once_flag global_cache_once;
+  absl::call_once(global_cache_once, []() {
+    (void) new (global_cache_storage) PatternCache(kDefaultMaxMem);
+  });
+  return reinterpret_cast<PatternCache*>(global_cache_storage);
+}
+
+std::string RE2::PatternCache::Key(absl::string_view pattern,
+                                   const Options& options) {
+  // Every option, then the pattern.
+  int64_t ints[2] = {
+      options.max_mem(),
+      options.bit_state_max_mem(),
+  };
+  bool bools[13] = {
+      options.encoding() == Options::EncodingLatin1,
+      options.posix_syntax(),
+      options.longest_match(),
+      options.log_errors(),
+      options.literal(),
+      options.never_nl(),
+      options.dot_nl(),
+      options.never_capture(),
+      options.case_sensitive(),
+      options.perl_classes(),
+      options.word_boundary(),
+      options.one_line(),
+      options.per_thread_dfa(),
+  };
+  std::string key;
+  key.reserve(sizeof ints + sizeof bools + pattern.size());
+  key.append(reinterpret_cast<const char*>(ints), sizeof ints);
+  key.append(reinterpret_cast<const char*>(bools), sizeof bools);
+  key.append(pattern.data(), pattern.size());
+  return key;
+}
+
+int64_t RE2::PatternCache::Mem(const RE2& re) {
+  // The pattern is kept twice, in the key and in the RE2.  The reverse
+  // program is only built if a search needs it, but it is about the same
+  // size as the forward one, so count it from the start.
+  int64_t mem = sizeof(Entry) + sizeof(RE2) + 2*re.pattern().size();
+  if (re.prog_ != NULL)
+    mem += 2*(sizeof(Prog) + re.prog_->size()*sizeof(Prog::Inst));
+  return mem;
+}
+
+std::shared_ptr<const RE2> RE2::PatternCache::Get(absl::string_view pattern,
+                                                  const Options& options) {
+  std::string key = Key(pattern, options);
+  {
+    absl::MutexLock l(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      hits_++;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->re;
+    }
+    misses_++;
+  }
+
+  // Build the RE2 without holding the lock, so that other patterns can
+  // be looked up meanwhile.  If another thread builds the same one at
+  // the same time, the first one into the cache wins.
+  auto re = std::make_shared<const RE2>(pattern, options);
+  int64_t mem = Mem(*re);
+
+  // Declared before the lock, so that the RE2s that are dropped
+  // are deleted after it is released.
+  EntryList dropped;
+  absl::MutexLock l(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->re;
+  }
+  entries_.push_front(Entry{std::move(key), re, mem});
+  index_[entries_.front().key] = entries_.begin();
+  mem_ += mem;
+  Evict(&dropped);
+  return re;
+}
+
+void RE2::PatternCache::Evict(EntryList* dropped) {
+  while (mem_ > max_mem_ && !entries_.empty()) {
+    Entry& e = entries_.back();
+    index_.erase(e.key);
+    mem_ -= e.mem;
+    dropped->splice(dropped->begin(), entries_, std::prev(entries_.end()));
+  }
+}
+
+void RE2::PatternCache::set_max_mem(int64_t max_mem) {
+  EntryList dropped;
+  absl::MutexLock l(mutex_);
+  max_mem_ = max_mem;
+  Evict(&dropped);
+}
+
+int64_t RE2::PatternCache::max_mem() const {
+  absl::MutexLock l(mutex_);
+  return max_mem_;
+}
+
+int64_t RE2::PatternCache::mem() const {
+  absl::MutexLock l(mutex_);
+  return mem_;
+}
+
+int RE2::PatternCache::size() const {
+  absl::MutexLock l(mutex_);
+  return static_cast<int>(entries_.size());
+}
+
+int64_t RE2::PatternCache::hits() const {
+  absl::MutexLock l(mutex_);
+  return hits_;
+}
+
+int64_t RE2::PatternCache::misses() const {
+  absl::MutexLock l(mutex_);
+  return misses_;
+}
+
+void RE2::PatternCache::Clear() {
+  EntryList dropped;
+  absl::MutexLock l(mutex_);
+  index_.clear();
+  dropped.swap(entries_);
+  mem_ = 0;
+}
+
+}  // namespace re2
@@ -0,0 +1,121 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_PATTERN_CACHE_H_
+#define RE2_PATTERN_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+// An RE2::PatternCache hands out compiled regexps, keyed by pattern and
+// options, so that code that builds the same RE2 over and over -- for
+// each request, say, or each time a configuration is loaded -- parses
+// and compiles it only once.  All the users of a pattern share one RE2,
+// and with it the compiled programs and the DFA state caches, which
+// are safe to use from many threads at once.
+//
+//   std::shared_ptr<const RE2> re =
+//       RE2::PatternCache::Global()->Get("(\\w+):(\\d+)", RE2::Quiet);
+//   if (RE2::FullMatch(text, *re, &key, &value)) ...
+//
+// The cache holds on to the RE2s that it has handed out most recently,
+// up to a limit on their memory; when it goes over, it drops the ones
+// that were used least recently.  An RE2 that the cache has dropped
+// stays valid for as long as anyone still holds it.
+//
+// The memory counted is that of the patterns and the compiled programs.
+// The DFA state caches that searches build as they go are bounded by
+// each RE2's max_mem() instead, as they are for any RE2.
+//
+// RE2s with errors are cached too, so asking again for a pattern that
+// does not parse does not parse it again.
+class RE2::PatternCache {
+ public:
+  // The limit for the process-wide cache.
+  static const int64_t kDefaultMaxMem = 64<<20;
+
+  // Keeps up to max_mem bytes of RE2s.
+  explicit PatternCache(int64_t max_mem);
+  ~PatternCache();
+
+  // Not copyable.
+  PatternCache(const PatternCache&) = delete;
+  PatternCache& operator=(const PatternCache&) = delete;
+
+  // Returns the process-wide cache, which keeps up to kDefaultMaxMem
+  // bytes of RE2s.  It is never destroyed.
+  static PatternCache* Global();
+
+  // Returns the RE2 for pattern and options, building it if the cache
+  // does not have it.  Never returns NULL; check ok() for errors.
+  // Safe to call from many threads at once.
+  std::shared_ptr<const RE2> Get(absl::string_view pattern,
+                                 const Options& options);
+
+  // Returns the RE2 for pattern with the default options.
+  std::shared_ptr<const RE2> Get(absl::string_view pattern) {
+    return Get(pattern, DefaultOptions);
+  }
+
+  // Changes the limit, dropping RE2s until the cache is within it.
+  void set_max_mem(int64_t max_mem);
+  int64_t max_mem() const;
+
+  // Returns the number of bytes of RE2s in the cache.
+  int64_t mem() const;
+
+  // Returns the number of RE2s in the cache.
+  int size() const;
+
+  // Returns the number of calls to Get() that found the RE2 in the
+  // cache and that had to build it.
+  int64_t hits() const;
+  int64_t misses() const;
+
+  // Drops all the RE2s.
+  void Clear();
+
+ private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const RE2> re;
+    int64_t mem;
+  };
+  using EntryList = std::list<Entry>;
+
+  // Returns the key for pattern and options.
+  static std::string Key(absl::string_view pattern, const Options& options);
+
+  // Returns the number of bytes to count for re.
+  static int64_t Mem(const RE2& re);
+
+  // Moves the least recently used RE2s to *dropped until mem_ is
+  // within max_mem_.
+  void Evict(EntryList* dropped) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  int64_t max_mem_ ABSL_GUARDED_BY(mutex_);
+  int64_t mem_ ABSL_GUARDED_BY(mutex_);
+  int64_t hits_ ABSL_GUARDED_BY(mutex_);
+  int64_t misses_ ABSL_GUARDED_BY(mutex_);
+  // Most recently used first.
+  EntryList entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<absl::string_view, EntryList::iterator> index_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace re2
+
+#endif  // RE2_PATTERN_CACHE_H_
@@ -5,7 +5,9 @@
 #include "re2/prefilter.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -13,6 +15,7 @@
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "re2/re2.h"
 #include "re2/regexp.h"
 #include "re2/unicode_casefold.h"
@@ -196,6 +199,32 @@ static Rune ToLowerRuneLatin1(Rune r) {
   return r;
 }
 
+std::string Prefilter::ToLowerUTF8(absl::string_view text) {
+  std::string lower;
+  lower.reserve(text.size());
+  const char* p = text.data();
+  const char* ep = p + text.size();
+  while (p < ep) {
+    if (static_cast<uint8_t>(*p) < Runeself) {
+      lower.push_back(static_cast<char>(ToLowerRune(*p++)));
+      continue;
+    }
+    Rune r = 0;
+    int n = 0;
+    if (fullrune(p, static_cast<int>(std::min(ptrdiff_t{UTFmax}, ep - p))))
+      n = chartorune(&r, p);
+    if (n == 0 || (n == 1 && r == Runeerror)) {
+      lower.push_back(*p++);  // not valid UTF-8
+      continue;
+    }
+    r = ToLowerRune(r);
+    char buf[UTFmax];
+    lower.append(buf, runetochar(buf, &r));
+    p += n;
+  }
+  return lower;
+}
+
 Prefilter* Prefilter::FromString(const std::string& str) {
   Prefilter* m = new Prefilter(Prefilter::ATOM);
   m->atom_ = str;
@@ -15,6 +15,7 @@
 
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
+#include "absl/strings/string_view.h"
 
 namespace re2 {
 
@@ -59,6 +60,11 @@ class Prefilter {
   // Returns a readable debug string of the prefilter.
   std::string DebugString() const;
 
+  // Lowercases UTF-8 text in the same way as the atoms of UTF-8 regexps,
+  // so that the atoms can be found in the result.  Bytes that aren't part
+  // of valid UTF-8 are copied unchanged.
+  static std::string ToLowerUTF8(absl::string_view text);
+
  private:
   template <typename H>
   friend H AbslHashValue(H h, const Prefilter& a) {
@@ -11,10 +11,13 @@
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
 #include "absl/strings/str_format.h"
@@ -24,12 +27,28 @@
 #include "re2/sparse_array.h"
 #include "re2/sparse_set.h"
 
-#if defined(__AVX2__)
+// The kernels for PrefixAccel_PackedCompare().  SSE2 is part of x86-64,
+// so it is always available.  GCC and Clang can compile the AVX2 kernel
+// even when the rest of the file isn't compiled for AVX2, in which case it
+// is used only if the CPU supports it.
+#if defined(__x86_64__) || defined(_M_X64)
+#define RE2_PREFIX_ACCEL_SSE2 1
+#if defined(__AVX2__) || defined(__GNUC__)
+#define RE2_PREFIX_ACCEL_AVX2 1
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define RE2_PREFIX_ACCEL_NEON 1
+#endif
+
+#if defined(__AVX2__) || defined(RE2_PREFIX_ACCEL_SSE2)
 #include <immintrin.h>
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
 #endif
+#if defined(RE2_PREFIX_ACCEL_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace re2 {
 
@@ -117,22 +136,67 @@ Prog::Prog()
     reversed_(false),
     did_flatten_(false),
     did_onepass_(false),
+    did_tagged_dfa_(false),
     start_(0),
     start_unanchored_(0),
     size_(0),
     bytemap_range_(0),
     prefix_foldcase_(false),
     prefix_size_(0),
+    prefix_kernel_(kPrefixAccelFrontAndBack),
     list_count_(0),
     bit_state_text_max_size_(0),
+    bitparallel_start_(0),
     dfa_mem_(0),
     dfa_first_(NULL),
-    dfa_longest_(NULL) {
+    dfa_longest_(NULL),
+    dfa_per_thread_(false),
+    num_per_thread_dfas_(0),
+    per_thread_dfas_(NULL),
+    tagged_dfa_mem_(0),
+    tagged_dfa_(NULL),
+    search_counters_(NULL) {
+}
+
+SearchCounters::~SearchCounters() {
+  for (std::atomic<Shard*>& shard : shards_)
+    delete shard.load(std::memory_order_relaxed);
+}
+
+SearchCounters::Shard* SearchCounters::NewShard(std::atomic<Shard*>* shard) {
+  // Another thread can get here first, in which case its shard wins.
+  Shard* s = new Shard;
+  Shard* old = NULL;
+  if (!shard->compare_exchange_strong(old, s, std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+    delete s;
+    return old;
+  }
+  return s;
+}
+
+void SearchCounters::Get(RE2::SearchStats* stats) const {
+  stats->dfa_searches = Read(kDFASearches);
+  stats->dfa_bytes = Read(kDFABytes);
+  stats->dfa_states_built = Read(kDFAStatesBuilt);
+  stats->dfa_transitions_built = Read(kDFATransitionsBuilt);
+  stats->dfa_cache_resets = Read(kDFACacheResets);
+  stats->dfa_bailouts = Read(kDFABailouts);
+  stats->dfa_failures = Read(kDFAFailures);
+  stats->dfa_mem_in_use = Read(kDFAMemInUse);
+  stats->dfa_mem_budget = Read(kDFAMemBudget);
+  stats->onepass_bytes = Read(kOnePassBytes);
+  stats->bitstate_bytes = Read(kBitStateBytes);
+  stats->bitparallel_bytes = Read(kBitParallelBytes);
+  stats->tagged_dfa_bytes = Read(kTaggedDFABytes);
+  stats->nfa_bytes = Read(kNFABytes);
 }
 
 Prog::~Prog() {
   DeleteDFA(dfa_longest_);
   DeleteDFA(dfa_first_);
+  DeletePerThreadDFAs();
+  DeleteTaggedDFA(tagged_dfa_);
   if (prefix_foldcase_)
     delete[] prefix_dfa_;
 }
@@ -363,6 +427,7 @@ class ByteMapBuilder {
   int nextcolor_;
   std::vector<std::pair<int, int>> colormap_;
   std::vector<std::pair<int, int>> ranges_;
+  absl::flat_hash_set<std::vector<std::pair<int, int>>> merged_;
 
   ByteMapBuilder(const ByteMapBuilder&) = delete;
   ByteMapBuilder& operator=(const ByteMapBuilder&) = delete;
@@ -384,6 +449,14 @@ void ByteMapBuilder::Mark(int lo, int hi) {
 }
 
 void ByteMapBuilder::Merge() {
+  // Merging the same batch again would split no ranges, and programs for
+  // large Unicode classes mark the same few UTF-8 continuation byte ranges
+  // hundreds of times, so skip any batch that has been merged before.
+  if (!merged_.insert(ranges_).second) {
+    ranges_.clear();
+    return;
+  }
+
   for (std::vector<std::pair<int, int>>::const_iterator it = ranges_.begin();
        it != ranges_.end();
        ++it) {
@@ -651,10 +724,26 @@ void Prog::Flatten() {
       list_heads_[flatmap[i]] = i;
   }
 
+  set_bit_state_max_mem(RE2::Options::kDefaultBitStateMaxMem);
+}
+
+void Prog::set_bit_state_max_mem(int64_t m) {
   // BitState allocates a bitmap of size list_count_ * (text.size()+1)
   // for tracking pairs of possibilities that it has already explored.
-  const size_t kBitStateBitmapMaxSize = 256*1024;  // max size in bits
-  bit_state_text_max_size_ = kBitStateBitmapMaxSize / list_count_ - 1;
+  // It indexes the bitmap with an int.
+  int64_t maxbits =
+      std::min<int64_t>(m, std::numeric_limits<int>::max() / 8) * 8;
+  bit_state_text_max_size_ =
+      static_cast<size_t>(std::max<int64_t>(maxbits / list_count_ - 1, 0));
+}
+
+int64_t Prog::TakeDFAMem(int64_t min, int64_t max) {
+  ABSL_DCHECK_GT(min, 0);
+  int64_t mem = std::min(dfa_mem_ / 4, max);
+  if (mem < min)
+    return 0;
+  dfa_mem_ -= mem;
+  return mem;
 }
 
 void Prog::MarkSuccessors(SparseArray<int>* rootmap,
@@ -1027,9 +1116,38 @@ void Prog::ConfigurePrefixAccel(const std::string& prefix,
     prefix_size_ = std::min(prefix_size_, kShiftDFAFinal);
     prefix_dfa_ = BuildShiftDFA(prefix.substr(0, prefix_size_));
   } else if (prefix_size_ != 1) {
-    // Use PrefixAccel_FrontAndBack().
+    // Use PrefixAccel_PackedCompare(), which might in turn
+    // use PrefixAccel_FrontAndBack().
     prefix_front_ = prefix.front();
     prefix_back_ = prefix.back();
+    // The front must come first: the scalar kernel looks for it with
+    // memchr(3). Repeat it to fill any slots left over.
+    const size_t offsets[4] = {
+      0, prefix_size_-1, prefix_size_/2, 1,
+    };
+    int n = 0;
+    for (size_t offset : offsets) {
+      bool seen = false;
+      for (int i = 0; i < n; i++)
+        seen |= prefix_probe_offset_[i] == offset;
+      if (!seen) {
+        prefix_probe_[n] = static_cast<uint8_t>(prefix[offset]);
+        prefix_probe_offset_[n] = offset;
+        n++;
+      }
+    }
+    for (; n < 4; n++) {
+      prefix_probe_[n] = prefix_probe_[0];
+      prefix_probe_offset_[n] = 0;
+    }
+    if (PrefixAccelKernelSupported(kPrefixAccelAVX2))
+      prefix_kernel_ = kPrefixAccelAVX2;
+    else if (PrefixAccelKernelSupported(kPrefixAccelSSE2))
+      prefix_kernel_ = kPrefixAccelSSE2;
+    else if (PrefixAccelKernelSupported(kPrefixAccelNEON))
+      prefix_kernel_ = kPrefixAccelNEON;
+    else
+      prefix_kernel_ = kPrefixAccelScalar;
   } else {
     // Use memchr(3).
     prefix_front_ = prefix.front();
@@ -1109,7 +1227,7 @@ const void* Prog::PrefixAccel_ShiftDFA(const void* data, size_t size) {
   return NULL;
 }
 
-#if defined(__AVX2__)
+#if defined(__AVX2__) || defined(RE2_PREFIX_ACCEL_SSE2)
 // Finds the least significant non-zero bit in n.
 static int FindLSBSet(uint32_t n) {
   ABSL_DCHECK_NE(n, uint32_t{0});
@@ -1178,4 +1296,186 @@ const void* Prog::PrefixAccel_FrontAndBack(const void* data, size_t size) {
   }
 }
 
+// Each kernel below looks for the first of the n candidate positions
+// starting at p at which all four bytes in probe[] occur at their offsets
+// in offset[].  The caller guarantees that the whole prefix fits in the
+// text at every candidate position, so none of the loads go out of bounds.
+
+static const char* PackedCompare_Scalar(const char* p, size_t n,
+                                        const uint8_t* probe,
+                                        const size_t* offset) {
+  const char* ep = p + n;
+  for (;; p++) {
+    p = reinterpret_cast<const char*>(memchr(p, probe[0], ep - p));
+    if (p == NULL ||
+        (static_cast<uint8_t>(p[offset[1]]) == probe[1] &&
+         static_cast<uint8_t>(p[offset[2]]) == probe[2] &&
+         static_cast<uint8_t>(p[offset[3]]) == probe[3]))
+      return p;
+  }
+}
+
+#if defined(RE2_PREFIX_ACCEL_SSE2)
+static const char* PackedCompare_SSE2(const char* p, size_t n,
+                                      const uint8_t* probe,
+                                      const size_t* offset) {
+  if (n >= sizeof(__m128i)) {
+    const __m128i set1_0 = _mm_set1_epi8(static_cast<char>(probe[0]));
+    const __m128i set1_1 = _mm_set1_epi8(static_cast<char>(probe[1]));
+    const __m128i set1_2 = _mm_set1_epi8(static_cast<char>(probe[2]));
+    const __m128i set1_3 = _mm_set1_epi8(static_cast<char>(probe[3]));
+    const char* endp = p + (n & ~(sizeof(__m128i)-1));
+    do {
+      const __m128i cmpeq_0 = _mm_cmpeq_epi8(set1_0, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p + offset[0])));
+      const __m128i cmpeq_1 = _mm_cmpeq_epi8(set1_1, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p + offset[1])));
+      const __m128i cmpeq_2 = _mm_cmpeq_epi8(set1_2, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p + offset[2])));
+      const __m128i cmpeq_3 = _mm_cmpeq_epi8(set1_3, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p + offset[3])));
+      const __m128i and_01 = _mm_and_si128(cmpeq_0, cmpeq_1);
+      const __m128i and_23 = _mm_and_si128(cmpeq_2, cmpeq_3);
+      const int movemask = _mm_movemask_epi8(_mm_and_si128(and_01, and_23));
+      if (movemask != 0)
+        return p + FindLSBSet(movemask);
+      p += sizeof(__m128i);
+    } while (p != endp);
+    n &= sizeof(__m128i)-1;
+  }
+  return PackedCompare_Scalar(p, n, probe, offset);
+}
+#endif
+
+#if defined(RE2_PREFIX_ACCEL_AVX2)
+#if !defined(__AVX2__)
+__attribute__((target("avx2")))
+#endif
+static const char* PackedCompare_AVX2(const char* p, size_t n,
+                                      const uint8_t* probe,
+                                      const size_t* offset) {
+  if (n >= sizeof(__m256i)) {
+    const __m256i set1_0 = _mm256_set1_epi8(static_cast<char>(probe[0]));
+    const __m256i set1_1 = _mm256_set1_epi8(static_cast<char>(probe[1]));
+    const __m256i set1_2 = _mm256_set1_epi8(static_cast<char>(probe[2]));
+    const __m256i set1_3 = _mm256_set1_epi8(static_cast<char>(probe[3]));
+    const char* endp = p + (n & ~(sizeof(__m256i)-1));
+    do {
+      const __m256i cmpeq_0 = _mm256_cmpeq_epi8(set1_0, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + offset[0])));
+      const __m256i cmpeq_1 = _mm256_cmpeq_epi8(set1_1, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + offset[1])));
+      const __m256i cmpeq_2 = _mm256_cmpeq_epi8(set1_2, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + offset[2])));
+      const __m256i cmpeq_3 = _mm256_cmpeq_epi8(set1_3, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + offset[3])));
+      const __m256i and_01 = _mm256_and_si256(cmpeq_0, cmpeq_1);
+      const __m256i and_23 = _mm256_and_si256(cmpeq_2, cmpeq_3);
+      const int movemask =
+          _mm256_movemask_epi8(_mm256_and_si256(and_01, and_23));
+      if (movemask != 0)
+        return p + FindLSBSet(movemask);
+      p += sizeof(__m256i);
+    } while (p != endp);
+    n &= sizeof(__m256i)-1;
+  }
+  return PackedCompare_Scalar(p, n, probe, offset);
+}
+#endif
+
+#if defined(RE2_PREFIX_ACCEL_NEON)
+static const char* PackedCompare_NEON(const char* p, size_t n,
+                                      const uint8_t* probe,
+                                      const size_t* offset) {
+  if (n >= sizeof(uint8x16_t)) {
+    const uint8x16_t dup_0 = vdupq_n_u8(probe[0]);
+    const uint8x16_t dup_1 = vdupq_n_u8(probe[1]);
+    const uint8x16_t dup_2 = vdupq_n_u8(probe[2]);
+    const uint8x16_t dup_3 = vdupq_n_u8(probe[3]);
+    const char* endp = p + (n & ~(sizeof(uint8x16_t)-1));
+    do {
+      const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+      const uint8x16_t ceq_0 = vceqq_u8(dup_0, vld1q_u8(u + offset[0]));
+      const uint8x16_t ceq_1 = vceqq_u8(dup_1, vld1q_u8(u + offset[1]));
+      const uint8x16_t ceq_2 = vceqq_u8(dup_2, vld1q_u8(u + offset[2]));
+      const uint8x16_t ceq_3 = vceqq_u8(dup_3, vld1q_u8(u + offset[3]));
+      const uint8x16_t and_0123 =
+          vandq_u8(vandq_u8(ceq_0, ceq_1), vandq_u8(ceq_2, ceq_3));
+      // NEON has no movemask, so narrow each byte to four bits instead.
+      const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+          vshrn_n_u16(vreinterpretq_u16_u8(and_0123), 4)), 0);
+      if (mask != 0)
+        return p + (__builtin_ctzll(mask) >> 2);
+      p += sizeof(uint8x16_t);
+    } while (p != endp);
+    n &= sizeof(uint8x16_t)-1;
+  }
+  return PackedCompare_Scalar(p, n, probe, offset);
+}
+#endif
+
+bool Prog::PrefixAccelKernelSupported(PrefixAccelKernel kernel) {
+  switch (kernel) {
+    case kPrefixAccelFrontAndBack:
+    case kPrefixAccelScalar:
+      return true;
+    case kPrefixAccelSSE2:
+#if defined(RE2_PREFIX_ACCEL_SSE2)
+      return true;
+#else
+      return false;
+#endif
+    case kPrefixAccelAVX2:
+#if defined(__AVX2__)
+      return true;
+#elif defined(RE2_PREFIX_ACCEL_AVX2)
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case kPrefixAccelNEON:
+#if defined(RE2_PREFIX_ACCEL_NEON)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+bool Prog::TESTING_ONLY_set_prefix_accel_kernel(PrefixAccelKernel kernel) {
+  if (!PrefixAccelKernelSupported(kernel))
+    return false;
+  prefix_kernel_ = kernel;
+  return true;
+}
+
+const void* Prog::PrefixAccel_PackedCompare(const void* data, size_t size) {
+  ABSL_DCHECK_GE(prefix_size_, size_t{2});
+  if (prefix_kernel_ == kPrefixAccelFrontAndBack)
+    return PrefixAccel_FrontAndBack(data, size);
+  if (size < prefix_size_)
+    return NULL;
+  // As in PrefixAccel_FrontAndBack(), the prefix can't start in
+  // the last prefix_size_-1 bytes.
+  const char* p = reinterpret_cast<const char*>(data);
+  size_t n = size - (prefix_size_-1);
+  switch (prefix_kernel_) {
+#if defined(RE2_PREFIX_ACCEL_SSE2)
+    case kPrefixAccelSSE2:
+      return PackedCompare_SSE2(p, n, prefix_probe_, prefix_probe_offset_);
+#endif
+#if defined(RE2_PREFIX_ACCEL_AVX2)
+    case kPrefixAccelAVX2:
+      return PackedCompare_AVX2(p, n, prefix_probe_, prefix_probe_offset_);
+#endif
+#if defined(RE2_PREFIX_ACCEL_NEON)
+    case kPrefixAccelNEON:
+      return PackedCompare_NEON(p, n, prefix_probe_, prefix_probe_offset_);
+#endif
+    default:
+      return PackedCompare_Scalar(p, n, prefix_probe_, prefix_probe_offset_);
+  }
+}
+
 }  // namespace re2
@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <cstring>
 #include <functional>
 #include <string>
@@ -21,6 +22,7 @@
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "re2/pod_array.h"
 #include "re2/re2.h"
 #include "re2/sparse_array.h"
@@ -53,8 +55,86 @@ enum EmptyOp {
 };
 
 class DFA;
+class TaggedDFA;
+struct DFAStream;
 class Regexp;
 
+// Counters of the work done in searching with one or more Progs, such as
+// the forward and reverse Progs of an RE2, for RE2::GetSearchStats().
+// The counters are kept in shards, each on its own cache lines, so that
+// threads counting at the same time seldom touch the same ones; reading
+// a counter sums its shards.  Every RE2 has these, so a shard is only
+// allocated when a thread first counts in it.
+class SearchCounters {
+ public:
+  enum Counter {
+    kDFASearches,
+    kDFABytes,
+    kDFAStatesBuilt,
+    kDFATransitionsBuilt,
+    kDFACacheResets,
+    kDFABailouts,
+    kDFAFailures,
+    kDFAMemInUse,
+    kDFAMemBudget,
+    kOnePassBytes,
+    kBitStateBytes,
+    kBitParallelBytes,
+    kTaggedDFABytes,
+    kNFABytes,
+    kNumCounters,
+  };
+
+  SearchCounters() {}
+  ~SearchCounters();
+
+  void Add(Counter c, int64_t n) {
+    GetShard()->counts[c].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // Like Add(), but not atomic, for the counters that every search adds
+  // to, which would cost too much otherwise.  Counts can be lost when
+  // threads that share a shard add at the same time, so these counters
+  // are approximate.  (The counters of memory must not drift, and so use
+  // Add().)
+  void AddUnsynced(Counter c, int64_t n) {
+    std::atomic<int64_t>* count = &GetShard()->counts[c];
+    count->store(count->load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  int64_t Read(Counter c) const {
+    int64_t n = 0;
+    for (const std::atomic<Shard*>& shard : shards_) {
+      const Shard* s = shard.load(std::memory_order_acquire);
+      if (s != NULL)
+        n += s->counts[c].load(std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  // Reads all of the counters into *stats.
+  void Get(RE2::SearchStats* stats) const;
+
+ private:
+  // Fewer shards than ShardedReaderMutex has, since every RE2 has these.
+  static constexpr int kShards = 8;
+
+  struct alignas(64) Shard {
+    std::atomic<int64_t> counts[kNumCounters] = {};
+  };
+
+  // Returns the calling thread's shard, allocating it if necessary.
+  // Defined after Prog, whose ThreadShardIndex() it uses.
+  inline Shard* GetShard();
+  Shard* NewShard(std::atomic<Shard*>* shard);
+
+  std::atomic<Shard*> shards_[kShards] = {};
+
+  SearchCounters(const SearchCounters&) = delete;
+  SearchCounters& operator=(const SearchCounters&) = delete;
+};
+
 // Compiled form of regexp program.
 class Prog {
  public:
@@ -235,8 +315,25 @@ class Prog {
   int inst_count(InstOp op) { return inst_count_[op]; }
   uint16_t* list_heads() { return list_heads_.data(); }
   size_t bit_state_text_max_size() { return bit_state_text_max_size_; }
+
+  // Limits the bitmap that SearchBitState() allocates to m bytes,
+  // which limits bit_state_text_max_size().
+  void set_bit_state_max_mem(int64_t m);
   int64_t dfa_mem() { return dfa_mem_; }
   void set_dfa_mem(int64_t dfa_mem) { dfa_mem_ = dfa_mem; }
+  bool dfa_per_thread() { return dfa_per_thread_; }
+  void set_dfa_per_thread(bool b) { dfa_per_thread_ = b; }
+  // The counters (if any) that searches with this Prog add to.
+  // Must be set before the Prog is shared between threads, and must
+  // outlive the Prog.  Defined in dfa.cc, since the DFAs that exist
+  // already count the memory that they hold.
+  SearchCounters* search_counters() { return search_counters_; }
+  void set_search_counters(SearchCounters* c);
+
+  // Returns a small integer identifying the calling thread, suitable for
+  // picking one of several shards, as SearchCounters and the DFA's cache
+  // mutex do.  Defined in dfa.cc.
+  static int ThreadShardIndex();
   bool anchor_start() { return anchor_start_; }
   void set_anchor_start(bool b) { anchor_start_ = b; }
   bool anchor_end() { return anchor_end_; }
@@ -244,6 +341,7 @@ class Prog {
   int bytemap_range() { return bytemap_range_; }
   const uint8_t* bytemap() { return bytemap_; }
   bool can_prefix_accel() { return prefix_size_ != 0; }
+  size_t prefix_size() { return prefix_size_; }
 
   // Accelerates to the first likely occurrence of the prefix.
   // Returns a pointer to the first byte or NULL if not found.
@@ -252,7 +350,7 @@ class Prog {
     if (prefix_foldcase_) {
       return PrefixAccel_ShiftDFA(data, size);
     } else if (prefix_size_ != 1) {
-      return PrefixAccel_FrontAndBack(data, size);
+      return PrefixAccel_PackedCompare(data, size);
     } else {
       return memchr(data, prefix_front_, size);
     }
@@ -269,6 +367,35 @@ class Prog {
   // prefix_back_ to return fewer false positives than memchr(3) alone.
   const void* PrefixAccel_FrontAndBack(const void* data, size_t size);
 
+  // An implementation of prefix accel that compares several bytes of the
+  // prefix (the front, the back, the middle and the second) against the
+  // text at once, a vector of candidate positions at a time, using the
+  // kernel in prefix_kernel_.  On repetitive text, such as logs in which
+  // many lines start and end alike, this returns far fewer false positives
+  // than PrefixAccel_FrontAndBack().
+  const void* PrefixAccel_PackedCompare(const void* data, size_t size);
+
+  // The kernels that PrefixAccel_PackedCompare() can use.  By default,
+  // ConfigurePrefixAccel() picks the fastest one that the CPU supports.
+  enum PrefixAccelKernel {
+    kPrefixAccelFrontAndBack,  // just use PrefixAccel_FrontAndBack()
+    kPrefixAccelScalar,        // memchr(3) for the front, then the rest
+    kPrefixAccelSSE2,          // 16 candidate positions at a time
+    kPrefixAccelAVX2,          // 32 candidate positions at a time
+    kPrefixAccelNEON,          // 16 candidate positions at a time
+  };
+
+  // Returns whether kernel can be used on this machine.
+  static bool PrefixAccelKernelSupported(PrefixAccelKernel kernel);
+
+  // Returns the kernel that PrefixAccel_PackedCompare() uses.
+  PrefixAccelKernel prefix_accel_kernel() { return prefix_kernel_; }
+
+  // Makes PrefixAccel_PackedCompare() use kernel instead.
+  // Returns false (and does nothing) if kernel is not supported.
+  // FOR TESTING ONLY.
+  bool TESTING_ONLY_set_prefix_accel_kernel(PrefixAccelKernel kernel);
+
   // Returns string representation of program for debugging.
   std::string Dump();
   std::string DumpUnanchored();
@@ -321,6 +448,50 @@ class Prog {
                  Anchor anchor, MatchKind kind, absl::string_view* match0,
                  bool* failed, SparseSet* matches);
 
+  // Like SearchDFA(text, context, anchor, kManyMatch, NULL, failed, matches),
+  // but also records where in text the DFA saw each match ID: positions
+  // must have an element per match ID, which is set for each ID in matches
+  // to the first position (or, if latest, the last position) at which that
+  // ID matched.  Running forward, those are ends of matches; running a
+  // reversed Prog backward, they are starts.
+  bool SearchDFAPositions(absl::string_view text, absl::string_view context,
+                          Anchor anchor, bool latest, bool* failed,
+                          SparseSet* matches, const char** positions);
+
+  // Like calling SearchDFA(texts[i], contexts[i], anchor, kind, NULL, ...)
+  // for each i, but looks up the DFA and takes its cache lock just once for
+  // the whole batch, which matters when the texts are short.  If contexts
+  // is empty, each text is its own context.  Sets (*results)[i] to 1 if
+  // texts[i] matched, 0 if not, or -1 if the DFA ran out of memory.
+  // If kind == kManyMatch and matches != NULL, sets (*matches)[i] to the
+  // match IDs for texts[i].
+  void SearchDFABatch(absl::Span<const absl::string_view> texts,
+                      absl::Span<const absl::string_view> contexts,
+                      Anchor anchor, MatchKind kind,
+                      std::vector<int>* results,
+                      std::vector<std::vector<int>>* matches);
+
+  // Like SearchDFA(text, context, kUnanchored, kind, match0, failed, NULL),
+  // but divides text among as many as num_threads threads, each of which
+  // searches its part speculatively.  (See dfa.cc for how.)  Texts that
+  // are too small to be worth it, and anchored regexps, are searched in
+  // the calling thread.
+  bool SearchDFAParallel(absl::string_view text, absl::string_view context,
+                         MatchKind kind, absl::string_view* match0,
+                         bool* failed, int num_threads);
+
+  // Streaming search using the longest-match DFA, for RE2::StreamMatcher.
+  // A DFAStream holds the state of a search over a text that arrives in
+  // chunks.  SearchDFAStream() searches chunk, the next part of the text,
+  // which is the last part if end_of_text is true, and sets *ends to the
+  // offsets in the text of the ends of the matches that it finds.
+  // (See dfa.cc for which matches those are.)
+  // Returns false if the DFA could not be built for lack of memory.
+  static DFAStream* NewDFAStream();
+  static void DeleteDFAStream(DFAStream* stream);
+  bool SearchDFAStream(DFAStream* stream, absl::string_view chunk,
+                       bool end_of_text, std::vector<int64_t>* ends);
+
   // The callback issued after building each DFA state with BuildEntireDFA().
   // If next is null, then the memory budget has been exhausted and building
   // will halt. Otherwise, the state has been built and next points to an array
@@ -335,8 +506,25 @@ class Prog {
   // avoids lots of unnecessary work.
   // If cb is not empty, it receives one callback per state built.
   // Returns the number of states built.
-  // FOR TESTING OR EXPERIMENTAL PURPOSES ONLY.
+  // State 0 is the start state for an unanchored search (or an anchored
+  // search, if anchor is kAnchored) at the beginning of the text.
+  // Used by RE2::SerializedDFA; otherwise, FOR TESTING ONLY.
   int BuildEntireDFA(MatchKind kind, const DFAStateCallback& cb);
+  int BuildEntireDFA(MatchKind kind, Anchor anchor,
+                     const DFAStateCallback& cb);
+
+  // Builds states of the DFA that SearchDFA() uses for anchor and kind
+  // ahead of time, so that the searches that would otherwise build them
+  // run at full speed from the start.  The first form searches each of
+  // texts (within contexts, or within itself if contexts is empty) to the
+  // end; the second builds about max_states states breadth-first from the
+  // start state for a search at the beginning of a text.  Both stop early
+  // if the DFA runs out of memory.  Returns the number of states built.
+  // When dfa_per_thread() is set, only the calling thread's DFA is built.
+  int WarmupDFA(absl::Span<const absl::string_view> texts,
+                absl::Span<const absl::string_view> contexts,
+                Anchor anchor, MatchKind kind);
+  int WarmupDFA(int max_states, Anchor anchor, MatchKind kind);
 
   // Compute bytemap.
   void ComputeByteMap();
@@ -359,7 +547,28 @@ class Prog {
                       Anchor anchor, MatchKind kind, absl::string_view* match,
                       int nmatch);
 
-  static const int kMaxOnePassCapture = 5;  // $0 through $4
+  // Bit-parallel NFA simulation: only correct if IsBitParallel() is true,
+  // which requires a small program without empty-width assertions.
+  // Keeps all of the threads in one machine word, so it needs no cache
+  // and costs the same for every byte, but it can only say whether
+  // there is a match, not where.  IsBitParallel() builds the tables on
+  // its first call, taking their memory from the DFA budget, so it must
+  // first be called before the DFAs are built, as RE2::Init() does.
+  bool IsBitParallel();
+  bool SearchBitParallel(absl::string_view text, absl::string_view context,
+                         Anchor anchor, MatchKind kind);
+
+  // Tagged DFA: only correct if CanTaggedDFA() is true, which requires
+  // capturing groups but no empty-width assertions.  Finds the submatches
+  // of a full match of text (anchored at both ends) at DFA speed, using
+  // a cache of states whose memory CanTaggedDFA() takes from the DFA
+  // budget, so it must be called before the DFAs are built, as
+  // RE2::Init() does.
+  // Sets *failed if the cache fills up too often, as SearchDFA() does;
+  // the caller should then use another engine.
+  bool CanTaggedDFA();
+  bool SearchTaggedDFA(absl::string_view text, absl::string_view context,
+                       absl::string_view* match, int nmatch, bool* failed);
 
   // Backtracking search: the gold standard against which the other
   // implementations are checked.  FOR TESTING ONLY.
@@ -394,6 +603,26 @@ class Prog {
   // its own Match instruction recording the index in the output vector.
   static Prog* CompileSet(Regexp* re, RE2::Anchor anchor, int64_t max_mem);
 
+  // Like CompileSet(), but compiles a Prog that runs backward over the
+  // input, for finding where the matches of a set begin.  Each of the
+  // regexps must be a concatenation that begins (not ends) with its match
+  // index, so that reversing it leaves the Match instruction last.
+  // Searched with kAnchored and kManyMatch from the end of some match,
+  // the Prog records the index of each regexp with a match ending there
+  // at each position where such a match begins.
+  static Prog* CompileReverseSet(Regexp* re, int64_t max_mem);
+
+  // Appends a serialized form of the flattened Prog to *data: its flags,
+  // start instructions, bytemap and instructions.  The prefix accel and
+  // the DFA budget are left to the caller.  Used by RE2::Serialize().
+  void Serialize(std::string* data);
+
+  // Reads a Prog that Serialize() wrote from the front of *data and moves
+  // *data past it.  Sets up the Prog as Flatten() and Compiler::Finish()
+  // would, taking the DFA budget out of max_mem.  Returns NULL if the
+  // instructions are not well formed.  Used by RE2::Deserialize().
+  static Prog* Deserialize(absl::string_view* data, int64_t max_mem);
+
   // Flattens the Prog from "tree" form to "list" form. This is an in-place
   // operation in the sense that the old instructions are lost.
   void Flatten();
@@ -428,17 +657,51 @@ class Prog {
   // FOR TESTING ONLY.
   static void TESTING_ONLY_set_dfa_should_bail_when_slow(bool b);
 
+  // Sets the smallest part of the text that SearchDFAParallel() gives
+  // a thread of its own.  FOR TESTING ONLY.
+  static void TESTING_ONLY_set_dfa_min_parallel_segment(size_t n);
+
+  // Controls whether resetting a DFA's state cache keeps its hottest
+  // states, as it does by default, or discards all of them.
+  // FOR TESTING ONLY.
+  static void TESTING_ONLY_set_dfa_keep_hot_states(bool b);
+
+  // Controls whether the DFA searches the texts of a batch in lockstep,
+  // as it does by default, or one after another.  FOR TESTING ONLY.
+  static void TESTING_ONLY_set_dfa_interleave_batches(bool b);
+
+  // Controls whether the compiler copies large character classes from
+  // a global cache of compiled classes, as it does by default, or always
+  // compiles them.  FOR TESTING ONLY.
+  static void TESTING_ONLY_set_compile_char_class_cache(bool b);
+
  private:
   friend class Compiler;
 
+  // DFAs for one thread when dfa_per_thread_ is set.  Defined in dfa.cc.
+  struct PerThreadDFA;
+
   DFA* GetDFA(MatchKind kind);
   void DeleteDFA(DFA* dfa);
+  void DeletePerThreadDFAs();
+  void DeleteTaggedDFA(TaggedDFA* tagged_dfa);
+
+  // Builds the tables for SearchBitParallel(), if it can.
+  void BuildBitParallel();
+
+  // Takes memory for another engine out of the DFA budget, as IsOnePass()
+  // does: as much of a quarter of what is left as fits in max.  Returns
+  // the amount taken, or 0 (taking nothing) if that would be less than
+  // min, which must be positive.  Must be called before the DFAs are
+  // built, which size themselves from what is left.
+  int64_t TakeDFAMem(int64_t min, int64_t max);
 
   bool anchor_start_;       // regexp has explicit start anchor
   bool anchor_end_;         // regexp has explicit end anchor
   bool reversed_;           // whether program runs backward over input
   bool did_flatten_;        // has Flatten been called?
   bool did_onepass_;        // has IsOnePass been called?
+  bool did_tagged_dfa_;     // has CanTaggedDFA been called?
 
   int start_;               // entry point for program
   int start_unanchored_;    // unanchored entry point for program
@@ -454,6 +717,11 @@ class Prog {
       int prefix_back_;     // last byte of prefix
     };
   };
+  // For PrefixAccel_PackedCompare(): the bytes of the prefix to compare and
+  // their offsets.  Short prefixes repeat the front to fill all four slots.
+  uint8_t prefix_probe_[4];
+  size_t prefix_probe_offset_[4];
+  PrefixAccelKernel prefix_kernel_;
 
   int list_count_;                  // count of lists (see above)
   int inst_count_[kNumInst];        // count of instructions by opcode
@@ -463,20 +731,40 @@ class Prog {
 
   PODArray<Inst> inst_;              // pointer to instruction array
   PODArray<uint8_t> onepass_nodes_;  // data for OnePass nodes
+  PODArray<int> onepass_caps_;       // capture sets for OnePass nodes
+  PODArray<uint64_t> bitparallel_;   // tables for SearchBitParallel
+  uint64_t bitparallel_start_;       // its threads at the start
 
   int64_t dfa_mem_;         // Maximum memory for DFAs.
   DFA* dfa_first_;          // DFA cached for kFirstMatch/kManyMatch
   DFA* dfa_longest_;        // DFA cached for kLongestMatch/kFullMatch
+  bool dfa_per_thread_;     // Use per-thread DFAs, not the two above?
+  int num_per_thread_dfas_; // Number of elements in per_thread_dfas_.
+  PerThreadDFA* per_thread_dfas_;  // DFAs cached for each thread
+  int64_t tagged_dfa_mem_;  // Memory for the tagged DFA.
+  TaggedDFA* tagged_dfa_;   // Tagged DFA, built on first use
+  SearchCounters* search_counters_;  // Not owned; may be NULL.
 
   uint8_t bytemap_[256];    // map from input bytes to byte classes
 
   absl::once_flag dfa_first_once_;
   absl::once_flag dfa_longest_once_;
+  absl::once_flag per_thread_dfas_once_;
+  absl::once_flag tagged_dfa_once_;
+  absl::once_flag bitparallel_once_;
 
   Prog(const Prog&) = delete;
   Prog& operator=(const Prog&) = delete;
 };
 
+inline SearchCounters::Shard* SearchCounters::GetShard() {
+  std::atomic<Shard*>* shard = &shards_[Prog::ThreadShardIndex() % kShards];
+  Shard* s = shard->load(std::memory_order_acquire);
+  if (s == NULL)
+    s = NewShard(shard);
+  return s;
+}
+
 // std::string_view in MSVC has iterators that aren't just pointers and
 // that don't allow comparisons between different objects - not even if
 // those objects are views into the same string! Thus, we provide these
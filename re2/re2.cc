@@ -53,7 +53,13 @@ void RE2::FUZZING_ONLY_set_maximum_global_replace_count(int i) {
 static const int kMaxArgs = 16;
 static const int kVecSize = 1+kMaxArgs;
 
+// Longest text that Match() runs bit-parallel.  Past this, a DFA with a
+// warm cache is faster, even for programs that need one table lookup
+// per byte.
+static const size_t kMaxBitParallelText = 32;
+
 const int RE2::Options::kDefaultMaxMem;  // initialized in re2.h
+const int RE2::Options::kDefaultBitStateMaxMem;  // initialized in re2.h
 
 RE2::Options::Options(RE2::CannedOptions opt)
   : max_mem_(kDefaultMaxMem),
@@ -68,7 +74,9 @@ RE2::Options::Options(RE2::CannedOptions opt)
     case_sensitive_(true),
     perl_classes_(false),
     word_boundary_(false),
-    one_line_(false) {
+    one_line_(false),
+    per_thread_dfa_(false),
+    bit_state_max_mem_(kDefaultBitStateMaxMem) {
 }
 
 // Empty objects for use as const references.
@@ -163,6 +171,10 @@ RE2::RE2(absl::string_view pattern, const Options& options) {
   Init(pattern, options);
 }
 
+RE2::RE2(absl::string_view pattern, const Options& options, Unparsed) {
+  InitFields(pattern, options);
+}
+
 int RE2::Options::ParseFlags() const {
   int flags = Regexp::ClassNL;
   switch (encoding()) {
@@ -207,7 +219,7 @@ int RE2::Options::ParseFlags() const {
   return flags;
 }
 
-void RE2::Init(absl::string_view pattern, const Options& options) {
+void RE2::InitFields(absl::string_view pattern, const Options& options) {
   static absl::once_flag empty_once;
   absl::call_once(empty_once, []() {
     (void) new (empty_storage) EmptyStorage;
@@ -224,13 +236,23 @@ void RE2::Init(absl::string_view pattern, const Options& options) {
   error_code_ = NoError;
   longest_match_ = options_.longest_match();
   is_one_pass_ = false;
+  is_bit_parallel_ = false;
+  is_tagged_dfa_ = false;
   prefix_foldcase_ = false;
   prefix_.clear();
   prog_ = NULL;
 
   rprog_ = NULL;
+  inner_literal_.clear();
+  inner_prefix_regexp_ = NULL;
+  inner_prefix_prog_ = NULL;
+  search_counters_ = NULL;
   named_groups_ = NULL;
   group_names_ = NULL;
+}
+
+void RE2::Init(absl::string_view pattern, const Options& options) {
+  InitFields(pattern, options);
 
   RegexpStatus status;
   entire_regexp_ = Regexp::Parse(
@@ -258,6 +280,17 @@ void RE2::Init(absl::string_view pattern, const Options& options) {
     suffix_regexp_ = entire_regexp_->Incref();
   }
 
+  // A required literal later in the regexp lets Match() skip text, but
+  // a literal of one byte is likely to occur too often to be worth it.
+  if (prefix_.empty() &&
+      entire_regexp_->RequiredInnerLiteral(&inner_literal_,
+                                           &inner_prefix_regexp_) &&
+      inner_literal_.size() < 2) {
+    inner_literal_.clear();
+    inner_prefix_regexp_->Decref();
+    inner_prefix_regexp_ = NULL;
+  }
+
   // Two thirds of the memory goes to the forward Prog,
   // one third to the reverse prog, because the forward
   // Prog has two DFAs but the reverse prog has one.
@@ -269,6 +302,10 @@ void RE2::Init(absl::string_view pattern, const Options& options) {
     error_code_ = RE2::ErrorPatternTooLarge;
     return;
   }
+  prog_->set_dfa_per_thread(options_.per_thread_dfa());
+  prog_->set_bit_state_max_mem(options_.bit_state_max_mem());
+  search_counters_ = new SearchCounters;
+  prog_->set_search_counters(search_counters_);
 
   // We used to compute this lazily, but it's used during the
   // typical control flow for a match call, so we now compute
@@ -281,11 +318,36 @@ void RE2::Init(absl::string_view pattern, const Options& options) {
   // and that is harder to do if the DFA has already
   // been built.
   is_one_pass_ = prog_->IsOnePass();
+
+  // Likewise for the bit-parallel tables.
+  is_bit_parallel_ = prog_->IsBitParallel();
+
+  // And for the tagged DFA, which only the NFA would otherwise do the
+  // work of: the one-pass machine is faster still.
+  is_tagged_dfa_ = !is_one_pass_ && prog_->CanTaggedDFA();
+}
+
+// Returns entire_regexp_, parsing the pattern if need be.
+re2::Regexp* RE2::Regexp() const {
+  absl::call_once(entire_regexp_once_, [](const RE2* re) {
+    // Only an RE2 from Deserialize() gets here without having parsed
+    // the pattern, and its pattern is known to parse.
+    if (re->entire_regexp_ == NULL && re->ok())
+      re->entire_regexp_ = Regexp::Parse(
+          *re->pattern_,
+          static_cast<Regexp::ParseFlags>(re->options_.ParseFlags()),
+          NULL);
+  }, this);
+  return entire_regexp_;
 }
 
 // Returns rprog_, computing it if needed.
 re2::Prog* RE2::ReverseProg() const {
   absl::call_once(rprog_once_, [](const RE2* re) {
+    // An RE2 from Deserialize() has no suffix_regexp_: its rprog_ (if it
+    // could be compiled at all) was deserialized along with prog_.
+    if (re->suffix_regexp_ == NULL)
+      return;
     re->rprog_ =
         re->suffix_regexp_->CompileToReverseProg(re->options_.max_mem() / 3);
     if (re->rprog_ == NULL) {
@@ -297,22 +359,103 @@ re2::Prog* RE2::ReverseProg() const {
       // is fine. More importantly, an RE2 object is supposed to be logically
       // immutable: whatever ok() would have returned after Init() completed,
       // it should continue to return that no matter what ReverseProg() does.
+    } else {
+      re->rprog_->set_dfa_per_thread(re->options_.per_thread_dfa());
+      re->rprog_->set_search_counters(re->search_counters_);
     }
   }, this);
   return rprog_;
 }
 
+// Returns whether SkipToInnerLiteral() can skip ahead to the first
+// place where the regexp before literal, which prog runs in reverse,
+// matches up to an occurrence of literal.  Consider any match: the
+// regexp before the literal matches from the start of the match up to
+// some occurrence of the literal.  If that regexp cannot match text that
+// contains the literal, and the literal cannot overlap itself, then that
+// occurrence is the first one after the start of the match, so skipping
+// ahead does not skip the start of the leftmost match.
+static bool CanSkipToInnerLiteral(Prog* prog, absl::string_view literal) {
+  for (size_t n = 1; n < literal.size(); n++) {
+    if (literal.substr(n) == literal.substr(0, literal.size() - n))
+      return false;
+  }
+
+  // Find the bytes that can occur in a match of prog by walking the
+  // instructions reachable from the anchored start.
+  bool canmatch[256] = {};
+  std::vector<bool> seen(prog->size());
+  std::vector<int> stk;
+  stk.push_back(prog->start());
+  while (!stk.empty()) {
+    int id = stk.back();
+    stk.pop_back();
+    if (id == 0 || seen[id])
+      continue;
+    seen[id] = true;
+    Prog::Inst* ip = prog->inst(id);
+    switch (ip->opcode()) {
+      case kInstByteRange:
+        for (int c = 0; c < 256; c++)
+          if (ip->Matches(c))
+            canmatch[c] = true;
+        stk.push_back(ip->out());
+        break;
+      case kInstCapture:
+      case kInstEmptyWidth:
+      case kInstNop:
+        stk.push_back(ip->out());
+        break;
+      default:
+        break;
+    }
+    if (!ip->last())
+      stk.push_back(id+1);
+  }
+  for (char c : literal) {
+    if (!canmatch[c & 0xFF])
+      return true;
+  }
+  return false;
+}
+
+// Returns inner_prefix_prog_, computing it if needed.
+re2::Prog* RE2::InnerPrefixProg() const {
+  absl::call_once(inner_prefix_prog_once_, [](const RE2* re) {
+    // Likewise for inner_prefix_prog_.
+    if (re->inner_prefix_regexp_ == NULL)
+      return;
+    // The regexp before the literal is usually small, and so is its DFA.
+    Prog* prog = re->inner_prefix_regexp_->CompileToReverseProg(
+        re->options_.max_mem() / 8);
+    if (prog == NULL)
+      return;
+    if (!CanSkipToInnerLiteral(prog, re->inner_literal_)) {
+      delete prog;
+      return;
+    }
+    prog->set_dfa_per_thread(re->options_.per_thread_dfa());
+    prog->set_search_counters(re->search_counters_);
+    re->inner_prefix_prog_ = prog;
+  }, this);
+  return inner_prefix_prog_;
+}
+
 RE2::~RE2() {
   if (group_names_ != empty_group_names())
     delete group_names_;
   if (named_groups_ != empty_named_groups())
     delete named_groups_;
+  delete inner_prefix_prog_;
   delete rprog_;
   delete prog_;
+  delete search_counters_;
   if (error_arg_ != empty_string())
     delete error_arg_;
   if (error_ != empty_string())
     delete error_;
+  if (inner_prefix_regexp_)
+    inner_prefix_regexp_->Decref();
   if (suffix_regexp_)
     suffix_regexp_->Decref();
   if (entire_regexp_)
@@ -661,6 +804,17 @@ bool RE2::Match(absl::string_view text,
                 Anchor re_anchor,
                 absl::string_view* submatch,
                 int nsubmatch) const {
+  return ParallelMatch(text, startpos, endpos, re_anchor, submatch, nsubmatch,
+                       1);
+}
+
+bool RE2::ParallelMatch(absl::string_view text,
+                        size_t startpos,
+                        size_t endpos,
+                        Anchor re_anchor,
+                        absl::string_view* submatch,
+                        int nsubmatch,
+                        int num_threads) const {
   if (!ok()) {
     if (options_.log_errors())
       ABSL_LOG(ERROR) << "Invalid RE2: " << *error_;
@@ -731,10 +885,29 @@ bool RE2::Match(absl::string_view text,
   Prog::MatchKind kind =
       longest_match_ ? Prog::kLongestMatch : Prog::kFirstMatch;
 
-  bool can_one_pass = is_one_pass_ && ncap <= Prog::kMaxOnePassCapture;
+  bool can_one_pass = is_one_pass_;
   bool can_bit_state = prog_->CanBitState();
   size_t bit_state_text_max_size = prog_->bit_state_text_max_size();
 
+  // If the caller only wants to know whether there is a match in a short
+  // text and the program is small enough, run it bit-parallel: that takes
+  // no locks and never has to build states, so it wins while the fixed
+  // cost of a DFA search dominates.  (Skipping to a required inner literal
+  // is faster still, though, and so is running the reverse DFA from the
+  // end of the text when the regexp is anchored there, so leave those
+  // cases to the DFA below.)
+  if (matchp == NULL && is_bit_parallel_ &&
+      subtext.size() <= kMaxBitParallelText &&
+      (re_anchor != UNANCHORED ||
+       (!prog_->anchor_end() &&
+        (inner_literal_.empty() || prog_->can_prefix_accel())))) {
+    if (re_anchor == ANCHOR_BOTH)
+      kind = Prog::kFullMatch;
+    if (re_anchor != UNANCHORED)
+      anchor = Prog::kAnchored;
+    return prog_->SearchBitParallel(subtext, text, anchor, kind);
+  }
+
 #ifdef RE2_HAVE_THREAD_LOCAL
   hooks::context = this;
 #endif
@@ -776,8 +949,14 @@ bool RE2::Match(absl::string_view text,
         break;
       }
 
-      if (!prog_->SearchDFA(subtext, text, anchor, kind,
-                            matchp, &dfa_failed, NULL)) {
+      // If the regexp requires a literal and prefix acceleration
+      // cannot skip text, search for the literal instead.
+      if (!inner_literal_.empty() && !prog_->can_prefix_accel() &&
+          !SkipToInnerLiteral(&subtext, text))
+        return false;
+
+      if (!prog_->SearchDFAParallel(subtext, text, kind,
+                                    matchp, &dfa_failed, num_threads)) {
         if (dfa_failed) {
           if (options_.log_errors())
             ABSL_LOG(ERROR) << "DFA out of memory: "
@@ -896,7 +1075,19 @@ bool RE2::Match(absl::string_view text,
         return false;
       }
     } else {
-      if (!prog_->SearchNFA(subtext1, text, anchor, kind, submatch, ncap)) {
+      // Given the match, the tagged DFA can find the submatches much
+      // faster than the NFA, unless its cache keeps filling up.
+      bool tagged_dfa_failed = true;
+      if (!skipped_test && is_tagged_dfa_ &&
+          !prog_->SearchTaggedDFA(subtext1, text, submatch, ncap,
+                                  &tagged_dfa_failed) &&
+          !tagged_dfa_failed) {
+        if (options_.log_errors())
+          ABSL_LOG(ERROR) << "SearchTaggedDFA inconsistency";
+        return false;
+      }
+      if (tagged_dfa_failed &&
+          !prog_->SearchNFA(subtext1, text, anchor, kind, submatch, ncap)) {
         if (!skipped_test && options_.log_errors())
           ABSL_LOG(ERROR) << "SearchNFA inconsistency";
         return false;
@@ -915,6 +1106,215 @@ bool RE2::Match(absl::string_view text,
   return true;
 }
 
+bool RE2::SkipToInnerLiteral(absl::string_view* subtext,
+                             absl::string_view text) const {
+  // Every match contains the literal.
+  size_t i = subtext->find(inner_literal_);
+  if (i == absl::string_view::npos)
+    return false;
+  Prog* prog = InnerPrefixProg();
+  if (prog == NULL)
+    return true;
+
+  // Look for where the regexp before the literal matches, backward from
+  // each occurrence of the literal in turn.  It cannot match across an
+  // earlier occurrence (see CanSkipToInnerLiteral()), so the searches
+  // stop there, which keeps the total work linear in the text size.
+  const char* bound = subtext->data();
+  for (;;) {
+    absl::string_view before(bound, subtext->data() + i - bound);
+    absl::string_view match;
+    bool failed = false;
+    if (prog->SearchDFA(before, text, Prog::kAnchored, Prog::kLongestMatch,
+                        &match, &failed, NULL)) {
+      subtext->remove_prefix(match.data() - subtext->data());
+      return true;
+    }
+    if (failed) {
+      // No match begins before bound, but we have to stop looking here.
+      subtext->remove_prefix(bound - subtext->data());
+      return true;
+    }
+    bound = subtext->data() + i + 1;
+    i = subtext->find(inner_literal_, i + inner_literal_.size());
+    if (i == absl::string_view::npos)
+      return false;
+  }
+}
+
+int RE2::MatchBatch(absl::Span<const absl::string_view> texts,
+                    Anchor re_anchor,
+                    std::vector<bool>* matched) const {
+  matched->assign(texts.size(), false);
+  if (!ok()) {
+    if (options_.log_errors())
+      ABSL_LOG(ERROR) << "Invalid RE2: " << *error_;
+    return 0;
+  }
+
+  // As in Match(), but decided once for the whole batch.
+  Anchor batch_anchor = re_anchor;
+  if (prog_->anchor_start() && prog_->anchor_end())
+    batch_anchor = ANCHOR_BOTH;
+  else if (prog_->anchor_start() && batch_anchor != ANCHOR_BOTH)
+    batch_anchor = ANCHOR_START;
+
+  // Check for the required prefix, if any.  Only the texts that have it
+  // are searched, without it but within the whole text.
+  absl::Span<const absl::string_view> subtexts = texts;
+  std::vector<absl::string_view> stripped;
+  std::vector<absl::string_view> contexts;
+  std::vector<size_t> index;
+  if (!prefix_.empty()) {
+    size_t prefixlen = prefix_.size();
+    for (size_t i = 0; i < texts.size(); i++) {
+      absl::string_view text = texts[i];
+      if (prefixlen > text.size())
+        continue;
+      if (prefix_foldcase_) {
+        if (ascii_strcasecmp(&prefix_[0], text.data(), prefixlen) != 0)
+          continue;
+      } else {
+        if (memcmp(&prefix_[0], text.data(), prefixlen) != 0)
+          continue;
+      }
+      stripped.push_back(text.substr(prefixlen));
+      contexts.push_back(text);
+      index.push_back(i);
+    }
+    subtexts = stripped;
+    if (batch_anchor != ANCHOR_BOTH)
+      batch_anchor = ANCHOR_START;
+  }
+
+  Prog* prog = prog_;
+  Prog::Anchor anchor = Prog::kAnchored;
+  Prog::MatchKind kind =
+      longest_match_ ? Prog::kLongestMatch : Prog::kFirstMatch;
+  if (batch_anchor == UNANCHORED) {
+    if (prog_->anchor_end()) {
+      // As in Match(), the reverse DFA can say whether there is a match.
+      prog = ReverseProg();
+      kind = Prog::kLongestMatch;
+    } else {
+      anchor = Prog::kUnanchored;
+    }
+  } else if (batch_anchor == ANCHOR_BOTH) {
+    kind = Prog::kFullMatch;
+  }
+
+#ifdef RE2_HAVE_THREAD_LOCAL
+  hooks::context = this;
+#endif
+  std::vector<int> results(subtexts.size(), -1);
+  if (prog != NULL)
+    prog->SearchDFABatch(subtexts, contexts, anchor, kind, &results, NULL);
+  int n = 0;
+  for (size_t j = 0; j < subtexts.size(); j++) {
+    size_t i = index.empty() ? j : index[j];
+    bool m = results[j] == 1;
+    if (results[j] < 0) {
+      // The DFA failed, so fall back to Match() for this text.
+      m = Match(texts[i], 0, texts[i].size(), re_anchor, NULL, 0);
+    }
+    (*matched)[i] = m;
+    n += m;
+  }
+  return n;
+}
+
+void RE2::GetSearchStats(SearchStats* stats) const {
+  *stats = SearchStats();
+  if (search_counters_ != NULL)
+    search_counters_->Get(stats);
+}
+
+int RE2::Warmup(absl::Span<const absl::string_view> samples,
+                Anchor re_anchor) const {
+  return WarmupDFAs(samples, 0, re_anchor);
+}
+
+int RE2::Warmup(int max_states, Anchor re_anchor) const {
+  if (max_states <= 0)
+    return 0;
+  return WarmupDFAs({}, max_states, re_anchor);
+}
+
+int RE2::WarmupDFAs(absl::Span<const absl::string_view> samples,
+                    int max_states, Anchor re_anchor) const {
+  if (!ok())
+    return 0;
+
+  // As in Match().
+  if (prog_->anchor_start() && prog_->anchor_end())
+    re_anchor = ANCHOR_BOTH;
+  else if (prog_->anchor_start() && re_anchor != ANCHOR_BOTH)
+    re_anchor = ANCHOR_START;
+
+  // The forward DFAs see only the samples that have the required prefix,
+  // if any, and without it.  The reverse DFA sees the whole samples.
+  std::vector<absl::string_view> texts;
+  std::vector<absl::string_view> contexts;
+  size_t prefixlen = prefix_.size();
+  for (absl::string_view sample : samples) {
+    if (prefixlen > 0) {
+      if (prefixlen > sample.size())
+        continue;
+      if (prefix_foldcase_) {
+        if (ascii_strcasecmp(&prefix_[0], sample.data(), prefixlen) != 0)
+          continue;
+      } else {
+        if (memcmp(&prefix_[0], sample.data(), prefixlen) != 0)
+          continue;
+      }
+    }
+    texts.push_back(sample.substr(prefixlen));
+    contexts.push_back(sample);
+  }
+  if (prefixlen > 0 && re_anchor != ANCHOR_BOTH)
+    re_anchor = ANCHOR_START;
+
+  auto warmup = [&](Prog* prog, absl::Span<const absl::string_view> t,
+                    Prog::Anchor anchor, Prog::MatchKind kind) -> int {
+    if (prog == NULL)
+      return 0;
+    if (max_states > 0)
+      return prog->WarmupDFA(max_states, anchor, kind);
+    return prog->WarmupDFA(t, contexts, anchor, kind);
+  };
+
+  // Which DFAs Match() uses depends also on whether it is asked where
+  // the match is: if not, an unanchored search wants just the earliest
+  // match, so it uses the DFA for the longest match; if so, it uses the
+  // DFA for kind and then the reverse DFA to find where the match began.
+  Prog::MatchKind kind =
+      longest_match_ ? Prog::kLongestMatch : Prog::kFirstMatch;
+  int n = 0;
+  switch (re_anchor) {
+    case UNANCHORED:
+      if (prog_->anchor_end()) {
+        n += warmup(ReverseProg(), contexts, Prog::kAnchored,
+                    Prog::kLongestMatch);
+        break;
+      }
+      n += warmup(prog_, texts, Prog::kUnanchored, Prog::kLongestMatch);
+      if (kind != Prog::kLongestMatch)
+        n += warmup(prog_, texts, Prog::kUnanchored, kind);
+      n += warmup(ReverseProg(), contexts, Prog::kAnchored,
+                  Prog::kLongestMatch);
+      break;
+
+    case ANCHOR_START:
+      n += warmup(prog_, texts, Prog::kAnchored, kind);
+      break;
+
+    case ANCHOR_BOTH:
+      n += warmup(prog_, texts, Prog::kAnchored, Prog::kFullMatch);
+      break;
+  }
+  return n;
+}
+
 // Internal matcher - like Match() but takes Args not string_views.
 bool RE2::DoMatch(absl::string_view text,
                   Anchor re_anchor,
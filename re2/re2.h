@@ -213,6 +213,7 @@
 
 #include <algorithm>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <type_traits>
@@ -220,6 +221,7 @@
 
 #include "absl/base/call_once.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "re2/stringpiece.h"
 
 #if defined(__APPLE__)
@@ -229,6 +231,7 @@
 namespace re2 {
 class Prog;
 class Regexp;
+class SearchCounters;
 }  // namespace re2
 
 namespace re2 {
@@ -245,6 +248,15 @@ class RE2 {
   // Defined in set.h.
   class Set;
 
+  // Defined in pattern_cache.h.
+  class PatternCache;
+
+  // Defined in serialized_dfa.h.
+  class SerializedDFA;
+
+  // Defined in stream_matcher.h.
+  class StreamMatcher;
+
   enum ErrorCode {
     NoError = 0,
 
@@ -293,6 +305,8 @@ class RE2 {
   // RE2 objects are expensive. You should probably use std::shared_ptr<RE2>
   // instead. If you really must copy, RE2(first.pattern(), first.options())
   // effectively does so: it produces a second object that mimics the first.
+  // To share one RE2 among code that builds the same pattern over and
+  // over, see RE2::PatternCache in pattern_cache.h.
   RE2(const RE2&) = delete;
   RE2& operator=(const RE2&) = delete;
   // Not movable.
@@ -337,7 +351,25 @@ class RE2 {
   // Returns the underlying Regexp; not for general use.
   // Returns entire_regexp_ so that callers don't need
   // to know about prefix_ and prefix_foldcase_.
-  re2::Regexp* Regexp() const { return entire_regexp_; }
+  // An RE2 from Deserialize() parses its pattern on the first call.
+  re2::Regexp* Regexp() const;
+
+  // Sets *data to a serialized form of this RE2: its compiled programs,
+  // both forward and reverse, and what RE2 needs besides them, such as
+  // the required prefix and the names of the capturing groups.  For a
+  // service that builds many RE2s at startup, loading them with
+  // Deserialize() is much faster than parsing and compiling them.
+  // Returns false and sets *error (if not NULL) if this RE2 is not ok().
+  bool Serialize(std::string* data, std::string* error) const;
+
+  // Returns the RE2 that data, as written by Serialize(), describes.
+  // The data is checked up front, so that searches with the RE2 cannot
+  // be made to read out of bounds, and is copied, so that it need not
+  // outlive the RE2.  It must have been written by the same version of
+  // RE2 on a machine with the same byte order.  Returns NULL and sets
+  // *error (if not NULL) if data is not valid.
+  static std::unique_ptr<RE2> Deserialize(absl::string_view data,
+                                          std::string* error);
 
   /***** The array-based matching interface ******/
 
@@ -589,6 +621,69 @@ class RE2 {
              absl::string_view* submatch,
              int nsubmatch) const;
 
+  // Like Match(texts[i], 0, texts[i].size(), re_anchor, NULL, 0) for each
+  // of texts, but much faster for a large batch of short texts: the work
+  // that Match() does on every call, such as finding the DFA and locking
+  // its cache, is done once for the whole batch.  Sets (*matched)[i] to
+  // whether texts[i] matched, and returns the number of texts that did.
+  int MatchBatch(absl::Span<const absl::string_view> texts,
+                 Anchor re_anchor,
+                 std::vector<bool>* matched) const;
+
+  // Like Match(), but an unanchored search may divide text among as many
+  // as num_threads threads, which can find a match in a very large text
+  // (or find that there is none) sooner.  The result is the same as that
+  // of Match().  Each call starts its own threads, so a thread is given
+  // no less than a megabyte of text; smaller texts, and anchored searches,
+  // are searched just as Match() would search them.
+  bool ParallelMatch(absl::string_view text,
+                     size_t startpos,
+                     size_t endpos,
+                     Anchor re_anchor,
+                     absl::string_view* submatch,
+                     int nsubmatch,
+                     int num_threads) const;
+
+  // Builds ahead of time the DFA states that Match() with re_anchor
+  // would build as it searches, so that the first calls to Match() after
+  // startup do not run slowly while they build them.  The first form runs
+  // the DFAs over each of samples, which should resemble the texts to be
+  // searched; the second builds about max_states states of each DFA,
+  // breadth-first from its start state.  Either may be called at any
+  // time, even while other threads call Match().  Returns the number of
+  // DFA states built, which is limited by max_mem: states built beyond
+  // that push out the earlier ones, so the warm-up is partly wasted.
+  int Warmup(absl::Span<const absl::string_view> samples,
+             Anchor re_anchor) const;
+  int Warmup(int max_states, Anchor re_anchor) const;
+
+  // Counters of the work done in searching with this RE2 (or RE2::Set),
+  // for monitoring: for example, a pattern whose DFA cache resets often
+  // or whose searches often fail needs a bigger max_mem.  Counting is
+  // cheap enough to leave on, because the counts of searches and bytes are
+  // not exact when many threads search at once.  The counters cover the
+  // forward and reverse DFAs together.  Every byte that a DFA searches
+  // takes one transition, so dfa_bytes - dfa_transitions_built is about
+  // how many transitions came from the cache (less, if searches stopped
+  // early).
+  struct SearchStats {
+    int64_t dfa_searches = 0;           // DFA searches run
+    int64_t dfa_bytes = 0;              // bytes of text given to them
+    int64_t dfa_states_built = 0;       // DFA states built
+    int64_t dfa_transitions_built = 0;  // DFA transitions built
+    int64_t dfa_cache_resets = 0;       // times a DFA cache filled up
+    int64_t dfa_bailouts = 0;           // DFA searches given up as too slow
+    int64_t dfa_failures = 0;           // failed DFA searches, bailouts too
+    int64_t dfa_mem_in_use = 0;         // bytes of DFA states now cached
+    int64_t dfa_mem_budget = 0;         // bytes that they may take up
+    int64_t onepass_bytes = 0;          // bytes searched by OnePass
+    int64_t bitstate_bytes = 0;         // bytes searched by BitState
+    int64_t bitparallel_bytes = 0;      // bytes searched by BitParallel
+    int64_t tagged_dfa_bytes = 0;       // bytes searched by the tagged DFA
+    int64_t nfa_bytes = 0;              // bytes searched by the NFA
+  };
+  void GetSearchStats(SearchStats* stats) const;
+
   // Check that the given rewrite string is suitable for use with this
   // regular expression.  It checks that:
   //   * The regular expression has enough parenthesized subexpressions
@@ -630,6 +725,9 @@ class RE2 {
     //   never_capture    (false) parse all parens as non-capturing
     //   case_sensitive   (true)  match is case-sensitive (regexp can override
     //                              with (?i) unless in posix_syntax mode)
+    //   per_thread_dfa   (false) give each thread its own DFA caches
+    //                              (see below)
+    //   bit_state_max_mem (see below)  max memory for a backtracking search
     //
     // The following options are only consulted when posix_syntax == true.
     // When posix_syntax == false, these features are always enabled and
@@ -666,10 +764,30 @@ class RE2 {
     //
     // Once a DFA fills its budget, it flushes its cache and starts over.
     // If this happens too often, RE2 falls back on the NFA implementation.
+    //
+    // Normally, all threads searching with an RE2 share its DFAs.  When many
+    // threads search concurrently, they contend for the DFAs' state caches
+    // and evict each other's states.  The per_thread_dfa option instead
+    // gives each thread (up to the number of hardware threads, but no more
+    // than leave each set 512 KiB; beyond that, threads share) its own set
+    // of DFAs.  The budget of each DFA above is then divided evenly among
+    // the sets, so max_mem should usually be raised accordingly.
+    //
+    // To find submatches, RE2 prefers a backtracking search that keeps
+    // a bitmap of (position, instruction) pairs it has visited, which is
+    // allocated for each search and cleared as the search needs it.  The
+    // bit_state_max_mem option limits the size of that bitmap, and thus
+    // the length of the texts searched that way; longer texts are searched
+    // by the NFA, which is slower.  The bitmap needs one bit per byte of
+    // text for each list of instructions in the Prog (roughly, each place
+    // in the regexp where a byte is matched).
 
     // For now, make the default budget something close to Code Search.
     static const int kDefaultMaxMem = 8<<20;
 
+    // The default bitmap limit is the fixed limit that RE2 used to have.
+    static const int kDefaultBitStateMaxMem = 32<<10;
+
     enum Encoding {
       EncodingUTF8 = 1,
       EncodingLatin1
@@ -688,7 +806,9 @@ class RE2 {
       case_sensitive_(true),
       perl_classes_(false),
       word_boundary_(false),
-      one_line_(false) {
+      one_line_(false),
+      per_thread_dfa_(false),
+      bit_state_max_mem_(kDefaultBitStateMaxMem) {
     }
 
     /*implicit*/ Options(CannedOptions);
@@ -732,6 +852,12 @@ class RE2 {
     bool one_line() const { return one_line_; }
     void set_one_line(bool b) { one_line_ = b; }
 
+    bool per_thread_dfa() const { return per_thread_dfa_; }
+    void set_per_thread_dfa(bool b) { per_thread_dfa_ = b; }
+
+    int64_t bit_state_max_mem() const { return bit_state_max_mem_; }
+    void set_bit_state_max_mem(int64_t m) { bit_state_max_mem_ = m; }
+
     void Copy(const Options& src) {
       *this = src;
     }
@@ -752,6 +878,8 @@ class RE2 {
     bool perl_classes_;
     bool word_boundary_;
     bool one_line_;
+    bool per_thread_dfa_;
+    int64_t bit_state_max_mem_;
   };
 
   // Returns the options set in the constructor.
@@ -770,6 +898,13 @@ class RE2 {
   static void FUZZING_ONLY_set_maximum_global_replace_count(int i);
 
  private:
+  // Used by Deserialize(): builds an RE2 for pattern and options
+  // without parsing or compiling the pattern.
+  struct Unparsed {};
+  RE2(absl::string_view pattern, const Options& options, Unparsed);
+
+  // Sets up the fields for pattern and options, as for an empty regexp.
+  void InitFields(absl::string_view pattern, const Options& options);
   void Init(absl::string_view pattern, const Options& options);
 
   bool DoMatch(absl::string_view text,
@@ -779,11 +914,22 @@ class RE2 {
                int n) const;
 
   re2::Prog* ReverseProg() const;
+  re2::Prog* InnerPrefixProg() const;
+
+  // Uses inner_literal_ to rule out a match in subtext or to move the
+  // start of subtext to where the leftmost match can begin.  Returns false
+  // if subtext cannot match.
+  bool SkipToInnerLiteral(absl::string_view* subtext,
+                          absl::string_view text) const;
+
+  // Implements both forms of Warmup(): samples is used if max_states <= 0.
+  int WarmupDFAs(absl::Span<const absl::string_view> samples,
+                 int max_states, Anchor re_anchor) const;
 
   // First cache line is relatively cold fields.
   const std::string* pattern_;    // string regular expression
   Options options_;               // option flags
-  re2::Regexp* entire_regexp_;    // parsed regular expression
+  mutable re2::Regexp* entire_regexp_;  // parsed regular expression
   re2::Regexp* suffix_regexp_;    // parsed regular expression, prefix_ removed
   const std::string* error_;      // error indicator (or points to empty string)
   const std::string* error_arg_;  // fragment of regexp showing error (or ditto)
@@ -794,18 +940,30 @@ class RE2 {
   ErrorCode error_code_ : 29;     // error code (29 bits is more than enough)
   bool longest_match_ : 1;        // cached copy of options_.longest_match()
   bool is_one_pass_ : 1;          // can use prog_->SearchOnePass?
+  bool is_bit_parallel_ : 1;      // can use prog_->SearchBitParallel?
+  bool is_tagged_dfa_ : 1;        // can use prog_->SearchTaggedDFA?
   bool prefix_foldcase_ : 1;      // prefix_ is ASCII case-insensitive
   std::string prefix_;            // required prefix (before suffix_regexp_)
   re2::Prog* prog_;               // compiled program for regexp
 
   // Reverse Prog for DFA execution only
   mutable re2::Prog* rprog_;
+  // Required literal after the start of the regexp (if prefix_ is empty)
+  std::string inner_literal_;
+  // Parsed regular expression before inner_literal_
+  re2::Regexp* inner_prefix_regexp_;
+  // Reverse Prog for inner_prefix_regexp_, if it cannot match inner_literal_
+  mutable re2::Prog* inner_prefix_prog_;
+  // Counters for prog_, rprog_ and inner_prefix_prog_
+  re2::SearchCounters* search_counters_;
   // Map from capture names to indices
   mutable const std::map<std::string, int>* named_groups_;
   // Map from capture indices to names
   mutable const std::map<int, std::string>* group_names_;
 
+  mutable absl::once_flag entire_regexp_once_;
   mutable absl::once_flag rprog_once_;
+  mutable absl::once_flag inner_prefix_prog_once_;
   mutable absl::once_flag named_groups_once_;
   mutable absl::once_flag group_names_once_;
 };
@@ -13,6 +13,8 @@
 
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,7 @@
 #include "absl/log/absl_log.h"
 #include "absl/synchronization/mutex.h"
 #include "re2/pod_array.h"
+#include "re2/re2.h"
 #include "re2/walker-inl.h"
 #include "util/utf.h"
 
@@ -32,6 +35,7 @@ namespace re2 {
 Regexp::Regexp(RegexpOp op, ParseFlags parse_flags)
   : op_(static_cast<uint8_t>(op)),
     simple_(false),
+    arena_(RegexpArena::Current() != NULL),
     parse_flags_(static_cast<uint16_t>(parse_flags)),
     ref_(1),
     nsub_(0),
@@ -66,6 +70,26 @@ Regexp::~Regexp() {
   }
 }
 
+void* Regexp::operator new(size_t size) {
+  RegexpArena* arena = RegexpArena::Current();
+  if (arena == NULL)
+    return ::operator new(size);
+  void* p = arena->Alloc(size);
+  arena->regexps_.push_back(static_cast<Regexp*>(p));
+  return p;
+}
+
+void Regexp::operator delete(void* p) {
+  // Only Regexps from outside any arena are ever deleted.
+  ::operator delete(p);
+}
+
+Regexp** Regexp::AllocSubInArena(int n) {
+  RegexpArena* arena = RegexpArena::Current();
+  ABSL_DCHECK(arena != NULL);
+  return static_cast<Regexp**>(arena->Alloc(n * sizeof(Regexp*)));
+}
+
 // If it's possible to destroy this regexp without recurring,
 // do so and return true.  Else return false.
 bool Regexp::QuickDestroy() {
@@ -101,6 +125,9 @@ int Regexp::Ref() {
 
 // Increments reference count, returns object as convenience.
 Regexp* Regexp::Incref() {
+  if (arena_)
+    return this;
+
   if (ref_ >= kMaxRef-1) {
     static absl::once_flag ref_once;
     absl::call_once(ref_once, []() {
@@ -126,6 +153,9 @@ Regexp* Regexp::Incref() {
 
 // Decrements reference count and deletes this object if count reaches 0.
 void Regexp::Decref() {
+  if (arena_)
+    return;
+
   if (ref_ == kMaxRef) {
     // Ref count is stored in overflow map.
     absl::MutexLock l(ref_mutex());
@@ -161,7 +191,7 @@ void Regexp::Destroy() {
       Regexp** subs = re->sub();
       for (int i = 0; i < re->nsub_; i++) {
         Regexp* sub = subs[i];
-        if (sub == NULL)
+        if (sub == NULL || sub->arena_)
           continue;
         if (sub->ref_ == kMaxRef)
           sub->Decref();
@@ -180,6 +210,77 @@ void Regexp::Destroy() {
   }
 }
 
+// The arena of the innermost RegexpArena::Scope on this thread.
+#ifdef RE2_HAVE_THREAD_LOCAL
+static thread_local RegexpArena* current_arena = NULL;
+#endif
+
+RegexpArena* RegexpArena::Current() {
+#ifdef RE2_HAVE_THREAD_LOCAL
+  return current_arena;
+#else
+  return NULL;
+#endif
+}
+
+RegexpArena::Scope::Scope(RegexpArena* arena) {
+#ifdef RE2_HAVE_THREAD_LOCAL
+  prev_ = current_arena;
+  current_arena = arena;
+#else
+  (void)arena;
+  prev_ = NULL;
+#endif
+}
+
+RegexpArena::Scope::~Scope() {
+#ifdef RE2_HAVE_THREAD_LOCAL
+  current_arena = prev_;
+#endif
+}
+
+RegexpArena::RegexpArena()
+    : next_(NULL),
+      avail_(0) {
+}
+
+RegexpArena::~RegexpArena() {
+  // Release the references to Regexps from outside the arena first,
+  // while all of the Regexps in the arena are still intact.
+  for (Regexp* re : regexps_) {
+    Regexp** subs = re->sub();
+    for (int i = 0; i < re->nsub_; i++) {
+      if (subs[i] != NULL && !subs[i]->arena_)
+        subs[i]->Decref();
+    }
+  }
+  // Then free whatever each Regexp owns besides its sub array,
+  // which is in the blocks along with the Regexp itself.
+  for (Regexp* re : regexps_) {
+    re->nsub_ = 0;
+    re->~Regexp();
+  }
+}
+
+void* RegexpArena::Alloc(size_t n) {
+  static const size_t kBlockSize = 16<<10;
+  n = (n + alignof(Regexp) - 1) & ~(alignof(Regexp) - 1);
+  if (n > avail_) {
+    if (n > kBlockSize/4) {
+      // Big sub arrays get blocks of their own.
+      blocks_.emplace_back(new char[n]);
+      return blocks_.back().get();
+    }
+    blocks_.emplace_back(new char[kBlockSize]);
+    next_ = blocks_.back().get();
+    avail_ = kBlockSize;
+  }
+  void* p = next_;
+  next_ += n;
+  avail_ -= n;
+  return p;
+}
+
 void Regexp::AddRuneToString(Rune r) {
   ABSL_DCHECK(op_ == kRegexpLiteralString);
   if (nrunes_ == 0) {
@@ -347,6 +448,8 @@ Regexp* Regexp::NewCharClass(CharClass* cc, ParseFlags flags) {
 void Regexp::Swap(Regexp* that) {
   // Regexp is not trivially copyable, so we cannot freely copy it with
   // memmove(3), but swapping objects like so is safe for our purposes.
+  // (Both must come from the same place, since their sub arrays do.)
+  ABSL_DCHECK(arena_ == that->arena_);
   char tmp[sizeof *this];
   void* vthis = reinterpret_cast<void*>(this);
   void* vthat = reinterpret_cast<void*>(that);
@@ -759,6 +862,46 @@ bool Regexp::RequiredPrefixForAccel(std::string* prefix, bool* foldcase) {
   return true;
 }
 
+// Determines whether regexp matches must contain a case-sensitive
+// fixed string somewhere other than at the start.  If so, returns the
+// longest such string and the regexp that comes before it.
+bool Regexp::RequiredInnerLiteral(std::string* literal, Regexp** prefix) {
+  literal->clear();
+  *prefix = NULL;
+
+  // No need for a walker: the regexp must be a concatenation with
+  // a literal char or string after its first element.  Literals
+  // inside capturing groups and other operators are not found.
+  if (op_ != kRegexpConcat)
+    return false;
+  int best = -1;
+  int bestlen = 0;
+  for (int i = 1; i < nsub_; i++) {
+    Regexp* re = sub()[i];
+    if (re->op_ != kRegexpLiteral &&
+        re->op_ != kRegexpLiteralString)
+      continue;
+    if (re->parse_flags() & FoldCase)
+      continue;
+    int nrunes = re->op_ == kRegexpLiteral ? 1 : re->nrunes_;
+    if (nrunes > bestlen) {
+      best = i;
+      bestlen = nrunes;
+    }
+  }
+  if (best < 0)
+    return false;
+
+  Regexp* re = sub()[best];
+  bool latin1 = (re->parse_flags() & Latin1) != 0;
+  Rune* runes = re->op_ == kRegexpLiteral ? &re->rune_ : re->runes_;
+  ConvertRunesToBytes(latin1, runes, bestlen, literal);
+  for (int j = 0; j < best; j++)
+    sub()[j]->Incref();
+  *prefix = Concat(sub(), best, parse_flags());
+  return true;
+}
+
 // Character class builder is a balanced binary tree (STL set)
 // containing non-overlapping, non-abutting RuneRanges.
 // The less-than operator used in the tree treats two
@@ -90,8 +90,10 @@
 #include <stdint.h>
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
@@ -241,6 +243,7 @@ struct RuneRangeLess {
 };
 
 class CharClassBuilder;
+class RegexpArena;
 
 class CharClass {
  public:
@@ -372,9 +375,11 @@ class Regexp {
   }
 
   // Increments reference count, returns object as convenience.
+  // Does nothing to a Regexp from a RegexpArena.
   Regexp* Incref();
 
   // Decrements reference count and deletes this object if count reaches 0.
+  // Does nothing to a Regexp from a RegexpArena.
   void Decref();
 
   // Parses string s to produce regular expression, returned.
@@ -477,6 +482,14 @@ class Regexp {
   // regardless of the return value.
   bool RequiredPrefixForAccel(std::string* prefix, bool* foldcase);
 
+  // Whether every match of this regexp must contain a non-empty fixed
+  // string, matched case-sensitively, after some non-empty sub-regexp.
+  // If so, returns the longest such string and the sub-regexp that
+  // precedes it.  The literal might end the regexp.
+  // Callers should expect *literal and *prefix to be "zeroed"
+  // regardless of the return value.
+  bool RequiredInnerLiteral(std::string* literal, Regexp** prefix);
+
   // Controls the maximum repeat count permitted by the parser.
   // FOR FUZZING ONLY.
   static void FUZZING_ONLY_set_maximum_repeat_count(int i);
@@ -491,6 +504,11 @@ class Regexp {
   void Destroy();
   bool QuickDestroy();
 
+  // Regexps come from the current RegexpArena, if there is one.
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+  friend class RegexpArena;
+
   // Helpers for Parse.  Listed here so they can edit Regexps.
   class ParseState;
 
@@ -546,9 +564,10 @@ class Regexp {
   void AllocSub(int n) {
     ABSL_DCHECK(n >= 0 && static_cast<uint16_t>(n) == n);
     if (n > 1)
-      submany_ = new Regexp*[n];
+      submany_ = arena_ ? AllocSubInArena(n) : new Regexp*[n];
     nsub_ = static_cast<uint16_t>(n);
   }
+  static Regexp** AllocSubInArena(int n);
 
   // Add Rune to LiteralString
   void AddRuneToString(Rune r);
@@ -562,8 +581,12 @@ class Regexp {
 
   // Is this regexp structure already simple
   // (has it been returned by Simplify)?
-  // uint8_t instead of bool to control space usage.
-  uint8_t simple_;
+  // A bit field instead of bool to control space usage.
+  uint8_t simple_ : 1;
+
+  // Does a RegexpArena own this regexp?  If so, the reference count
+  // is left alone, and the arena releases the regexp when it goes.
+  uint8_t arena_ : 1;
 
   // Flags saved from parsing and used during execution.
   // (Only FoldCase is used.)
@@ -627,6 +650,52 @@ class Regexp {
   Regexp& operator=(const Regexp&) = delete;
 };
 
+// An arena for Regexps that are needed only for a while, such as the
+// simplified regexp that the compiler walks or the regexps of an RE2::Set
+// until it is compiled.  While a RegexpArena::Scope is active on a thread,
+// the Regexps that the thread creates come from the arena of the innermost
+// one.  Incref() and Decref() do nothing to them; instead, the arena
+// releases all of them at once when it is destroyed, along with their
+// references to Regexps from outside the arena.  So no Regexp may refer
+// to a Regexp from an arena that is destroyed first.
+//
+// Arenas need thread_local; where RE2 does without it, Regexps are
+// allocated one by one as usual.
+class RegexpArena {
+ public:
+  RegexpArena();
+  ~RegexpArena();
+
+  class Scope {
+   public:
+    explicit Scope(RegexpArena* arena);
+    ~Scope();
+
+   private:
+    RegexpArena* prev_;
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+ private:
+  friend class Regexp;
+
+  // Returns the arena of the innermost Scope on this thread, or NULL.
+  static RegexpArena* Current();
+
+  // Returns n bytes, aligned for a Regexp.
+  void* Alloc(size_t n);
+
+  std::vector<Regexp*> regexps_;  // all Regexps from the arena
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_;   // next free byte in the last block
+  size_t avail_;  // free bytes in the last block
+
+  RegexpArena(const RegexpArena&) = delete;
+  RegexpArena& operator=(const RegexpArena&) = delete;
+};
+
 // Character class set: contains non-overlapping, non-abutting RuneRanges.
 typedef std::set<RuneRange, RuneRangeLess> RuneRangeSet;
 
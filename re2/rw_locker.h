@@ -0,0 +1,67 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_RW_LOCKER_H_
+#define RE2_RW_LOCKER_H_
+
+#include "absl/base/thread_annotations.h"
+
+namespace re2 {
+
+// Reader-writer lock helper.
+//
+// The DFA and the tagged DFA use a reader-writer mutex to protect their
+// state graphs.  Traversing the state graph requires holding the mutex
+// for reading, and discarding the state graph and starting over requires
+// holding the lock for writing.  If a search needs to expand the graph
+// but is out of memory, it will need to drop its read lock and then
+// acquire the write lock.  Since it cannot then atomically downgrade from
+// write lock to read lock, it runs the rest of the search holding the
+// write lock.  (This probably helps avoid repeated contention, but really
+// the decision is forced by the Mutex interface.)  It's a bit complicated
+// to keep track of whether the lock is held for reading or writing and
+// thread that through the search, so instead we encapsulate it in the
+// RWLocker and pass that around.
+//
+// Mutex must have ReaderLock(), ReaderUnlock(), WriterLock() and
+// WriterUnlock(), as absl::Mutex does.
+template <typename Mutex>
+class RWLocker {
+ public:
+  explicit RWLocker(Mutex* mu) : mu_(mu), writing_(false) {
+    mu_->ReaderLock();
+  }
+
+  ~RWLocker() {
+    if (!writing_)
+      mu_->ReaderUnlock();
+    else
+      mu_->WriterUnlock();
+  }
+
+  // If the lock is only held for reading right now,
+  // drop the read lock and re-acquire for writing.
+  // Subsequent calls to LockForWriting are no-ops.
+  // Notice that the lock is *released* temporarily.
+  // This function is marked as ABSL_NO_THREAD_SAFETY_ANALYSIS because
+  // the annotations don't support lock upgrade.
+  void LockForWriting() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    if (!writing_) {
+      mu_->ReaderUnlock();
+      mu_->WriterLock();
+      writing_ = true;
+    }
+  }
+
+ private:
+  Mutex* mu_;
+  bool writing_;
+
+  RWLocker(const RWLocker&) = delete;
+  RWLocker& operator=(const RWLocker&) = delete;
+};
+
+}  // namespace re2
+
+#endif  // RE2_RW_LOCKER_H_
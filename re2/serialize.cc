@@ -0,0 +1,567 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tested by serialize_test.cc.
+//
+// RE2::Serialize() and RE2::Deserialize(), and the Prog functions that
+// they use to write and read compiled programs.
+//
+// The serialized form is a Header followed by the fields of the RE2 and
+// then its programs, each of which is its flattened instructions in their
+// in-memory form, preceded by what Compiler::Finish() would have set up.
+// Everything is written in the byte order of the machine and read back
+// with memmove(3), so the data need not be aligned.  A Prog is rebuilt
+// from the instructions with a single copy; the lists that Flatten()
+// made are found again from the "last" bits, which is also how the
+// instructions are checked: every successor must be the head of a list.
+// The tables for SearchBitParallel() follow the instructions, since they
+// are the slowest part of the Prog to rebuild; the one-pass analysis and
+// the rest are redone, but only if they succeeded the first time.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/log/absl_check.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "re2/pod_array.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/regexp.h"
+
+namespace re2 {
+
+namespace {
+
+const char kMagic[8] = {'R', 'E', '2', 'P', 'R', 'O', 'G', '\0'};
+const uint32_t kVersion = 1;
+const uint32_t kByteOrder = 0x01020304;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+};
+
+// The instructions are written as they are in memory.
+static_assert(sizeof(Prog::Inst) == 8, "Prog::Inst must be 8 bytes");
+
+// Flags for the options of the RE2.
+enum {
+  kOptLatin1 = 1 << 0,
+  kOptPosixSyntax = 1 << 1,
+  kOptLongestMatch = 1 << 2,
+  kOptLogErrors = 1 << 3,
+  kOptLiteral = 1 << 4,
+  kOptNeverNL = 1 << 5,
+  kOptDotNL = 1 << 6,
+  kOptNeverCapture = 1 << 7,
+  kOptCaseSensitive = 1 << 8,
+  kOptPerlClasses = 1 << 9,
+  kOptWordBoundary = 1 << 10,
+  kOptOneLine = 1 << 11,
+  kOptPerThreadDFA = 1 << 12,
+  kOptAll = (1 << 13) - 1,
+};
+
+// Flags for what the RE2 worked out about its programs.
+enum {
+  kRE2PrefixFoldCase = 1 << 0,  // prefix_ is ASCII case-insensitive
+  kRE2AccelFoldCase = 1 << 1,   // prefix accel is case-insensitive
+  kRE2OnePass = 1 << 2,         // IsOnePass() was true
+  kRE2BitParallel = 1 << 3,     // IsBitParallel() was true
+  kRE2TaggedDFA = 1 << 4,       // CanTaggedDFA() was true
+  kRE2ReverseProg = 1 << 5,     // the reverse Prog follows
+  kRE2InnerPrefixProg = 1 << 6, // the inner prefix Prog follows
+  kRE2All = (1 << 7) - 1,
+};
+
+// Flags for a Prog.
+enum {
+  kProgAnchorStart = 1 << 0,
+  kProgAnchorEnd = 1 << 1,
+  kProgReversed = 1 << 2,
+  kProgAll = (1 << 3) - 1,
+};
+
+void AppendBytes(const void* p, size_t n, std::string* data) {
+  data->append(static_cast<const char*>(p), n);
+}
+
+template <typename T>
+void Append(T t, std::string* data) {
+  AppendBytes(&t, sizeof t, data);
+}
+
+void AppendString(absl::string_view s, std::string* data) {
+  Append(static_cast<uint32_t>(s.size()), data);
+  AppendBytes(s.data(), s.size(), data);
+}
+
+bool ReadBytes(absl::string_view* data, void* p, size_t n) {
+  if (data->size() < n)
+    return false;
+  memmove(p, data->data(), n);
+  data->remove_prefix(n);
+  return true;
+}
+
+template <typename T>
+bool Read(absl::string_view* data, T* t) {
+  return ReadBytes(data, t, sizeof *t);
+}
+
+bool ReadString(absl::string_view* data, std::string* s) {
+  uint32_t n;
+  if (!Read(data, &n) || data->size() < n)
+    return false;
+  s->assign(data->data(), n);
+  data->remove_prefix(n);
+  return true;
+}
+
+}  // namespace
+
+void Prog::Serialize(std::string* data) {
+  ABSL_DCHECK(did_flatten_);
+  uint32_t flags = (anchor_start_ ? kProgAnchorStart : 0) |
+                   (anchor_end_ ? kProgAnchorEnd : 0) |
+                   (reversed_ ? kProgReversed : 0);
+  Append(flags, data);
+  Append(static_cast<uint32_t>(start_), data);
+  Append(static_cast<uint32_t>(start_unanchored_), data);
+  Append(static_cast<uint32_t>(bytemap_range_), data);
+  AppendBytes(bytemap_, sizeof bytemap_, data);
+  Append(static_cast<uint32_t>(size_), data);
+  AppendBytes(inst_.data(), size_*sizeof inst_[0], data);
+  // The bit-parallel tables take longer to build than the rest of the
+  // Prog takes to read, so they are written out too, if there are any.
+  Append(static_cast<uint32_t>(bitparallel_.size()), data);
+  if (bitparallel_.size() > 0) {
+    Append(bitparallel_start_, data);
+    AppendBytes(bitparallel_.data(), bitparallel_.size()*sizeof(uint64_t),
+                data);
+  }
+}
+
+Prog* Prog::Deserialize(absl::string_view* data, int64_t max_mem) {
+  uint32_t flags, start, start_unanchored, bytemap_range, size;
+  uint8_t bytemap[256];
+  if (!Read(data, &flags) ||
+      !Read(data, &start) ||
+      !Read(data, &start_unanchored) ||
+      !Read(data, &bytemap_range) ||
+      !ReadBytes(data, bytemap, sizeof bytemap) ||
+      !Read(data, &size))
+    return NULL;
+  if ((flags & ~kProgAll) != 0 ||
+      size < 1 || size > static_cast<uint32_t>(Inst::kMaxInst) ||
+      start >= size || start_unanchored >= size ||
+      bytemap_range < 1 || bytemap_range > 256 ||
+      data->size() / sizeof(Inst) < size)
+    return NULL;
+  for (int c = 0; c < 256; c++) {
+    if (bytemap[c] >= bytemap_range)
+      return NULL;
+  }
+
+  std::unique_ptr<Prog> prog(new Prog);
+  prog->anchor_start_ = (flags & kProgAnchorStart) != 0;
+  prog->anchor_end_ = (flags & kProgAnchorEnd) != 0;
+  prog->reversed_ = (flags & kProgReversed) != 0;
+  prog->start_ = static_cast<int>(start);
+  prog->start_unanchored_ = static_cast<int>(start_unanchored);
+  prog->bytemap_range_ = static_cast<int>(bytemap_range);
+  memmove(prog->bytemap_, bytemap, sizeof bytemap);
+  prog->size_ = static_cast<int>(size);
+  prog->inst_ = PODArray<Inst>(prog->size_);
+  ReadBytes(data, prog->inst_.data(), size*sizeof(Inst));
+
+  // Find the lists: each one runs up to an instruction marked last.
+  // Number them as Flatten() does, in order, and count the instructions.
+  PODArray<int> list(prog->size_);
+  int list_count = 0;
+  for (int i = 0; i < kNumInst; i++)
+    prog->inst_count_[i] = 0;
+  for (int id = 0; id < prog->size_; id++) {
+    Inst* ip = prog->inst(id);
+    list[id] = id == 0 || prog->inst(id-1)->last() ? list_count++ : -1;
+    prog->inst_count_[ip->opcode()]++;
+  }
+  if (!prog->inst(prog->size_-1)->last())
+    return NULL;
+  // Instruction 0 is always Fail, in a list by itself: the engines
+  // skip id 0 without looking at it, so it must not hide anything else.
+  if (prog->inst(0)->opcode() != kInstFail || !prog->inst(0)->last())
+    return NULL;
+  auto is_head = [&](int id) {
+    return 0 <= id && id < prog->size_ && list[id] >= 0;
+  };
+  if (!is_head(prog->start_) || !is_head(prog->start_unanchored_))
+    return NULL;
+
+  // Check that the instructions are as Flatten() leaves them, so that
+  // the engines cannot be led out of bounds.
+  for (int id = 0; id < prog->size_; id++) {
+    Inst* ip = prog->inst(id);
+    switch (ip->opcode()) {
+      default:
+        // Flatten() turns every Alt into a list.
+        return NULL;
+
+      case kInstAltMatch:
+        // Its successors are the two instructions after it in its list.
+        if (ip->last() || prog->inst(id+1)->last() ||
+            ip->out() != id+1 || ip->out1() != id+2)
+          return NULL;
+        break;
+
+      case kInstByteRange:
+        if (ip->lo() > ip->hi() || !is_head(ip->out()))
+          return NULL;
+        // The hint must stay within the list.
+        for (int i = id; i < id + ip->hint(); i++) {
+          if (prog->inst(i)->last())
+            return NULL;
+        }
+        break;
+
+      case kInstCapture:
+        if (ip->cap() < 0 || !is_head(ip->out()))
+          return NULL;
+        break;
+
+      case kInstEmptyWidth:
+        if ((ip->empty() & ~kEmptyAllFlags) != 0 || !is_head(ip->out()))
+          return NULL;
+        break;
+
+      case kInstNop:
+        if (!is_head(ip->out()))
+          return NULL;
+        break;
+
+      case kInstMatch:
+      case kInstFail:
+        break;
+    }
+  }
+
+  // The rest is what Flatten() and Compiler::Finish() set up.
+  prog->did_flatten_ = true;
+  prog->list_count_ = list_count;
+  if (prog->size_ <= 512) {
+    prog->list_heads_ = PODArray<uint16_t>(prog->size_);
+    memset(prog->list_heads_.data(), 0xFF,
+           prog->size_*sizeof prog->list_heads_[0]);
+    for (int id = 0; id < prog->size_; id++) {
+      if (list[id] >= 0)
+        prog->list_heads_[id] = static_cast<uint16_t>(list[id]);
+    }
+  }
+  prog->set_bit_state_max_mem(RE2::Options::kDefaultBitStateMaxMem);
+
+  if (max_mem <= 0) {
+    prog->set_dfa_mem(1<<20);
+  } else {
+    int64_t m = max_mem - sizeof(Prog);
+    m -= prog->size_*sizeof(Prog::Inst);  // account for inst_
+    if (prog->CanBitState())
+      m -= prog->size_*sizeof(uint16_t);  // account for list_heads_
+    if (m < 0)
+      m = 0;
+    prog->set_dfa_mem(m);
+  }
+
+  // Take the bit-parallel tables as IsBitParallel() would have built them,
+  // checking that no thread can index past the end of the Follow() tables.
+  uint32_t ntables;
+  if (!Read(data, &ntables))
+    return NULL;
+  if (ntables > 0) {
+    int ninst = prog->inst_count(kInstByteRange);
+    int nchunks = (ninst + 7) / 8;
+    uint64_t start_mask;
+    if (prog->reversed_ || prog->start() == 0 ||
+        prog->inst_count(kInstEmptyWidth) > 0 || ninst > 63 ||
+        ntables != static_cast<uint32_t>(bytemap_range + 256*nchunks) ||
+        !Read(data, &start_mask) ||
+        data->size() / sizeof(uint64_t) < ntables)
+      return NULL;
+    PODArray<uint64_t> tables(ntables);
+    ReadBytes(data, tables.data(), ntables*sizeof tables[0]);
+    // No thread may be past the last ByteRange.
+    uint64_t threads = (uint64_t{1} << ninst) - 1;
+    uint64_t match = uint64_t{1} << 63;
+    if ((start_mask & ~(threads | match)) != 0)
+      return NULL;
+    for (uint32_t i = 0; i < ntables; i++) {
+      uint64_t valid = i < bytemap_range ? threads : threads | match;
+      if ((tables[i] & ~valid) != 0)
+        return NULL;
+    }
+    absl::call_once(prog->bitparallel_once_, [&]() {
+      int64_t mem = static_cast<int64_t>(ntables)*sizeof(uint64_t);
+      if (prog->TakeDFAMem(mem, mem) == 0)
+        return;
+      prog->bitparallel_start_ = start_mask;
+      prog->bitparallel_ = std::move(tables);
+    });
+  }
+  return prog.release();
+}
+
+bool RE2::Serialize(std::string* data, std::string* error) const {
+  std::string unused;
+  if (error == NULL)
+    error = &unused;
+  if (!ok()) {
+    *error = "invalid regexp: " + this->error();
+    return false;
+  }
+
+  // Compile the reverse Prog now, if it has not been already,
+  // so that the RE2 that Deserialize() returns need not.
+  Prog* rprog = ReverseProg();
+  Prog* inner_prefix_prog = NULL;
+  if (!inner_literal_.empty())
+    inner_prefix_prog = InnerPrefixProg();
+
+  // The prefix accel is not kept in the Prog, so work it out again from
+  // the regexp that prog_ was compiled from.  An RE2 from Deserialize()
+  // has to parse its pattern to find that.
+  re2::Regexp* suffix = NULL;
+  if (suffix_regexp_ != NULL) {
+    suffix = suffix_regexp_->Incref();
+  } else {
+    std::string unused_prefix;
+    bool unused_foldcase;
+    if (!Regexp()->RequiredPrefix(&unused_prefix, &unused_foldcase, &suffix))
+      suffix = Regexp()->Incref();
+  }
+  std::string accel;
+  bool accel_foldcase = false;
+  if (!suffix->RequiredPrefixForAccel(&accel, &accel_foldcase))
+    accel.clear();
+  suffix->Decref();
+
+  uint32_t opts =
+      (options_.encoding() == Options::EncodingLatin1 ? kOptLatin1 : 0) |
+      (options_.posix_syntax() ? kOptPosixSyntax : 0) |
+      (options_.longest_match() ? kOptLongestMatch : 0) |
+      (options_.log_errors() ? kOptLogErrors : 0) |
+      (options_.literal() ? kOptLiteral : 0) |
+      (options_.never_nl() ? kOptNeverNL : 0) |
+      (options_.dot_nl() ? kOptDotNL : 0) |
+      (options_.never_capture() ? kOptNeverCapture : 0) |
+      (options_.case_sensitive() ? kOptCaseSensitive : 0) |
+      (options_.perl_classes() ? kOptPerlClasses : 0) |
+      (options_.word_boundary() ? kOptWordBoundary : 0) |
+      (options_.one_line() ? kOptOneLine : 0) |
+      (options_.per_thread_dfa() ? kOptPerThreadDFA : 0);
+  uint32_t flags =
+      (prefix_foldcase_ ? kRE2PrefixFoldCase : 0) |
+      (accel_foldcase ? kRE2AccelFoldCase : 0) |
+      (is_one_pass_ ? kRE2OnePass : 0) |
+      (is_bit_parallel_ ? kRE2BitParallel : 0) |
+      (is_tagged_dfa_ ? kRE2TaggedDFA : 0) |
+      (rprog != NULL ? kRE2ReverseProg : 0) |
+      (inner_prefix_prog != NULL ? kRE2InnerPrefixProg : 0);
+
+  Header h;
+  memset(&h, 0, sizeof h);
+  memmove(h.magic, kMagic, sizeof h.magic);
+  h.version = kVersion;
+  h.byte_order = kByteOrder;
+
+  data->clear();
+  AppendBytes(&h, sizeof h, data);
+  Append(opts, data);
+  Append(options_.max_mem(), data);
+  Append(options_.bit_state_max_mem(), data);
+  AppendString(*pattern_, data);
+  Append(flags, data);
+  Append(static_cast<uint32_t>(num_captures_), data);
+  AppendString(prefix_, data);
+  AppendString(accel, data);
+  AppendString(inner_literal_, data);
+  const std::map<std::string, int>& named_groups = NamedCapturingGroups();
+  Append(static_cast<uint32_t>(named_groups.size()), data);
+  for (const auto& kv : named_groups) {
+    AppendString(kv.first, data);
+    Append(static_cast<uint32_t>(kv.second), data);
+  }
+  prog_->Serialize(data);
+  if (rprog != NULL)
+    rprog->Serialize(data);
+  if (inner_prefix_prog != NULL)
+    inner_prefix_prog->Serialize(data);
+  return true;
+}
+
+std::unique_ptr<RE2> RE2::Deserialize(absl::string_view data,
+                                      std::string* error) {
+  std::string unused;
+  if (error == NULL)
+    error = &unused;
+
+  Header h;
+  if (!ReadBytes(&data, &h, sizeof h)) {
+    *error = "truncated header";
+    return NULL;
+  }
+  if (memcmp(h.magic, kMagic, sizeof h.magic) != 0) {
+    *error = "bad magic number";
+    return NULL;
+  }
+  if (h.version != kVersion) {
+    *error = absl::StrFormat("unsupported version %d", h.version);
+    return NULL;
+  }
+  if (h.byte_order != kByteOrder) {
+    *error = "wrong byte order";
+    return NULL;
+  }
+
+  uint32_t opts, flags, num_captures, num_named_groups;
+  int64_t max_mem, bit_state_max_mem;
+  std::string pattern, prefix, accel, inner_literal;
+  if (!Read(&data, &opts) ||
+      !Read(&data, &max_mem) ||
+      !Read(&data, &bit_state_max_mem) ||
+      !ReadString(&data, &pattern) ||
+      !Read(&data, &flags) ||
+      !Read(&data, &num_captures) ||
+      !ReadString(&data, &prefix) ||
+      !ReadString(&data, &accel) ||
+      !ReadString(&data, &inner_literal) ||
+      !Read(&data, &num_named_groups)) {
+    *error = "truncated data";
+    return NULL;
+  }
+  if ((opts & ~kOptAll) != 0 || (flags & ~kRE2All) != 0 ||
+      num_captures > static_cast<uint32_t>(Prog::Inst::kMaxInst)) {
+    *error = "corrupt data";
+    return NULL;
+  }
+
+  Options options;
+  options.set_encoding((opts & kOptLatin1) ? Options::EncodingLatin1
+                                           : Options::EncodingUTF8);
+  options.set_posix_syntax((opts & kOptPosixSyntax) != 0);
+  options.set_longest_match((opts & kOptLongestMatch) != 0);
+  options.set_log_errors((opts & kOptLogErrors) != 0);
+  options.set_literal((opts & kOptLiteral) != 0);
+  options.set_never_nl((opts & kOptNeverNL) != 0);
+  options.set_dot_nl((opts & kOptDotNL) != 0);
+  options.set_never_capture((opts & kOptNeverCapture) != 0);
+  options.set_case_sensitive((opts & kOptCaseSensitive) != 0);
+  options.set_perl_classes((opts & kOptPerlClasses) != 0);
+  options.set_word_boundary((opts & kOptWordBoundary) != 0);
+  options.set_one_line((opts & kOptOneLine) != 0);
+  options.set_per_thread_dfa((opts & kOptPerThreadDFA) != 0);
+  options.set_max_mem(max_mem);
+  options.set_bit_state_max_mem(bit_state_max_mem);
+
+  std::unique_ptr<RE2> re(new RE2(pattern, options, Unparsed()));
+  re->num_captures_ = static_cast<int>(num_captures);
+  re->prefix_ = std::move(prefix);
+  re->prefix_foldcase_ = (flags & kRE2PrefixFoldCase) != 0;
+  re->inner_literal_ = std::move(inner_literal);
+
+  std::map<std::string, int>* named_groups = new std::map<std::string, int>;
+  std::map<int, std::string>* group_names = new std::map<int, std::string>;
+  re->named_groups_ = named_groups;
+  re->group_names_ = group_names;
+  for (uint32_t i = 0; i < num_named_groups; i++) {
+    std::string name;
+    uint32_t index;
+    if (!ReadString(&data, &name) || !Read(&data, &index)) {
+      *error = "truncated data";
+      return NULL;
+    }
+    if (index < 1 || index > num_captures) {
+      *error = "corrupt data";
+      return NULL;
+    }
+    (*named_groups)[name] = static_cast<int>(index);
+    (*group_names)[static_cast<int>(index)] = name;
+  }
+  // Mark them as computed.
+  re->NamedCapturingGroups();
+  re->CapturingGroupNames();
+
+  // As in Init(), two thirds of the memory goes to the forward Prog
+  // and one third to the reverse Prog.
+  re->prog_ = Prog::Deserialize(&data, options.max_mem()*2/3);
+  if (re->prog_ == NULL) {
+    *error = "corrupt program";
+    return NULL;
+  }
+  if (!accel.empty() && !re->prog_->reversed())
+    re->prog_->ConfigurePrefixAccel(accel, (flags & kRE2AccelFoldCase) != 0);
+  re->prog_->set_dfa_per_thread(options.per_thread_dfa());
+  re->prog_->set_bit_state_max_mem(options.bit_state_max_mem());
+  re->search_counters_ = new SearchCounters;
+  re->prog_->set_search_counters(re->search_counters_);
+
+  if (flags & kRE2ReverseProg) {
+    re->rprog_ = Prog::Deserialize(&data, options.max_mem()/3);
+    if (re->rprog_ == NULL) {
+      *error = "corrupt reverse program";
+      return NULL;
+    }
+    re->rprog_->set_dfa_per_thread(options.per_thread_dfa());
+    re->rprog_->set_search_counters(re->search_counters_);
+  }
+  if (flags & kRE2InnerPrefixProg) {
+    re->inner_prefix_prog_ = Prog::Deserialize(&data, options.max_mem()/8);
+    if (re->inner_prefix_prog_ == NULL) {
+      *error = "corrupt inner prefix program";
+      return NULL;
+    }
+    re->inner_prefix_prog_->set_dfa_per_thread(options.per_thread_dfa());
+    re->inner_prefix_prog_->set_search_counters(re->search_counters_);
+  }
+  if (!data.empty()) {
+    *error = "trailing data";
+    return NULL;
+  }
+
+  // The engines trust the capture registers to fit the submatches.
+  for (Prog* prog : {re->prog_, re->rprog_, re->inner_prefix_prog_}) {
+    if (prog == NULL)
+      continue;
+    for (int id = 0; id < prog->size(); id++) {
+      Prog::Inst* ip = prog->inst(id);
+      if (ip->opcode() == kInstCapture &&
+          ip->cap() >= 2*(re->num_captures_+1)) {
+        *error = "corrupt program";
+        return NULL;
+      }
+    }
+  }
+
+  // Redo the analyses that Init() does, but only those that succeeded
+  // when the RE2 was built, since they are deterministic.  Each of them
+  // takes its memory from the DFA budget, as in Init().  IsBitParallel()
+  // finds its tables already deserialized.
+  re->is_one_pass_ = (flags & kRE2OnePass) && re->prog_->IsOnePass();
+  re->is_bit_parallel_ =
+      (flags & kRE2BitParallel) && re->prog_->IsBitParallel();
+  re->is_tagged_dfa_ = !re->is_one_pass_ && (flags & kRE2TaggedDFA) &&
+                       re->prog_->CanTaggedDFA();
+
+  // ReverseProg() and InnerPrefixProg() have nothing to compile.
+  re->ReverseProg();
+  re->InnerPrefixProg();
+  return re;
+}
+
+}  // namespace re2
@@ -0,0 +1,305 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/serialized_dfa.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/regexp.h"
+
+namespace re2 {
+
+// The serialized form is a Header followed by the transition table:
+// for each state, one entry per byte class plus one for the end of the
+// text.  Each entry is the offset in the table of the row for the next
+// state (that is, the state number premultiplied by num_next), or all
+// ones if no match is possible any more.  The entries are uint16_t if
+// there are few enough states, uint32_t otherwise.
+//
+// The states are numbered so that the matching states come last, which
+// lets the matcher notice both a match and a dead end with a single
+// comparison against match_start.  Like the lazily built DFA, the table
+// notices matches one byte late: a state is a matching state if a match
+// ended just before the last byte consumed, so the final transition on
+// "end of text" reports any match that ends at the end of the text.
+
+namespace {
+
+const char kMagic[8] = {'R', 'E', '2', 'D', 'F', 'A', '\0', '\0'};
+const uint32_t kVersion = 1;
+const uint32_t kByteOrder = 0x01020304;
+
+enum {
+  kFlagEndMatch = 1 << 0,  // match must end at the end of the text
+  kFlagWide = 1 << 1,      // entries are uint32_t, not uint16_t
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t flags;
+  uint32_t num_states;
+  uint32_t num_next;     // number of byte classes, plus one
+  uint32_t start;        // offset of the start state
+  uint32_t match_start;  // offset of the first matching state
+  uint8_t bytemap[256];
+};
+
+static_assert(sizeof(Header) % sizeof(uint32_t) == 0,
+              "Header must preserve alignment of the table");
+
+template <typename T>
+constexpr T Dead() { return static_cast<T>(-1); }
+
+template <typename T>
+void AppendTable(const std::vector<int>& next, std::string* data) {
+  size_t off = data->size();
+  data->resize(off + next.size() * sizeof(T));
+  for (size_t i = 0; i < next.size(); i++) {
+    T t = next[i] < 0 ? Dead<T>() : static_cast<T>(next[i]);
+    memmove(&(*data)[off + i * sizeof(T)], &t, sizeof t);
+  }
+}
+
+template <typename T>
+bool ValidTable(const T* table, size_t n, uint32_t num_next) {
+  for (size_t i = 0; i < n; i++)
+    if (table[i] != Dead<T>() && (table[i] >= n || table[i] % num_next != 0))
+      return false;
+  return true;
+}
+
+}  // namespace
+
+bool RE2::SerializedDFA::Serialize(const RE2& re, RE2::Anchor anchor,
+                                   std::string* data, std::string* error) {
+  std::string unused;
+  if (error == NULL)
+    error = &unused;
+  if (!re.ok()) {
+    *error = "invalid regexp: " + re.error();
+    return false;
+  }
+
+  // Compile the entire regexp, not the suffix that RE2 uses after
+  // stripping a required prefix: the table has to do all of the work.
+  std::unique_ptr<Prog> prog(
+      re.Regexp()->CompileToProg(re.options().max_mem()));
+  if (prog == NULL) {
+    *error = "pattern too large - compile failed";
+    return false;
+  }
+
+  // This mirrors what Prog::SearchDFA() does for a search that wants only
+  // the earliest match or, when the match must end at the end of the text,
+  // the longest one.  Either way, it is the longest-match DFA.
+  Prog::Anchor a = Prog::kUnanchored;
+  if (anchor != RE2::UNANCHORED || prog->anchor_start())
+    a = Prog::kAnchored;
+  bool end_match = anchor == RE2::ANCHOR_BOTH || prog->anchor_end();
+
+  int nnext = prog->bytemap_range() + 1;
+  std::vector<int> next;
+  std::vector<bool> match;
+  bool oom = false;
+  prog->BuildEntireDFA(Prog::kLongestMatch, a,
+                       [&](const int* n, bool m) {
+                         if (n == NULL) {
+                           oom = true;
+                           return;
+                         }
+                         next.insert(next.end(), n, n + nnext);
+                         match.push_back(m);
+                       });
+  if (oom) {
+    *error = "DFA out of memory";
+    return false;
+  }
+  // BuildEntireDFA() builds nothing either if the start state is dead
+  // (nothing can match) or if the DFA could not be initialized at all.
+  // Tell those apart by asking the lazy DFA directly.
+  if (match.empty()) {
+    bool failed = false;
+    prog->SearchDFA(absl::string_view(), absl::string_view(), a,
+                    Prog::kLongestMatch, NULL, &failed, NULL);
+    if (failed) {
+      *error = "DFA out of memory";
+      return false;
+    }
+  }
+
+  // Renumber the states so that the matching states come last.
+  int nstates = static_cast<int>(match.size());
+  std::vector<int> renumber(nstates);
+  int nmatch = 0;
+  for (int i = 0; i < nstates; i++)
+    nmatch += match[i];
+  int nonmatching = 0;
+  int matching = nstates - nmatch;
+  for (int i = 0; i < nstates; i++)
+    renumber[i] = match[i] ? matching++ : nonmatching++;
+
+  if (static_cast<int64_t>(nstates) * nnext >= int64_t{1} << 31) {
+    *error = "DFA too large";
+    return false;
+  }
+  std::vector<int> table(next.size());
+  for (int i = 0; i < nstates; i++) {
+    for (int j = 0; j < nnext; j++) {
+      int ns = next[i * nnext + j];
+      table[renumber[i] * nnext + j] = ns < 0 ? -1 : renumber[ns] * nnext;
+    }
+  }
+  bool wide = table.size() >= Dead<uint16_t>();
+
+  Header h;
+  memset(&h, 0, sizeof h);
+  memmove(h.magic, kMagic, sizeof h.magic);
+  h.version = kVersion;
+  h.byte_order = kByteOrder;
+  h.flags = (end_match ? kFlagEndMatch : 0) | (wide ? kFlagWide : 0);
+  h.num_states = static_cast<uint32_t>(nstates);
+  h.num_next = static_cast<uint32_t>(nnext);
+  h.start = nstates > 0 ? static_cast<uint32_t>(renumber[0] * nnext) : 0;
+  h.match_start = static_cast<uint32_t>((nstates - nmatch) * nnext);
+  memmove(h.bytemap, prog->bytemap(), sizeof h.bytemap);
+
+  data->assign(reinterpret_cast<const char*>(&h), sizeof h);
+  if (wide)
+    AppendTable<uint32_t>(table, data);
+  else
+    AppendTable<uint16_t>(table, data);
+  return true;
+}
+
+RE2::SerializedDFA::SerializedDFA(absl::string_view data)
+    : end_match_(false),
+      wide_(false),
+      num_states_(0),
+      num_next_(0),
+      start_(0),
+      match_start_(0),
+      bytemap_(NULL),
+      table_(NULL) {
+  Header h;
+  if (data.size() < sizeof h) {
+    error_ = "truncated header";
+    return;
+  }
+  if (reinterpret_cast<uintptr_t>(data.data()) % alignof(uint32_t) != 0) {
+    error_ = "misaligned data";
+    return;
+  }
+  memmove(&h, data.data(), sizeof h);
+  if (memcmp(h.magic, kMagic, sizeof h.magic) != 0) {
+    error_ = "bad magic number";
+    return;
+  }
+  if (h.version != kVersion) {
+    error_ = absl::StrFormat("unsupported version %d", h.version);
+    return;
+  }
+  if (h.byte_order != kByteOrder) {
+    error_ = "wrong byte order";
+    return;
+  }
+  if ((h.flags & ~(kFlagEndMatch | kFlagWide)) != 0 ||
+      h.num_next < 2 || h.num_next > 257) {
+    error_ = "corrupt header";
+    return;
+  }
+  for (int i = 0; i < 256; i++) {
+    if (h.bytemap[i] >= h.num_next - 1) {
+      error_ = "corrupt bytemap";
+      return;
+    }
+  }
+  size_t entry_size = (h.flags & kFlagWide) ? sizeof(uint32_t)
+                                            : sizeof(uint16_t);
+  size_t entries = static_cast<size_t>(h.num_states) * h.num_next;
+  if (h.num_states > (data.size() - sizeof h) / h.num_next ||
+      data.size() != sizeof h + entries * entry_size) {
+    error_ = "truncated table";
+    return;
+  }
+  if ((entries > 0 && (h.start >= entries || h.start % h.num_next != 0)) ||
+      h.match_start > entries || h.match_start % h.num_next != 0) {
+    error_ = "corrupt header";
+    return;
+  }
+
+  end_match_ = (h.flags & kFlagEndMatch) != 0;
+  wide_ = (h.flags & kFlagWide) != 0;
+  num_states_ = h.num_states;
+  num_next_ = h.num_next;
+  start_ = h.start;
+  match_start_ = h.match_start;
+  bytemap_ = reinterpret_cast<const uint8_t*>(data.data()) +
+             offsetof(Header, bytemap);
+  table_ = data.data() + sizeof h;
+
+  bool valid;
+  if (wide_)
+    valid = ValidTable(static_cast<const uint32_t*>(table_), entries,
+                       num_next_);
+  else
+    valid = ValidTable(static_cast<const uint16_t*>(table_), entries,
+                       num_next_);
+  if (!valid) {
+    error_ = "corrupt table";
+    return;
+  }
+}
+
+RE2::SerializedDFA::~SerializedDFA() {}
+
+bool RE2::SerializedDFA::Match(absl::string_view text) const {
+  if (!ok() || num_states_ == 0)
+    return false;
+  if (wide_)
+    return MatchTable(static_cast<const uint32_t*>(table_), text);
+  else
+    return MatchTable(static_cast<const uint16_t*>(table_), text);
+}
+
+template <typename T>
+bool RE2::SerializedDFA::MatchTable(const T* table,
+                                    absl::string_view text) const {
+  const uint8_t* bytemap = bytemap_;
+  const bool end_match = end_match_;
+  const size_t match_start = match_start_;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+  const uint8_t* ep = p + text.size();
+  size_t s = start_;
+  if (!end_match && s >= match_start)
+    return true;
+  for (; p < ep; p++) {
+    size_t ns = table[s + bytemap[*p]];
+    // Dead<T>() is greater than any state,
+    // so this also catches the dead end.
+    if (ns >= match_start) {
+      if (ns == Dead<T>())
+        return false;
+      if (!end_match)
+        return true;
+    }
+    s = ns;
+  }
+  // Process "end of text" to see if it triggers a match.
+  size_t ns = table[s + num_next_ - 1];
+  return ns >= match_start && ns != Dead<T>();
+}
+
+}  // namespace re2
@@ -0,0 +1,83 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_SERIALIZED_DFA_H_
+#define RE2_SERIALIZED_DFA_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+// An RE2::SerializedDFA runs a DFA that was built out completely ahead
+// of time and serialized into a flat, versioned table.  Normally, RE2
+// builds its DFAs lazily, one state at a time, as searches need them;
+// that costs time on the first searches and memory in every process.
+// For a fixed set of regexps, the DFAs can instead be built offline with
+// Serialize(), written to a file and then mapped into memory (e.g. with
+// mmap(2)) by any number of processes.  The matcher runs directly from
+// the mapped table: it never allocates, locks or builds states.
+//
+// The table answers only whether the regexp matches: like RE2::Match()
+// with no submatches.  Building it fails if the complete DFA does not fit
+// in the memory budget, which is likely for regexps such as (a|b)*a.{20}.
+//
+// The table is written in the byte order of the machine that built it;
+// a SerializedDFA rejects a table with the wrong byte order or version.
+class RE2::SerializedDFA {
+ public:
+  // Builds the entire DFA for re, as it would be used for
+  // re.Match(text, 0, text.size(), anchor, NULL, 0), and sets *data to
+  // its serialized form.  Returns false and sets *error (if not NULL)
+  // if re is not ok or if the DFA does not fit in the budget given by
+  // re.options().max_mem().
+  static bool Serialize(const RE2& re, RE2::Anchor anchor, std::string* data,
+                        std::string* error);
+
+  // Uses the serialized DFA in data, which is not copied: data must
+  // remain valid, and unchanged, for the lifetime of the SerializedDFA.
+  // data.data() must be suitably aligned for uint32_t (as are the results
+  // of mmap(2) and std::string).  The table is validated up front, so
+  // that Match() cannot be made to read out of bounds.
+  explicit SerializedDFA(absl::string_view data);
+  ~SerializedDFA();
+
+  // Not copyable.
+  SerializedDFA(const SerializedDFA&) = delete;
+  SerializedDFA& operator=(const SerializedDFA&) = delete;
+
+  // Returns whether data held a valid table.
+  // If not, error() says what was wrong with it.
+  bool ok() const { return error_.empty(); }
+  const std::string& error() const { return error_; }
+
+  // Returns the number of DFA states in the table.
+  int num_states() const { return static_cast<int>(num_states_); }
+
+  // Returns whether the regexp matches text.
+  // Safe for concurrent use by multiple threads.
+  bool Match(absl::string_view text) const;
+
+ private:
+  template <typename T>
+  bool MatchTable(const T* table, absl::string_view text) const;
+
+  std::string error_;
+  bool end_match_;          // match must end at the end of text
+  bool wide_;               // table entries are uint32_t, not uint16_t
+  uint32_t num_states_;     // number of states
+  uint32_t num_next_;       // number of byte classes (+1 for end of text)
+  uint32_t start_;          // offset in table_ of the start state
+  uint32_t match_start_;    // offset in table_ of the first matching state
+  const uint8_t* bytemap_;  // map from input bytes to byte classes
+  const void* table_;       // num_states_ rows of num_next_ next states
+};
+
+}  // namespace re2
+
+#endif  // RE2_SERIALIZED_DFA_H_
@@ -5,8 +5,11 @@
 #include "re2/set.h"
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <algorithm>
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
@@ -14,19 +17,266 @@
 
 #include "absl/log/absl_log.h"
 #include "absl/strings/string_view.h"
+#include "re2/aho_corasick.h"
 #include "re2/pod_array.h"
 #include "re2/prog.h"
 #include "re2/re2.h"
 #include "re2/regexp.h"
 #include "re2/sparse_set.h"
+#include "re2/walker-inl.h"
+#include "util/utf.h"
 
 namespace re2 {
 
+// The prefilter looks for literals that the regexps require.  A regexp
+// contributes either one literal or, for an alternation, one literal per
+// branch; any more than this and the regexp is treated as having none.
+static const int kMaxLiterals = 16;
+
+// Literals are truncated to this many bytes to keep the prefilter small.
+// Any prefix of a required literal is, of course, required too.
+static const size_t kMaxLiteralSize = 16;
+
+// Widths beyond this are treated as unbounded.
+static const int kMaxWidth = 1<<16;
+
+namespace {
+
+// A literal that matches of some regexp must contain.
+struct RequiredLiteral {
+  std::string bytes;
+  bool foldcase;  // whether ASCII case is folded
+  int lead;       // most bytes a match can have before it, or -1 if unbounded
+};
+
+// What RequiredLiteralsWalker has learned about a regexp.
+struct LiteralInfo {
+  LiteralInfo() : width(0), required(false), looks_behind(false) {}
+
+  int width;          // most bytes it can match, or -1 if unbounded
+  bool required;      // whether every match contains one of literals
+  bool looks_behind;  // whether it uses ^, \A, \b or \B
+  std::vector<RequiredLiteral> literals;
+};
+
+// Walks a regexp to find a set of literals, one of which every match of
+// the regexp must contain, together with how far into the match each of
+// them can be.
+class RequiredLiteralsWalker : public Regexp::Walker<LiteralInfo> {
+ public:
+  RequiredLiteralsWalker() {}
+
+  LiteralInfo PostVisit(Regexp* re, LiteralInfo parent_arg,
+                        LiteralInfo pre_arg, LiteralInfo* child_args,
+                        int nchild_args) override;
+
+  LiteralInfo ShortVisit(Regexp* re, LiteralInfo parent_arg) override {
+    // Assume the worst.
+    LiteralInfo info;
+    info.width = -1;
+    info.looks_behind = true;
+    return info;
+  }
+
+ private:
+  RequiredLiteralsWalker(const RequiredLiteralsWalker&) = delete;
+  RequiredLiteralsWalker& operator=(const RequiredLiteralsWalker&) = delete;
+};
+
+}  // namespace
+
+static int AddWidths(int a, int b) {
+  if (a < 0 || b < 0 || a + b > kMaxWidth)
+    return -1;
+  return a + b;
+}
+
+static int MultiplyWidth(int width, int n) {
+  if (width < 0 || n < 0 || (width > 0 && n > kMaxWidth / width))
+    return -1;
+  return width * n;
+}
+
+// Returns whether the literals in a narrow down the search more than
+// the literals in b: literals with bounded leads let Match() skip ahead,
+// and longer literals occur less often.
+static bool BetterLiterals(const LiteralInfo& a, const LiteralInfo& b) {
+  if (!b.required)
+    return a.required;
+  if (!a.required)
+    return false;
+  auto bounded = [](const LiteralInfo& info) -> bool {
+    for (const RequiredLiteral& lit : info.literals)
+      if (lit.lead < 0)
+        return false;
+    return true;
+  };
+  auto shortest = [](const LiteralInfo& info) -> size_t {
+    size_t n = SIZE_MAX;
+    for (const RequiredLiteral& lit : info.literals)
+      n = std::min(n, lit.bytes.size());
+    return n;
+  };
+  if (bounded(a) != bounded(b))
+    return bounded(a);
+  return shortest(a) > shortest(b);
+}
+
+LiteralInfo RequiredLiteralsWalker::PostVisit(Regexp* re,
+                                              LiteralInfo parent_arg,
+                                              LiteralInfo pre_arg,
+                                              LiteralInfo* child_args,
+                                              int nchild_args) {
+  LiteralInfo info;
+  for (int i = 0; i < nchild_args; i++)
+    info.looks_behind |= child_args[i].looks_behind;
+  bool latin1 = (re->parse_flags() & Regexp::Latin1) != 0;
+
+  switch (re->op()) {
+    case kRegexpNoMatch:
+      // Vacuously, every match contains one of no literals.
+      info.required = true;
+      break;
+
+    case kRegexpEmptyMatch:
+    case kRegexpEndLine:
+    case kRegexpEndText:
+    case kRegexpHaveMatch:
+      break;
+
+    case kRegexpBeginLine:
+    case kRegexpBeginText:
+    case kRegexpWordBoundary:
+    case kRegexpNoWordBoundary:
+      info.looks_behind = true;
+      break;
+
+    case kRegexpLiteral:
+    case kRegexpLiteralString: {
+      Rune rune = re->op() == kRegexpLiteral ? re->rune() : 0;
+      Rune* runes = re->op() == kRegexpLiteral ? &rune : re->runes();
+      int nrunes = re->op() == kRegexpLiteral ? 1 : re->nrunes();
+      std::string bytes;
+      for (int i = 0; i < nrunes; i++) {
+        if (latin1) {
+          bytes.push_back(static_cast<char>(runes[i]));
+        } else {
+          char buf[UTFmax];
+          bytes.append(buf, runetochar(buf, &runes[i]));
+        }
+      }
+      info.width = static_cast<int>(bytes.size());
+      info.required = true;
+      info.literals.push_back(
+          {bytes, (re->parse_flags() & Regexp::FoldCase) != 0, 0});
+      break;
+    }
+
+    case kRegexpAnyChar:
+      info.width = latin1 ? 1 : UTFmax;
+      break;
+
+    case kRegexpAnyByte:
+      info.width = 1;
+      break;
+
+    case kRegexpCharClass: {
+      Rune hi = 0;
+      for (CharClass::iterator it = re->cc()->begin();
+           it != re->cc()->end(); ++it)
+        hi = std::max(hi, it->hi);
+      char buf[UTFmax];
+      info.width = latin1 ? 1 : runetochar(buf, &hi);
+      break;
+    }
+
+    case kRegexpConcat: {
+      int width = 0;
+      LiteralInfo best;
+      for (int i = 0; i < nchild_args; i++) {
+        LiteralInfo& child = child_args[i];
+        if (child.required) {
+          for (RequiredLiteral& lit : child.literals)
+            lit.lead = AddWidths(lit.lead, width);
+          if (BetterLiterals(child, best)) {
+            best.required = true;
+            best.literals.swap(child.literals);
+          }
+        }
+        width = AddWidths(width, child.width);
+      }
+      info.width = width;
+      info.required = best.required;
+      info.literals.swap(best.literals);
+      break;
+    }
+
+    case kRegexpAlternate: {
+      info.required = true;
+      for (int i = 0; i < nchild_args; i++) {
+        LiteralInfo& child = child_args[i];
+        if (i == 0 || child.width < 0)
+          info.width = child.width;
+        else if (info.width >= 0)
+          info.width = std::max(info.width, child.width);
+        if (!child.required ||
+            info.literals.size() + child.literals.size() > kMaxLiterals) {
+          info.required = false;
+          info.literals.clear();
+        }
+        if (info.required)
+          info.literals.insert(info.literals.end(), child.literals.begin(),
+                               child.literals.end());
+      }
+      break;
+    }
+
+    case kRegexpStar:
+      info.width = -1;
+      break;
+
+    case kRegexpQuest:
+      info.width = child_args[0].width;
+      break;
+
+    case kRegexpPlus:
+    case kRegexpRepeat:
+      // The first repetition is at the start, so its literals are too.
+      if (re->op() == kRegexpPlus) {
+        info.width = -1;
+        info.required = child_args[0].required;
+      } else {
+        info.width = re->max() < 0 ? -1 : MultiplyWidth(child_args[0].width,
+                                                       re->max());
+        info.required = child_args[0].required && re->min() > 0;
+      }
+      if (info.required)
+        info.literals.swap(child_args[0].literals);
+      break;
+
+    case kRegexpCapture:
+      info.width = child_args[0].width;
+      info.required = child_args[0].required;
+      info.literals.swap(child_args[0].literals);
+      break;
+
+    default:
+      ABSL_LOG(DFATAL) << "unexpected op: " << re->op();
+      info.width = -1;
+      info.looks_behind = true;
+      break;
+  }
+  return info;
+}
+
 RE2::Set::Set(const RE2::Options& options, RE2::Anchor anchor)
     : options_(options),
       anchor_(anchor),
+      arena_(new RegexpArena),
       compiled_(false),
-      size_(0) {
+      size_(0),
+      prefilter_reach_(-1),
+      reverse_once_(new absl::once_flag) {
   options_.set_never_capture(true);  // might unblock some optimisations
 }
 
@@ -38,15 +288,29 @@ RE2::Set::~Set() {
 RE2::Set::Set(Set&& other)
     : options_(other.options_),
       anchor_(other.anchor_),
+      arena_(std::move(other.arena_)),
       elem_(std::move(other.elem_)),
       compiled_(other.compiled_),
       size_(other.size_),
-      prog_(std::move(other.prog_)) {
+      search_counters_(std::move(other.search_counters_)),
+      prog_(std::move(other.prog_)),
+      prefilter_(std::move(other.prefilter_)),
+      prefilter_reach_(other.prefilter_reach_),
+      reverse_elem_(std::move(other.reverse_elem_)),
+      reverse_prog_(std::move(other.reverse_prog_)),
+      reverse_once_(std::move(other.reverse_once_)) {
+  other.arena_.reset(new RegexpArena);
   other.elem_.clear();
   other.elem_.shrink_to_fit();
   other.compiled_ = false;
   other.size_ = 0;
+  other.search_counters_.reset();
   other.prog_.reset();
+  other.prefilter_.reset();
+  other.prefilter_reach_ = -1;
+  other.reverse_elem_.clear();
+  other.reverse_prog_.reset();
+  other.reverse_once_.reset(new absl::once_flag);
 }
 
 RE2::Set& RE2::Set::operator=(Set&& other) {
@@ -67,6 +331,8 @@ int RE2::Set::Add(absl::string_view pattern, std::string* error) {
     return -1;
   }
 
+  // The regexps come from arena_, which Compile() releases all at once.
+  RegexpArena::Scope scope(arena_.get());
   Regexp::ParseFlags pf = static_cast<Regexp::ParseFlags>(
     options_.ParseFlags());
   RegexpStatus status;
@@ -115,19 +381,140 @@ bool RE2::Set::Compile() {
               return a.first < b.first;
             });
 
+  // Keep the patterns for ReverseProg(), which parses them again if
+  // MatchPositions() ever needs them.  Add() made each regexp a
+  // concatenation ending with its HaveMatch, unless Concat() nested a
+  // very long concatenation, in which case there is no reverse Prog.
+  if (anchor_ == RE2::UNANCHORED) {
+    for (Elem& e : elem_) {
+      re2::Regexp* m = e.second;
+      if (m->op() != kRegexpConcat ||
+          m->sub()[m->nsub()-1]->op() != kRegexpHaveMatch) {
+        reverse_elem_.clear();
+        break;
+      }
+      reverse_elem_.emplace_back(std::move(e.first),
+                                 m->sub()[m->nsub()-1]->match_id());
+    }
+  }
+
   PODArray<re2::Regexp*> sub(size_);
   for (int i = 0; i < size_; i++)
     sub[i] = elem_[i].second;
   elem_.clear();
   elem_.shrink_to_fit();
 
+  CompilePrefilter(sub.data(), size_);
+
+  {
+    RegexpArena::Scope scope(arena_.get());
+    Regexp::ParseFlags pf = static_cast<Regexp::ParseFlags>(
+      options_.ParseFlags());
+    re2::Regexp* re = re2::Regexp::Alternate(sub.data(), size_, pf);
+
+    prog_.reset(Prog::CompileSet(re, anchor_, options_.max_mem()));
+    re->Decref();
+  }
+  arena_.reset();
+  if (prog_ == nullptr)
+    return false;
+  prog_->set_dfa_per_thread(options_.per_thread_dfa());
+  search_counters_.reset(new SearchCounters);
+  prog_->set_search_counters(search_counters_.get());
+  return true;
+}
+
+void RE2::Set::CompilePrefilter(re2::Regexp** sub, int nsub) {
+  std::vector<std::string> literals;
+  bool foldcase = false;
+  bool looks_behind = false;
+  int reach = 0;
+  RequiredLiteralsWalker w;
+  for (int i = 0; i < nsub; i++) {
+    LiteralInfo info = w.Walk(sub[i], LiteralInfo());
+    if (w.stopped_early() || !info.required)
+      return;
+    looks_behind |= info.looks_behind;
+    for (RequiredLiteral& lit : info.literals) {
+      if (lit.bytes.size() > kMaxLiteralSize)
+        lit.bytes.resize(kMaxLiteralSize);
+      foldcase |= lit.foldcase;
+      if (reach >= 0 && lit.lead >= 0)
+        reach = std::max(reach,
+                         lit.lead + static_cast<int>(lit.bytes.size()));
+      else
+        reach = -1;
+      literals.push_back(std::move(lit.bytes));
+    }
+  }
+  std::sort(literals.begin(), literals.end());
+  literals.erase(std::unique(literals.begin(), literals.end()),
+                 literals.end());
+
+  prefilter_.reset(
+      new AhoCorasick(literals, foldcase, options_.max_mem() / 4));
+  if (!prefilter_->ok()) {
+    prefilter_.reset();
+    return;
+  }
+  // Skipping ahead would hide the context that ^, \A, \b and \B need.
+  if (anchor_ == RE2::UNANCHORED && !looks_behind)
+    prefilter_reach_ = reach;
+}
+
+re2::Regexp* RE2::Set::ReverseRegexp() const {
+  // Running backward, each regexp's HaveMatch would match before the rest
+  // of the regexp, so the reverse regexps begin with it instead.  (That
+  // also stops Alternate() from factoring them apart.)
+  if (reverse_elem_.empty())
+    return NULL;
   Regexp::ParseFlags pf = static_cast<Regexp::ParseFlags>(
     options_.ParseFlags());
-  re2::Regexp* re = re2::Regexp::Alternate(sub.data(), size_, pf);
+  int nsub = static_cast<int>(reverse_elem_.size());
+  PODArray<re2::Regexp*> rsub(nsub);
+  for (int i = 0; i < nsub; i++) {
+    re2::Regexp* re = Regexp::Parse(reverse_elem_[i].first, pf, NULL);
+    if (re == NULL) {
+      for (int j = 0; j < i; j++)
+        rsub[j]->Decref();
+      return NULL;
+    }
+    int id = reverse_elem_[i].second;
+    if (re->op() == kRegexpConcat) {
+      int n = re->nsub();
+      PODArray<re2::Regexp*> sub(n + 1);
+      sub[0] = re2::Regexp::HaveMatch(id, pf);
+      for (int j = 0; j < n; j++)
+        sub[j+1] = re->sub()[j]->Incref();
+      re->Decref();
+      rsub[i] = re2::Regexp::Concat(sub.data(), n + 1, pf);
+    } else {
+      re2::Regexp* sub[2];
+      sub[0] = re2::Regexp::HaveMatch(id, pf);
+      sub[1] = re;
+      rsub[i] = re2::Regexp::Concat(sub, 2, pf);
+    }
+  }
+  return re2::Regexp::Alternate(rsub.data(), nsub, pf);
+}
 
-  prog_.reset(Prog::CompileSet(re, anchor_, options_.max_mem()));
-  re->Decref();
-  return prog_ != nullptr;
+re2::Prog* RE2::Set::ReverseProg() const {
+  absl::call_once(*reverse_once_, [](const RE2::Set* set) {
+    re2::Regexp* re = set->ReverseRegexp();
+    if (re == NULL)
+      return;
+    set->reverse_prog_.reset(Prog::CompileReverseSet(
+        re, set->options_.max_mem()));
+    re->Decref();
+    if (set->reverse_prog_ == nullptr) {
+      if (set->options_.log_errors())
+        ABSL_LOG(ERROR) << "Error reverse compiling set";
+    } else {
+      set->reverse_prog_->set_dfa_per_thread(set->options_.per_thread_dfa());
+      set->reverse_prog_->set_search_counters(set->search_counters_.get());
+    }
+  }, this);
+  return reverse_prog_.get();
 }
 
 bool RE2::Set::Match(absl::string_view text, std::vector<int>* v) const {
@@ -151,6 +538,19 @@ bool RE2::Set::Match(absl::string_view text, std::vector<int>* v,
     matches.reset(new SparseSet(size_));
     v->clear();
   }
+  if (prefilter_ != NULL) {
+    const char* p = prefilter_->FindFirst(text);
+    if (p == NULL) {
+      if (error_info != NULL)
+        error_info->kind = kNoError;
+      return false;
+    }
+    // No match can start more than prefilter_reach_ bytes before the end
+    // of the first occurrence of a literal. (Any match contains one.)
+    if (prefilter_reach_ >= 0 &&
+        p - text.data() > static_cast<ptrdiff_t>(prefilter_reach_))
+      text.remove_prefix(p - text.data() - prefilter_reach_);
+  }
   bool ret = prog_->SearchDFA(text, text, Prog::kAnchored, Prog::kManyMatch,
                               NULL, &dfa_failed, matches.get());
   if (dfa_failed) {
@@ -182,4 +582,228 @@ bool RE2::Set::Match(absl::string_view text, std::vector<int>* v,
   return true;
 }
 
+int RE2::Set::MatchBatch(absl::Span<const absl::string_view> texts,
+                         std::vector<bool>* matched,
+                         std::vector<std::vector<int>>* v,
+                         ErrorInfo* error_info) const {
+  matched->assign(texts.size(), false);
+  if (v != NULL) {
+    v->resize(texts.size());
+    for (std::vector<int>& ids : *v)
+      ids.clear();
+  }
+  if (!compiled_) {
+    if (error_info != NULL)
+      error_info->kind = kNotCompiled;
+    ABSL_LOG(DFATAL) << "RE2::Set::MatchBatch() called before compiling";
+    return 0;
+  }
+#ifdef RE2_HAVE_THREAD_LOCAL
+  hooks::context = NULL;
+#endif
+  // As in Match(), the prefilter rules out some of the texts and says
+  // where to start searching the rest.
+  std::vector<absl::string_view> subtexts;
+  std::vector<size_t> index;
+  subtexts.reserve(texts.size());
+  index.reserve(texts.size());
+  for (size_t i = 0; i < texts.size(); i++) {
+    absl::string_view text = texts[i];
+    if (prefilter_ != NULL) {
+      const char* p = prefilter_->FindFirst(text);
+      if (p == NULL)
+        continue;
+      if (prefilter_reach_ >= 0 &&
+          p - text.data() > static_cast<ptrdiff_t>(prefilter_reach_))
+        text.remove_prefix(p - text.data() - prefilter_reach_);
+    }
+    subtexts.push_back(text);
+    index.push_back(i);
+  }
+
+  std::vector<int> results;
+  std::vector<std::vector<int>> ids;
+  prog_->SearchDFABatch(subtexts, {}, Prog::kAnchored, Prog::kManyMatch,
+                        &results, v != NULL ? &ids : NULL);
+  ErrorKind kind = kNoError;
+  int n = 0;
+  for (size_t j = 0; j < subtexts.size(); j++) {
+    if (results[j] < 0) {
+      kind = kOutOfMemory;
+      continue;
+    }
+    if (results[j] == 0)
+      continue;
+    if (v != NULL) {
+      if (ids[j].empty()) {
+        kind = kInconsistent;
+        ABSL_LOG(DFATAL)
+            << "RE2::Set::MatchBatch() matched, but no matches returned";
+        continue;
+      }
+      (*v)[index[j]].swap(ids[j]);
+    }
+    (*matched)[index[j]] = true;
+    n++;
+  }
+  if (kind == kOutOfMemory && options_.log_errors())
+    ABSL_LOG(ERROR) << "DFA out of memory: "
+                    << "program size " << prog_->size() << ", "
+                    << "list count " << prog_->list_count() << ", "
+                    << "bytemap range " << prog_->bytemap_range();
+  if (error_info != NULL)
+    error_info->kind = kind;
+  return n;
+}
+
+void RE2::Set::GetSearchStats(RE2::SearchStats* stats) const {
+  *stats = RE2::SearchStats();
+  if (search_counters_ != NULL)
+    search_counters_->Get(stats);
+}
+
+int RE2::Set::Warmup(absl::Span<const absl::string_view> samples) const {
+  if (!compiled_) {
+    ABSL_LOG(DFATAL) << "RE2::Set::Warmup() called before compiling";
+    return 0;
+  }
+  return prog_->WarmupDFA(samples, {}, Prog::kAnchored, Prog::kManyMatch);
+}
+
+int RE2::Set::Warmup(int max_states) const {
+  if (!compiled_) {
+    ABSL_LOG(DFATAL) << "RE2::Set::Warmup() called before compiling";
+    return 0;
+  }
+  return prog_->WarmupDFA(max_states, Prog::kAnchored, Prog::kManyMatch);
+}
+
+bool RE2::Set::MatchPositions(absl::string_view text, bool want_begin,
+                              std::vector<MatchPosition>* positions,
+                              ErrorInfo* error_info) const {
+  positions->clear();
+  if (!compiled_) {
+    if (error_info != NULL)
+      error_info->kind = kNotCompiled;
+    ABSL_LOG(DFATAL) << "RE2::Set::MatchPositions() called before compiling";
+    return false;
+  }
+#ifdef RE2_HAVE_THREAD_LOCAL
+  hooks::context = NULL;
+#endif
+  // As in Match(), the prefilter can rule out the text or say where
+  // to start searching it.  Offsets are still relative to text.
+  absl::string_view subtext = text;
+  if (prefilter_ != NULL) {
+    const char* p = prefilter_->FindFirst(subtext);
+    if (p == NULL) {
+      if (error_info != NULL)
+        error_info->kind = kNoError;
+      return false;
+    }
+    if (prefilter_reach_ >= 0 &&
+        p - subtext.data() > static_cast<ptrdiff_t>(prefilter_reach_))
+      subtext.remove_prefix(p - subtext.data() - prefilter_reach_);
+  }
+
+  // One allocation holds the ends and, if needed, the begins of the
+  // matches and the distinct ends to run backward from.
+  bool dfa_failed = false;
+  SparseSet matches(size_);
+  PODArray<const char*> scratch(3*size_);
+  const char** ends = scratch.data();
+  const char** begins = NULL;
+  memset(ends, 0, size_*sizeof ends[0]);
+  bool ret = prog_->SearchDFAPositions(subtext, subtext, Prog::kAnchored,
+                                       anchor_ == RE2::ANCHOR_START,
+                                       &dfa_failed, &matches, ends);
+  if (dfa_failed) {
+    if (options_.log_errors())
+      ABSL_LOG(ERROR) << "DFA out of memory: "
+                      << "program size " << prog_->size() << ", "
+                      << "list count " << prog_->list_count() << ", "
+                      << "bytemap range " << prog_->bytemap_range();
+    if (error_info != NULL)
+      error_info->kind = kOutOfMemory;
+    return false;
+  }
+  if (ret == false) {
+    if (error_info != NULL)
+      error_info->kind = kNoError;
+    return false;
+  }
+  if (matches.empty()) {
+    if (error_info != NULL)
+      error_info->kind = kInconsistent;
+    ABSL_LOG(DFATAL)
+        << "RE2::Set::MatchPositions() matched, but no matches returned";
+    return false;
+  }
+
+  re2::Prog* rprog = NULL;
+  if (anchor_ == RE2::UNANCHORED && want_begin)
+    rprog = ReverseProg();
+  if (rprog != NULL) {
+    // A backward pass from the end of some matches finds where they begin:
+    // the last position that it records for an index is the leftmost.
+    // Matches that end elsewhere need passes of their own.  No match of an
+    // index ends before its end, so running the passes from the rightmost
+    // end leftward leaves the right begin for each index.
+    const char** distinct = ends + 2*size_;
+    int ndistinct = 0;
+    for (int id : matches)
+      distinct[ndistinct++] = ends[id];
+    std::sort(distinct, distinct + ndistinct, std::greater<const char*>());
+    ndistinct = static_cast<int>(
+        std::unique(distinct, distinct + ndistinct) - distinct);
+    begins = ends + size_;
+    memset(begins, 0, size_*sizeof begins[0]);
+    for (int i = 0; i < ndistinct; i++) {
+      const char* end = distinct[i];
+      matches.clear();
+      absl::string_view prefix(subtext.data(),
+                               static_cast<size_t>(end - subtext.data()));
+      rprog->SearchDFAPositions(prefix, subtext, Prog::kAnchored, true,
+                                &dfa_failed, &matches, begins);
+      if (dfa_failed) {
+        if (options_.log_errors())
+          ABSL_LOG(ERROR) << "DFA out of memory: "
+                          << "program size " << rprog->size() << ", "
+                          << "list count " << rprog->list_count() << ", "
+                          << "bytemap range " << rprog->bytemap_range();
+        if (error_info != NULL)
+          error_info->kind = kOutOfMemory;
+        return false;
+      }
+    }
+  }
+
+  // The ends say which indices matched, so scanning them in order yields
+  // the positions sorted by index.
+  for (int id = 0; id < size_; id++) {
+    if (ends[id] == NULL)
+      continue;
+    size_t begin = 0;
+    if (anchor_ == RE2::UNANCHORED) {
+      if (begins == NULL) {
+        begin = npos;
+      } else if (begins[id] != NULL) {
+        begin = static_cast<size_t>(begins[id] - text.data());
+      } else {
+        positions->clear();
+        if (error_info != NULL)
+          error_info->kind = kInconsistent;
+        ABSL_LOG(DFATAL)
+            << "RE2::Set::MatchPositions() matched, but found no start";
+        return false;
+      }
+    }
+    positions->push_back(
+        {id, begin, static_cast<size_t>(ends[id] - text.data())});
+  }
+  if (error_info != NULL)
+    error_info->kind = kNoError;
+  return true;
+}
+
 }  // namespace re2
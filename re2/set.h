@@ -5,17 +5,24 @@
 #ifndef RE2_SET_H_
 #define RE2_SET_H_
 
+#include <stddef.h>
+
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "re2/re2.h"
 
 namespace re2 {
+class AhoCorasick;
 class Prog;
 class Regexp;
+class RegexpArena;
+class SearchCounters;
 }  // namespace re2
 
 namespace re2 {
@@ -35,6 +42,15 @@ class RE2::Set {
     ErrorKind kind;
   };
 
+  // Where in the text one of the regexps in the set matched.
+  struct MatchPosition {
+    int index;     // the index of the regexp, as returned by Add()
+    size_t begin;  // offset of the start of the match, or npos if not known
+    size_t end;    // offset of the end of the match
+  };
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
   Set(const RE2::Options& options, RE2::Anchor anchor);
   ~Set();
 
@@ -59,6 +75,13 @@ class RE2::Set {
 
   // Compiles the set in preparation for matching.
   // Returns false if the compiler runs out of memory.
+  //
+  // If every regexp in the set requires some literal string, Compile()
+  // also builds a prefilter that looks for those literals: Match() then
+  // returns false without running the DFA if none of them occurs in the
+  // text. If, in addition, the set is unanchored and it can bound how far
+  // before a literal a match can start, Match() starts the DFA there.
+  // The prefilter uses up to a quarter of max_mem on top of the DFA.
   // Add() must not be called again after Compile().
   // Compile() must be called before Match().
   bool Compile();
@@ -75,15 +98,82 @@ class RE2::Set {
   bool Match(absl::string_view text, std::vector<int>* v,
              ErrorInfo* error_info) const;
 
+  // Like Match() for each of texts, but much faster for a large batch of
+  // short texts, since the DFA cache is locked just once for the batch.
+  // Sets (*matched)[i] to whether texts[i] matches at least one of the
+  // regexps and, if v is not NULL, (*v)[i] to the indices of those that
+  // it matches.  Returns the number of texts that matched.
+  // If error_info is not NULL, sets it to kOutOfMemory if the DFA ran out
+  // of memory (in which case the texts it was searching count as not
+  // matching), and to kNoError otherwise.
+  int MatchBatch(absl::Span<const absl::string_view> texts,
+                 std::vector<bool>* matched,
+                 std::vector<std::vector<int>>* v,
+                 ErrorInfo* error_info) const;
+
+  // Like RE2::Warmup(): builds ahead of time the DFA states that Match()
+  // would build as it searches, either by running the DFA over each of
+  // samples or by building about max_states states breadth-first from its
+  // start state.  Returns the number of DFA states built.  The reverse
+  // DFA that MatchPositions() may use is not built.
+  // Compile() must be called before Warmup().
+  int Warmup(absl::Span<const absl::string_view> samples) const;
+  int Warmup(int max_states) const;
+
+  // Like RE2::GetSearchStats(): reads the counters of the work done in
+  // searching with this set.
+  void GetSearchStats(RE2::SearchStats* stats) const;
+
+  // Like Match(), but fills positions with where each of the matching
+  // regexps matched, sorted by index.  The DFA sees only where matches end,
+  // so which match is reported depends on the anchor of the set:
+  //   UNANCHORED:   the match that ends first.  begin is npos unless
+  //                 want_begin, in which case a second pass runs backward
+  //                 from end to find the leftmost start of a match that
+  //                 ends there.  The reverse Prog for this is compiled on
+  //                 first use, with up to max_mem of its own; if that
+  //                 fails, begin is npos after all.
+  //   ANCHOR_START: the longest match.  begin is 0.
+  //   ANCHOR_BOTH:  the whole text.  begin is 0.
+  // Offsets are in bytes from the start of text.
+  bool MatchPositions(absl::string_view text, bool want_begin,
+                      std::vector<MatchPosition>* positions,
+                      ErrorInfo* error_info) const;
+
  private:
   typedef std::pair<std::string, re2::Regexp*> Elem;
 
+  // Builds prefilter_ for the regexps in sub, if possible.
+  void CompilePrefilter(re2::Regexp** sub, int nsub);
+
+  // Returns the regexp from which ReverseProg() compiles reverse_prog_,
+  // or NULL if there is none.
+  re2::Regexp* ReverseRegexp() const;
+
+  // Returns the reverse Prog, compiling it on first use,
+  // or NULL if there is none.
+  re2::Prog* ReverseProg() const;
+
   RE2::Options options_;
   RE2::Anchor anchor_;
+  // Holds the regexps in elem_ until Compile() is done with them.
+  std::unique_ptr<re2::RegexpArena> arena_;
   std::vector<Elem> elem_;
   bool compiled_;
   int size_;
+  // Counters for prog_ and reverse_prog_, declared first to outlive them.
+  std::unique_ptr<re2::SearchCounters> search_counters_;
   std::unique_ptr<re2::Prog> prog_;
+  std::unique_ptr<re2::AhoCorasick> prefilter_;
+  // How far before the end of a literal a match can start,
+  // or -1 if Match() must start the DFA at the start of the text.
+  int prefilter_reach_;
+  // For an unanchored set, the patterns with their match indices, from
+  // which MatchPositions() compiles reverse_prog_ when it first needs it.
+  std::vector<std::pair<std::string, int>> reverse_elem_;
+  mutable std::unique_ptr<re2::Prog> reverse_prog_;
+  // Heap-allocated to keep the Set movable.
+  mutable std::unique_ptr<absl::once_flag> reverse_once_;
 };
 
 }  // namespace re2
@@ -0,0 +1,113 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_SHARDED_READER_MUTEX_H_
+#define RE2_SHARDED_READER_MUTEX_H_
+
+#include <atomic>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "re2/prog.h"
+
+namespace re2 {
+
+// A reader-writer mutex for the DFA state cache.
+//
+// Every search acquires the cache mutex for reading, so with absl::Mutex
+// all searching threads hammer on the same cache line, which limits the
+// scaling of a shared RE2 on many cores.  Here, readers instead increment
+// a counter in one of several shards, each on its own cache line, picked
+// by Prog::ThreadShardIndex().  Writers (which flush the cache and so are
+// rare) announce themselves by setting writer_ and then sleep until all
+// of the counters drain: a reader that empties a shard while writer_ is
+// set wakes the writer to look again.  Readers that see writer_ set back
+// off and block on writer_mu_, which the writer holds, so writers are
+// never starved.
+//
+// Readers and writers both use sequentially consistent operations on
+// a counter and then on writer_ (or vice versa), so at least one of a
+// concurrent reader and writer is guaranteed to see the other.
+class ABSL_LOCKABLE ShardedReaderMutex {
+ public:
+  ShardedReaderMutex() : writer_(false) {}
+
+  void ReaderLock() ABSL_SHARED_LOCK_FUNCTION()
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    std::atomic<int>* readers =
+        &shards_[Prog::ThreadShardIndex() % kShards].readers;
+    for (;;) {
+      readers->fetch_add(1, std::memory_order_seq_cst);
+      if (!writer_.load(std::memory_order_seq_cst))
+        return;
+      // A writer is active or waiting: get out of its way and then
+      // wait for it to finish before trying again.
+      Release(readers);
+      writer_mu_.Lock();
+      writer_mu_.Unlock();
+    }
+  }
+
+  void ReaderUnlock() ABSL_UNLOCK_FUNCTION()
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    Release(&shards_[Prog::ThreadShardIndex() % kShards].readers);
+  }
+
+  void WriterLock() ABSL_EXCLUSIVE_LOCK_FUNCTION()
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    writer_mu_.Lock();
+    writer_.store(true, std::memory_order_seq_cst);
+    absl::MutexLock l(drain_mu_);
+    while (!Drained())
+      drained_.Wait(&drain_mu_);
+  }
+
+  void WriterUnlock() ABSL_UNLOCK_FUNCTION()
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    writer_.store(false, std::memory_order_seq_cst);
+    writer_mu_.Unlock();
+  }
+
+ private:
+  // Enough shards to spread out the readers on typical hardware
+  // without making each DFA much bigger.
+  static constexpr int kShards = 16;
+
+  struct alignas(64) Shard {
+    std::atomic<int> readers{0};
+  };
+
+  // Drops a reader from *readers, waking the writer if it is waiting
+  // and that was the last reader in the shard.  The writer checks the
+  // counters while holding drain_mu_, so signalling under drain_mu_
+  // cannot slip in between its check and its wait.
+  void Release(std::atomic<int>* readers) {
+    if (readers->fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+        writer_.load(std::memory_order_seq_cst)) {
+      absl::MutexLock l(drain_mu_);
+      drained_.Signal();
+    }
+  }
+
+  bool Drained() const {
+    for (const Shard& shard : shards_) {
+      if (shard.readers.load(std::memory_order_seq_cst) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  Shard shards_[kShards];
+  std::atomic<bool> writer_;
+  absl::Mutex writer_mu_;  // held by the writer, if any
+  absl::Mutex drain_mu_;   // guards the writer's wait for the readers
+  absl::CondVar drained_;  // signalled when a shard drains under a writer
+
+  ShardedReaderMutex(const ShardedReaderMutex&) = delete;
+  ShardedReaderMutex& operator=(const ShardedReaderMutex&) = delete;
+};
+
+}  // namespace re2
+
+#endif  // RE2_SHARDED_READER_MUTEX_H_
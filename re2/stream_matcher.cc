@@ -0,0 +1,69 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/stream_matcher.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/regexp.h"
+
+namespace re2 {
+
+RE2::StreamMatcher::StreamMatcher(const RE2& re)
+    : prog_(NULL),
+      own_prog_(NULL),
+      stream_(NULL),
+      offset_(0) {
+  if (!re.ok())
+    return;
+  if (re.prefix_.empty()) {
+    prog_ = re.prog_;
+  } else {
+    // RE2 compiled only the part of the regexp after the required prefix,
+    // which it matches separately, so compile the entire regexp here.
+    own_prog_ = re.Regexp()->CompileToProg(re.options().max_mem()*2/3);
+    if (own_prog_ == NULL)
+      return;
+    prog_ = own_prog_;
+  }
+  stream_ = Prog::NewDFAStream();
+}
+
+RE2::StreamMatcher::~StreamMatcher() {
+  Prog::DeleteDFAStream(stream_);
+  delete own_prog_;
+}
+
+bool RE2::StreamMatcher::Write(absl::string_view chunk,
+                               std::vector<int64_t>* ends) {
+  if (stream_ == NULL) {
+    ends->clear();
+    return false;
+  }
+  offset_ += chunk.size();
+  return prog_->SearchDFAStream(stream_, chunk, false, ends);
+}
+
+bool RE2::StreamMatcher::Finish(std::vector<int64_t>* ends) {
+  if (stream_ == NULL) {
+    ends->clear();
+    return false;
+  }
+  return prog_->SearchDFAStream(stream_, absl::string_view(), true, ends);
+}
+
+void RE2::StreamMatcher::Reset() {
+  if (stream_ == NULL)
+    return;
+  Prog::DeleteDFAStream(stream_);
+  stream_ = Prog::NewDFAStream();
+  offset_ = 0;
+}
+
+}  // namespace re2
@@ -0,0 +1,82 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef RE2_STREAM_MATCHER_H_
+#define RE2_STREAM_MATCHER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+class Prog;
+struct DFAStream;
+
+// An RE2::StreamMatcher searches a text that arrives in chunks, such as
+// data read from a network connection or a file too large to hold in
+// memory, without having to buffer it.  It runs the regexp's DFA over
+// each chunk as it is written and carries the DFA state over to the next
+// one, so a match can span any number of chunks, and empty-width
+// assertions such as \b and $ see the bytes on both sides of a chunk
+// boundary, just as they would if the text were searched all at once.
+//
+// The matcher reports where matches end, as offsets from the start of
+// the stream; like the DFA, it cannot tell where they begin.  It reports
+// the end of the match that ends first, then starts over where that match
+// ended and reports the end of the match that ends first from there, and
+// so on.  If it finds an empty match where the last match ended, it starts
+// over one byte later instead.  For example, matching "a+" against "aaa"
+// reports 1, 2 and 3.
+//
+// Any number of StreamMatchers can search with the same RE2 at once,
+// sharing its DFA states.  A StreamMatcher itself is not safe for
+// concurrent use, but it can be passed from one thread to another.
+class RE2::StreamMatcher {
+ public:
+  // re must remain valid for the lifetime of the StreamMatcher.
+  explicit StreamMatcher(const RE2& re);
+  ~StreamMatcher();
+
+  // Not copyable.
+  StreamMatcher(const StreamMatcher&) = delete;
+  StreamMatcher& operator=(const StreamMatcher&) = delete;
+
+  // Returns whether the matcher can search: whether re is ok.
+  bool ok() const { return stream_ != NULL; }
+
+  // Searches chunk, the next part of the stream, and sets *ends to the
+  // offsets at which the matches found end, in increasing order.
+  // A match that ends at the end of a chunk is not reported until the
+  // next call, because whether it matches can depend on the next byte.
+  // Returns false if the search failed because the DFA could not be
+  // built within re.options().max_mem(); unlike RE2::Match(), which
+  // would fall back to a slower engine, the stream cannot go on.
+  bool Write(absl::string_view chunk, std::vector<int64_t>* ends);
+
+  // Ends the stream, setting *ends to the end of the stream if a match
+  // ends there that Write() could not report.  Returns false if the
+  // search failed.  After Finish(), call Reset() to search a new stream.
+  bool Finish(std::vector<int64_t>* ends);
+
+  // Discards the state of the stream, so that the matcher can search a
+  // new one, starting at offset 0.
+  void Reset();
+
+  // Returns the number of bytes written since the stream began.
+  int64_t offset() const { return offset_; }
+
+ private:
+  Prog* prog_;         // the program to run
+  Prog* own_prog_;     // prog_, if it does not belong to re
+  DFAStream* stream_;  // the state of the search
+  int64_t offset_;     // bytes written so far
+};
+
+}  // namespace re2
+
+#endif  // RE2_STREAM_MATCHER_H_
@@ -0,0 +1,678 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tested by search_test.cc, exhaustive_test.cc, tester.cc.
+//
+// Prog::SearchTaggedDFA is a lazily built tagged DFA, in the style of
+// Laurikari's TDFA, for the second half of a search for submatches:
+// once the DFA has found where a match begins and ends, it runs an
+// anchored, full match over that text with one table lookup per byte,
+// keeping the capture positions in registers rather than in the states.
+//
+// A state is the list of threads that the NFA would have after reading
+// the same bytes, in priority order.  Without empty-width assertions,
+// that list does not depend on where in the text the bytes are, so the
+// transitions can be cached as the DFA does.  The registers are kept in
+// rows, one register per capture slot (other than the two for the whole
+// match, which the caller knows already), and the state also says which
+// row each thread uses: threads that got to where they are by the same
+// path through the captures share a row.  A transition carries the
+// operations that turn the rows of the old state into the rows of the
+// new one: copy each row from the row that its threads came from, then
+// set the slots of the captures that they passed to the current position.
+// At the end of the text, the first thread in the list that is at a Match
+// wins, which is what the NFA would find for a full match.  Until then,
+// the rows of the threads at a Match are not needed, so the transitions
+// skip them; and since rows are numbered in order of their first thread,
+// the other rows mostly stay where they are, so a typical transition in
+// the middle of a long match has nothing to do at all.
+//
+// The states and transitions live in a cache with a fixed memory budget,
+// which is taken from the DFA budget when the RE2 is built, as the
+// one-pass tables are.  When the cache fills, it is reset; if that
+// happens too often, the search fails and the caller uses the NFA.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/hash/hash.h"
+#include "absl/log/absl_check.h"
+#include "absl/log/absl_log.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "re2/pod_array.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/rw_locker.h"
+#include "re2/sparse_set.h"
+
+namespace re2 {
+
+class TaggedDFA {
+ public:
+  TaggedDFA(Prog* prog, int64_t max_mem);
+  ~TaggedDFA();
+
+  bool ok() const { return !init_failed_; }
+
+  // Searches for a full match of text, filling in match[0..nmatch).
+  // Sets *failed if the cache had to be reset too often.
+  bool Search(absl::string_view text, absl::string_view* match, int nmatch,
+              bool* failed);
+
+  // Returns the number of capture slots that a row needs for the Prog,
+  // or 0 if it has no capturing groups.
+  static int NumTags(Prog* prog);
+
+  // Returns the least memory with which a TaggedDFA can be useful.
+  static int64_t MinMemory(Prog* prog);
+
+ private:
+  struct Transition;
+
+  struct State {
+    int* inst_;    // ninst_ ByteRange and Match instructions, in priority
+                   // order, followed by the row of each of them
+    int ninst_;    // # of threads
+    int nrows_;    // # of rows that the threads use
+    std::atomic<Transition*> next_[];  // one per input byte class
+  };
+
+  // The operations are pairs: (dst row, src row) to copy a row,
+  // or (register, -1) to set a register to the current position.
+  // The first nlive_ are for the rows of the threads that can read
+  // another byte; the nall_ after them are for the rows of all threads,
+  // for at the end of the text.
+  struct Transition {
+    State* next_;  // state after the byte
+    int nrows_;    // # of rows that the operations use
+    int nlive_;    // # of operations for the rows of ByteRange threads
+    int nall_;     // # of operations for the rows of all threads
+    int ops_[];
+  };
+
+  struct StateHash {
+    size_t operator()(const State* a) const {
+      ABSL_DCHECK(a != NULL);
+      return absl::Hash<absl::Span<const int>>()(
+          absl::MakeConstSpan(a->inst_, 2*a->ninst_));
+    }
+  };
+
+  struct StateEqual {
+    bool operator()(const State* a, const State* b) const {
+      ABSL_DCHECK(a != NULL);
+      ABSL_DCHECK(b != NULL);
+      return a == b ||
+             (a->ninst_ == b->ninst_ &&
+              memcmp(a->inst_, b->inst_,
+                     2*a->ninst_*sizeof a->inst_[0]) == 0);
+    }
+  };
+
+  typedef absl::flat_hash_set<State*, StateHash, StateEqual> StateSet;
+
+  // An entry on the stack of AddToList: an instruction to visit,
+  // or, if id is 0, the length to which to cut the tags back.
+  struct AddState {
+    int id;
+    int ntags;
+  };
+
+  using RWLocker = re2::RWLocker<absl::Mutex>;
+
+  // Appends the threads reached from id to list_, giving them rows
+  // that take their registers from row src (or -1 for none).
+  void AddToList(int id, int src) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the transition out of s on byte c (or out of the start
+  // state if s is NULL), building it if need be.
+  // Returns NULL if the cache is out of memory.
+  Transition* GetTransition(State* s, int c);
+
+  // Makes a transition from a state with nrows rows to the state for
+  // list_, with the operations for the rows in rowsrc_ and rowtags_,
+  // and charges it against the budget.
+  // Returns NULL if the cache is out of memory.
+  Transition* NewTransition(int nrows) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Appends to ops_ the operations for the new rows, or only for those
+  // in live_ if all is false, using rows from *spare on as scratch.
+  // Returns the number of operations.
+  int AppendOps(bool all, int* spare) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Looks up the state with the given threads and rows in the cache,
+  // adding it if need be.  Returns NULL if the cache is out of memory.
+  State* CachedState(const int* inst, int ninst)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Frees all of the states and transitions.
+  void ClearCache() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Resets the cache, taking cache_mutex_ for writing.
+  void ResetCache(RWLocker* cache_lock);
+
+  Prog* prog_;
+  int ntags_;           // # of registers in a row
+  int nnext_;           // # of transitions out of a state
+  bool init_failed_;    // initialization failed (out of memory)
+
+  absl::Mutex mutex_;   // mutex_ >= cache_mutex_.r
+
+  // Scratch space for building transitions, protected by mutex_.
+  SparseSet visited_;            // instructions visited by AddToList
+  std::vector<AddState> stk_;    // stack for AddToList
+  std::vector<int> tags_;        // tags set on the way to stk_.back()
+  std::vector<int> sorted_;      // tags_, sorted and without duplicates
+  std::vector<int> list_;        // threads of the new state, then rows
+  std::vector<int> rows_;        // row of each thread of the new state
+  std::vector<int> rowsrc_;      // row that each new row comes from
+  std::vector<int> rowtags_;     // tags that each new row sets ...
+  std::vector<int> rowtagpos_;   // ... from rowtags_[rowtagpos_[row]]
+  std::vector<bool> live_;       // whether each new row has a ByteRange
+  std::vector<int> moves_;       // (dst row, src row) pairs left to copy
+  std::vector<int> readers_;     // # of moves_ that read each row
+  std::vector<int> ops_;         // operations of the new transition
+
+  int64_t mem_budget_ ABSL_GUARDED_BY(mutex_);  // memory left for the cache
+  int64_t state_budget_;         // memory for the cache when it is empty
+  StateSet state_cache_ ABSL_GUARDED_BY(mutex_);
+  std::atomic<Transition*> start_;  // into the start state, or NULL
+
+  // Held for reading by searches and for writing by ResetCache.
+  absl::Mutex cache_mutex_;
+
+  TaggedDFA(const TaggedDFA&) = delete;
+  TaggedDFA& operator=(const TaggedDFA&) = delete;
+};
+
+// Approximate cost of a State in the hash set, beyond its own memory.
+static const int kStateCacheOverhead = 18;
+
+// As in the DFA, if the search resets the cache and then fills it again
+// within 10 bytes per state, the NFA would be faster.
+static const int kMinBytesPerState = 10;
+
+int TaggedDFA::NumTags(Prog* prog) {
+  int ncap = 0;
+  for (int id = 0; id < prog->size(); id++) {
+    Prog::Inst* ip = prog->inst(id);
+    if (ip->opcode() == kInstCapture)
+      ncap = std::max(ncap, ip->cap() + 1);
+  }
+  // The slots for the whole match are not tags.
+  return std::max(ncap - 2, 0);
+}
+
+int64_t TaggedDFA::MinMemory(Prog* prog) {
+  // Room for 20 states as big as they can be, as the DFA asks.
+  int64_t one_state = sizeof(State) +
+                      prog->bytemap_range()*sizeof(Transition*) +
+                      2*(prog->inst_count(kInstByteRange) +
+                         prog->inst_count(kInstMatch))*sizeof(int) +
+                      kStateCacheOverhead;
+  return sizeof(TaggedDFA) + 3*prog->size()*sizeof(int) + 20*one_state;
+}
+
+TaggedDFA::TaggedDFA(Prog* prog, int64_t max_mem)
+    : prog_(prog),
+      ntags_(NumTags(prog)),
+      nnext_(prog->bytemap_range()),
+      init_failed_(false),
+      visited_(prog->size()),
+      mem_budget_(max_mem),
+      state_budget_(0),
+      start_(NULL) {
+  if (ntags_ == 0 || max_mem < MinMemory(prog)) {
+    init_failed_ = true;
+    return;
+  }
+  // Account for the space used by visited_ and the other scratch space.
+  mem_budget_ -= sizeof(TaggedDFA) + 3*prog_->size()*sizeof(int);
+  state_budget_ = mem_budget_;
+}
+
+TaggedDFA::~TaggedDFA() {
+  absl::MutexLock l(mutex_);
+  ClearCache();
+}
+
+void TaggedDFA::ClearCache() {
+  Transition* t = start_.load(std::memory_order_relaxed);
+  delete[] reinterpret_cast<char*>(t);
+  start_.store(NULL, std::memory_order_relaxed);
+  for (State* s : state_cache_) {
+    for (int i = 0; i < nnext_; i++) {
+      t = s->next_[i].load(std::memory_order_relaxed);
+      delete[] reinterpret_cast<char*>(t);
+    }
+    delete[] reinterpret_cast<char*>(s);
+  }
+  state_cache_.clear();
+  mem_budget_ = state_budget_;
+}
+
+void TaggedDFA::AddToList(int id0, int src) {
+  stk_.clear();
+  tags_.clear();
+  stk_.push_back({id0, 0});
+  while (!stk_.empty()) {
+    AddState a = stk_.back();
+    stk_.pop_back();
+    if (a.id == 0) {
+      // Cut back the tags that the last Capture added.
+      tags_.resize(a.ntags);
+      continue;
+    }
+
+  Loop:
+    // Each instruction is visited at most once, by its highest priority
+    // path, as in the NFA.
+    if (a.id == 0 || visited_.contains(a.id))
+      continue;
+    visited_.insert_new(a.id);
+
+    Prog::Inst* ip = prog_->inst(a.id);
+    switch (ip->opcode()) {
+      default:
+        ABSL_LOG(DFATAL) << "unhandled " << ip->opcode() << " in AddToList";
+        break;
+
+      case kInstByteRange:
+      case kInstMatch: {
+        // A new thread.  It shares a row with the earlier threads that
+        // came from the same row and set the same tags, if any.
+        sorted_.assign(tags_.begin(), tags_.end());
+        std::sort(sorted_.begin(), sorted_.end());
+        sorted_.erase(std::unique(sorted_.begin(), sorted_.end()),
+                      sorted_.end());
+        int nrows = static_cast<int>(rowsrc_.size());
+        int row = 0;
+        for (; row < nrows; row++) {
+          if (rowsrc_[row] == src &&
+              std::equal(sorted_.begin(), sorted_.end(),
+                         rowtags_.begin() + rowtagpos_[row],
+                         rowtags_.begin() + rowtagpos_[row+1]))
+            break;
+        }
+        if (row == nrows) {
+          rowsrc_.push_back(src);
+          rowtags_.insert(rowtags_.end(), sorted_.begin(), sorted_.end());
+          rowtagpos_.push_back(static_cast<int>(rowtags_.size()));
+        }
+        list_.push_back(a.id);
+        rows_.push_back(row);
+        if (ip->last())
+          break;
+        a = {a.id+1, 0};
+        goto Loop;
+      }
+
+      case kInstCapture:
+        if (!ip->last())
+          stk_.push_back({a.id+1, 0});
+        stk_.push_back({0, static_cast<int>(tags_.size())});
+        tags_.push_back(ip->cap() - 2);
+        a = {ip->out(), 0};
+        goto Loop;
+
+      case kInstNop:
+        if (!ip->last())
+          stk_.push_back({a.id+1, 0});
+        a = {ip->out(), 0};
+        goto Loop;
+
+      case kInstAltMatch:
+        // Only a hint for the NFA; the alternatives follow on the list.
+        ABSL_DCHECK(!ip->last());
+        a = {a.id+1, 0};
+        goto Loop;
+
+      case kInstFail:
+        if (ip->last())
+          break;
+        a = {a.id+1, 0};
+        goto Loop;
+    }
+  }
+}
+
+TaggedDFA::State* TaggedDFA::CachedState(const int* inst, int ninst) {
+  State state;
+  state.inst_ = const_cast<int*>(inst);
+  state.ninst_ = ninst;
+  StateSet::iterator it = state_cache_.find(&state);
+  if (it != state_cache_.end())
+    return *it;
+
+  int64_t nextmem = nnext_*sizeof(std::atomic<Transition*>);
+  int64_t mem = sizeof(State) + nextmem + 2*ninst*sizeof(int);
+  if (mem_budget_ < mem + kStateCacheOverhead)
+    return NULL;
+  mem_budget_ -= mem + kStateCacheOverhead;
+
+  char* space = new char[mem];
+  State* s = new (space) State;
+  for (int i = 0; i < nnext_; i++)
+    (void) new (&s->next_[i]) std::atomic<Transition*>(NULL);
+  s->inst_ = reinterpret_cast<int*>(space + sizeof(State) + nextmem);
+  if (ninst > 0)
+    memmove(s->inst_, inst, 2*ninst*sizeof(int));
+  s->ninst_ = ninst;
+  s->nrows_ = 0;
+  for (int i = 0; i < ninst; i++)
+    s->nrows_ = std::max(s->nrows_, inst[ninst+i] + 1);
+  state_cache_.insert(s);
+  return s;
+}
+
+int TaggedDFA::AppendOps(bool all, int* spare) {
+  // The copies run in place, so no row can be written before the copies
+  // that read it have run.  The new rows come from the old rows in no
+  // particular order, so make the copies whose rows nothing else reads,
+  // until only cycles are left; then save one row of a cycle in a spare
+  // row and have its readers read that instead, which breaks the cycle.
+  size_t begin = ops_.size();
+  int nnew = static_cast<int>(rowsrc_.size());
+  moves_.clear();
+  readers_.assign(*spare + nnew, 0);
+  for (int row = 0; row < nnew; row++) {
+    int src = rowsrc_[row];
+    if (src >= 0 && src != row && (all || live_[row])) {
+      moves_.push_back(row);
+      moves_.push_back(src);
+      readers_[src]++;
+    }
+  }
+  while (!moves_.empty()) {
+    bool progress = false;
+    for (size_t i = 0; i < moves_.size(); ) {
+      int dst = moves_[i];
+      int src = moves_[i+1];
+      if (readers_[dst] > 0) {
+        i += 2;
+        continue;
+      }
+      ops_.push_back(dst);
+      ops_.push_back(src);
+      readers_[src]--;
+      moves_[i] = moves_[moves_.size()-2];
+      moves_[i+1] = moves_[moves_.size()-1];
+      moves_.resize(moves_.size()-2);
+      progress = true;
+    }
+    if (!progress) {
+      int dst = moves_[0];
+      ops_.push_back(*spare);
+      ops_.push_back(dst);
+      for (size_t i = 0; i < moves_.size(); i += 2) {
+        if (moves_[i+1] == dst)
+          moves_[i+1] = *spare;
+      }
+      readers_[*spare] = readers_[dst];
+      readers_[dst] = 0;
+      (*spare)++;
+    }
+  }
+
+  // The registers to set are not read, so they come last.
+  for (int row = 0; row < nnew; row++) {
+    if (!all && !live_[row])
+      continue;
+    for (int i = rowtagpos_[row]; i < rowtagpos_[row+1]; i++) {
+      ops_.push_back(row*ntags_ + rowtags_[i]);
+      ops_.push_back(-1);
+    }
+  }
+  return static_cast<int>(ops_.size() - begin) / 2;
+}
+
+TaggedDFA::Transition* TaggedDFA::NewTransition(int nrows) {
+  int ninst = static_cast<int>(list_.size());
+  int nnew = static_cast<int>(rowsrc_.size());
+  live_.assign(nnew, false);
+  for (int i = 0; i < ninst; i++) {
+    if (prog_->inst(list_[i])->opcode() == kInstByteRange)
+      live_[rows_[i]] = true;
+  }
+  list_.insert(list_.end(), rows_.begin(), rows_.end());
+  State* ns = CachedState(list_.data(), ninst);
+  if (ns == NULL)
+    return NULL;
+
+  ops_.clear();
+  int spare = std::max(nrows, nnew);
+  int nlive = AppendOps(false, &spare);
+  int nall = AppendOps(true, &spare);
+
+  int64_t mem = sizeof(Transition) + ops_.size()*sizeof(int);
+  if (mem_budget_ < mem)
+    return NULL;
+  mem_budget_ -= mem;
+
+  Transition* t = new (new char[mem]) Transition;
+  t->next_ = ns;
+  t->nrows_ = spare;
+  t->nlive_ = nlive;
+  t->nall_ = nall;
+  if (!ops_.empty())
+    memmove(t->ops_, ops_.data(), ops_.size()*sizeof(int));
+  return t;
+}
+
+TaggedDFA::Transition* TaggedDFA::GetTransition(State* s, int c) {
+  std::atomic<Transition*>* slot =
+      s == NULL ? &start_ : &s->next_[prog_->bytemap()[c]];
+  Transition* t = slot->load(std::memory_order_acquire);
+  if (t != NULL)
+    return t;
+
+  absl::MutexLock l(mutex_);
+  // Another thread might have built it while we waited for the lock.
+  t = slot->load(std::memory_order_relaxed);
+  if (t != NULL)
+    return t;
+
+  visited_.clear();
+  list_.clear();
+  rows_.clear();
+  rowsrc_.clear();
+  rowtags_.clear();
+  rowtagpos_.assign(1, 0);
+  if (s == NULL) {
+    AddToList(prog_->start(), -1);
+  } else {
+    for (int i = 0; i < s->ninst_; i++) {
+      Prog::Inst* ip = prog_->inst(s->inst_[i]);
+      if (ip->opcode() == kInstByteRange && ip->Matches(c))
+        AddToList(ip->out(), s->inst_[s->ninst_ + i]);
+    }
+  }
+  t = NewTransition(s == NULL ? 0 : s->nrows_);
+  if (t != NULL)
+    slot->store(t, std::memory_order_release);
+  return t;
+}
+
+void TaggedDFA::ResetCache(RWLocker* cache_lock) {
+  // Once no other search is using the cache, it is safe to free it.
+  cache_lock->LockForWriting();
+  absl::MutexLock l(mutex_);
+  hooks::GetDFAStateCacheResetHook()({
+      state_budget_,
+      state_cache_.size(),
+  });
+  ClearCache();
+}
+
+bool TaggedDFA::Search(absl::string_view text, absl::string_view* match,
+                       int nmatch, bool* failed) {
+  *failed = false;
+  RWLocker l(&cache_mutex_);
+
+  // The registers, in rows of ntags_.  Grown as needed.
+  PODArray<const char*> regs;
+
+  const uint8_t* bytemap = prog_->bytemap();
+  const uint8_t* bp = reinterpret_cast<const uint8_t*>(text.data());
+  const uint8_t* ep = bp + text.size();
+  const uint8_t* p = bp;
+  const uint8_t* resetp = NULL;
+  State* s = NULL;  // the start state, to begin with
+  Transition* t = GetTransition(NULL, 0);
+  for (;;) {
+    if (t == NULL) {
+      // Out of memory.  Reset the cache and try again, unless it was
+      // reset too recently, and remember the current state's threads,
+      // which resetting the cache frees.
+      if (resetp != NULL) {
+        absl::MutexLock ml(mutex_);
+        if (static_cast<size_t>(p - resetp) <
+            kMinBytesPerState*state_cache_.size()) {
+          hooks::GetDFASearchFailureHook()({
+              // Nothing yet...
+          });
+          *failed = true;
+          return false;
+        }
+      }
+      resetp = p;
+      std::vector<int> inst;
+      if (s != NULL)
+        inst.assign(s->inst_, s->inst_ + 2*s->ninst_);
+      ResetCache(&l);
+      if (s != NULL) {
+        absl::MutexLock ml(mutex_);
+        s = CachedState(inst.data(), static_cast<int>(inst.size()) / 2);
+      }
+      if (s != NULL || inst.empty())
+        t = GetTransition(s, p == bp ? 0 : p[-1]);
+      if (t == NULL) {
+        // Not even one state fits.
+        hooks::GetDFASearchFailureHook()({
+            // Nothing yet...
+        });
+        *failed = true;
+        return false;
+      }
+    }
+
+    // Move to the next state and run the operations on the way.
+    bool start = s == NULL;
+    s = t->next_;
+    if (s->ninst_ == 0)
+      return false;
+    if (regs.size() < t->nrows_*ntags_) {
+      PODArray<const char*> bigger(std::max(2*regs.size(),
+                                            t->nrows_*ntags_));
+      if (regs.size() > 0)
+        memmove(bigger.data(), regs.data(), regs.size()*sizeof regs[0]);
+      regs = std::move(bigger);
+    }
+    const char** r = regs.data();
+    if (start) {
+      for (int i = 0; i < s->nrows_*ntags_; i++)
+        r[i] = NULL;
+    }
+    const int* op = t->ops_;
+    const int* end = op + 2*t->nlive_;
+    if (p == ep) {
+      op = end;
+      end += 2*t->nall_;
+    }
+    for (; op < end; op += 2) {
+      if (op[1] >= 0)
+        memmove(r + op[0]*ntags_, r + op[1]*ntags_, ntags_*sizeof r[0]);
+      else
+        r[op[0]] = reinterpret_cast<const char*>(p);
+    }
+
+    if (p == ep)
+      break;
+    int c = *p++;
+    t = s->next_[bytemap[c]].load(std::memory_order_acquire);
+    if (t == NULL)
+      t = GetTransition(s, c);
+  }
+
+  // The first thread at a Match wins.
+  for (int i = 0; i < s->ninst_; i++) {
+    if (prog_->inst(s->inst_[i])->opcode() != kInstMatch)
+      continue;
+    if (nmatch > 0)
+      match[0] = text;
+    const char** row = regs.data() + s->inst_[s->ninst_ + i]*ntags_;
+    for (int j = 1; j < nmatch; j++) {
+      if (2*j-1 >= ntags_ || row[2*j-2] == NULL || row[2*j-1] == NULL) {
+        match[j] = absl::string_view();
+        continue;
+      }
+      match[j] = absl::string_view(row[2*j-2],
+                                   static_cast<size_t>(row[2*j-1] -
+                                                       row[2*j-2]));
+    }
+    return true;
+  }
+  return false;
+}
+
+bool Prog::CanTaggedDFA() {
+  if (did_tagged_dfa_)
+    return tagged_dfa_mem_ > 0;
+  did_tagged_dfa_ = true;
+
+  if (reversed_ || start() == 0)
+    return false;
+  if (inst_count(kInstEmptyWidth) > 0)
+    return false;
+  if (TaggedDFA::NumTags(this) == 0)
+    return false;
+
+  // Steal memory for the cache from the overall DFA budget,
+  // as IsOnePass() does.
+  tagged_dfa_mem_ = TakeDFAMem(TaggedDFA::MinMemory(this),
+                               std::numeric_limits<int64_t>::max());
+  return tagged_dfa_mem_ > 0;
+}
+
+bool Prog::SearchTaggedDFA(absl::string_view text, absl::string_view context,
+                           absl::string_view* match, int nmatch,
+                           bool* failed) {
+  *failed = false;
+  if (search_counters_ != NULL)
+    search_counters_->AddUnsynced(SearchCounters::kTaggedDFABytes,
+                                  text.size());
+
+  if (context.data() == NULL)
+    context = text;
+  if (anchor_start() && BeginPtr(context) != BeginPtr(text))
+    return false;
+  if (anchor_end() && EndPtr(context) != EndPtr(text))
+    return false;
+
+  absl::call_once(tagged_dfa_once_, [](Prog* prog) {
+    prog->tagged_dfa_ = new TaggedDFA(prog, prog->tagged_dfa_mem_);
+  }, this);
+  if (!tagged_dfa_->ok()) {
+    *failed = true;
+    return false;
+  }
+  return tagged_dfa_->Search(text, match, nmatch, failed);
+}
+
+void Prog::DeleteTaggedDFA(TaggedDFA* tagged_dfa) {
+  delete tagged_dfa;
+}
+
+}  // namespace re2
@@ -0,0 +1,110 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/aho_corasick.h"
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+
+namespace re2 {
+
+// Returns the end of the earliest-ending occurrence of any of strings in
+// text, or -1 if there is none, the slow way.
+static int FindFirstSlowly(const std::vector<std::string>& strings,
+                           bool foldcase, absl::string_view text) {
+  auto fold = [foldcase](char c) -> char {
+    return foldcase && 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c;
+  };
+  for (size_t end = 1; end <= text.size(); end++) {
+    for (const std::string& s : strings) {
+      if (s.empty() || s.size() > end)
+        continue;
+      size_t i = 0;
+      while (i < s.size() && fold(s[i]) == fold(text[end - s.size() + i]))
+        i++;
+      if (i == s.size())
+        return static_cast<int>(end);
+    }
+  }
+  return -1;
+}
+
+TEST(AhoCorasick, FindFirst) {
+  const std::vector<std::string> sets[] = {
+    {},
+    {"a"},
+    {"he", "she", "his", "hers"},
+    {"abcd", "bc", "c"},
+    {"aaab", "aab", "ab"},
+    {"Foo", "BAR", "baz"},
+    {"\xe2\x98\xba", "\xff"},
+    {"", "xyz"},
+  };
+  const char* texts[] = {
+    "",
+    "a",
+    "ushers",
+    "abcd",
+    "xxxaaaab",
+    "foo",
+    "FOO bar Baz",
+    "smile \xe2\x98\xba",
+    "\xfe\xff",
+    "wxyz",
+    "nothing to see here",
+  };
+  for (const std::vector<std::string>& strings : sets) {
+    for (bool foldcase : {false, true}) {
+      AhoCorasick ac(strings, foldcase, 1<<20);
+      ASSERT_TRUE(ac.ok());
+      for (const char* text : texts) {
+        absl::string_view t(text);
+        const char* p = ac.FindFirst(t);
+        EXPECT_EQ(p == NULL ? -1 : static_cast<int>(p - t.data()),
+                  FindFirstSlowly(strings, foldcase, t))
+            << "text " << text << ", foldcase " << foldcase;
+      }
+    }
+  }
+}
+
+TEST(AhoCorasick, FindAll) {
+  std::vector<std::string> strings = {"he", "she", "his", "hers", "", "he"};
+  AhoCorasick ac(strings, false, 1<<20);
+  ASSERT_TRUE(ac.ok());
+  std::vector<int> ids;
+  ac.FindAll("ushers", &ids);
+  EXPECT_EQ(ids, std::vector<int>({0, 1, 3, 5}));
+  ac.FindAll("this and that", &ids);
+  EXPECT_EQ(ids, std::vector<int>({2}));
+  ac.FindAll("nothing", &ids);
+  EXPECT_TRUE(ids.empty());
+
+  AhoCorasick folded(strings, true, 1<<20);
+  folded.FindAll("HIS HERS", &ids);
+  EXPECT_EQ(ids, std::vector<int>({0, 2, 3, 5}));
+}
+
+TEST(AhoCorasick, OutOfMemory) {
+  std::vector<std::string> strings;
+  for (int i = 0; i < 1000; i++)
+    strings.push_back(std::to_string(i * 7919));
+  AhoCorasick ac(strings, false, 1<<10);
+  EXPECT_FALSE(ac.ok());
+  EXPECT_TRUE(ac.FindFirst("7919") == NULL);
+
+  AhoCorasick big(strings, false, 1<<20);
+  ASSERT_TRUE(big.ok());
+  EXPECT_GT(big.num_states(), 1000);
+  EXPECT_LE(big.memory(), size_t{1<<20});
+  absl::string_view text = "xx15838xx";
+  EXPECT_EQ(big.FindFirst(text), text.data() + 7);
+}
+
+}  // namespace re2
@@ -428,4 +428,30 @@ TEST(TestCompile, Bug35237384) {
       forward);
 }
 
+TEST(TestCompile, CharClassCache) {
+  // Large character classes are copied from a global cache of compiled
+  // classes, which must not change the programs that result, whether the
+  // copy lands where the class was first compiled or anywhere else.
+  const char* patterns[] = {
+    "\\p{L}",
+    "[^\\p{L}\\p{N}]",
+    "x\\p{Greek}+y\\p{Greek}",
+    "(?i)[\\p{Lu}\\p{Cyrillic}]+|\\p{Lu}",
+    "\\p{Han}(\\p{L}\\p{N})*\\p{Han}",
+  };
+  for (const char* pattern : patterns) {
+    std::string forward, reverse;
+    Prog::TESTING_ONLY_set_compile_char_class_cache(false);
+    Dump(pattern, Regexp::LikePerl, &forward, &reverse);
+    Prog::TESTING_ONLY_set_compile_char_class_cache(true);
+    // The first time may fill the cache; the second must copy from it.
+    for (int i = 0; i < 2; i++) {
+      std::string cached_forward, cached_reverse;
+      Dump(pattern, Regexp::LikePerl, &cached_forward, &cached_reverse);
+      EXPECT_EQ(forward, cached_forward) << pattern;
+      EXPECT_EQ(reverse, cached_reverse) << pattern;
+    }
+  }
+}
+
 }  // namespace re2
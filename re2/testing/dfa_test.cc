@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <thread>
 #include <vector>
@@ -18,6 +20,7 @@
 #include "re2/prog.h"
 #include "re2/re2.h"
 #include "re2/regexp.h"
+#include "re2/sharded_reader_mutex.h"
 #include "re2/testing/string_generator.h"
 #include "util/malloc_counter.h"
 
@@ -373,4 +376,319 @@ TEST(DFA, Callback) {
   EXPECT_EQ(nfail, 0);
 }
 
+// Test that a parallel search finds the same match as a sequential one,
+// however the text is divided up.
+TEST(DFA, Parallel) {
+  Prog::TESTING_ONLY_set_dfa_min_parallel_segment(16);
+  const char* patterns[] = {
+    "abc",
+    "a+b",
+    "(a|b)*c",
+    "\\bfoo\\b",
+    "(?m)^foo$",
+    "x.*y",
+    "a.*b",
+    "[ab]{3}c",
+    "(?i)FOO|hello",
+    "\\w+\\s\\w+",
+    "q",
+    "(?s).*",
+    "",
+    "o[^o]*o",
+  };
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 3000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "abcxyfo \nhel"[(x >> 16) % 12];
+  }
+  for (const char* pattern : patterns) {
+    for (bool longest : {false, true}) {
+      RE2::Options opt;
+      opt.set_longest_match(longest);
+      RE2 re(pattern, opt);
+      ASSERT_TRUE(re.ok()) << pattern;
+      for (size_t n : {size_t{0}, size_t{40}, size_t{500}, text.size()}) {
+        for (size_t startpos : {size_t{0}, size_t{7}}) {
+          if (startpos > n)
+            continue;
+          // Both searches must see the same text for the submatches
+          // to point at the same bytes.
+          absl::string_view subtext = absl::string_view(text).substr(0, n);
+          for (int nsubmatch : {0, 1, 2}) {
+            absl::string_view want[2], got[2];
+            bool want_match = re.Match(subtext, startpos, n,
+                                       RE2::UNANCHORED, want, nsubmatch);
+            for (int nthreads : {2, 7}) {
+              bool got_match =
+                  re.ParallelMatch(subtext, startpos, n,
+                                   RE2::UNANCHORED, got, nsubmatch, nthreads);
+              ASSERT_EQ(got_match, want_match)
+                  << pattern << " longest " << longest << " text size " << n;
+              for (int i = 0; i < nsubmatch && want_match; i++)
+                ASSERT_EQ(got[i].data(), want[i].data())
+                    << pattern << " longest " << longest << " text size " << n;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // When the DFA runs out of memory, the search still finds the match.
+  RE2::Options opt;
+  opt.set_max_mem(1<<15);
+  RE2 small("a[ab]{10}b", opt);
+  RE2 big("a[ab]{10}b");
+  std::string ab;
+  for (char c : text)
+    ab += c == 'a' ? 'a' : 'b';
+  absl::string_view want, got;
+  ASSERT_TRUE(big.Match(ab, 0, ab.size(), RE2::UNANCHORED, &want, 1));
+  ASSERT_TRUE(small.ParallelMatch(ab, 0, ab.size(), RE2::UNANCHORED, &got, 1,
+                                  4));
+  EXPECT_EQ(got, want);
+  Prog::TESTING_ONLY_set_dfa_min_parallel_segment(1<<20);
+}
+
+// Check that keeping the hottest states across cache resets
+// does not change the results of searches.
+TEST(DFA, KeepHotStates) {
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(false);
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 20000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "abcdxyz\n"[(x >> 16) % 8];
+  }
+  for (const char* pattern : {"[a-c][^x-z]{10}d", "[ab][^z]{9}$",
+                              "(?m)[a-c][^dz]{9}$"}) {
+    Regexp* re = Regexp::Parse(pattern, Regexp::LikePerl, NULL);
+    ASSERT_TRUE(re != NULL);
+    Prog* want_prog = re->CompileToProg(0);
+    ASSERT_TRUE(want_prog != NULL);
+    for (bool keep : {false, true}) {
+      Prog::TESTING_ONLY_set_dfa_keep_hot_states(keep);
+      Prog* prog = re->CompileToProg(1<<16);
+      ASSERT_TRUE(prog != NULL);
+      state_cache_resets = 0;
+      for (Prog::MatchKind kind : {Prog::kFirstMatch, Prog::kLongestMatch}) {
+        for (size_t n = 0; n <= text.size(); n += 997) {
+          absl::string_view t = absl::string_view(text).substr(n);
+          absl::string_view want, got;
+          bool want_matched = want_prog->SearchNFA(t, t, Prog::kUnanchored,
+                                                   kind, &want, 1);
+          bool failed = false;
+          bool got_matched = prog->SearchDFA(t, t, Prog::kUnanchored, kind,
+                                             &got, &failed, NULL);
+          ASSERT_FALSE(failed);
+          ASSERT_EQ(got_matched, want_matched)
+              << pattern << " keep " << keep << " offset " << n;
+          if (want_matched) {
+            ASSERT_EQ(got.data() + got.size(), want.data() + want.size())
+                << pattern << " keep " << keep << " offset " << n;
+          }
+        }
+      }
+      EXPECT_GT(state_cache_resets, 0) << pattern;
+      delete prog;
+    }
+    delete want_prog;
+    re->Decref();
+  }
+  Prog::TESTING_ONLY_set_dfa_keep_hot_states(true);
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(true);
+}
+
+// Check that searching the texts of a batch in lockstep gives the same
+// results as searching them one at a time, even when the state cache
+// keeps filling up.
+TEST(DFA, InterleavedBatch) {
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(false);
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 20000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "abcdxyz\n"[(x >> 16) % 8];
+  }
+  // Texts of many lengths, some of them empty, with the text around them
+  // as their contexts.
+  std::vector<absl::string_view> texts;
+  for (size_t n = 0, len = 0; n + len <= text.size(); n += len + 1) {
+    texts.push_back(absl::string_view(text).substr(n, len));
+    len = (len * 7 + 3) % 61;
+  }
+  std::vector<absl::string_view> contexts(texts.size(), text);
+  state_cache_resets = 0;
+  for (const char* pattern : {"[a-c][^x-z]{10}d", "^[ab][^z]{3}", "z$",
+                              "(?m)[a-c][^dz]{5}$", "\\b[a-d]+\\b", ""}) {
+    Regexp* re = Regexp::Parse(pattern, Regexp::LikePerl, NULL);
+    ASSERT_TRUE(re != NULL);
+    for (bool reversed : {false, true}) {
+      for (int64_t max_mem : {1<<16, 1<<20}) {
+        Prog* prog = reversed ? re->CompileToReverseProg(max_mem)
+                              : re->CompileToProg(max_mem);
+        ASSERT_TRUE(prog != NULL);
+        for (Prog::MatchKind kind : {Prog::kFirstMatch, Prog::kLongestMatch,
+                                     Prog::kFullMatch}) {
+          for (Prog::Anchor anchor : {Prog::kUnanchored, Prog::kAnchored}) {
+            for (bool with_contexts : {false, true}) {
+              absl::Span<const absl::string_view> c;
+              if (with_contexts)
+                c = contexts;
+              std::vector<int> want, got;
+              Prog::TESTING_ONLY_set_dfa_interleave_batches(false);
+              prog->SearchDFABatch(texts, c, anchor, kind, &want, NULL);
+              Prog::TESTING_ONLY_set_dfa_interleave_batches(true);
+              prog->SearchDFABatch(texts, c, anchor, kind, &got, NULL);
+              ASSERT_EQ(got, want)
+                  << pattern << " reversed " << reversed << " max_mem "
+                  << max_mem << " kind " << kind << " anchor " << anchor
+                  << " contexts " << with_contexts;
+              for (size_t i = 0; i < texts.size(); i += 101) {
+                absl::string_view ctx = with_contexts ? text : texts[i];
+                bool failed = false;
+                bool matched = prog->SearchDFA(texts[i], ctx, anchor, kind,
+                                               NULL, &failed, NULL);
+                if (!failed && got[i] != -1) {
+                  ASSERT_EQ(got[i], matched ? 1 : 0) << pattern << " " << i;
+                }
+              }
+            }
+          }
+        }
+        delete prog;
+      }
+    }
+    re->Decref();
+  }
+  EXPECT_GT(state_cache_resets, 0);
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(true);
+}
+
+// Check that the tagged DFA finds the same submatches as the NFA, even
+// when its cache keeps filling up, and from several threads at once.
+TEST(TaggedDFA, SmallCache) {
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 20000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "ab"[(x >> 16) % 2];
+  }
+  std::vector<absl::string_view> texts;
+  for (size_t n = 0; n <= text.size(); n += 997)
+    texts.push_back(absl::string_view(text).substr(n));
+
+  for (const char* pattern : {"(.*)a([ab]{6})(b*)",
+                              "([ab]*?)(b[ab]{6})([ab]*)"}) {
+    Regexp* re = Regexp::Parse(pattern, Regexp::LikePerl, NULL);
+    ASSERT_TRUE(re != NULL);
+    Prog* want_prog = re->CompileToProg(0);
+    ASSERT_TRUE(want_prog != NULL);
+    std::vector<std::vector<absl::string_view>> want(texts.size());
+    for (size_t i = 0; i < texts.size(); i++) {
+      want[i].resize(4);
+      if (!want_prog->SearchNFA(texts[i], texts[i], Prog::kAnchored,
+                                Prog::kFullMatch, want[i].data(), 4))
+        want[i].clear();
+    }
+
+    for (int64_t max_mem : {1<<17, 1<<18, 1<<22}) {
+      Prog* prog = re->CompileToProg(max_mem);
+      ASSERT_TRUE(prog != NULL);
+      ASSERT_TRUE(prog->CanTaggedDFA()) << pattern;
+      state_cache_resets = 0;
+      std::atomic<int> searched(0);
+      auto search = [&](int step) {
+        for (size_t i = 0; i < texts.size(); i += step) {
+          absl::string_view got[4];
+          bool failed = false;
+          bool matched = prog->SearchTaggedDFA(texts[i], texts[i], got, 4,
+                                               &failed);
+          if (failed)
+            continue;
+          searched++;
+          ASSERT_EQ(matched, !want[i].empty()) << pattern << " " << i;
+          for (int j = 0; matched && j < 4; j++) {
+            ASSERT_EQ(got[j].data(), want[i][j].data())
+                << pattern << " " << i << " $" << j;
+            ASSERT_EQ(got[j].size(), want[i][j].size())
+                << pattern << " " << i << " $" << j;
+          }
+        }
+      };
+      search(1);
+      EXPECT_GT(searched, 0) << pattern << " " << max_mem;
+      if (max_mem == 1<<17) {
+        EXPECT_GT(state_cache_resets, 0) << pattern << " " << max_mem;
+      }
+
+      std::vector<std::thread> threads;
+      for (int i = 0; i < absl::GetFlag(FLAGS_threads); i++)
+        threads.emplace_back(search, 1 + i);
+      for (std::thread& t : threads)
+        t.join();
+      delete prog;
+    }
+    delete want_prog;
+    re->Decref();
+  }
+}
+
+// Check that a writer of the DFA's cache mutex waits for the readers
+// that hold it, and that readers wait for the writer in turn.
+TEST(ShardedReaderMutex, Handoff) {
+  ShardedReaderMutex mu;
+  std::atomic<int> stage{0};
+
+  mu.ReaderLock();
+  std::thread writer([&]() {
+    mu.WriterLock();
+    stage.store(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    stage.store(2);
+    mu.WriterUnlock();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(stage.load(), 0);
+  mu.ReaderUnlock();
+
+  while (stage.load() == 0)
+    std::this_thread::yield();
+  mu.ReaderLock();
+  EXPECT_EQ(stage.load(), 2);
+  mu.ReaderUnlock();
+  writer.join();
+}
+
+// Check that readers and writers exclude each other under contention.
+TEST(ShardedReaderMutex, Contention) {
+  ShardedReaderMutex mu;
+  int value = 0;  // odd only while a writer holds mu
+  std::atomic<int> bad{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < 2000; j++) {
+        if ((i + j) % 100 == 0) {
+          mu.WriterLock();
+          value++;
+          std::this_thread::yield();
+          value++;
+          mu.WriterUnlock();
+        } else {
+          mu.ReaderLock();
+          if (value % 2 != 0)
+            bad.fetch_add(1);
+          mu.ReaderUnlock();
+        }
+      }
+    });
+  }
+  for (std::thread& t : threads)
+    t.join();
+  EXPECT_EQ(bad.load(), 0);
+  EXPECT_EQ(value, 2*8*20);
+}
+
 }  // namespace re2
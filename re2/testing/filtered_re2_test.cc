@@ -14,6 +14,7 @@
 #include "absl/base/macros.h"
 #include "absl/log/absl_log.h"
 #include "gtest/gtest.h"
+#include "re2/prefilter.h"
 #include "re2/re2.h"
 
 namespace re2 {
@@ -281,6 +282,59 @@ TEST(FilteredRE2Test, MatchTests) {
   EXPECT_EQ(size_t{2}, matching_regexps.size());
 }
 
+TEST(FilteredRE2Test, MatchWithoutAtoms) {
+  FilterTestVars v;
+  AtomTest* t = &atom_tests[2];
+  EXPECT_EQ("SubstrAtomRemovesSuperStrInOr", std::string(t->testname));
+  size_t nregexp;
+  for (nregexp = 0; nregexp < ABSL_ARRAYSIZE(t->regexps); nregexp++)
+    if (t->regexps[nregexp] == NULL)
+      break;
+  AddRegexpsAndCompile(t->regexps, nregexp, &v);
+
+  // The atoms are lowercase, so the matcher has to fold case
+  // in order to find them.
+  const char* texts[] = {
+    "abc121212xyz",
+    "ABC12312YYYZZZ",
+    "abcd12yyy32yyyzzz",
+    "mnmnppqqqppp",
+    "nothing",
+  };
+  for (const char* text : texts) {
+    std::string lower = Prefilter::ToLowerUTF8(text);
+    std::vector<int> atom_ids;
+    for (size_t i = 0; i < v.atoms.size(); i++)
+      if (lower.find(v.atoms[i]) != std::string::npos)
+        atom_ids.push_back(static_cast<int>(i));
+    std::vector<int> expected;
+    v.f.AllMatches(text, atom_ids, &expected);
+    v.f.AllMatches(text, &v.matches);
+    EXPECT_EQ(expected, v.matches) << text;
+    EXPECT_EQ(v.f.FirstMatch(text, atom_ids), v.f.FirstMatch(text)) << text;
+  }
+}
+
+TEST(FilteredRE2Test, MatchWithoutAtomsUnicode) {
+  FilterTestVars v;
+  AtomTest* t = &atom_tests[4];
+  EXPECT_EQ("UnicodeLower", std::string(t->testname));
+  size_t nregexp;
+  for (nregexp = 0; nregexp < ABSL_ARRAYSIZE(t->regexps); nregexp++)
+    if (t->regexps[nregexp] == NULL)
+      break;
+  AddRegexpsAndCompile(t->regexps, nregexp, &v);
+
+  v.f.AllMatches("xx ΔΔΠϖΠΣςΣ xx", &v.matches);
+  EXPECT_EQ(std::vector<int>({0}), v.matches);
+  v.f.AllMatches("ΛΜΝΟΠ ψρστυ", &v.matches);
+  EXPECT_EQ(std::vector<int>({1, 2}), v.matches);
+  v.f.AllMatches("λμνοπ", &v.matches);
+  EXPECT_TRUE(v.matches.empty());
+  EXPECT_EQ(2, v.f.FirstMatch("ψρστυ"));
+  EXPECT_EQ(-1, v.f.FirstMatch("ΨΡΣΤΥ"));
+}
+
 TEST(FilteredRE2Test, EmptyStringInStringSetBug) {
   // Bug due to find() finding "" at the start of everything in a string
   // set and thus SimplifyStringSet() would end up erasing everything.
@@ -308,6 +362,7 @@ TEST(FilteredRE2Test, MoveSemantics) {
   EXPECT_EQ(0, v1.matches[0]);
   v1.f.AllMatches("abc bar2 xyz", {0}, &v1.matches);
   EXPECT_EQ(size_t{0}, v1.matches.size());
+  EXPECT_EQ(0, v1.f.FirstMatch("abc foo1 xyz"));
 
   // The moved-to object should do what the moved-from object did.
   FilterTestVars v2;
@@ -317,6 +372,7 @@ TEST(FilteredRE2Test, MoveSemantics) {
   EXPECT_EQ(0, v2.matches[0]);
   v2.f.AllMatches("abc bar2 xyz", {0}, &v2.matches);
   EXPECT_EQ(size_t{0}, v2.matches.size());
+  EXPECT_EQ(0, v2.f.FirstMatch("abc foo1 xyz"));
 
   // The moved-from object should have been reset and be reusable.
   v1.f.Add("bar\\d+", v1.opts, &id);
@@ -329,6 +385,8 @@ TEST(FilteredRE2Test, MoveSemantics) {
   v1.f.AllMatches("abc bar2 xyz", {0}, &v1.matches);
   EXPECT_EQ(size_t{1}, v1.matches.size());
   EXPECT_EQ(0, v1.matches[0]);
+  EXPECT_EQ(-1, v1.f.FirstMatch("abc foo1 xyz"));
+  EXPECT_EQ(0, v1.f.FirstMatch("abc bar2 xyz"));
 
   // Verify that "overwriting" works and also doesn't leak memory.
   // (The latter will need a leak detector such as LeakSanitizer.)
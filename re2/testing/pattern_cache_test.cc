@@ -0,0 +1,166 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/pattern_cache.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "gtest/gtest.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+TEST(PatternCache, Shares) {
+  RE2::PatternCache cache(1<<20);
+  std::shared_ptr<const RE2> a = cache.Get("(\\w+):(\\d+)");
+  ASSERT_TRUE(a->ok());
+  EXPECT_EQ(a->pattern(), "(\\w+):(\\d+)");
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_GT(cache.mem(), 0);
+
+  std::shared_ptr<const RE2> b = cache.Get("(\\w+):(\\d+)");
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 1);
+
+  std::string key;
+  int value;
+  EXPECT_TRUE(RE2::FullMatch("port:80", *b, &key, &value));
+  EXPECT_EQ(key, "port");
+  EXPECT_EQ(value, 80);
+}
+
+TEST(PatternCache, Options) {
+  RE2::PatternCache cache(1<<20);
+  RE2::Options options;
+  std::shared_ptr<const RE2> a = cache.Get("abc", options);
+  options.set_case_sensitive(false);
+  std::shared_ptr<const RE2> b = cache.Get("abc", options);
+  options.set_max_mem(options.max_mem() / 2);
+  std::shared_ptr<const RE2> c = cache.Get("abc", options);
+  std::shared_ptr<const RE2> d = cache.Get("abc", RE2::DefaultOptions);
+  EXPECT_NE(a.get(), b.get());
+  EXPECT_NE(b.get(), c.get());
+  EXPECT_EQ(a.get(), d.get());
+  EXPECT_EQ(cache.size(), 3);
+
+  EXPECT_FALSE(RE2::FullMatch("ABC", *a));
+  EXPECT_TRUE(RE2::FullMatch("ABC", *b));
+  EXPECT_TRUE(RE2::FullMatch("ABC", *c));
+
+  // The same pattern as a literal is a different RE2.
+  std::shared_ptr<const RE2> e = cache.Get("a.c");
+  RE2::Options literal;
+  literal.set_literal(true);
+  std::shared_ptr<const RE2> f = cache.Get("a.c", literal);
+  EXPECT_NE(e.get(), f.get());
+  EXPECT_TRUE(RE2::FullMatch("abc", *e));
+  EXPECT_FALSE(RE2::FullMatch("abc", *f));
+}
+
+TEST(PatternCache, Errors) {
+  RE2::PatternCache cache(1<<20);
+  std::shared_ptr<const RE2> a = cache.Get("a(", RE2::Quiet);
+  EXPECT_FALSE(a->ok());
+  EXPECT_EQ(a->error_code(), RE2::ErrorMissingParen);
+  std::shared_ptr<const RE2> b = cache.Get("a(", RE2::Quiet);
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(cache.hits(), 1);
+}
+
+TEST(PatternCache, Evicts) {
+  // Make room for ten RE2s like these.
+  RE2::PatternCache cache(1<<20);
+  cache.Get("(x000)y");
+  cache.set_max_mem(10*cache.mem());
+  cache.Clear();
+
+  std::shared_ptr<const RE2> first = cache.Get("(x999)y");
+  for (int i = 0; i < 1000; i++)
+    cache.Get(absl::StrFormat("(x%03d)y", i % 50));
+  EXPECT_LE(cache.mem(), cache.max_mem());
+  EXPECT_EQ(cache.size(), 10);
+
+  // The least recently used RE2 is gone from the cache,
+  // but it still works for whoever holds it.
+  EXPECT_TRUE(RE2::FullMatch("x999y", *first));
+  int64_t misses = cache.misses();
+  std::shared_ptr<const RE2> again = cache.Get("(x999)y");
+  EXPECT_EQ(cache.misses(), misses + 1);
+  EXPECT_NE(first.get(), again.get());
+
+  // The most recently used RE2 is still there.
+  std::shared_ptr<const RE2> last = cache.Get("(x999)y");
+  EXPECT_EQ(again.get(), last.get());
+
+  cache.set_max_mem(0);
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.mem(), 0);
+  EXPECT_TRUE(RE2::FullMatch("x999y", *last));
+
+  // With no room at all, Get() still returns a working RE2.
+  std::shared_ptr<const RE2> re = cache.Get("a+");
+  EXPECT_TRUE(RE2::FullMatch("aaa", *re));
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(PatternCache, Clear) {
+  RE2::PatternCache cache(1<<20);
+  std::shared_ptr<const RE2> a = cache.Get("a+b");
+  cache.Get("c+d");
+  EXPECT_EQ(cache.size(), 2);
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.mem(), 0);
+  EXPECT_TRUE(RE2::FullMatch("aab", *a));
+  EXPECT_NE(a.get(), cache.Get("a+b").get());
+}
+
+TEST(PatternCache, Global) {
+  RE2::PatternCache* cache = RE2::PatternCache::Global();
+  EXPECT_EQ(cache, RE2::PatternCache::Global());
+  EXPECT_EQ(cache->max_mem(), RE2::PatternCache::kDefaultMaxMem);
+  std::shared_ptr<const RE2> a = cache->Get("global[0-9]");
+  EXPECT_EQ(a.get(), RE2::PatternCache::Global()->Get("global[0-9]").get());
+}
+
+TEST(PatternCache, Threads) {
+  RE2::PatternCache cache(1<<20);
+  const int kPatterns = 16;
+  std::vector<std::shared_ptr<const RE2>> want(kPatterns);
+  for (int i = 0; i < kPatterns; i++)
+    want[i] = cache.Get(absl::StrFormat("(\\d+)-%d", i));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, &want, t]() {
+      for (int i = 0; i < 1000; i++) {
+        int n = (i * 7 + t) % kPatterns;
+        std::shared_ptr<const RE2> re =
+            cache.Get(absl::StrFormat("(\\d+)-%d", n));
+        ASSERT_EQ(re.get(), want[n].get());
+        int x;
+        ASSERT_TRUE(RE2::FullMatch(absl::StrFormat("%d-%d", i, n), *re, &x));
+        ASSERT_EQ(x, i);
+        // Also build some patterns that nobody else does.
+        if (i % 100 == 0)
+          cache.Get(absl::StrFormat("(\\d+)-%d-%d", t, i));
+      }
+    });
+  }
+  for (std::thread& t : threads)
+    t.join();
+  EXPECT_EQ(cache.misses(), kPatterns + 4*10);
+}
+
+}  // namespace re2
@@ -14,6 +14,7 @@
 
 #include <map>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -1696,4 +1697,418 @@ TEST(RE2, InitNULL) {
   ASSERT_TRUE(RE2::FullMatch("", NULL));
 }
 
+// Check that per_thread_dfa gives the same results as the shared DFAs,
+// both with one thread and with several searching at once.
+TEST(RE2, PerThreadDFA) {
+  RE2::Options opt;
+  opt.set_per_thread_dfa(true);
+  RE2 re("([a-c]+)@([a-c]+)\\.com", opt);
+  ASSERT_TRUE(re.ok());
+  auto search = [&re]() {
+    for (int i = 0; i < 100; i++) {
+      absl::string_view user, host;
+      EXPECT_TRUE(RE2::PartialMatch("xx abc@cab.com yy", re, &user, &host));
+      EXPECT_EQ(user, "abc");
+      EXPECT_EQ(host, "cab");
+      EXPECT_FALSE(RE2::PartialMatch("xx abc@cab.org yy", re));
+      EXPECT_TRUE(RE2::FullMatch("a@b.com", re));
+    }
+  };
+  search();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+    threads.emplace_back(search);
+  for (std::thread& t : threads)
+    t.join();
+
+  // However many hardware threads there are, a thread's DFA keeps a fair
+  // share of the default budget.
+  RE2 re2("[a-c]+@[a-c]+\\.com", opt);
+  ASSERT_TRUE(re2.ok());
+  ASSERT_TRUE(RE2::PartialMatch("xx abc@cab.com yy", re2));
+  RE2::SearchStats stats;
+  re2.GetSearchStats(&stats);
+  EXPECT_GE(stats.dfa_mem_budget, 128<<10);
+}
+
+// Check that MatchBatch() gives the same results as Match() on each text.
+TEST(RE2, MatchBatch) {
+  const char* patterns[] = {
+    "abc",
+    "^abc",
+    "(?i)^ABC\\b",
+    "foo$",
+    "^foo$",
+    "\\bx\\w*",
+    "a.*b",
+    "",
+    "(?m)^line$",
+    "\\x{263a}+",
+  };
+  const std::vector<absl::string_view> texts = {
+    "", "abc", "ABC d", "abcd", "xabc", "foo", "a foo", "foo bar", "xyz",
+    "ab", "line\nline", "\xe2\x98\xba", "a\xff", "b",
+  };
+  for (const char* pattern : patterns) {
+    for (bool longest : {false, true}) {
+      RE2::Options opt;
+      opt.set_longest_match(longest);
+      RE2 re(pattern, opt);
+      ASSERT_TRUE(re.ok()) << pattern;
+      for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                                 RE2::ANCHOR_BOTH}) {
+        std::vector<bool> matched;
+        int n = re.MatchBatch(texts, anchor, &matched);
+        ASSERT_EQ(matched.size(), texts.size());
+        int want_n = 0;
+        for (size_t i = 0; i < texts.size(); i++) {
+          bool want = re.Match(texts[i], 0, texts[i].size(), anchor, NULL, 0);
+          want_n += want;
+          EXPECT_EQ(matched[i], want)
+              << pattern << " on " << texts[i] << " anchor " << anchor;
+        }
+        EXPECT_EQ(n, want_n) << pattern;
+      }
+    }
+  }
+
+  RE2 bad("a(", RE2::Quiet);
+  std::vector<bool> matched;
+  EXPECT_EQ(bad.MatchBatch(texts, RE2::UNANCHORED, &matched), 0);
+  EXPECT_EQ(matched, std::vector<bool>(texts.size(), false));
+}
+
+// Check that searching for a required literal after the start of the
+// regexp does not change the results of Match().  Wrapping the regexp
+// in a capturing group hides the literal, so that gives the answers.
+TEST(RE2, InnerLiteral) {
+  const char* patterns[] = {
+    "\\w+@example\\.com",
+    "[0-9]+ms",
+    "(\\d+)ms\\b",
+    "[^y]*yz",
+    "x*yz",
+    "\\bab\\b[a-z]*yz",
+    "(?:xyzyy|y)yz",    // the regexp before the literal can contain it
+    "a+aa",             // the literal can overlap itself
+    ".*ab",
+    "(?m)^a*bc$",
+    "(?i)a+bc",         // no case-sensitive literal
+  };
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 4000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "abcxyz@.m0s \n"[(x >> 16) % 13];
+    if ((x >> 8) % 97 == 0)
+      text += "@example.com";
+  }
+  for (const char* pattern : patterns) {
+    for (bool longest : {false, true}) {
+      RE2::Options opt;
+      opt.set_longest_match(longest);
+      RE2 re(pattern, opt);
+      RE2 ref(absl::StrFormat("(%s)", pattern), opt);
+      ASSERT_TRUE(re.ok()) << pattern;
+      ASSERT_TRUE(ref.ok()) << pattern;
+      for (size_t len : {0, 1, 5, 20, 200, 4000}) {
+        for (size_t pos = 0; pos + len <= text.size(); pos += 97 + len) {
+          absl::string_view want[2], got[2];
+          bool want_matched = ref.Match(text, pos, pos + len, RE2::UNANCHORED,
+                                        want, 2);
+          bool got_matched = re.Match(text, pos, pos + len, RE2::UNANCHORED,
+                                      got, 1);
+          ASSERT_EQ(got_matched, want_matched)
+              << pattern << " at " << pos << " len " << len;
+          if (want_matched) {
+            ASSERT_EQ(got[0].data(), want[0].data()) << pattern << " " << pos;
+            ASSERT_EQ(got[0].size(), want[0].size()) << pattern << " " << pos;
+          }
+          ASSERT_EQ(re.Match(text, pos, pos + len, RE2::UNANCHORED, NULL, 0),
+                    want_matched)
+              << pattern << " at " << pos << " len " << len;
+        }
+      }
+    }
+  }
+}
+
+TEST(RE2, Warmup) {
+  const char* patterns[] = {
+    "abc",
+    "^abc[0-9]+",
+    "(?i)^ABC\\b",
+    "[a-z]+foo$",
+    "\\bx\\w*y",
+    "a.*b",
+  };
+  const std::vector<absl::string_view> samples = {
+    "xxabc123", "ABC def", "barfoo", "a xwwy b", "abc", "",
+  };
+  for (const char* pattern : patterns) {
+    for (bool longest : {false, true}) {
+      RE2::Options opt;
+      opt.set_longest_match(longest);
+      for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                                 RE2::ANCHOR_BOTH}) {
+        RE2 re(pattern, opt);
+        ASSERT_TRUE(re.ok()) << pattern;
+        EXPECT_GT(re.Warmup(samples, anchor), 0) << pattern;
+        // Everything that the samples need has been built.
+        EXPECT_EQ(re.Warmup(samples, anchor), 0) << pattern;
+
+        RE2 re2(pattern, opt);
+        ASSERT_TRUE(re2.ok()) << pattern;
+        EXPECT_GT(re2.Warmup(100, anchor), 0) << pattern;
+        EXPECT_EQ(re2.Warmup(100, anchor), 0) << pattern;
+
+        // Warming up does not change any results.
+        RE2 cold(pattern, opt);
+        for (absl::string_view text : samples) {
+          absl::string_view m, m1, m2;
+          bool want = cold.Match(text, 0, text.size(), anchor, &m, 1);
+          EXPECT_EQ(re.Match(text, 0, text.size(), anchor, &m1, 1), want);
+          EXPECT_EQ(re2.Match(text, 0, text.size(), anchor, &m2, 1), want);
+          if (want) {
+            EXPECT_EQ(m1.data(), m.data());
+            EXPECT_EQ(m1.size(), m.size());
+            EXPECT_EQ(m2.data(), m.data());
+            EXPECT_EQ(m2.size(), m.size());
+          }
+        }
+      }
+    }
+  }
+
+  RE2 bad("a(", RE2::Quiet);
+  EXPECT_EQ(bad.Warmup(samples, RE2::UNANCHORED), 0);
+  EXPECT_EQ(bad.Warmup(100, RE2::UNANCHORED), 0);
+}
+
+// Check that bit_state_max_mem decides which texts the BitState search
+// gets and that the results do not depend on it.
+TEST(RE2, BitStateMaxMem) {
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 40000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "abc xyz"[(x >> 16) % 7];
+  }
+  absl::string_view want[3];
+  for (int64_t max_mem : {int64_t{0}, int64_t{1}<<10, int64_t{1}<<20,
+                          int64_t{1}<<30}) {
+    RE2::Options opt;
+    opt.set_bit_state_max_mem(max_mem);
+    RE2 re("(.*) (\\w+)(.*)", opt);
+    ASSERT_TRUE(re.ok());
+    absl::string_view got[3];
+    ASSERT_TRUE(RE2::FullMatch(text, re, &got[0], &got[1], &got[2]));
+    if (max_mem == 0) {
+      for (int i = 0; i < 3; i++)
+        want[i] = got[i];
+    }
+    for (int i = 0; i < 3; i++) {
+      EXPECT_EQ(got[i].data(), want[i].data()) << max_mem << " $" << i+1;
+      EXPECT_EQ(got[i].size(), want[i].size()) << max_mem << " $" << i+1;
+    }
+    RE2::SearchStats stats;
+    re.GetSearchStats(&stats);
+    if (max_mem >= int64_t{1}<<20) {
+      EXPECT_EQ(stats.bitstate_bytes, static_cast<int64_t>(text.size()));
+      EXPECT_EQ(stats.nfa_bytes, 0);
+    } else {
+      EXPECT_EQ(stats.bitstate_bytes, 0);
+      EXPECT_EQ(stats.tagged_dfa_bytes, static_cast<int64_t>(text.size()));
+      EXPECT_EQ(stats.nfa_bytes, 0);
+    }
+  }
+}
+
+TEST(RE2, NFAManyCaptures) {
+  // The lazy prefix makes the pattern not one-pass, the word boundary
+  // rules out the tagged DFA, and disabling BitState leaves the NFA to
+  // track all of the capture slots.
+  const int kGroups = 300;
+  std::string pattern = "\\b(\\w*?)";
+  std::string text;
+  for (int i = 0; i < kGroups; i++) {
+    pattern += "(\\w)";
+    text += "abcdefghij"[i % 10];
+  }
+  RE2::Options opt;
+  opt.set_bit_state_max_mem(0);
+  RE2 re(pattern, opt);
+  ASSERT_TRUE(re.ok());
+  ASSERT_EQ(re.NumberOfCapturingGroups(), kGroups + 1);
+
+  std::vector<absl::string_view> got(kGroups + 1);
+  std::vector<RE2::Arg> args(kGroups + 1);
+  std::vector<const RE2::Arg*> argp(kGroups + 1);
+  for (int i = 0; i <= kGroups; i++) {
+    args[i] = &got[i];
+    argp[i] = &args[i];
+  }
+  ASSERT_TRUE(RE2::FullMatchN(text, re, argp.data(), kGroups + 1));
+  EXPECT_EQ(got[0], "");
+  for (int i = 0; i < kGroups; i++) {
+    EXPECT_EQ(got[i+1].data(), text.data() + i) << "$" << i+2;
+    EXPECT_EQ(got[i+1].size(), 1) << "$" << i+2;
+  }
+
+  RE2::SearchStats stats;
+  re.GetSearchStats(&stats);
+  EXPECT_EQ(stats.bitstate_bytes, 0);
+  EXPECT_EQ(stats.onepass_bytes, 0);
+  EXPECT_EQ(stats.nfa_bytes, static_cast<int64_t>(text.size()));
+}
+
+TEST(RE2, BitParallel) {
+  // Searches that only ask whether there is a match run bit-parallel
+  // when the program is small enough; the others use the DFA.
+  struct {
+    const char* regexp;
+    bool bit_parallel;
+  } tests[] = {
+    { "a+b", true },
+    { "(?i)[a-f0-9]{8}-[a-f0-9]{4}", true },
+    { "x*", true },
+    { "^ab+$", true },
+    { "ab+$", true },
+    { "(abc|abd)+e?", true },
+    { "a\\bb", false },
+    { "(?m)^abc", false },
+    { "[a-z]{64}", false },
+  };
+  const char* texts[] = {
+    "", "ab", "aaab", "xaaabx", "abc", "ABCDEF01-9abc", "abdabce", "a b",
+  };
+  for (const auto& t : tests) {
+    RE2 re(t.regexp);
+    ASSERT_TRUE(re.ok()) << t.regexp;
+    for (const char* text : texts) {
+      absl::string_view sp(text);
+      for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                                 RE2::ANCHOR_BOTH}) {
+        absl::string_view m;
+        bool want = re.Match(sp, 0, sp.size(), anchor, &m, 1);
+        EXPECT_EQ(re.Match(sp, 0, sp.size(), anchor, NULL, 0), want)
+            << t.regexp << " on " << text << " anchor=" << anchor;
+      }
+    }
+    RE2::SearchStats stats;
+    re.GetSearchStats(&stats);
+    if (t.bit_parallel)
+      EXPECT_GT(stats.bitparallel_bytes, 0) << t.regexp;
+    else
+      EXPECT_EQ(stats.bitparallel_bytes, 0) << t.regexp;
+  }
+  // Longer texts go to the DFA, which is faster once its cache is warm,
+  // and so do unanchored searches for a regexp anchored at the end,
+  // which the reverse DFA can start at the end of the text.
+  RE2 re("a+b");
+  ASSERT_TRUE(re.ok());
+  EXPECT_TRUE(RE2::PartialMatch(std::string(100, 'a') + "b", re));
+  RE2 end("ab+$");
+  ASSERT_TRUE(end.ok());
+  EXPECT_TRUE(RE2::PartialMatch("xxab", end));
+  RE2::SearchStats stats;
+  re.GetSearchStats(&stats);
+  EXPECT_EQ(stats.bitparallel_bytes, 0);
+  end.GetSearchStats(&stats);
+  EXPECT_EQ(stats.bitparallel_bytes, 0);
+}
+
+TEST(RE2, TaggedDFA) {
+  // Patterns that are not one-pass and have no empty-width assertions
+  // get their submatches from the tagged DFA when BitState is off.
+  struct {
+    const char* regexp;
+    const char* text;
+    const char* want[2];  // NULL if the group does not match
+  } tests[] = {
+    { "(a+)(a*)b", "aaab", { "aaa", "" } },
+    { "(\\w+)\\s*(\\w+)", "hello world", { "hello", "world" } },
+    { "(a|ab)(c|bcd)d*", "abcd", { "a", "bcd" } },
+    { "(.*)(\\d+)", "abc123", { "abc12", "3" } },
+    { "(.*?)(\\d+)", "abc123", { "abc", "123" } },
+    { "(.*)(y)?z", "abz", { "ab", NULL } },
+    { "((a)|b)+b", "abb", { "b", "a" } },
+  };
+  for (const auto& t : tests) {
+    RE2::Options opt;
+    opt.set_bit_state_max_mem(0);
+    RE2 re(t.regexp, opt);
+    ASSERT_TRUE(re.ok()) << t.regexp;
+    absl::string_view got[2];
+    ASSERT_TRUE(RE2::FullMatch(t.text, re, &got[0], &got[1])) << t.regexp;
+    for (int i = 0; i < 2; i++) {
+      if (t.want[i] == NULL)
+        EXPECT_TRUE(got[i].data() == NULL) << t.regexp << " $" << i+1;
+      else
+        EXPECT_EQ(got[i], t.want[i]) << t.regexp << " $" << i+1;
+    }
+    RE2::SearchStats stats;
+    re.GetSearchStats(&stats);
+    EXPECT_EQ(stats.tagged_dfa_bytes, static_cast<int64_t>(strlen(t.text)))
+        << t.regexp;
+    EXPECT_EQ(stats.nfa_bytes, 0) << t.regexp;
+  }
+}
+
+TEST(RE2, GetSearchStats) {
+  // The \b keeps the search below off SearchBitParallel().
+  RE2 re("\\b(a+)(b+)");
+  ASSERT_TRUE(re.ok());
+  RE2::SearchStats stats;
+  re.GetSearchStats(&stats);
+  EXPECT_EQ(stats.dfa_searches, 0);
+  EXPECT_EQ(stats.dfa_mem_budget, 0);
+
+  std::string text = "xxxx aaabbbxxxx";
+  ASSERT_TRUE(RE2::PartialMatch(text, re));
+  re.GetSearchStats(&stats);
+  EXPECT_EQ(stats.dfa_searches, 1);
+  EXPECT_EQ(stats.dfa_bytes, static_cast<int64_t>(text.size()));
+  EXPECT_GT(stats.dfa_states_built, 0);
+  EXPECT_GT(stats.dfa_transitions_built, 0);
+  EXPECT_LE(stats.dfa_transitions_built, stats.dfa_bytes + 1);
+  EXPECT_EQ(stats.dfa_cache_resets, 0);
+  EXPECT_EQ(stats.dfa_failures, 0);
+  EXPECT_GT(stats.dfa_mem_in_use, 0);
+  EXPECT_LT(stats.dfa_mem_in_use, stats.dfa_mem_budget);
+
+  // Submatches of a short anchored text come from OnePass,
+  // without the DFA.
+  std::string a, b;
+  ASSERT_TRUE(RE2::FullMatch("aabb", re, &a, &b));
+  re.GetSearchStats(&stats);
+  EXPECT_EQ(stats.dfa_searches, 1);
+  EXPECT_EQ(stats.onepass_bytes, 4);
+
+  // A DFA that cannot fit in max_mem resets its cache again and again,
+  // gives up and leaves the search to the NFA.
+  RE2::Options opt;
+  opt.set_max_mem(1<<17);
+  opt.set_log_errors(false);
+  RE2 big("[a-q][^u-z]{13}\\n", opt);
+  ASSERT_TRUE(big.ok());
+  std::string random;
+  uint32_t x = 1;
+  for (int i = 0; i < 100000; i++) {
+    x = x * 1103515245 + 12345;
+    random += static_cast<char>('a' + (x >> 16) % 26);
+  }
+  EXPECT_FALSE(RE2::PartialMatch(random, big));
+  big.GetSearchStats(&stats);
+  EXPECT_GT(stats.dfa_cache_resets, 0);
+  EXPECT_GT(stats.dfa_bailouts, 0);
+  EXPECT_GE(stats.dfa_failures, stats.dfa_bailouts);
+  EXPECT_EQ(stats.nfa_bytes, static_cast<int64_t>(random.size()));
+  EXPECT_LE(stats.dfa_mem_in_use, stats.dfa_mem_budget);
+
+  RE2 bad("a(", RE2::Quiet);
+  bad.GetSearchStats(&stats);
+  EXPECT_EQ(stats.dfa_searches, 0);
+}
+
 }  // namespace re2
@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
@@ -19,9 +21,15 @@
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "benchmark/benchmark.h"
+#include "re2/filtered_re2.h"
+#include "re2/pattern_cache.h"
+#include "re2/prefilter.h"
 #include "re2/prog.h"
 #include "re2/re2.h"
 #include "re2/regexp.h"
+#include "re2/serialized_dfa.h"
+#include "re2/set.h"
+#include "re2/stream_matcher.h"
 #include "util/malloc_counter.h"
 #include "util/pcre.h"
 
@@ -137,14 +145,16 @@ typedef void SearchImpl(benchmark::State& state, const char* regexp,
 
 SearchImpl SearchDFA, SearchNFA, SearchOnePass, SearchBitState, SearchPCRE,
     SearchRE2, SearchCachedDFA, SearchCachedNFA, SearchCachedOnePass,
-    SearchCachedBitState, SearchCachedPCRE, SearchCachedRE2;
+    SearchCachedBitState, SearchCachedBitParallel, SearchCachedPCRE,
+    SearchCachedRE2, SearchCachedSerializedDFA;
 
 typedef void ParseImpl(benchmark::State& state, const char* regexp,
                        absl::string_view text);
 
 ParseImpl Parse1NFA, Parse1OnePass, Parse1BitState, Parse1PCRE, Parse1RE2,
     Parse1Backtrack, Parse1CachedNFA, Parse1CachedOnePass, Parse1CachedBitState,
-    Parse1CachedPCRE, Parse1CachedRE2, Parse1CachedBacktrack;
+    Parse1CachedTaggedDFA, Parse1CachedPCRE, Parse1CachedRE2,
+    Parse1CachedBacktrack;
 
 ParseImpl Parse3NFA, Parse3OnePass, Parse3BitState, Parse3PCRE, Parse3RE2,
     Parse3Backtrack, Parse3CachedNFA, Parse3CachedOnePass, Parse3CachedBitState,
@@ -154,6 +164,8 @@ ParseImpl SearchParse2CachedPCRE, SearchParse2CachedRE2;
 
 ParseImpl SearchParse1CachedPCRE, SearchParse1CachedRE2;
 
+Prog* GetCachedProg(const char* regexp);
+
 // Benchmark: failed search for regexp in random text.
 
 // Generate random text that won't contain the search string,
@@ -211,11 +223,13 @@ void Search(benchmark::State& state, const char* regexp, SearchImpl* search) {
 
 void Search_Easy0_CachedDFA(benchmark::State& state)     { Search(state, EASY0, SearchCachedDFA); }
 void Search_Easy0_CachedNFA(benchmark::State& state)     { Search(state, EASY0, SearchCachedNFA); }
+void Search_Easy0_CachedBitParallel(benchmark::State& state) { Search(state, EASY0, SearchCachedBitParallel); }
 void Search_Easy0_CachedPCRE(benchmark::State& state)    { Search(state, EASY0, SearchCachedPCRE); }
 void Search_Easy0_CachedRE2(benchmark::State& state)     { Search(state, EASY0, SearchCachedRE2); }
 
 BENCHMARK_RANGE(Search_Easy0_CachedDFA,     8, 16<<20)->ThreadRange(1, NumCPUs());
 BENCHMARK_RANGE(Search_Easy0_CachedNFA,     8, 256<<10)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Easy0_CachedBitParallel, 8, 16<<20)->ThreadRange(1, NumCPUs());
 #ifdef USEPCRE
 BENCHMARK_RANGE(Search_Easy0_CachedPCRE,    8, 16<<20)->ThreadRange(1, NumCPUs());
 #endif
@@ -223,11 +237,13 @@ BENCHMARK_RANGE(Search_Easy0_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs()
 
 void Search_Easy1_CachedDFA(benchmark::State& state)     { Search(state, EASY1, SearchCachedDFA); }
 void Search_Easy1_CachedNFA(benchmark::State& state)     { Search(state, EASY1, SearchCachedNFA); }
+void Search_Easy1_CachedBitParallel(benchmark::State& state) { Search(state, EASY1, SearchCachedBitParallel); }
 void Search_Easy1_CachedPCRE(benchmark::State& state)    { Search(state, EASY1, SearchCachedPCRE); }
 void Search_Easy1_CachedRE2(benchmark::State& state)     { Search(state, EASY1, SearchCachedRE2); }
 
 BENCHMARK_RANGE(Search_Easy1_CachedDFA,     8, 16<<20)->ThreadRange(1, NumCPUs());
 BENCHMARK_RANGE(Search_Easy1_CachedNFA,     8, 256<<10)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Easy1_CachedBitParallel, 8, 16<<20)->ThreadRange(1, NumCPUs());
 #ifdef USEPCRE
 BENCHMARK_RANGE(Search_Easy1_CachedPCRE,    8, 16<<20)->ThreadRange(1, NumCPUs());
 #endif
@@ -235,11 +251,13 @@ BENCHMARK_RANGE(Search_Easy1_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs()
 
 void Search_Easy2_CachedDFA(benchmark::State& state)     { Search(state, EASY2, SearchCachedDFA); }
 void Search_Easy2_CachedNFA(benchmark::State& state)     { Search(state, EASY2, SearchCachedNFA); }
+void Search_Easy2_CachedBitParallel(benchmark::State& state) { Search(state, EASY2, SearchCachedBitParallel); }
 void Search_Easy2_CachedPCRE(benchmark::State& state)    { Search(state, EASY2, SearchCachedPCRE); }
 void Search_Easy2_CachedRE2(benchmark::State& state)     { Search(state, EASY2, SearchCachedRE2); }
 
 BENCHMARK_RANGE(Search_Easy2_CachedDFA,     8, 16<<20)->ThreadRange(1, NumCPUs());
 BENCHMARK_RANGE(Search_Easy2_CachedNFA,     8, 256<<10)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Easy2_CachedBitParallel, 8, 16<<20)->ThreadRange(1, NumCPUs());
 #ifdef USEPCRE
 BENCHMARK_RANGE(Search_Easy2_CachedPCRE,    8, 16<<20)->ThreadRange(1, NumCPUs());
 #endif
@@ -247,11 +265,13 @@ BENCHMARK_RANGE(Search_Easy2_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs()
 
 void Search_Medium_CachedDFA(benchmark::State& state)     { Search(state, MEDIUM, SearchCachedDFA); }
 void Search_Medium_CachedNFA(benchmark::State& state)     { Search(state, MEDIUM, SearchCachedNFA); }
+void Search_Medium_CachedBitParallel(benchmark::State& state) { Search(state, MEDIUM, SearchCachedBitParallel); }
 void Search_Medium_CachedPCRE(benchmark::State& state)    { Search(state, MEDIUM, SearchCachedPCRE); }
 void Search_Medium_CachedRE2(benchmark::State& state)     { Search(state, MEDIUM, SearchCachedRE2); }
 
 BENCHMARK_RANGE(Search_Medium_CachedDFA,     8, 16<<20)->ThreadRange(1, NumCPUs());
 BENCHMARK_RANGE(Search_Medium_CachedNFA,     8, 256<<10)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Medium_CachedBitParallel, 8, 16<<20)->ThreadRange(1, NumCPUs());
 #ifdef USEPCRE
 BENCHMARK_RANGE(Search_Medium_CachedPCRE,    8, 256<<10)->ThreadRange(1, NumCPUs());
 #endif
@@ -281,6 +301,137 @@ BENCHMARK_RANGE(Search_Fanout_CachedPCRE,    8, 4<<10)->ThreadRange(1, NumCPUs()
 #endif
 BENCHMARK_RANGE(Search_Fanout_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs());
 
+// These have no prefix to accelerate, but they require a literal,
+// which RE2 (but not the DFA on its own) searches for instead.
+#define EMAIL      "\\w+@example\\.com"
+#define MILLIS     "[0-9]+ millis\\b"
+
+void Search_Email_CachedDFA(benchmark::State& state)      { Search(state, EMAIL, SearchCachedDFA); }
+void Search_Email_CachedRE2(benchmark::State& state)      { Search(state, EMAIL, SearchCachedRE2); }
+void Search_Millis_CachedDFA(benchmark::State& state)     { Search(state, MILLIS, SearchCachedDFA); }
+void Search_Millis_CachedRE2(benchmark::State& state)     { Search(state, MILLIS, SearchCachedRE2); }
+
+BENCHMARK_RANGE(Search_Email_CachedDFA,      8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Email_CachedRE2,      8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Millis_CachedDFA,     8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Millis_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: searching with a DFA state cache too small for the search,
+// which therefore resets the cache again and again, either keeping the
+// hottest states or discarding all of them, as it used to.
+// The range is the memory budget, not the size of the text.
+
+void SearchSmallCacheDFA(benchmark::State& state, const char* regexp,
+                         bool keep) {
+  Regexp* re = Regexp::Parse(regexp, Regexp::LikePerl, NULL);
+  ABSL_CHECK(re);
+  Prog* prog = re->CompileToProg(state.range(0));
+  ABSL_CHECK(prog);
+  std::string text = RandomText(1<<20);
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(false);
+  Prog::TESTING_ONLY_set_dfa_keep_hot_states(keep);
+  for (auto _ : state) {
+    bool failed = false;
+    ABSL_CHECK(!prog->SearchDFA(text, absl::string_view(), Prog::kUnanchored,
+                                Prog::kFirstMatch, NULL, &failed, NULL));
+    ABSL_CHECK(!failed);
+  }
+  Prog::TESTING_ONLY_set_dfa_keep_hot_states(true);
+  Prog::TESTING_ONLY_set_dfa_should_bail_when_slow(true);
+  state.SetBytesProcessed(state.iterations() * text.size());
+  delete prog;
+  re->Decref();
+}
+
+// Each state of the DFA for this one records which of the last 14 bytes
+// were in [a-q], so random text visits many thousands of them.
+#define EXPONENTIAL "[a-q][^u-z]{13}\\n"
+
+void Search_Hard_SmallCache_KeepHot(benchmark::State& state)             { SearchSmallCacheDFA(state, HARD, true); }
+void Search_Hard_SmallCache_DiscardAll(benchmark::State& state)          { SearchSmallCacheDFA(state, HARD, false); }
+void Search_Fanout_SmallCache_KeepHot(benchmark::State& state)           { SearchSmallCacheDFA(state, FANOUT, true); }
+void Search_Fanout_SmallCache_DiscardAll(benchmark::State& state)        { SearchSmallCacheDFA(state, FANOUT, false); }
+void Search_Exponential_SmallCache_KeepHot(benchmark::State& state)      { SearchSmallCacheDFA(state, EXPONENTIAL, true); }
+void Search_Exponential_SmallCache_DiscardAll(benchmark::State& state)   { SearchSmallCacheDFA(state, EXPONENTIAL, false); }
+
+BENCHMARK(Search_Hard_SmallCache_KeepHot)->RangeMultiplier(2)->Range(32<<10, 256<<10);
+BENCHMARK(Search_Hard_SmallCache_DiscardAll)->RangeMultiplier(2)->Range(32<<10, 256<<10);
+BENCHMARK(Search_Fanout_SmallCache_KeepHot)->RangeMultiplier(2)->Range(256<<10, 2<<20);
+BENCHMARK(Search_Fanout_SmallCache_DiscardAll)->RangeMultiplier(2)->Range(256<<10, 2<<20);
+BENCHMARK(Search_Exponential_SmallCache_KeepHot)->RangeMultiplier(2)->Range(64<<10, 4<<20);
+BENCHMARK(Search_Exponential_SmallCache_DiscardAll)->RangeMultiplier(2)->Range(64<<10, 4<<20);
+
+// Benchmark: the first search with a new RE2, with or without warming up
+// its DFA beforehand on a sample of the same kind of text.
+
+void SearchFirstCall(benchmark::State& state, const char* regexp, bool warm) {
+  std::string text = RandomText(state.range(0));
+  std::string sample = RandomText(64<<10);
+  for (auto _ : state) {
+    state.PauseTiming();
+    RE2 re(regexp, RE2::Latin1);
+    ABSL_CHECK(re.ok());
+    if (warm)
+      re.Warmup({sample}, RE2::UNANCHORED);
+    state.ResumeTiming();
+    ABSL_CHECK(!RE2::PartialMatch(text, re));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Benchmark: the first search with a new Prog, whose DFA has no states
+// yet, against running it bit-parallel.
+
+void SearchColdProg(benchmark::State& state, const char* regexp,
+                    bool bit_parallel) {
+  std::string text = RandomText(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    Regexp* re = Regexp::Parse(regexp, Regexp::LikePerl, NULL);
+    ABSL_CHECK(re);
+    Prog* prog = re->CompileToProg(0);
+    ABSL_CHECK(prog);
+    ABSL_CHECK(prog->IsBitParallel());
+    state.ResumeTiming();
+    if (bit_parallel) {
+      ABSL_CHECK(!prog->SearchBitParallel(text, absl::string_view(),
+                                          Prog::kUnanchored,
+                                          Prog::kFirstMatch));
+    } else {
+      bool failed = false;
+      ABSL_CHECK(!prog->SearchDFA(text, absl::string_view(),
+                                  Prog::kUnanchored, Prog::kFirstMatch,
+                                  NULL, &failed, NULL));
+      ABSL_CHECK(!failed);
+    }
+    state.PauseTiming();
+    delete prog;
+    re->Decref();
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void Search_Easy1_Cold_DFA(benchmark::State& state)          { SearchColdProg(state, EASY1, false); }
+void Search_Easy1_Cold_BitParallel(benchmark::State& state)  { SearchColdProg(state, EASY1, true); }
+void Search_Medium_Cold_DFA(benchmark::State& state)         { SearchColdProg(state, MEDIUM, false); }
+void Search_Medium_Cold_BitParallel(benchmark::State& state) { SearchColdProg(state, MEDIUM, true); }
+
+BENCHMARK_RANGE(Search_Easy1_Cold_DFA, 8, 1<<20);
+BENCHMARK_RANGE(Search_Easy1_Cold_BitParallel, 8, 1<<20);
+BENCHMARK_RANGE(Search_Medium_Cold_DFA, 8, 1<<20);
+BENCHMARK_RANGE(Search_Medium_Cold_BitParallel, 8, 1<<20);
+
+void Search_Hard_FirstCall_Cold(benchmark::State& state)          { SearchFirstCall(state, HARD, false); }
+void Search_Hard_FirstCall_Warm(benchmark::State& state)          { SearchFirstCall(state, HARD, true); }
+void Search_Exponential_FirstCall_Cold(benchmark::State& state)   { SearchFirstCall(state, EXPONENTIAL, false); }
+void Search_Exponential_FirstCall_Warm(benchmark::State& state)   { SearchFirstCall(state, EXPONENTIAL, true); }
+
+BENCHMARK_RANGE(Search_Hard_FirstCall_Cold, 1<<10, 1<<20);
+BENCHMARK_RANGE(Search_Hard_FirstCall_Warm, 1<<10, 1<<20);
+BENCHMARK_RANGE(Search_Exponential_FirstCall_Cold, 1<<10, 1<<20);
+BENCHMARK_RANGE(Search_Exponential_FirstCall_Warm, 1<<10, 1<<20);
+
 void Search_Parens_CachedDFA(benchmark::State& state)     { Search(state, PARENS, SearchCachedDFA); }
 void Search_Parens_CachedNFA(benchmark::State& state)     { Search(state, PARENS, SearchCachedNFA); }
 void Search_Parens_CachedPCRE(benchmark::State& state)    { Search(state, PARENS, SearchCachedPCRE); }
@@ -293,6 +444,33 @@ BENCHMARK_RANGE(Search_Parens_CachedPCRE,    8, 8)->ThreadRange(1, NumCPUs());
 #endif
 BENCHMARK_RANGE(Search_Parens_CachedRE2,     8, 16<<20)->ThreadRange(1, NumCPUs());
 
+// Same, but asking the NFA for all of the submatches, so that it has
+// to track the capture slots of every thread.
+
+void Search_ParensCaptures_CachedNFA(benchmark::State& state) {
+  std::string s = RandomText(state.range(0));
+  s += "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  Prog* prog = GetCachedProg(PARENS);
+  absl::string_view sp[28];  // 28 because sp[0] is whole match.
+  for (auto _ : state) {
+    ABSL_CHECK(prog->SearchNFA(s, absl::string_view(), Prog::kUnanchored,
+                               Prog::kFirstMatch, sp, 28));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_RANGE(Search_ParensCaptures_CachedNFA, 8, 256<<10)->ThreadRange(1, NumCPUs());
+
+// Compare the lazily built DFA with one built ahead of time.
+
+void Search_Easy1_SerializedDFA(benchmark::State& state)  { Search(state, EASY1, SearchCachedSerializedDFA); }
+void Search_Medium_SerializedDFA(benchmark::State& state) { Search(state, MEDIUM, SearchCachedSerializedDFA); }
+void Search_Hard_SerializedDFA(benchmark::State& state)   { Search(state, HARD, SearchCachedSerializedDFA); }
+
+BENCHMARK_RANGE(Search_Easy1_SerializedDFA,  8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Medium_SerializedDFA, 8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Hard_SerializedDFA,   8, 16<<20)->ThreadRange(1, NumCPUs());
+
 void SearchBigFixed(benchmark::State& state, SearchImpl* search) {
   std::string s;
   s.append(state.range(0)/2, 'x');
@@ -315,6 +493,71 @@ BENCHMARK_RANGE(Search_BigFixed_CachedPCRE,    8, 32<<10)->ThreadRange(1, NumCPU
 #endif
 BENCHMARK_RANGE(Search_BigFixed_CachedRE2,     8, 1<<20)->ThreadRange(1, NumCPUs());
 
+// Compare the prefix accel kernels on text in which candidates for
+// the prefix are rare (random text) and on text in which they are common
+// (log lines that start and end like the prefix, but don't match it).
+
+void SearchPrefixAccel(benchmark::State& state, const std::string& text,
+                       Prog::PrefixAccelKernel kernel) {
+  Regexp* re = Regexp::Parse("ERROR: timeout", Regexp::LikePerl, NULL);
+  ABSL_CHECK(re);
+  Prog* prog = re->CompileToProg(0);
+  ABSL_CHECK(prog);
+  ABSL_CHECK(prog->can_prefix_accel());
+  if (prog->TESTING_ONLY_set_prefix_accel_kernel(kernel)) {
+    for (auto _ : state) {
+      bool failed = false;
+      ABSL_CHECK_EQ(prog->SearchDFA(text, absl::string_view(),
+                                    Prog::kUnanchored, Prog::kFirstMatch,
+                                    NULL, &failed, NULL),
+                    false);
+      ABSL_CHECK_EQ(failed, false);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+  } else {
+    state.SkipWithError("kernel not supported");
+  }
+  delete prog;
+  re->Decref();
+}
+
+void SearchPrefixAccelRandom(benchmark::State& state,
+                             Prog::PrefixAccelKernel kernel) {
+  std::string text = RandomText(state.range(0));
+  SearchPrefixAccel(state, text, kernel);
+}
+
+void SearchPrefixAccelLogs(benchmark::State& state,
+                           Prog::PrefixAccelKernel kernel) {
+  std::string text;
+  while (text.size() < static_cast<size_t>(state.range(0)))
+    text.append("ERROR: restart\n");
+  text.resize(state.range(0));
+  SearchPrefixAccel(state, text, kernel);
+}
+
+void Search_PrefixAccel_Random_FrontAndBack(benchmark::State& state) { SearchPrefixAccelRandom(state, Prog::kPrefixAccelFrontAndBack); }
+void Search_PrefixAccel_Random_Scalar(benchmark::State& state)       { SearchPrefixAccelRandom(state, Prog::kPrefixAccelScalar); }
+void Search_PrefixAccel_Random_SSE2(benchmark::State& state)         { SearchPrefixAccelRandom(state, Prog::kPrefixAccelSSE2); }
+void Search_PrefixAccel_Random_AVX2(benchmark::State& state)         { SearchPrefixAccelRandom(state, Prog::kPrefixAccelAVX2); }
+void Search_PrefixAccel_Random_NEON(benchmark::State& state)         { SearchPrefixAccelRandom(state, Prog::kPrefixAccelNEON); }
+void Search_PrefixAccel_Logs_FrontAndBack(benchmark::State& state)   { SearchPrefixAccelLogs(state, Prog::kPrefixAccelFrontAndBack); }
+void Search_PrefixAccel_Logs_Scalar(benchmark::State& state)         { SearchPrefixAccelLogs(state, Prog::kPrefixAccelScalar); }
+void Search_PrefixAccel_Logs_SSE2(benchmark::State& state)           { SearchPrefixAccelLogs(state, Prog::kPrefixAccelSSE2); }
+void Search_PrefixAccel_Logs_AVX2(benchmark::State& state)           { SearchPrefixAccelLogs(state, Prog::kPrefixAccelAVX2); }
+void Search_PrefixAccel_Logs_NEON(benchmark::State& state)           { SearchPrefixAccelLogs(state, Prog::kPrefixAccelNEON); }
+
+BENCHMARK_RANGE(Search_PrefixAccel_Random_FrontAndBack, 8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Random_Scalar,       8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Random_SSE2,         8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Random_AVX2,         8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Random_NEON,         8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Logs_FrontAndBack,   8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Logs_Scalar,         8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Logs_SSE2,           8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Logs_AVX2,           8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_PrefixAccel_Logs_NEON,           8, 1<<20)->ThreadRange(1, NumCPUs());
+
 // Benchmark: FindAndConsume
 
 void FindAndConsume(benchmark::State& state) {
@@ -332,6 +575,58 @@ void FindAndConsume(benchmark::State& state) {
 
 BENCHMARK_RANGE(FindAndConsume, 8, 16<<20)->ThreadRange(1, NumCPUs());
 
+// Benchmark: many short searches against one shared regexp.
+// The text is short enough that the cost of acquiring the DFA
+// cache lock dominates, so this shows how well readers scale.
+
+void SearchShort(benchmark::State& state, const char* regexp,
+                 SearchImpl* search) {
+  std::string s = RandomText(state.range(0));
+  search(state, regexp, s, Prog::kUnanchored, false);
+  state.SetItemsProcessed(state.iterations());
+}
+
+void Search_Short_CachedDFA(benchmark::State& state)     { SearchShort(state, MEDIUM, SearchCachedDFA); }
+void Search_Short_CachedRE2(benchmark::State& state)     { SearchShort(state, MEDIUM, SearchCachedRE2); }
+
+BENCHMARK(Search_Short_CachedDFA)->Arg(16)->Arg(64)->ThreadRange(1, NumCPUs());
+BENCHMARK(Search_Short_CachedRE2)->Arg(16)->Arg(64)->ThreadRange(1, NumCPUs());
+
+// Benchmark: as above, but with each thread using its own DFAs,
+// which avoids contention for the DFA state caches entirely.
+// Compare against Search_*_CachedRE2.
+
+void SearchPerThreadDFA(benchmark::State& state, const char* regexp) {
+  static auto& mutex = *new absl::Mutex;
+  static auto& cache = *new absl::flat_hash_map<std::string, RE2*>;
+  RE2* re;
+  {
+    absl::MutexLock lock(mutex);
+    re = cache[regexp];
+    if (re == NULL) {
+      RE2::Options opt;
+      opt.set_per_thread_dfa(true);
+      re = new RE2(regexp, opt);
+      ABSL_CHECK_EQ(re->error(), "");
+      cache[regexp] = re;
+    }
+  }
+  std::string s = RandomText(state.range(0));
+  for (auto _ : state) {
+    ABSL_CHECK(!RE2::PartialMatch(s, *re));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void Search_Short_PerThreadRE2(benchmark::State& state)  { SearchPerThreadDFA(state, MEDIUM); }
+void Search_Hard_PerThreadRE2(benchmark::State& state)   { SearchPerThreadDFA(state, HARD); }
+void Search_Fanout_PerThreadRE2(benchmark::State& state) { SearchPerThreadDFA(state, FANOUT); }
+
+BENCHMARK(Search_Short_PerThreadRE2)->Arg(16)->Arg(64)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Hard_PerThreadRE2,   8, 16<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Fanout_PerThreadRE2, 8, 16<<20)->ThreadRange(1, NumCPUs());
+
 // Benchmark: successful anchored search.
 
 void SearchSuccess(benchmark::State& state, const char* regexp,
@@ -610,6 +905,7 @@ void Parse_CachedSplitHard_PCRE(benchmark::State& state)      { Parse1SplitHard(
 void Parse_CachedSplitHard_RE2(benchmark::State& state)       { Parse1SplitHard(state, Parse1CachedRE2); }
 void Parse_CachedSplitHard_BitState(benchmark::State& state)  { Parse1SplitHard(state, Parse1CachedBitState); }
 void Parse_CachedSplitHard_Backtrack(benchmark::State& state) { Parse1SplitHard(state, Parse1CachedBacktrack); }
+void Parse_CachedSplitHard_TaggedDFA(benchmark::State& state) { Parse1SplitHard(state, Parse1CachedTaggedDFA); }
 
 #ifdef USEPCRE
 BENCHMARK(Parse_CachedSplitHard_PCRE)->ThreadRange(1, NumCPUs());
@@ -618,6 +914,7 @@ BENCHMARK(Parse_CachedSplitHard_RE2)->ThreadRange(1, NumCPUs());
 BENCHMARK(Parse_CachedSplitHard_BitState)->ThreadRange(1, NumCPUs());
 BENCHMARK(Parse_CachedSplitHard_NFA)->ThreadRange(1, NumCPUs());
 BENCHMARK(Parse_CachedSplitHard_Backtrack)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedSplitHard_TaggedDFA)->ThreadRange(1, NumCPUs());
 
 // Benchmark: Parse1SplitHard, big text, small match.
 
@@ -653,11 +950,15 @@ void Parse1SplitBig2(benchmark::State& state,
 
 void Parse_CachedSplitBig2_PCRE(benchmark::State& state)      { Parse1SplitBig2(state, SearchParse1CachedPCRE); }
 void Parse_CachedSplitBig2_RE2(benchmark::State& state)       { Parse1SplitBig2(state, SearchParse1CachedRE2); }
+void Parse_CachedSplitBig2_NFA(benchmark::State& state)       { Parse1SplitBig2(state, Parse1CachedNFA); }
+void Parse_CachedSplitBig2_TaggedDFA(benchmark::State& state) { Parse1SplitBig2(state, Parse1CachedTaggedDFA); }
 
 #ifdef USEPCRE
 BENCHMARK(Parse_CachedSplitBig2_PCRE)->ThreadRange(1, NumCPUs());
 #endif
 BENCHMARK(Parse_CachedSplitBig2_RE2)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedSplitBig2_NFA)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedSplitBig2_TaggedDFA)->ThreadRange(1, NumCPUs());
 
 // Benchmark: measure time required to parse (but not execute)
 // a simple regular expression.
@@ -752,6 +1053,22 @@ void CompileRE2(benchmark::State& state, const std::string& regexp) {
   }
 }
 
+void DeserializeRE2(benchmark::State& state, const std::string& regexp) {
+  std::string data;
+  ABSL_CHECK(RE2(regexp).Serialize(&data, NULL));
+  for (auto _ : state) {
+    std::unique_ptr<RE2> re = RE2::Deserialize(data, NULL);
+    ABSL_CHECK(re != NULL);
+  }
+}
+
+void CachedCompileRE2(benchmark::State& state, const std::string& regexp) {
+  for (auto _ : state) {
+    std::shared_ptr<const RE2> re = RE2::PatternCache::Global()->Get(regexp);
+    ABSL_CHECK_EQ(re->error(), "");
+  }
+}
+
 void RunBuild(benchmark::State& state, const std::string& regexp,
               void (*run)(benchmark::State&, const std::string&)) {
   run(state, regexp);
@@ -763,6 +1080,11 @@ void RunBuild(benchmark::State& state, const std::string& regexp,
 ABSL_FLAG(std::string, compile_regexp, "(.*)-(\\d+)-of-(\\d+)",
           "regexp for compile benchmarks");
 
+// Unicode classes dominate the time it takes to compile this one.
+ABSL_FLAG(std::string, compile_unicode_regexp,
+          "([\\p{L}\\p{N}_]+)@([^\\p{Z}\\p{P}]+)\\.\\p{Han}+",
+          "regexp for Unicode compile benchmarks");
+
 namespace re2 {
 
 void BM_PCRE_Compile(benchmark::State& state)             { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), CompilePCRE); }
@@ -774,6 +1096,22 @@ void BM_Regexp_Compile(benchmark::State& state)           { RunBuild(state, absl
 void BM_Regexp_SimplifyCompile(benchmark::State& state)   { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), SimplifyCompileRegexp); }
 void BM_Regexp_NullWalk(benchmark::State& state)          { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), NullWalkRegexp); }
 void BM_RE2_Compile(benchmark::State& state)              { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), CompileRE2); }
+void BM_RE2_CachedCompile(benchmark::State& state)        { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), CachedCompileRE2); }
+void BM_RE2_Deserialize(benchmark::State& state)          { RunBuild(state, absl::GetFlag(FLAGS_compile_regexp), DeserializeRE2); }
+
+// The uncached Unicode compile benchmarks turn off the compiler's global
+// cache of large character classes, so they run in one thread only.
+void RunUncachedBuild(benchmark::State& state, const std::string& regexp,
+                      void (*run)(benchmark::State&, const std::string&)) {
+  Prog::TESTING_ONLY_set_compile_char_class_cache(false);
+  RunBuild(state, regexp, run);
+  Prog::TESTING_ONLY_set_compile_char_class_cache(true);
+}
+
+void BM_CompileToProg_Unicode(benchmark::State& state)          { RunBuild(state, absl::GetFlag(FLAGS_compile_unicode_regexp), CompileToProg); }
+void BM_CompileToProg_UnicodeUncached(benchmark::State& state)  { RunUncachedBuild(state, absl::GetFlag(FLAGS_compile_unicode_regexp), CompileToProg); }
+void BM_RE2_Compile_Unicode(benchmark::State& state)            { RunBuild(state, absl::GetFlag(FLAGS_compile_unicode_regexp), CompileRE2); }
+void BM_RE2_Compile_UnicodeUncached(benchmark::State& state)    { RunUncachedBuild(state, absl::GetFlag(FLAGS_compile_unicode_regexp), CompileRE2); }
 
 #ifdef USEPCRE
 BENCHMARK(BM_PCRE_Compile)->ThreadRange(1, NumCPUs());
@@ -786,6 +1124,12 @@ BENCHMARK(BM_Regexp_Compile)->ThreadRange(1, NumCPUs());
 BENCHMARK(BM_Regexp_SimplifyCompile)->ThreadRange(1, NumCPUs());
 BENCHMARK(BM_Regexp_NullWalk)->ThreadRange(1, NumCPUs());
 BENCHMARK(BM_RE2_Compile)->ThreadRange(1, NumCPUs());
+BENCHMARK(BM_RE2_CachedCompile)->ThreadRange(1, NumCPUs());
+BENCHMARK(BM_RE2_Deserialize)->ThreadRange(1, NumCPUs());
+BENCHMARK(BM_CompileToProg_Unicode)->ThreadRange(1, NumCPUs());
+BENCHMARK(BM_CompileToProg_UnicodeUncached);
+BENCHMARK(BM_RE2_Compile_Unicode)->ThreadRange(1, NumCPUs());
+BENCHMARK(BM_RE2_Compile_UnicodeUncached);
 
 // Makes text of size nbytes, then calls run to search
 // the text for regexp iters times.
@@ -974,8 +1318,9 @@ Prog* GetCachedProg(const char* regexp) {
     ABSL_CHECK(prog);
     cache[regexp] = prog;
     re->Decref();
-    // We must call this here - while we have exclusive access.
+    // We must call these here - while we have exclusive access.
     prog->IsOnePass();
+    prog->CanTaggedDFA();
   }
   return prog;
 }
@@ -1030,6 +1375,18 @@ void SearchCachedNFA(benchmark::State& state, const char* regexp,
   }
 }
 
+void SearchCachedBitParallel(benchmark::State& state, const char* regexp,
+                             absl::string_view text, Prog::Anchor anchor,
+                             bool expect_match) {
+  Prog* prog = GetCachedProg(regexp);
+  ABSL_CHECK(prog->IsBitParallel());
+  for (auto _ : state) {
+    ABSL_CHECK_EQ(prog->SearchBitParallel(text, absl::string_view(), anchor,
+                                          Prog::kFirstMatch),
+                  expect_match);
+  }
+}
+
 void SearchCachedOnePass(benchmark::State& state, const char* regexp,
                          absl::string_view text, Prog::Anchor anchor,
                          bool expect_match) {
@@ -1080,6 +1437,33 @@ void SearchCachedRE2(benchmark::State& state, const char* regexp,
   }
 }
 
+void SearchCachedSerializedDFA(benchmark::State& state, const char* regexp,
+                               absl::string_view text, Prog::Anchor anchor,
+                               bool expect_match) {
+  static auto& mutex = *new absl::Mutex;
+  static auto& cache =
+      *new absl::flat_hash_map<std::string, RE2::SerializedDFA*>;
+  RE2::SerializedDFA* dfa;
+  {
+    absl::MutexLock lock(mutex);
+    std::string key = absl::StrFormat("%d %s", anchor, regexp);
+    dfa = cache[key];
+    if (dfa == NULL) {
+      RE2 re(regexp);
+      std::string* data = new std::string;
+      ABSL_CHECK(RE2::SerializedDFA::Serialize(
+          re, anchor == Prog::kAnchored ? RE2::ANCHOR_START : RE2::UNANCHORED,
+          data, NULL));
+      dfa = new RE2::SerializedDFA(*data);
+      ABSL_CHECK(dfa->ok());
+      cache[key] = dfa;
+    }
+  }
+  for (auto _ : state) {
+    ABSL_CHECK_EQ(dfa->Match(text), expect_match);
+  }
+}
+
 // Runs implementation to full match regexp against text,
 // extracting three submatches.  Expects match always.
 
@@ -1305,6 +1689,17 @@ void Parse1CachedNFA(benchmark::State& state, const char* regexp,
   }
 }
 
+void Parse1CachedTaggedDFA(benchmark::State& state, const char* regexp,
+                           absl::string_view text) {
+  Prog* prog = GetCachedProg(regexp);
+  ABSL_CHECK(prog->CanTaggedDFA());
+  absl::string_view sp[2];  // 2 because sp[0] is whole match.
+  for (auto _ : state) {
+    bool failed = false;
+    ABSL_CHECK(prog->SearchTaggedDFA(text, text, sp, 2, &failed));
+  }
+}
+
 void Parse1CachedOnePass(benchmark::State& state, const char* regexp,
                          absl::string_view text) {
   Prog* prog = GetCachedProg(regexp);
@@ -1602,4 +1997,362 @@ BENCHMARK(PossibleMatchRange_Complex);
 BENCHMARK(PossibleMatchRange_Prefix);
 BENCHMARK(PossibleMatchRange_NoProg);
 
+// Benchmark: RE2::Set of URL patterns, each of which requires a literal
+// (the site name) near the start of a match.
+
+void SetURLs(benchmark::State& state, const std::string& suffix) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  for (int i = 0; i < 1000; i++)
+    ABSL_CHECK_EQ(s.Add(absl::StrFormat(
+                            "https?://(www\\.)?site%d\\.example/[a-z]+", i),
+                        NULL),
+                  i);
+  ABSL_CHECK(s.Compile());
+  std::string text = RandomText(state.range(0)) + suffix;
+  std::vector<int> v;
+  for (auto _ : state) {
+    ABSL_CHECK_EQ(s.Match(text, &v), !suffix.empty());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Set_URLs_NoMatch(benchmark::State& state)    { SetURLs(state, ""); }
+void Set_URLs_MatchAtEnd(benchmark::State& state) { SetURLs(state, " https://site999.example/x"); }
+
+BENCHMARK_RANGE(Set_URLs_NoMatch,    8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Set_URLs_MatchAtEnd, 8, 1<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: parsing and compiling an RE2::Set of many patterns.
+
+void Set_Compile(benchmark::State& state) {
+  RE2::Options opt;
+  opt.set_max_mem(int64_t{1}<<30);
+  std::vector<std::string> patterns;
+  for (int i = 0; i < state.range(0); i++)
+    patterns.push_back(
+        absl::StrFormat("(user|admin)%d@host%d\\.example", i, i % 97));
+  for (auto _ : state) {
+    RE2::Set s(opt, RE2::ANCHOR_BOTH);
+    for (int i = 0; i < state.range(0); i++)
+      ABSL_CHECK_EQ(s.Add(patterns[i], NULL), i);
+    ABSL_CHECK(s.Compile());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_RANGE(Set_Compile, 1<<10, 1<<17);
+
+// Benchmark: locating the match of the same URL patterns, either by
+// running the RE2 for each regexp that the set says matched, as callers
+// used to have to, or by asking the set where the matches end (and,
+// if want_begin, where they begin).
+
+void SetURLsLocate(benchmark::State& state, bool positions, bool want_begin) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  std::vector<std::unique_ptr<RE2>> res;
+  for (int i = 0; i < 1000; i++) {
+    std::string pattern =
+        absl::StrFormat("https?://(www\\.)?site%d\\.example/[a-z]+", i);
+    ABSL_CHECK_EQ(s.Add(pattern, NULL), i);
+    res.emplace_back(new RE2(pattern));
+  }
+  ABSL_CHECK(s.Compile());
+  std::string text = RandomText(state.range(0)) +
+                     " https://site999.example/x " +
+                     RandomText(state.range(0));
+  std::vector<int> v;
+  std::vector<RE2::Set::MatchPosition> found;
+  absl::string_view m;
+  for (auto _ : state) {
+    if (positions) {
+      ABSL_CHECK(s.MatchPositions(text, want_begin, &found, NULL));
+      ABSL_CHECK_EQ(found.size(), size_t{1});
+    } else {
+      ABSL_CHECK(s.Match(text, &v));
+      for (int i : v)
+        ABSL_CHECK(res[i]->Match(text, 0, text.size(), RE2::UNANCHORED,
+                                 &m, 1));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Set_URLs_LocateWithRE2(benchmark::State& state)  { SetURLsLocate(state, false, false); }
+void Set_URLs_MatchEnds(benchmark::State& state)      { SetURLsLocate(state, true, false); }
+void Set_URLs_MatchPositions(benchmark::State& state) { SetURLsLocate(state, true, true); }
+
+BENCHMARK_RANGE(Set_URLs_LocateWithRE2,  8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Set_URLs_MatchEnds,      8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Set_URLs_MatchPositions, 8, 1<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: FilteredRE2 with the same URL patterns, either finding the
+// atoms in the text itself or being given them by a caller that looks
+// for each atom in the lowercased text, as callers used to have to.
+
+void FilteredURLs(benchmark::State& state, bool builtin) {
+  FilteredRE2 f;
+  for (int i = 0; i < 1000; i++) {
+    int id;
+    ABSL_CHECK_EQ(f.Add(absl::StrFormat(
+                            "https?://(www\\.)?site%d\\.example/[a-z]+", i),
+                        RE2::DefaultOptions, &id),
+                  RE2::NoError);
+  }
+  std::vector<std::string> atoms;
+  f.Compile(&atoms);
+  std::string text = RandomText(state.range(0)) + " https://site999.example/x";
+  std::vector<int> v;
+  for (auto _ : state) {
+    if (builtin) {
+      f.AllMatches(text, &v);
+    } else {
+      std::string lower = Prefilter::ToLowerUTF8(text);
+      std::vector<int> matched;
+      for (size_t i = 0; i < atoms.size(); i++)
+        if (lower.find(atoms[i]) != std::string::npos)
+          matched.push_back(static_cast<int>(i));
+      f.AllMatches(text, matched, &v);
+    }
+    ABSL_CHECK_EQ(v.size(), size_t{1});
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void FilteredRE2_URLs_Builtin(benchmark::State& state)  { FilteredURLs(state, true); }
+void FilteredRE2_URLs_TwoStep(benchmark::State& state)  { FilteredURLs(state, false); }
+
+BENCHMARK_RANGE(FilteredRE2_URLs_Builtin, 8, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(FilteredRE2_URLs_TwoStep, 8, 1<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: searching 1MB of text written to a StreamMatcher in chunks of
+// the given size.  Compare with Search_*_CachedDFA, which sees all of the
+// text at once.
+
+void SearchStream(benchmark::State& state, const char* regexp) {
+  std::string text = RandomText(1<<20);
+  RE2 re(regexp);
+  RE2::StreamMatcher m(re);
+  ABSL_CHECK(m.ok());
+  size_t n = static_cast<size_t>(state.range(0));
+  std::vector<int64_t> v;
+  for (auto _ : state) {
+    m.Reset();
+    for (size_t i = 0; i < text.size(); i += n) {
+      ABSL_CHECK(m.Write(absl::string_view(text).substr(i, n), &v));
+      ABSL_CHECK(v.empty());
+    }
+    ABSL_CHECK(m.Finish(&v));
+    ABSL_CHECK(v.empty());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Search_Stream_Easy1(benchmark::State& state)   { SearchStream(state, EASY1); }
+void Search_Stream_Medium(benchmark::State& state)  { SearchStream(state, MEDIUM); }
+
+BENCHMARK_RANGE(Search_Stream_Easy1,  64, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(Search_Stream_Medium, 64, 1<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: searching 1GB of synthetic log data, in which the line
+// that matches is the last one, with ParallelMatch() and state.range(0)
+// threads.
+
+const std::string& LogData() {
+  static const std::string* data = [] {
+    static const char* levels[] = {"DEBUG", "INFO", "WARN"};
+    static const char* words[] = {"request", "handled", "cache", "miss",
+                                  "user", "session", "opened", "closed"};
+    std::string* s = new std::string;
+    s->reserve((1<<30) + 100);
+    uint32_t x = 1;
+    while (s->size() < 1<<30) {
+      x = x * 1103515245 + 12345;
+      absl::StrAppendFormat(s, "2026-10-16 %02d:%02d:%02d %s worker-%d %s %s "
+                               "in %dms\n",
+                            (x >> 8) % 24, (x >> 12) % 60, (x >> 18) % 60,
+                            levels[(x >> 24) % 3], (x >> 4) % 64,
+                            words[(x >> 16) % 8], words[(x >> 20) % 8],
+                            (x >> 10) % 1000);
+    }
+    s->append("2026-10-16 23:59:59 ERROR worker-7 request timed out\n");
+    return s;
+  }();
+  return *data;
+}
+
+void SearchParallelLog(benchmark::State& state, const char* regexp) {
+  const std::string& text = LogData();
+  RE2 re(regexp);
+  ABSL_CHECK(re.ok());
+  int nthreads = static_cast<int>(state.range(0));
+  absl::string_view m;
+  for (auto _ : state) {
+    ABSL_CHECK(re.ParallelMatch(text, 0, text.size(), RE2::UNANCHORED, &m, 1,
+                                nthreads));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Search_Parallel_Log_Literal(benchmark::State& state) { SearchParallelLog(state, "ERROR [a-z]+-\\d+ .* timed out"); }
+void Search_Parallel_Log_Class(benchmark::State& state)   { SearchParallelLog(state, "[A-Z]{5} [a-z]+-\\d+ .* timed out"); }
+
+BENCHMARK(Search_Parallel_Log_Literal)->RangeMultiplier(2)->Range(1, NumCPUs())->UseRealTime();
+BENCHMARK(Search_Parallel_Log_Class)->RangeMultiplier(2)->Range(1, NumCPUs())->UseRealTime();
+
+// Benchmark: matching a million 32-byte strings, one call at a time
+// or in batches of state.range(0).
+
+void MatchShortStrings(benchmark::State& state, bool set, bool batch) {
+  static const std::string* text =
+      new std::string(RandomText(16<<20) + RandomText(16<<20));
+  std::vector<absl::string_view> texts;
+  for (size_t i = 0; i < text->size(); i += 32)
+    texts.push_back(absl::string_view(*text).substr(i, 32));
+  RE2 re("[a-z]+=[0-9]+;");
+  ABSL_CHECK(re.ok());
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ABSL_CHECK_GE(s.Add("[a-z]+=[0-9]+;", NULL), 0);
+  ABSL_CHECK_GE(s.Add("\\d{4}-\\d{2}", NULL), 0);
+  ABSL_CHECK(s.Compile());
+  size_t n = static_cast<size_t>(state.range(0));
+  std::vector<bool> matched;
+  for (auto _ : state) {
+    for (size_t i = 0; i < texts.size(); i += n) {
+      absl::Span<const absl::string_view> chunk =
+          absl::MakeConstSpan(texts).subspan(i, n);
+      if (batch && set) {
+        s.MatchBatch(chunk, &matched, NULL, NULL);
+      } else if (batch) {
+        re.MatchBatch(chunk, RE2::UNANCHORED, &matched);
+      } else {
+        for (absl::string_view t : chunk) {
+          if (set)
+            benchmark::DoNotOptimize(s.Match(t, NULL));
+          else
+            benchmark::DoNotOptimize(RE2::PartialMatch(t, re));
+        }
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * texts.size());
+  state.SetBytesProcessed(state.iterations() * text->size());
+}
+
+void MatchShort_RE2_OneAtATime(benchmark::State& state)  { MatchShortStrings(state, false, false); }
+void MatchShort_RE2_Batch(benchmark::State& state)       { MatchShortStrings(state, false, true); }
+void MatchShort_Set_OneAtATime(benchmark::State& state)  { MatchShortStrings(state, true, false); }
+void MatchShort_Set_Batch(benchmark::State& state)       { MatchShortStrings(state, true, true); }
+
+BENCHMARK(MatchShort_RE2_OneAtATime)->Arg(1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(MatchShort_RE2_Batch, 16, 1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK(MatchShort_Set_OneAtATime)->Arg(1<<20)->ThreadRange(1, NumCPUs());
+BENCHMARK_RANGE(MatchShort_Set_Batch, 16, 1<<20)->ThreadRange(1, NumCPUs());
+
+// Benchmark: matching a million 64-byte strings in one batch, with the
+// DFA advancing several of them at a time or taking them one by one.
+
+void MatchBatchInterleaved(benchmark::State& state, const char* regexp,
+                           bool interleave) {
+  static const std::string* text = new std::string(
+      RandomText(16<<20) + RandomText(16<<20) + RandomText(16<<20) +
+      RandomText(16<<20));
+  std::vector<absl::string_view> texts;
+  for (size_t i = 0; i < text->size(); i += 64)
+    texts.push_back(absl::string_view(*text).substr(i, 64));
+  RE2 re(regexp);
+  ABSL_CHECK(re.ok());
+  Prog::TESTING_ONLY_set_dfa_interleave_batches(interleave);
+  std::vector<bool> matched;
+  for (auto _ : state)
+    re.MatchBatch(texts, RE2::UNANCHORED, &matched);
+  Prog::TESTING_ONLY_set_dfa_interleave_batches(true);
+  state.SetItemsProcessed(state.iterations() * texts.size());
+  state.SetBytesProcessed(state.iterations() * text->size());
+}
+
+void MatchBatch_Easy_Interleaved(benchmark::State& state)  { MatchBatchInterleaved(state, "[a-z]+=[0-9]+;", true); }
+void MatchBatch_Easy_OneByOne(benchmark::State& state)     { MatchBatchInterleaved(state, "[a-z]+=[0-9]+;", false); }
+void MatchBatch_Big_Interleaved(benchmark::State& state)   { MatchBatchInterleaved(state, "[a-q][^u-z]{13}x", true); }
+void MatchBatch_Big_OneByOne(benchmark::State& state)      { MatchBatchInterleaved(state, "[a-q][^u-z]{13}x", false); }
+
+BENCHMARK(MatchBatch_Easy_Interleaved);
+BENCHMARK(MatchBatch_Easy_OneByOne);
+BENCHMARK(MatchBatch_Big_Interleaved);
+BENCHMARK(MatchBatch_Big_OneByOne);
+
+// Benchmark: use a regexp with ten capturing groups to parse a log line,
+// which is one-pass but used to have too many groups for the one-pass
+// engine.
+
+#define LOGLINE "(\\d+)-(\\d+)-(\\d+) (\\d+):(\\d+):(\\d+) ([A-Z]+) ([a-z]+)-(\\d+) (.*)"
+
+void Parse10(benchmark::State& state, int engine) {
+  static const char text[] =
+      "2026-10-16 23:59:59 ERROR worker-7 request timed out";
+  absl::string_view sp[11];  // 11 because sp[0] is whole match.
+  if (engine == 3) {
+    RE2& re = *GetCachedRE2(LOGLINE);
+    const RE2::Arg* args[10];
+    RE2::Arg argv[10];
+    for (int i = 0; i < 10; i++) {
+      argv[i] = &sp[i+1];
+      args[i] = &argv[i];
+    }
+    for (auto _ : state)
+      ABSL_CHECK(RE2::FullMatchN(text, re, args, 10));
+  } else {
+    Prog* prog = GetCachedProg(LOGLINE);
+    ABSL_CHECK(prog->IsOnePass());
+    for (auto _ : state) {
+      if (engine == 0) {
+        ABSL_CHECK(prog->SearchOnePass(text, text, Prog::kAnchored,
+                                       Prog::kFullMatch, sp, 11));
+      } else if (engine == 1) {
+        ABSL_CHECK(prog->SearchBitState(text, text, Prog::kAnchored,
+                                        Prog::kFullMatch, sp, 11));
+      } else {
+        ABSL_CHECK(prog->SearchNFA(text, text, Prog::kAnchored,
+                                   Prog::kFullMatch, sp, 11));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void Parse_CachedLogLine10_OnePass(benchmark::State& state)   { Parse10(state, 0); }
+void Parse_CachedLogLine10_BitState(benchmark::State& state)  { Parse10(state, 1); }
+void Parse_CachedLogLine10_NFA(benchmark::State& state)       { Parse10(state, 2); }
+void Parse_CachedLogLine10_RE2(benchmark::State& state)       { Parse10(state, 3); }
+
+BENCHMARK(Parse_CachedLogLine10_OnePass)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedLogLine10_BitState)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedLogLine10_NFA)->ThreadRange(1, NumCPUs());
+BENCHMARK(Parse_CachedLogLine10_RE2)->ThreadRange(1, NumCPUs());
+
+// Benchmark: extracting submatches from a match of state.range(0) bytes
+// with a regexp that is not one-pass, with the bitmap of the BitState
+// search limited to the default 32 KiB or to 256 KiB.  Texts too long
+// for the bitmap go to the NFA.
+
+void ParseMediumText(benchmark::State& state, int64_t bit_state_max_mem) {
+  std::string text = RandomText(state.range(0));
+  for (char& c : text)
+    if (c == '\n')
+      c = ' ';
+  RE2::Options opt;
+  opt.set_bit_state_max_mem(bit_state_max_mem);
+  RE2 re("(.*) (\\S+) (.*)", opt);
+  ABSL_CHECK(re.ok());
+  absl::string_view a, b, c;
+  for (auto _ : state)
+    ABSL_CHECK(RE2::FullMatch(text, re, &a, &b, &c));
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void Parse_MediumText_BitState32K(benchmark::State& state)  { ParseMediumText(state, 32<<10); }
+void Parse_MediumText_BitState256K(benchmark::State& state) { ParseMediumText(state, 256<<10); }
+
+BENCHMARK_RANGE(Parse_MediumText_BitState32K, 1<<10, 64<<10);
+BENCHMARK_RANGE(Parse_MediumText_BitState256K, 1<<10, 64<<10);
+
 }  // namespace re2
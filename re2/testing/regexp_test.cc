@@ -45,6 +45,36 @@ TEST(Regexp, BigConcat) {
   x->Decref();
 }
 
+// Test that Regexps from an arena leave the reference counts of
+// Regexps from outside it as they found them.
+TEST(Regexp, Arena) {
+  Regexp* x = Regexp::Parse("x", Regexp::NoParseFlags, NULL);
+  {
+    RegexpArena arena;
+    RegexpArena::Scope scope(&arena);
+    Regexp* re = Regexp::Parse("(a+|b)*c{2,5}", Regexp::PerlX, NULL);
+    ASSERT_TRUE(re != NULL);
+    std::vector<Regexp*> v(3, x);
+    for (size_t i = 0; i < v.size(); i++)
+      x->Incref();
+    Regexp* y = Regexp::Concat(v.data(), static_cast<int>(v.size()),
+                               Regexp::NoParseFlags);
+    ASSERT_EQ(y->ToString(), "xxx");
+    ASSERT_EQ(x->Ref(), 4);
+    Regexp* sre = re->Simplify();
+    ASSERT_EQ(sre->ToString(), "(a+|b)*cc(?:c(?:cc?)?)?");
+    // Does nothing: the arena releases them.
+    for (int i = 0; i < 100000; i++)
+      sre->Incref();
+    sre->Decref();
+    re->Decref();
+    y->Decref();
+    ASSERT_EQ(x->Ref(), 4);
+  }
+  ASSERT_EQ(x->Ref(), 1);
+  x->Decref();
+}
+
 TEST(Regexp, NamedCaptures) {
   Regexp* x;
   RegexpStatus status;
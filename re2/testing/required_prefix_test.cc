@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 
 #include <stddef.h>
+#include <string.h>
 
 #include <string>
 
@@ -198,4 +199,57 @@ TEST(PrefixAccel, SimpleTests) {
   }
 }
 
+TEST(PrefixAccel, Kernels) {
+  const Prog::PrefixAccelKernel kernels[] = {
+    Prog::kPrefixAccelScalar,
+    Prog::kPrefixAccelSSE2,
+    Prog::kPrefixAccelAVX2,
+    Prog::kPrefixAccelNEON,
+  };
+  const char* prefixes[] = {
+    "ab",
+    "aab",
+    "abca",
+    "ERROR: timeout",
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxy",
+  };
+  for (const char* prefix : prefixes) {
+    Regexp* re = Regexp::Parse(prefix, Regexp::LikePerl, NULL);
+    ASSERT_TRUE(re != NULL);
+    Prog* prog = re->CompileToProg(0);
+    ASSERT_TRUE(prog != NULL);
+    ASSERT_TRUE(prog->can_prefix_accel());
+    EXPECT_NE(prog->prefix_accel_kernel(), Prog::kPrefixAccelFrontAndBack);
+    // Decoys differ from the prefix in just one of the bytes that the
+    // kernels compare, so they must all skip over them. Vary the position
+    // of the match so that both the vector loops and the tails find it.
+    size_t size = strlen(prefix);
+    std::string decoys;
+    for (size_t i : {size_t{0}, size-1, size/2, size_t{1}}) {
+      decoys.append(prefix);
+      decoys[decoys.size() - size + i] ^= 0x20;
+    }
+    for (Prog::PrefixAccelKernel kernel : kernels) {
+      if (!prog->TESTING_ONLY_set_prefix_accel_kernel(kernel))
+        continue;
+      for (int j = 0; j < 70; j++) {
+        std::string text = std::string(j, '.') + decoys;
+        EXPECT_TRUE(prog->PrefixAccel(text.data(), text.size()) == NULL)
+            << "prefix " << prefix << ", kernel " << kernel;
+        text.append(prefix);
+        const char* p = reinterpret_cast<const char*>(
+            prog->PrefixAccel(text.data(), text.size()));
+        EXPECT_EQ(text.size() - size, p - text.data())
+            << "prefix " << prefix << ", kernel " << kernel;
+        // A match that doesn't fit in the text mustn't be found.
+        text.pop_back();
+        EXPECT_TRUE(prog->PrefixAccel(text.data(), text.size()) == NULL)
+            << "prefix " << prefix << ", kernel " << kernel;
+      }
+    }
+    delete prog;
+    re->Decref();
+  }
+}
+
 }  // namespace re2
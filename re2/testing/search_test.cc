@@ -309,6 +309,13 @@ RegexpTest simple_tests[] = {
   { "a\\C+?", "a" },
   { "a\\C??", "a" },
 
+  // More capturing parens than fit in a one-pass action.
+  { "(\\d+)-(\\d+)-(\\d+) (\\d+):(\\d+):(\\d+) (\\w+) ([a-z]+)=(\\d*)",
+    "2026-10-16 23:59:59 INFO user=42" },
+  { "(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)(k)(l)(m)(n)(o)(p)(q)",
+    "abcdefghijklmnopq" },
+  { "(a)?(b)?(c)?(d)?(e)?(f)?(g)?(h)?(i)?(j)?x", "acegix" },
+
   // Former bugs.
   { "a\\C*|ba\\C", "baba" },
   { "\\w*I\\w*", "Inc." },
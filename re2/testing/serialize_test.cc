@@ -0,0 +1,199 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/regexp.h"
+
+namespace re2 {
+
+static const char* kPatterns[] = {
+  "abc",
+  "(a+)(b+)",
+  "(?i)hello, (\\w+)",
+  "^abc",
+  "abc$",
+  "(?P<key>\\w+)=(?P<value>\\d+)",
+  "\\bfoo\\b",
+  "(.*)(\\d+)",
+  "(a|ab)(c|bcd)(d*)",
+  "x*",
+  "",
+  "[^a]",
+  "(?s)a(.)c",
+  "\\x{263a}+",
+  "[a-z]+@example\\.com",
+  "(\\w+)ba[rz](\\d*)",
+  "a\\C*z",
+  "(?:)^$",
+};
+
+static const char* kTexts[] = {
+  "",
+  "abc",
+  "xabcx",
+  "aaabbbccc",
+  "HeLLo, World",
+  "key=42 other=7",
+  "a foo bar",
+  "afoo",
+  "took 153ms",
+  "abcd",
+  "\xe2\x98\xba\xe2\x98\xba",
+  "a\nc",
+  "mail bob@example.com now",
+  "fooobar123 xbaz",
+  "a whole lot of text z",
+  "\xff\xfe",
+};
+
+TEST(Serialize, MatchesRE2) {
+  const RE2::Anchor anchors[] = {
+    RE2::UNANCHORED,
+    RE2::ANCHOR_START,
+    RE2::ANCHOR_BOTH,
+  };
+  for (const char* pattern : kPatterns) {
+    for (bool latin1 : {false, true}) {
+      RE2::Options opt(latin1 ? RE2::Latin1 : RE2::DefaultOptions);
+      opt.set_log_errors(false);
+      RE2 re(pattern, opt);
+      if (latin1 && !re.ok())
+        continue;  // \x{263a} is not Latin-1.
+      ASSERT_TRUE(re.ok()) << pattern;
+      std::string data, error;
+      ASSERT_TRUE(re.Serialize(&data, &error)) << pattern << ": " << error;
+      std::unique_ptr<RE2> got = RE2::Deserialize(data, &error);
+      ASSERT_TRUE(got != NULL) << pattern << ": " << error;
+      ASSERT_TRUE(got->ok());
+      EXPECT_EQ(got->pattern(), re.pattern());
+      EXPECT_EQ(got->options().encoding(), re.options().encoding());
+      EXPECT_EQ(got->NumberOfCapturingGroups(), re.NumberOfCapturingGroups());
+      EXPECT_EQ(got->NamedCapturingGroups(), re.NamedCapturingGroups());
+      EXPECT_EQ(got->CapturingGroupNames(), re.CapturingGroupNames());
+      EXPECT_EQ(got->ProgramSize(), re.ProgramSize());
+      EXPECT_EQ(got->ReverseProgramSize(), re.ReverseProgramSize());
+      EXPECT_EQ(got->Regexp()->ToString(), re.Regexp()->ToString());
+
+      const int kMaxSubmatch = 4;
+      for (const char* text : kTexts) {
+        absl::string_view t(text);
+        for (RE2::Anchor anchor : anchors) {
+          absl::string_view want[kMaxSubmatch];
+          absl::string_view have[kMaxSubmatch];
+          int n = 1 + re.NumberOfCapturingGroups();
+          bool matched = re.Match(t, 0, t.size(), anchor, want, n);
+          ASSERT_EQ(got->Match(t, 0, t.size(), anchor, have, n), matched)
+              << "pattern " << pattern << ", text " << text
+              << ", anchor " << anchor << ", latin1 " << latin1;
+          for (int i = 0; matched && i < n; i++) {
+            EXPECT_EQ(have[i].data(), want[i].data())
+                << "pattern " << pattern << ", text " << text << " $" << i;
+            EXPECT_EQ(have[i].size(), want[i].size())
+                << "pattern " << pattern << ", text " << text << " $" << i;
+          }
+        }
+      }
+
+      // Serializing the deserialized RE2 gives back the same data.
+      std::string again;
+      ASSERT_TRUE(got->Serialize(&again, NULL)) << pattern;
+      EXPECT_EQ(again, data) << pattern;
+    }
+  }
+}
+
+TEST(Serialize, Options) {
+  RE2::Options opt;
+  opt.set_case_sensitive(false);
+  opt.set_longest_match(true);
+  opt.set_max_mem(1<<21);
+  opt.set_bit_state_max_mem(1<<10);
+  RE2 re("(a+|a+b)c", opt);
+  std::string data;
+  ASSERT_TRUE(re.Serialize(&data, NULL));
+  std::unique_ptr<RE2> got = RE2::Deserialize(data, NULL);
+  ASSERT_TRUE(got != NULL);
+  EXPECT_FALSE(got->options().case_sensitive());
+  EXPECT_TRUE(got->options().longest_match());
+  EXPECT_EQ(got->options().max_mem(), 1<<21);
+  EXPECT_EQ(got->options().bit_state_max_mem(), 1<<10);
+  std::string s;
+  EXPECT_TRUE(RE2::PartialMatch("xAABCx", *got, &s));
+  EXPECT_EQ(s, "AAB");
+}
+
+TEST(Serialize, RejectsBadRegexp) {
+  RE2 re("a(", RE2::Quiet);
+  std::string data, error;
+  EXPECT_FALSE(re.Serialize(&data, &error));
+  EXPECT_EQ(error, "invalid regexp: " + re.error());
+}
+
+TEST(Serialize, RejectsCorruptData) {
+  RE2 re("(?P<name>\\w+)\\s+(\\d+)");
+  std::string data;
+  ASSERT_TRUE(re.Serialize(&data, NULL));
+
+  std::string error;
+  EXPECT_TRUE(RE2::Deserialize("", &error) == NULL);
+  EXPECT_EQ(error, "truncated header");
+
+  // No prefix of the data is valid.
+  for (size_t n = 0; n < data.size(); n++)
+    EXPECT_TRUE(RE2::Deserialize(data.substr(0, n), NULL) == NULL) << n;
+  EXPECT_TRUE(RE2::Deserialize(data + "x", &error) == NULL);
+  EXPECT_EQ(error, "trailing data");
+
+  std::string bad_magic = data;
+  bad_magic[0] = 'X';
+  EXPECT_TRUE(RE2::Deserialize(bad_magic, &error) == NULL);
+  EXPECT_EQ(error, "bad magic number");
+
+  std::string bad_version = data;
+  uint32_t version;
+  memmove(&version, &bad_version[8], sizeof version);
+  version++;
+  memmove(&bad_version[8], &version, sizeof version);
+  EXPECT_TRUE(RE2::Deserialize(bad_version, &error) == NULL);
+  EXPECT_EQ(error, "unsupported version 2");
+
+  // Make the last instruction an Alt, which Flatten() never leaves.
+  // The reverse Prog comes last, followed by its (empty) count of
+  // bit-parallel tables.
+  std::string bad_prog = data;
+  uint32_t out_opcode;
+  size_t last = bad_prog.size() - sizeof(uint32_t) - 8;
+  memmove(&out_opcode, &bad_prog[last], sizeof out_opcode);
+  out_opcode &= ~7;
+  memmove(&bad_prog[last], &out_opcode, sizeof out_opcode);
+  EXPECT_TRUE(RE2::Deserialize(bad_prog, &error) == NULL);
+
+  // Instruction 0 must be a Fail in a list by itself.  First make that
+  // of the reverse Prog a Match, then make its list run on.
+  size_t first = data.size() - sizeof(uint32_t) -
+                 sizeof(Prog::Inst) * re.ReverseProgramSize();
+  std::string bad_fail = data;
+  memmove(&out_opcode, &bad_fail[first], sizeof out_opcode);
+  out_opcode = (out_opcode & ~7) | kInstMatch;
+  memmove(&bad_fail[first], &out_opcode, sizeof out_opcode);
+  EXPECT_TRUE(RE2::Deserialize(bad_fail, &error) == NULL);
+
+  std::string bad_list = data;
+  memmove(&out_opcode, &bad_list[first], sizeof out_opcode);
+  out_opcode &= ~8;
+  memmove(&bad_list[first], &out_opcode, sizeof out_opcode);
+  EXPECT_TRUE(RE2::Deserialize(bad_list, &error) == NULL);
+}
+
+}  // namespace re2
@@ -0,0 +1,144 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/serialized_dfa.h"
+
+#include <stddef.h>
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+#include "re2/re2.h"
+
+namespace re2 {
+
+static const char* kPatterns[] = {
+  "abc",
+  "a+b+c",
+  "(?i)hello",
+  "^abc",
+  "abc$",
+  "^abc$",
+  "(?m)^abc$",
+  "\\bfoo\\b",
+  "\\Bfoo",
+  "x*",
+  "",
+  "[^a]",
+  "a.c",
+  "(?s)a.c",
+  "\\x{263a}+",
+  "(a|ab)(c|bcd)",
+  "[0-9]+ms",
+  "\\w+@example\\.com",
+  "a\\C*z",
+  "$",
+  "^",
+  "(?:)^$",
+};
+
+static const char* kTexts[] = {
+  "",
+  "abc",
+  "xabcx",
+  "ab\nabc\nx",
+  "abc\n",
+  "aaabbbccc",
+  "HeLLo world",
+  "foo",
+  "a foo bar",
+  "afoo",
+  "foobar",
+  "\xe2\x98\xba\xe2\x98\xba",
+  "a\nc",
+  "abcd",
+  "took 153ms",
+  "mail bob@example.com now",
+  "a whole lot of text z",
+  "\xff\xfe",
+};
+
+TEST(SerializedDFA, MatchesRE2) {
+  const RE2::Anchor anchors[] = {
+    RE2::UNANCHORED,
+    RE2::ANCHOR_START,
+    RE2::ANCHOR_BOTH,
+  };
+  for (const char* pattern : kPatterns) {
+    for (bool latin1 : {false, true}) {
+      RE2::Options opt(latin1 ? RE2::Latin1 : RE2::DefaultOptions);
+      opt.set_log_errors(false);
+      RE2 re(pattern, opt);
+      if (latin1 && !re.ok())
+        continue;  // \x{263a} is not Latin-1.
+      ASSERT_TRUE(re.ok()) << pattern;
+      for (RE2::Anchor anchor : anchors) {
+        std::string data, error;
+        ASSERT_TRUE(RE2::SerializedDFA::Serialize(re, anchor, &data, &error))
+            << pattern << ": " << error;
+        RE2::SerializedDFA dfa(data);
+        ASSERT_TRUE(dfa.ok()) << pattern << ": " << dfa.error();
+        for (const char* text : kTexts) {
+          absl::string_view t(text);
+          EXPECT_EQ(dfa.Match(t), re.Match(t, 0, t.size(), anchor, NULL, 0))
+              << "pattern " << pattern << ", text " << text
+              << ", anchor " << anchor << ", latin1 " << latin1;
+        }
+      }
+    }
+  }
+}
+
+TEST(SerializedDFA, NeverMatches) {
+  RE2 re("a\\bb");
+  std::string data;
+  ASSERT_TRUE(
+      RE2::SerializedDFA::Serialize(re, RE2::UNANCHORED, &data, NULL));
+  RE2::SerializedDFA dfa(data);
+  ASSERT_TRUE(dfa.ok());
+  EXPECT_FALSE(dfa.Match("ab"));
+  EXPECT_FALSE(dfa.Match(""));
+}
+
+TEST(SerializedDFA, OutOfMemory) {
+  // The DFA for this has about 2^20 states.
+  RE2::Options opt;
+  opt.set_max_mem(1<<20);
+  RE2 re("a[ab]{20}b", opt);
+  ASSERT_TRUE(re.ok());
+  std::string data, error;
+  EXPECT_FALSE(
+      RE2::SerializedDFA::Serialize(re, RE2::UNANCHORED, &data, &error));
+  EXPECT_EQ(error, "DFA out of memory");
+
+  RE2 bad("(", RE2::Quiet);
+  EXPECT_FALSE(
+      RE2::SerializedDFA::Serialize(bad, RE2::UNANCHORED, &data, &error));
+}
+
+TEST(SerializedDFA, RejectsCorruptData) {
+  RE2 re("a+b");
+  std::string data;
+  ASSERT_TRUE(
+      RE2::SerializedDFA::Serialize(re, RE2::UNANCHORED, &data, NULL));
+
+  EXPECT_FALSE(RE2::SerializedDFA("").ok());
+  EXPECT_FALSE(RE2::SerializedDFA(data.substr(0, data.size() - 1)).ok());
+
+  std::string bad_magic = data;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(RE2::SerializedDFA(bad_magic).ok());
+
+  // Make the last transition point past the last state.
+  std::string bad_table = data;
+  bad_table[bad_table.size() - 2] = '\x7f';
+  bad_table[bad_table.size() - 1] = '\x7f';
+  RE2::SerializedDFA dfa(bad_table);
+  EXPECT_FALSE(dfa.ok());
+  EXPECT_EQ(dfa.error(), "corrupt table");
+  EXPECT_FALSE(dfa.Match("ab"));
+}
+
+}  // namespace re2
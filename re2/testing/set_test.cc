@@ -5,7 +5,10 @@
 #include "re2/set.h"
 
 #include <stddef.h>
+#include <string.h>
 
+#include <algorithm>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -232,4 +235,250 @@ TEST(Set, MoveSemantics) {
   ASSERT_EQ(s1.Match("abc bar2 xyz", NULL), false);
 }
 
+TEST(Set, Prefilter) {
+  // Every regexp in each of these sets requires a literal,
+  // so the sets use the prefilter.
+  const std::vector<std::vector<std::string>> sets = {
+    {"foo", "bar"},
+    {"https?://example\\.com/", "[a-z]{2,8}\\.example\\.org", "x{3}y"},
+    {"a.{0,5}needle", "(?i)HayStack", "(?:abc|xyz)[0-9]+"},
+    {"\\bword\\b", "^start", "end$", "(?m)^line"},
+    {".*tail", "(head)+.*", "a\\C?b"},
+    {"\\x{263a}+", "caf\\x{e9}"},
+    {"never\\bmatches", "[^\\x00-\\x{10ffff}]"},
+  };
+  const char* texts[] = {
+    "",
+    "foo",
+    "xxbarxx",
+    "see https://example.com/ now",
+    "see http://example.com",
+    "www.example.org",
+    "xxxxxy",
+    "a12345needle",
+    "a123456needle",
+    "the haystack",
+    "abc42 xyz",
+    "a word here",
+    "swordfish",
+    "start here and end",
+    "not at start\nline two",
+    "a tail",
+    "headhead and more",
+    "ab a\xff" "b",
+    "\xe2\x98\xba\xe2\x98\xba",
+    "caf\xc3\xa9",
+    "never matches",
+  };
+  const RE2::Anchor anchors[] = {
+    RE2::UNANCHORED,
+    RE2::ANCHOR_START,
+    RE2::ANCHOR_BOTH,
+  };
+  for (const std::vector<std::string>& patterns : sets) {
+    for (RE2::Anchor anchor : anchors) {
+      RE2::Set s(RE2::DefaultOptions, anchor);
+      for (const std::string& pattern : patterns)
+        ASSERT_GE(s.Add(pattern, NULL), 0) << pattern;
+      ASSERT_EQ(s.Compile(), true);
+      for (const char* text : texts) {
+        std::vector<int> want;
+        for (size_t i = 0; i < patterns.size(); i++) {
+          RE2 re(patterns[i]);
+          if (re.Match(text, 0, strlen(text), anchor, NULL, 0))
+            want.push_back(static_cast<int>(i));
+        }
+        std::vector<int> v;
+        EXPECT_EQ(s.Match(text, &v), !want.empty()) << text;
+        std::sort(v.begin(), v.end());
+        EXPECT_EQ(v, want) << text;
+        EXPECT_EQ(s.Match(text, NULL), !want.empty()) << text;
+      }
+    }
+  }
+}
+
+TEST(Set, MatchBatch) {
+  const std::vector<std::vector<std::string>> sets = {
+    {"foo", "bar"},
+    {"a+", "b*c", "(?i)^XY"},
+    {"\\bword\\b", "^start", "end$", "(?m)^line"},
+    {"", "z"},
+  };
+  const std::vector<absl::string_view> texts = {
+    "", "foo", "xbarx", "aac", "xyz", "a word", "start here", "the end",
+    "one\nline two", "nothing", "zzz", "XY",
+  };
+  for (const std::vector<std::string>& patterns : sets) {
+    for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                               RE2::ANCHOR_BOTH}) {
+      RE2::Set s(RE2::DefaultOptions, anchor);
+      for (const std::string& pattern : patterns)
+        ASSERT_GE(s.Add(pattern, NULL), 0) << pattern;
+      ASSERT_EQ(s.Compile(), true);
+      std::vector<bool> matched;
+      std::vector<std::vector<int>> v;
+      RE2::Set::ErrorInfo info;
+      int n = s.MatchBatch(texts, &matched, &v, &info);
+      EXPECT_EQ(info.kind, RE2::Set::kNoError);
+      ASSERT_EQ(matched.size(), texts.size());
+      ASSERT_EQ(v.size(), texts.size());
+      int want_n = 0;
+      for (size_t i = 0; i < texts.size(); i++) {
+        std::vector<int> want;
+        bool want_matched = s.Match(texts[i], &want);
+        want_n += want_matched;
+        EXPECT_EQ(matched[i], want_matched) << texts[i];
+        std::sort(want.begin(), want.end());
+        std::sort(v[i].begin(), v[i].end());
+        EXPECT_EQ(v[i], want) << texts[i];
+      }
+      EXPECT_EQ(n, want_n);
+      std::vector<bool> matched2;
+      EXPECT_EQ(s.MatchBatch(texts, &matched2, NULL, NULL), want_n);
+      EXPECT_EQ(matched2, matched);
+    }
+  }
+}
+
+TEST(Set, Warmup) {
+  const std::vector<absl::string_view> samples = {
+    "foo", "xbarx", "aac", "a word", "nothing",
+  };
+  for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                             RE2::ANCHOR_BOTH}) {
+    RE2::Set s(RE2::DefaultOptions, anchor);
+    ASSERT_EQ(s.Add("foo", NULL), 0);
+    ASSERT_EQ(s.Add("b[a-z]r", NULL), 1);
+    ASSERT_EQ(s.Add("\\bword\\b", NULL), 2);
+    ASSERT_EQ(s.Compile(), true);
+    EXPECT_GT(s.Warmup(samples), 0);
+    EXPECT_EQ(s.Warmup(samples), 0);
+    EXPECT_GE(s.Warmup(100), 0);
+    EXPECT_EQ(s.Warmup(100), 0);
+
+    RE2::Set cold(RE2::DefaultOptions, anchor);
+    ASSERT_EQ(cold.Add("foo", NULL), 0);
+    ASSERT_EQ(cold.Add("b[a-z]r", NULL), 1);
+    ASSERT_EQ(cold.Add("\\bword\\b", NULL), 2);
+    ASSERT_EQ(cold.Compile(), true);
+    for (absl::string_view text : samples) {
+      std::vector<int> v, want;
+      EXPECT_EQ(s.Match(text, &v), cold.Match(text, &want)) << text;
+      std::sort(v.begin(), v.end());
+      std::sort(want.begin(), want.end());
+      EXPECT_EQ(v, want) << text;
+    }
+  }
+}
+
+TEST(Set, GetSearchStats) {
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("\\bfo+", NULL), 0);
+  ASSERT_EQ(s.Add("ba[rz]\\b", NULL), 1);
+  ASSERT_EQ(s.Compile(), true);
+  RE2::SearchStats stats;
+  s.GetSearchStats(&stats);
+  EXPECT_EQ(stats.dfa_searches, 0);
+
+  std::vector<int> v;
+  ASSERT_TRUE(s.Match("foo bar", &v));
+  std::vector<RE2::Set::MatchPosition> positions;
+  ASSERT_TRUE(s.MatchPositions("foo bar", true, &positions, NULL));
+  s.GetSearchStats(&stats);
+  // Match(), then MatchPositions() forward and backward.
+  EXPECT_GE(stats.dfa_searches, 3);
+  EXPECT_GT(stats.dfa_states_built, 0);
+  EXPECT_GT(stats.dfa_mem_in_use, 0);
+  EXPECT_LT(stats.dfa_mem_in_use, stats.dfa_mem_budget);
+
+  RE2::Set moved(std::move(s));
+  RE2::SearchStats stats2;
+  moved.GetSearchStats(&stats2);
+  EXPECT_EQ(stats2.dfa_searches, stats.dfa_searches);
+}
+
+TEST(Set, MatchPositions) {
+  const std::vector<std::vector<std::string>> sets = {
+    {"foo", "bar"},
+    {"a+", "b*c", "(?i)XY", "a.*d", "[0-9]+", "x?y"},
+    {"", "z"},
+  };
+  const std::vector<std::string> texts = {
+    "", "foo", "xbarxfoo", "aac", "xyz", "aaad caad", "AbcXYz 42 yy",
+    "nothing", "zzz", "barfoobar",
+  };
+  for (const std::vector<std::string>& patterns : sets) {
+    for (RE2::Anchor anchor : {RE2::UNANCHORED, RE2::ANCHOR_START,
+                               RE2::ANCHOR_BOTH}) {
+      RE2::Set s(RE2::DefaultOptions, anchor);
+      for (const std::string& pattern : patterns)
+        ASSERT_GE(s.Add(pattern, NULL), 0) << pattern;
+      ASSERT_EQ(s.Compile(), true);
+      for (const std::string& text : texts) {
+        // Work out the expected positions the slow way.
+        std::vector<RE2::Set::MatchPosition> want;
+        for (size_t i = 0; i < patterns.size(); i++) {
+          RE2 re(patterns[i]);
+          ASSERT_TRUE(re.ok());
+          auto matches = [&](size_t b, size_t e) -> bool {
+            return re.Match(text, b, e, RE2::ANCHOR_BOTH, NULL, 0);
+          };
+          RE2::Set::MatchPosition pos = {static_cast<int>(i), 0, 0};
+          bool found = false;
+          if (anchor == RE2::UNANCHORED) {
+            for (size_t e = 0; e <= text.size() && !found; e++)
+              for (size_t b = 0; b <= e && !found; b++)
+                if (matches(b, e)) {
+                  pos.begin = b;
+                  pos.end = e;
+                  found = true;
+                }
+          } else if (anchor == RE2::ANCHOR_START) {
+            for (size_t e = text.size() + 1; e > 0 && !found; e--)
+              if (matches(0, e-1)) {
+                pos.end = e-1;
+                found = true;
+              }
+          } else if (matches(0, text.size())) {
+            pos.end = text.size();
+            found = true;
+          }
+          if (found)
+            want.push_back(pos);
+        }
+
+        for (bool want_begin : {false, true}) {
+          std::vector<RE2::Set::MatchPosition> got;
+          RE2::Set::ErrorInfo info;
+          EXPECT_EQ(s.MatchPositions(text, want_begin, &got, &info),
+                    !want.empty()) << text;
+          EXPECT_EQ(info.kind, RE2::Set::kNoError);
+          ASSERT_EQ(got.size(), want.size()) << text;
+          for (size_t j = 0; j < want.size(); j++) {
+            EXPECT_EQ(got[j].index, want[j].index) << text;
+            EXPECT_EQ(got[j].end, want[j].end) << text << " " << j;
+            if (anchor == RE2::UNANCHORED && !want_begin)
+              EXPECT_EQ(got[j].begin, RE2::Set::npos) << text;
+            else
+              EXPECT_EQ(got[j].begin, want[j].begin) << text << " " << j;
+          }
+        }
+      }
+    }
+  }
+
+  // Moving the set must not lose the reverse Prog.
+  RE2::Set s(RE2::DefaultOptions, RE2::UNANCHORED);
+  ASSERT_EQ(s.Add("b+c", NULL), 0);
+  ASSERT_EQ(s.Compile(), true);
+  std::vector<RE2::Set::MatchPosition> got;
+  ASSERT_EQ(s.MatchPositions("abbbcd", true, &got, NULL), true);
+  RE2::Set t(std::move(s));
+  ASSERT_EQ(t.MatchPositions("abbbcd", true, &got, NULL), true);
+  ASSERT_EQ(got.size(), 1u);
+  EXPECT_EQ(got[0].begin, 1u);
+  EXPECT_EQ(got[0].end, 5u);
+}
+
 }  // namespace re2
@@ -0,0 +1,237 @@
+// Copyright 2026 The RE2 Authors.  All Rights Reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re2/stream_matcher.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+#include "re2/prog.h"
+#include "re2/re2.h"
+#include "re2/regexp.h"
+
+namespace re2 {
+
+static int state_cache_resets = 0;
+
+struct SetHooks {
+  SetHooks() {
+    hooks::SetDFAStateCacheResetHook([](const hooks::DFAStateCacheReset&) {
+      ++state_cache_resets;
+    });
+  }
+} set_hooks;
+
+// Returns the offsets that a StreamMatcher should report for re in text,
+// the slow way: using the NFA to try every possible match.
+static std::vector<int64_t> MatchEndsSlowly(const RE2& re,
+                                            absl::string_view text) {
+  std::unique_ptr<Prog> prog(re.Regexp()->CompileToProg(0));
+  // Returns the end of the earliest-ending match that begins at or
+  // after pos, or -1 if there is none.
+  auto earliest = [&](size_t pos) -> int64_t {
+    for (size_t end = pos; end <= text.size(); end++) {
+      for (size_t begin = pos; begin <= end; begin++) {
+        if (prog->SearchNFA(text.substr(begin, end - begin), text,
+                            Prog::kAnchored, Prog::kFullMatch, NULL, 0))
+          return static_cast<int64_t>(end);
+      }
+    }
+    return -1;
+  };
+  std::vector<int64_t> ends;
+  int64_t last = -1;
+  size_t pos = 0;
+  while (pos <= text.size()) {
+    int64_t end = earliest(pos);
+    if (end < 0)
+      break;
+    if (end == last) {
+      pos = static_cast<size_t>(end) + 1;
+      continue;
+    }
+    ends.push_back(end);
+    last = end;
+    pos = static_cast<size_t>(end);
+  }
+  return ends;
+}
+
+// Writes text to m in chunks of at most n bytes and then finishes,
+// returning all of the offsets that m reported.
+static std::vector<int64_t> MatchEnds(RE2::StreamMatcher* m,
+                                      absl::string_view text, size_t n) {
+  std::vector<int64_t> ends, v;
+  m->Reset();
+  for (size_t i = 0; i < text.size(); i += n) {
+    EXPECT_TRUE(m->Write(text.substr(i, n), &v));
+    ends.insert(ends.end(), v.begin(), v.end());
+  }
+  EXPECT_EQ(m->offset(), static_cast<int64_t>(text.size()));
+  EXPECT_TRUE(m->Finish(&v));
+  ends.insert(ends.end(), v.begin(), v.end());
+  return ends;
+}
+
+static const char* kPatterns[] = {
+  "abc",
+  "a+",
+  "a*",
+  "",
+  "x|xy|yz",
+  "\\bfoo\\b",
+  "\\Bo",
+  "foo$",
+  "foo\\z",
+  "(?m)^foo$",
+  "^foo",
+  "\\Afoo",
+  "^$",
+  "(?i)hello",
+  "[a-z]+ing\\b",
+  "(?s).*",
+  "abc.*",
+  "\\w+\\s+\\w+",
+  "\\xff",
+  "\\x{263a}",
+  "\\x{263a}|\\xff",
+};
+
+static const char* kTexts[] = {
+  "",
+  "abc",
+  "xabcabcx",
+  "aaa",
+  "baab",
+  "xyz xyyz",
+  "foo food foo",
+  "foo\nfoo\n",
+  "hello HELLO hElLo",
+  "singing ringing ring",
+  "smile \xe2\x98\xba \xff!",
+};
+
+TEST(StreamMatcher, Chunks) {
+  for (const char* pattern : kPatterns) {
+    RE2 utf8(pattern);
+    RE2 latin1(pattern, RE2::Latin1);
+    for (const RE2* r : {&utf8, &latin1}) {
+      if (r == &latin1 && !latin1.ok())
+        continue;  // not valid in Latin-1
+      ASSERT_TRUE(r->ok()) << pattern;
+      RE2::StreamMatcher m(*r);
+      ASSERT_TRUE(m.ok());
+      for (const char* text : kTexts) {
+        std::vector<int64_t> want = MatchEndsSlowly(*r, text);
+        // Try every chunk size, including one byte at a time
+        // and all of the text at once.
+        absl::string_view t(text);
+        for (size_t n = 1; n <= t.size() || n == 1; n++)
+          EXPECT_EQ(MatchEnds(&m, t, n), want)
+              << "pattern " << pattern << ", text " << text
+              << ", chunk size " << n;
+        // Also try an empty chunk between every pair of bytes.
+        std::vector<int64_t> ends, v;
+        m.Reset();
+        for (size_t i = 0; i < t.size(); i++) {
+          EXPECT_TRUE(m.Write(absl::string_view(), &v));
+          ends.insert(ends.end(), v.begin(), v.end());
+          EXPECT_TRUE(m.Write(t.substr(i, 1), &v));
+          ends.insert(ends.end(), v.begin(), v.end());
+        }
+        EXPECT_TRUE(m.Finish(&v));
+        ends.insert(ends.end(), v.begin(), v.end());
+        EXPECT_EQ(ends, want) << "pattern " << pattern << ", text " << text;
+      }
+    }
+  }
+}
+
+TEST(StreamMatcher, MatchSpansChunks) {
+  RE2 re("needle\\b");
+  RE2::StreamMatcher m(re);
+  std::vector<int64_t> v;
+  EXPECT_TRUE(m.Write("hay hay nee", &v));
+  EXPECT_TRUE(v.empty());
+  EXPECT_TRUE(m.Write("dle", &v));
+  // Not yet: the next byte could be a word character.
+  EXPECT_TRUE(v.empty());
+  EXPECT_TRUE(m.Write("s needle hay", &v));
+  EXPECT_EQ(v, std::vector<int64_t>({22}));
+  EXPECT_TRUE(m.Write(" needle", &v));
+  EXPECT_TRUE(v.empty());
+  EXPECT_TRUE(m.Finish(&v));
+  EXPECT_EQ(v, std::vector<int64_t>({33}));
+  // Finish() again, or writing after it, finds nothing more.
+  EXPECT_TRUE(m.Finish(&v));
+  EXPECT_TRUE(v.empty());
+  EXPECT_TRUE(m.Write("needle ", &v));
+  EXPECT_TRUE(v.empty());
+
+  m.Reset();
+  EXPECT_EQ(m.offset(), 0);
+  EXPECT_TRUE(m.Write("needle ", &v));
+  EXPECT_EQ(v, std::vector<int64_t>({6}));
+}
+
+TEST(StreamMatcher, BadRegexp) {
+  RE2 re("a(", RE2::Quiet);
+  RE2::StreamMatcher m(re);
+  EXPECT_FALSE(m.ok());
+  std::vector<int64_t> v;
+  EXPECT_FALSE(m.Write("a(", &v));
+  EXPECT_FALSE(m.Finish(&v));
+}
+
+// The state saved between chunks must survive the DFA cache being reset,
+// both by this stream and by others searching with the same RE2.
+TEST(StreamMatcher, CacheReset) {
+  std::string text;
+  uint32_t x = 1;
+  for (int i = 0; i < 3000; i++) {
+    x = x * 1103515245 + 12345;
+    text += "ab"[(x >> 16) & 1];
+  }
+
+  RE2 big("a[ab]{10}b$|a[ab]{12}a");
+  std::vector<int64_t> want = MatchEndsSlowly(big, text);
+  ASSERT_FALSE(want.empty());
+  {
+    RE2::StreamMatcher m(big);
+    EXPECT_EQ(MatchEnds(&m, text, text.size()), want);
+  }
+
+  RE2::Options opt;
+  opt.set_max_mem(1<<16);
+  RE2 small("a[ab]{10}b$|a[ab]{12}a", opt);
+  RE2::StreamMatcher m1(small);
+  RE2::StreamMatcher m2(small);
+  state_cache_resets = 0;
+  for (size_t n : {7, 100, 4096}) {
+    m1.Reset();
+    m2.Reset();
+    std::vector<int64_t> ends1, ends2, v;
+    for (size_t i = 0; i < text.size(); i += n) {
+      ASSERT_TRUE(m1.Write(absl::string_view(text).substr(i, n), &v));
+      ends1.insert(ends1.end(), v.begin(), v.end());
+      ASSERT_TRUE(m2.Write(absl::string_view(text).substr(i, n), &v));
+      ends2.insert(ends2.end(), v.begin(), v.end());
+    }
+    ASSERT_TRUE(m1.Finish(&v));
+    ends1.insert(ends1.end(), v.begin(), v.end());
+    ASSERT_TRUE(m2.Finish(&v));
+    ends2.insert(ends2.end(), v.begin(), v.end());
+    EXPECT_EQ(ends1, want) << "chunk size " << n;
+    EXPECT_EQ(ends2, want) << "chunk size " << n;
+  }
+  EXPECT_GT(state_cache_resets, 0);
+}
+
+}  // namespace re2
@@ -47,6 +47,8 @@ const char* engine_names[kEngineMax] = {
   "DFA1",
   "OnePass",
   "BitState",
+  "BitParallel",
+  "TaggedDFA",
   "RE2",
   "RE2a",
   "RE2b",
@@ -384,8 +386,7 @@ void TestInstance::RunSearch(Engine type, absl::string_view orig_text,
     case kEngineOnePass:
       if (prog_ == NULL ||
           !prog_->IsOnePass() ||
-          anchor == Prog::kUnanchored ||
-          nsubmatch > Prog::kMaxOnePassCapture) {
+          anchor == Prog::kUnanchored) {
         result->skipped = true;
         break;
       }
@@ -405,6 +406,35 @@ void TestInstance::RunSearch(Engine type, absl::string_view orig_text,
       result->have_submatch = true;
       break;
 
+    case kEngineBitParallel:
+      if (prog_ == NULL ||
+          !prog_->IsBitParallel()) {
+        result->skipped = true;
+        break;
+      }
+      result->matched = prog_->SearchBitParallel(text, context, anchor,
+                                                 kind_);
+      break;
+
+    case kEngineTaggedDFA: {
+      if (prog_ == NULL ||
+          !prog_->CanTaggedDFA() ||
+          kind_ != Prog::kFullMatch) {
+        result->skipped = true;
+        break;
+      }
+      bool failed;
+      result->matched = prog_->SearchTaggedDFA(text, context,
+                                               result->submatch, nsubmatch,
+                                               &failed);
+      if (failed) {
+        result->skipped = true;
+        break;
+      }
+      result->have_submatch = true;
+      break;
+    }
+
     case kEngineRE2:
     case kEngineRE2a:
     case kEngineRE2b: {
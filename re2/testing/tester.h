@@ -26,6 +26,8 @@ enum Engine {
   kEngineDFA1,             // Prog::SearchDFA, ask for match[0]
   kEngineOnePass,          // Prog::SearchOnePass, if applicable
   kEngineBitState,         // Prog::SearchBitState
+  kEngineBitParallel,      // Prog::SearchBitParallel, if applicable
+  kEngineTaggedDFA,        // Prog::SearchTaggedDFA, if applicable
   kEngineRE2,              // RE2, all submatches
   kEngineRE2a,             // RE2, only ask for match[0]
   kEngineRE2b,             // RE2, only ask whether it matched